@@ -0,0 +1,535 @@
+#include "archive.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Little-endian field readers for zip structures
+static uint16_t read_u16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t read_u64(const unsigned char* p) {
+    return static_cast<uint64_t>(read_u32(p)) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+}
+
+// Read the central directory of a zip file without touching any entry data
+bool read_zip_directory(const std::string& zip_path, std::vector<ZipEntry>& entries) {
+    entries.clear();
+    std::ifstream in(zip_path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    if (file_size < 22) {
+        return false;
+    }
+
+    // The end of central directory record sits within the last 64 KB + 22 bytes (comment length is 16-bit)
+    uint64_t tail_size = std::min<uint64_t>(file_size, 65535 + 22);
+    std::vector<unsigned char> tail(static_cast<size_t>(tail_size));
+    in.seekg(static_cast<std::streamoff>(file_size - tail_size));
+    in.read(reinterpret_cast<char*>(tail.data()), static_cast<std::streamsize>(tail_size));
+    if (!in) {
+        return false;
+    }
+
+    size_t eocd = std::string::npos;
+    for (size_t i = tail.size() - 22 + 1; i-- > 0;) {
+        if (read_u32(&tail[i]) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == std::string::npos) {
+        std::cerr << "Not a zip file (no end of central directory): " << zip_path << std::endl;
+        return false;
+    }
+
+    uint64_t entry_count = read_u16(&tail[eocd + 10]);
+    uint64_t cd_size = read_u32(&tail[eocd + 12]);
+    uint64_t cd_offset = read_u32(&tail[eocd + 16]);
+
+    // ZIP64: the locator directly precedes the classic record and points at the 64-bit one
+    if (eocd >= 20 && read_u32(&tail[eocd - 20]) == 0x07064b50) {
+        uint64_t zip64_eocd_offset = read_u64(&tail[eocd - 20 + 8]);
+        unsigned char rec[56];
+        in.seekg(static_cast<std::streamoff>(zip64_eocd_offset));
+        in.read(reinterpret_cast<char*>(rec), sizeof(rec));
+        if (!in || read_u32(rec) != 0x06064b50) {
+            std::cerr << "Corrupt ZIP64 end of central directory: " << zip_path << std::endl;
+            return false;
+        }
+        entry_count = read_u64(rec + 32);
+        cd_size = read_u64(rec + 40);
+        cd_offset = read_u64(rec + 48);
+    }
+
+    if (cd_offset + cd_size > file_size) {
+        std::cerr << "Central directory out of range: " << zip_path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> cd(static_cast<size_t>(cd_size));
+    in.seekg(static_cast<std::streamoff>(cd_offset));
+    in.read(reinterpret_cast<char*>(cd.data()), static_cast<std::streamsize>(cd_size));
+    if (!in) {
+        return false;
+    }
+
+    entries.reserve(static_cast<size_t>(entry_count));
+    size_t pos = 0;
+    for (uint64_t n = 0; n < entry_count; ++n) {
+        if (pos + 46 > cd.size() || read_u32(&cd[pos]) != 0x02014b50) {
+            std::cerr << "Corrupt central directory entry in: " << zip_path << std::endl;
+            entries.clear();
+            return false;
+        }
+        const unsigned char* h = &cd[pos];
+        uint16_t name_len = read_u16(h + 28);
+        uint16_t extra_len = read_u16(h + 30);
+        uint16_t comment_len = read_u16(h + 32);
+        if (pos + 46 + name_len + extra_len + comment_len > cd.size()) {
+            std::cerr << "Truncated central directory in: " << zip_path << std::endl;
+            entries.clear();
+            return false;
+        }
+
+        ZipEntry entry;
+        entry.method = read_u16(h + 10);
+        entry.crc32 = read_u32(h + 16);
+        entry.compressed_size = read_u32(h + 20);
+        entry.uncompressed_size = read_u32(h + 24);
+        entry.local_header_offset = read_u32(h + 42);
+        entry.name.assign(reinterpret_cast<const char*>(h + 46), name_len);
+
+        // Sizes and offset saturated at 0xFFFFFFFF live in the ZIP64 extra field, in this order
+        const unsigned char* extra = h + 46 + name_len;
+        for (size_t e = 0; e + 4 <= extra_len;) {
+            uint16_t tag = read_u16(extra + e);
+            uint16_t len = read_u16(extra + e + 2);
+            if (tag == 0x0001) {
+                const unsigned char* f = extra + e + 4;
+                const unsigned char* end = f + len;
+                if (entry.uncompressed_size == 0xFFFFFFFF && f + 8 <= end) { entry.uncompressed_size = read_u64(f); f += 8; }
+                if (entry.compressed_size == 0xFFFFFFFF && f + 8 <= end) { entry.compressed_size = read_u64(f); f += 8; }
+                if (entry.local_header_offset == 0xFFFFFFFF && f + 8 <= end) { entry.local_header_offset = read_u64(f); }
+            }
+            e += 4 + len;
+        }
+
+        entries.push_back(std::move(entry));
+        pos += 46 + name_len + extra_len + comment_len;
+    }
+    return true;
+}
+
+// CRC-32 (IEEE), slice-by-8
+static const uint32_t (&crc32_tables())[8][256] {
+    static uint32_t tables[8][256];
+    static bool initialized = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            tables[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int t = 1; t < 8; ++t) {
+                tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xff];
+            }
+        }
+        return true;
+    }();
+    (void)initialized;
+    return tables;
+}
+
+uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t len) {
+    const uint32_t (&t)[8][256] = crc32_tables();
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ read_u32(data);
+        uint32_t hi = read_u32(data + 4);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = t[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Raw DEFLATE (RFC 1951) decoder. Codes up to FAST_BITS long resolve with one table lookup,
+// longer ones fall back to a canonical walk.
+namespace {
+
+const int FAST_BITS = 10;
+const int MAX_BITS = 15;
+
+struct Huffman {
+    uint16_t fast[1 << FAST_BITS];   // (length << 9) | symbol, 0 when the code is longer than FAST_BITS
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[288];
+};
+
+struct BitReader {
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t bits = 0;
+    int count = 0;
+
+    void refill() {
+        while (count <= 56 && p < end) {
+            bits |= static_cast<uint64_t>(*p++) << count;
+            count += 8;
+        }
+    }
+    bool need(int n) {
+        if (count < n) {
+            refill();
+        }
+        return count >= n;
+    }
+    uint32_t take(int n) {
+        uint32_t v = static_cast<uint32_t>(bits & ((1ULL << n) - 1));
+        bits >>= n;
+        count -= n;
+        return v;
+    }
+};
+
+// Returns false for over-subscribed codes; incomplete codes are allowed (RFC 1951 permits one-code trees)
+bool build_huffman(Huffman& h, const uint8_t* lengths, int n) {
+    std::fill(std::begin(h.count), std::end(h.count), 0);
+    std::fill(std::begin(h.fast), std::end(h.fast), 0);
+    for (int i = 0; i < n; ++i) {
+        h.count[lengths[i]]++;
+    }
+    h.count[0] = 0;
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offsets[MAX_BITS + 2];
+    offsets[1] = 0;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+        offsets[len + 1] = offsets[len] + h.count[len];
+    }
+    uint16_t next_code[MAX_BITS + 1];
+    uint16_t code = 0;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+        next_code[len] = code;
+        code = static_cast<uint16_t>((code + h.count[len]) << 1);
+    }
+
+    for (int sym = 0; sym < n; ++sym) {
+        int len = lengths[sym];
+        if (len == 0) {
+            continue;
+        }
+        h.symbol[offsets[len]++] = static_cast<uint16_t>(sym);
+        uint32_t c = next_code[len]++;
+        if (len <= FAST_BITS) {
+            // The bitstream carries codes MSB first, so index the table by the reversed code
+            uint32_t reversed = 0;
+            for (int i = 0; i < len; ++i) {
+                reversed |= ((c >> i) & 1) << (len - 1 - i);
+            }
+            for (uint32_t fill = reversed; fill < (1u << FAST_BITS); fill += (1u << len)) {
+                h.fast[fill] = static_cast<uint16_t>((len << 9) | sym);
+            }
+        }
+    }
+    return true;
+}
+
+int decode_symbol(BitReader& br, const Huffman& h) {
+    br.need(MAX_BITS);
+    uint16_t entry = h.fast[br.bits & ((1u << FAST_BITS) - 1)];
+    if (entry != 0 && (entry >> 9) <= br.count) {
+        br.take(entry >> 9);
+        return entry & 0x1ff;
+    }
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+        if (br.count < 1) {
+            return -1;
+        }
+        code |= static_cast<int>(br.take(1));
+        int count = h.count[len];
+        if (code - count < first) {
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+bool inflate_codes(BitReader& br, const Huffman& lencode, const Huffman& distcode, unsigned char* out, size_t out_len, size_t& pos) {
+    for (;;) {
+        int sym = decode_symbol(br, lencode);
+        if (sym < 0) {
+            return false;
+        }
+        if (sym < 256) {
+            if (pos >= out_len) {
+                return false;
+            }
+            out[pos++] = static_cast<unsigned char>(sym);
+            continue;
+        }
+        if (sym == 256) {
+            return true;
+        }
+        sym -= 257;
+        if (sym >= 29 || !br.need(LENGTH_EXTRA[sym])) {
+            return false;
+        }
+        size_t length = LENGTH_BASE[sym] + br.take(LENGTH_EXTRA[sym]);
+        int dsym = decode_symbol(br, distcode);
+        if (dsym < 0 || dsym >= 30 || !br.need(DIST_EXTRA[dsym])) {
+            return false;
+        }
+        size_t dist = DIST_BASE[dsym] + br.take(DIST_EXTRA[dsym]);
+        if (dist > pos || length > out_len - pos) {
+            return false;
+        }
+        unsigned char* dst = out + pos;
+        const unsigned char* src = dst - dist;
+        if (dist >= length) {
+            std::memcpy(dst, src, length);
+        } else {
+            for (size_t i = 0; i < length; ++i) {
+                dst[i] = src[i];
+            }
+        }
+        pos += length;
+    }
+}
+
+const Huffman* fixed_tables() {
+    static Huffman tables[2];
+    static bool initialized = [] {
+        uint8_t lengths[288];
+        for (int i = 0; i < 144; ++i) lengths[i] = 8;
+        for (int i = 144; i < 256; ++i) lengths[i] = 9;
+        for (int i = 256; i < 280; ++i) lengths[i] = 7;
+        for (int i = 280; i < 288; ++i) lengths[i] = 8;
+        build_huffman(tables[0], lengths, 288);
+        for (int i = 0; i < 30; ++i) lengths[i] = 5;
+        build_huffman(tables[1], lengths, 30);
+        return true;
+    }();
+    (void)initialized;
+    return tables;
+}
+
+bool read_dynamic_tables(BitReader& br, Huffman& lencode, Huffman& distcode) {
+    static const uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    if (!br.need(14)) {
+        return false;
+    }
+    int nlen = static_cast<int>(br.take(5)) + 257;
+    int ndist = static_cast<int>(br.take(5)) + 1;
+    int ncode = static_cast<int>(br.take(4)) + 4;
+    if (nlen > 286 || ndist > 30) {
+        return false;
+    }
+
+    uint8_t lengths[320] = { 0 };
+    for (int i = 0; i < ncode; ++i) {
+        if (!br.need(3)) {
+            return false;
+        }
+        lengths[ORDER[i]] = static_cast<uint8_t>(br.take(3));
+    }
+    Huffman lencode_lengths;
+    if (!build_huffman(lencode_lengths, lengths, 19)) {
+        return false;
+    }
+
+    std::fill(std::begin(lengths), std::end(lengths), 0);
+    int index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode_symbol(br, lencode_lengths);
+        if (sym < 0) {
+            return false;
+        }
+        if (sym < 16) {
+            lengths[index++] = static_cast<uint8_t>(sym);
+            continue;
+        }
+        uint8_t value = 0;
+        int repeat;
+        if (sym == 16) {
+            if (index == 0 || !br.need(2)) {
+                return false;
+            }
+            value = lengths[index - 1];
+            repeat = 3 + static_cast<int>(br.take(2));
+        } else if (sym == 17) {
+            if (!br.need(3)) {
+                return false;
+            }
+            repeat = 3 + static_cast<int>(br.take(3));
+        } else {
+            if (!br.need(7)) {
+                return false;
+            }
+            repeat = 11 + static_cast<int>(br.take(7));
+        }
+        if (index + repeat > nlen + ndist) {
+            return false;
+        }
+        while (repeat-- > 0) {
+            lengths[index++] = value;
+        }
+    }
+    if (lengths[256] == 0) {
+        return false;   // no end-of-block code
+    }
+    return build_huffman(lencode, lengths, nlen) && build_huffman(distcode, lengths + nlen, ndist);
+}
+
+} // namespace
+
+// Inflate a raw deflate stream whose decompressed size is known up front (as it is for zip entries)
+bool inflate_raw(const unsigned char* in, size_t in_len, unsigned char* out, size_t out_len) {
+    BitReader br;
+    br.p = in;
+    br.end = in + in_len;
+    size_t pos = 0;
+    bool last = false;
+    std::unique_ptr<Huffman[]> dynamic(new Huffman[2]);
+
+    while (!last) {
+        if (!br.need(3)) {
+            return false;
+        }
+        last = br.take(1) != 0;
+        uint32_t type = br.take(2);
+        if (type == 0) {
+            // Stored block: drop to a byte boundary, then LEN and NLEN
+            br.take(br.count % 8);
+            if (!br.need(32)) {
+                return false;
+            }
+            uint32_t len = br.take(16);
+            uint32_t nlen = br.take(16);
+            if (len != (~nlen & 0xffff) || len > out_len - pos) {
+                return false;
+            }
+            // Whole bytes may still sit in the bit buffer ahead of the input pointer
+            while (len > 0 && br.count >= 8) {
+                out[pos++] = static_cast<unsigned char>(br.take(8));
+                len--;
+            }
+            if (static_cast<size_t>(br.end - br.p) < len) {
+                return false;
+            }
+            std::memcpy(out + pos, br.p, len);
+            br.p += len;
+            pos += len;
+        } else if (type == 1) {
+            const Huffman* fixed = fixed_tables();
+            if (!inflate_codes(br, fixed[0], fixed[1], out, out_len, pos)) {
+                return false;
+            }
+        } else if (type == 2) {
+            if (!read_dynamic_tables(br, dynamic[0], dynamic[1]) || !inflate_codes(br, dynamic[0], dynamic[1], out, out_len, pos)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return pos == out_len;
+}
+
+bool ZipArchive::open(const std::string& path) {
+    path_ = path;
+    if (in_.is_open()) {
+        in_.close();
+    }
+    if (!read_zip_directory(path, entries_)) {
+        return false;
+    }
+    in_.open(path, std::ios::binary);
+    return static_cast<bool>(in_);
+}
+
+const ZipEntry* ZipArchive::find(const std::string& name) const {
+    for (const ZipEntry& entry : entries_) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool ZipArchive::read(const ZipEntry& entry, std::vector<unsigned char>& data) {
+    unsigned char header[30];
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(entry.local_header_offset));
+    in_.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in_ || read_u32(header) != 0x04034b50) {
+        std::cerr << "Bad local header for " << entry.name << " in " << path_ << std::endl;
+        return false;
+    }
+    // The local name/extra lengths may differ from the central directory copy
+    in_.seekg(read_u16(header + 26) + read_u16(header + 28), std::ios::cur);
+
+    std::vector<unsigned char> compressed(static_cast<size_t>(entry.compressed_size));
+    in_.read(reinterpret_cast<char*>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+    if (!in_) {
+        std::cerr << "Truncated entry " << entry.name << " in " << path_ << std::endl;
+        return false;
+    }
+
+    if (entry.method == 0) {
+        data.swap(compressed);
+    } else if (entry.method == 8) {
+        data.resize(static_cast<size_t>(entry.uncompressed_size));
+        if (!inflate_raw(compressed.data(), compressed.size(), data.data(), data.size())) {
+            std::cerr << "Corrupt deflate data for " << entry.name << " in " << path_ << std::endl;
+            return false;
+        }
+    } else {
+        std::cerr << "Unsupported compression method " << entry.method << " for " << entry.name << std::endl;
+        return false;
+    }
+
+    if (crc32_update(0, data.data(), data.size()) != entry.crc32) {
+        std::cerr << "CRC mismatch for " << entry.name << " in " << path_ << std::endl;
+        return false;
+    }
+    return true;
+}
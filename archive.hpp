@@ -0,0 +1,39 @@
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One entry of a zip central directory
+struct ZipEntry {
+    std::string name;                 // path inside the archive, '/' separated
+    uint16_t method = 0;              // 0 = stored, 8 = deflate
+    uint32_t crc32 = 0;
+    uint64_t compressed_size = 0;
+    uint64_t uncompressed_size = 0;
+    uint64_t local_header_offset = 0;
+    bool is_directory() const { return !name.empty() && name.back() == '/'; }
+};
+
+// Read-only access to the entries of a zip file
+class ZipArchive {
+public:
+    bool open(const std::string& path);
+    const std::vector<ZipEntry>& entries() const { return entries_; }
+    const ZipEntry* find(const std::string& name) const;
+    bool read(const ZipEntry& entry, std::vector<unsigned char>& data);   // decompresses and checks the CRC
+
+private:
+    std::string path_;
+    std::ifstream in_;
+    std::vector<ZipEntry> entries_;
+};
+
+bool read_zip_directory(const std::string& zip_path, std::vector<ZipEntry>& entries);
+bool inflate_raw(const unsigned char* in, size_t in_len, unsigned char* out, size_t out_len);
+uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t len);
+
+#endif
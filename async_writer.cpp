@@ -0,0 +1,379 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "async_writer.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Up to 4 MB in flight per file; small files get one buffer of their own size
+static const size_t ASYNC_WRITE_BUFFER_SIZE = 1 << 20;
+static const size_t ASYNC_WRITE_MIN_BUFFER_SIZE = 64 * 1024;
+static const size_t ASYNC_WRITE_BUFFERS = 4;
+
+struct AsyncFileWriter::Buffer {
+    std::vector<char> data;
+    size_t used = 0;
+    long long offset = 0;
+    bool in_flight = false;
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+#endif
+};
+
+#ifdef _WIN32
+// Administrators hold SE_MANAGE_VOLUME_NAME but it starts out disabled
+static bool enable_manage_volume_privilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool ok = LookupPrivilegeValueA(nullptr, SE_MANAGE_VOLUME_NAME, &privileges.Privileges[0].Luid) &&
+              AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+              GetLastError() != ERROR_NOT_ALL_ASSIGNED;
+    CloseHandle(token);
+    return ok;
+}
+
+// Until it is written, the part up to expected_size reads as whatever was on the disk before;
+// callers trim the file to what they wrote and delete files whose download failed
+void* open_for_offset_writes(const std::string& path, long long expected_size, bool& overlapped) {
+    static std::once_flag once;
+    static bool privileged = false;
+    std::call_once(once, [] { privileged = enable_manage_volume_privilege(); });
+
+    if (privileged && expected_size > 0) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+        FILE_END_OF_FILE_INFO end_of_file;
+        end_of_file.EndOfFile.QuadPart = expected_size;
+        if (SetFileInformationByHandle(file, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file)) &&
+            SetFileValidData(file, expected_size)) {
+            overlapped = true;
+            return file;
+        }
+        // Not NTFS, or the volume refused: start over with a plain handle
+        CloseHandle(file);
+    }
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    // Still worth reserving the space in one piece
+    if (expected_size > 0) {
+        FILE_END_OF_FILE_INFO end_of_file;
+        end_of_file.EndOfFile.QuadPart = expected_size;
+        SetFileInformationByHandle(file, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file));
+    }
+    overlapped = false;
+    return file;
+}
+#endif
+
+AsyncFileWriter::AsyncFileWriter() = default;
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+}
+
+bool AsyncFileWriter::open(const std::string& path, long long expected_size) {
+    close();
+    buffers_.clear();
+    current_ = nullptr;
+    offset_ = 0;
+    failed_ = false;
+    buffer_size_ = ASYNC_WRITE_BUFFER_SIZE;
+    if (expected_size > 0 && static_cast<unsigned long long>(expected_size) < buffer_size_) {
+        buffer_size_ = std::max(ASYNC_WRITE_MIN_BUFFER_SIZE, static_cast<size_t>(expected_size));
+    }
+#ifdef _WIN32
+    bool overlapped = false;
+    HANDLE file = open_for_offset_writes(path, expected_size, overlapped);
+    if (!file) {
+        return false;
+    }
+    HANDLE port = nullptr;
+    if (overlapped) {
+        port = CreateIoCompletionPort(file, nullptr, 0, 1);
+        if (!port) {
+            CloseHandle(file);
+            return false;
+        }
+    }
+    file_ = file;
+    port_ = port;
+#else
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+#ifdef __linux__
+    // Reserve the space in one piece; unlike posix_fallocate this never falls back to writing zeros
+    if (expected_size > 0) {
+        fallocate(fd_, 0, 0, static_cast<off_t>(expected_size));
+    }
+#endif
+    bool overlapped = false;
+#endif
+    if (!overlapped) {
+        stopping_ = false;
+        writer_ = std::thread(&AsyncFileWriter::writer_loop, this);
+    }
+    open_ = true;
+    return true;
+}
+
+// A buffer that is not being written, allocating up to the limit before waiting for one
+AsyncFileWriter::Buffer* AsyncFileWriter::acquire() {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& buffer : buffers_) {
+                if (!buffer->in_flight) {
+                    return buffer.get();
+                }
+            }
+        }
+        if (buffers_.size() < ASYNC_WRITE_BUFFERS) {
+            buffers_.emplace_back(new Buffer());
+            buffers_.back()->data.resize(buffer_size_);
+            return buffers_.back().get();
+        }
+        if (!wait_one()) {
+            return nullptr;
+        }
+    }
+}
+
+char* AsyncFileWriter::reserve(size_t& available) {
+    available = 0;
+    if (!open_ || failed_) {
+        return nullptr;
+    }
+    if (!current_) {
+        current_ = acquire();
+        if (!current_) {
+            return nullptr;
+        }
+    }
+    available = current_->data.size() - current_->used;
+    return current_->data.data() + current_->used;
+}
+
+bool AsyncFileWriter::commit(size_t len) {
+    if (!current_) {
+        return len == 0 && !failed_;
+    }
+    current_->used += len;
+    if (current_->used == current_->data.size()) {
+        submit(current_);
+        current_ = nullptr;
+    }
+    return !failed_;
+}
+
+bool AsyncFileWriter::write(const void* data, size_t len) {
+    const char* bytes = static_cast<const char*>(data);
+    while (len > 0) {
+        size_t available;
+        char* space = reserve(available);
+        if (!space) {
+            return false;
+        }
+        size_t chunk = std::min(len, available);
+        memcpy(space, bytes, chunk);
+        bytes += chunk;
+        len -= chunk;
+        if (!commit(chunk)) {
+            return false;
+        }
+    }
+    return !failed_;
+}
+
+void AsyncFileWriter::submit(Buffer* buffer) {
+#ifdef _WIN32
+    if (port_) {
+        submit_overlapped(buffer);
+        return;
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer->offset = offset_;
+        offset_ += static_cast<long long>(buffer->used);
+        buffer->in_flight = true;
+        queue_.push_back(buffer);
+    }
+    changed_.notify_all();
+}
+
+#ifdef _WIN32
+void AsyncFileWriter::submit_overlapped(Buffer* buffer) {
+    buffer->offset = offset_;
+    offset_ += static_cast<long long>(buffer->used);
+    memset(&buffer->overlapped, 0, sizeof(buffer->overlapped));
+    buffer->overlapped.Offset = static_cast<DWORD>(buffer->offset);
+    buffer->overlapped.OffsetHigh = static_cast<DWORD>(buffer->offset >> 32);
+    buffer->in_flight = true;
+    // Completion is reported through the port even when WriteFile finishes at once
+    if (!WriteFile(file_, buffer->data.data(), static_cast<DWORD>(buffer->used), nullptr, &buffer->overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        buffer->in_flight = false;
+        buffer->used = 0;
+        failed_ = true;
+    }
+}
+#endif
+
+// Block until at least one buffer has been written
+bool AsyncFileWriter::wait_one() {
+#ifdef _WIN32
+    if (port_) {
+        return wait_overlapped();
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] {
+        return std::any_of(buffers_.begin(), buffers_.end(), [](const std::unique_ptr<Buffer>& buffer) { return !buffer->in_flight; });
+    });
+    return true;
+}
+
+#ifdef _WIN32
+bool AsyncFileWriter::wait_overlapped() {
+    DWORD bytes = 0;
+    ULONG_PTR key = 0;
+    OVERLAPPED* overlapped = nullptr;
+    BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, INFINITE);
+    if (!overlapped) {
+        failed_ = true;
+        return false;
+    }
+    for (const auto& buffer : buffers_) {
+        if (&buffer->overlapped == overlapped) {
+            if (!ok || bytes != buffer->used) {
+                failed_ = true;
+            }
+            buffer->in_flight = false;
+            buffer->used = 0;
+        }
+    }
+    return true;
+}
+#endif
+
+// Synchronous write of a whole buffer at offset, on the writer thread
+bool AsyncFileWriter::write_at(const char* data, size_t size, long long offset) {
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED position;
+        memset(&position, 0, sizeof(position));
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(file_, data, static_cast<DWORD>(size), &written, &position) || written == 0) {
+            return false;
+        }
+#else
+        ssize_t written = pwrite(fd_, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+#endif
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+    return true;
+}
+
+void AsyncFileWriter::writer_loop() {
+    for (;;) {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            buffer = queue_.front();
+            queue_.pop_front();
+        }
+        bool ok = write_at(buffer->data.data(), buffer->used, buffer->offset);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok) {
+                failed_ = true;
+            }
+            buffer->in_flight = false;
+            buffer->used = 0;
+        }
+        changed_.notify_all();
+    }
+}
+
+bool AsyncFileWriter::close() {
+    if (!open_) {
+        return !failed_;
+    }
+    if (current_ && current_->used > 0) {
+        submit(current_);
+    }
+    current_ = nullptr;
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        writer_.join();
+    }
+#ifdef _WIN32
+    for (;;) {
+        bool pending = std::any_of(buffers_.begin(), buffers_.end(), [](const std::unique_ptr<Buffer>& buffer) { return buffer->in_flight; });
+        if (!pending || !wait_one()) {
+            break;
+        }
+    }
+    // Drop whatever part of the preallocated size was not written
+    FILE_END_OF_FILE_INFO end_of_file;
+    end_of_file.EndOfFile.QuadPart = offset_;
+    if (!SetFileInformationByHandle(file_, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file))) {
+        failed_ = true;
+    }
+    if (port_) {
+        CloseHandle(port_);
+    }
+    CloseHandle(file_);
+    port_ = file_ = nullptr;
+#else
+    if (ftruncate(fd_, static_cast<off_t>(offset_)) != 0) {
+        failed_ = true;
+    }
+    if (::close(fd_) != 0) {
+        failed_ = true;
+    }
+    fd_ = -1;
+#endif
+    open_ = false;
+    return !failed_;
+}
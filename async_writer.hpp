@@ -0,0 +1,78 @@
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sequential file writer that keeps several large buffers in flight, so the caller can go on
+// receiving the next megabyte while the previous ones are still being written. On Windows a file
+// whose valid data length could be set up front (see open_for_offset_writes) takes overlapped
+// writes collected through an I/O completion port; otherwise a writer thread writes each buffer
+// at its offset. The caller fills buffers in place:
+//
+//   size_t available;
+//   char* space = writer.reserve(available);
+//   size_t got = receive(space, available);
+//   writer.commit(got);
+class AsyncFileWriter {
+public:
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+    bool open(const std::string& path, long long expected_size = -1);   // sizes the file up front when known
+    char* reserve(size_t& available);   // free space in the current buffer; null after a failed write
+    bool commit(size_t len);
+    bool write(const void* data, size_t len);
+    bool close();   // waits for outstanding writes and trims the file; false if any write failed
+    long long bytes_written() const { return offset_; }
+
+private:
+    struct Buffer;
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+    Buffer* acquire();
+    void submit(Buffer* buffer);
+    bool wait_one();
+
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+    Buffer* current_ = nullptr;
+    size_t buffer_size_ = 0;
+    long long offset_ = 0;   // file offset where the current buffer starts
+    std::atomic<bool> failed_{ false };
+    bool open_ = false;
+#ifdef _WIN32
+    void submit_overlapped(Buffer* buffer);
+    bool wait_overlapped();
+#endif
+    void writer_loop();
+    bool write_at(const char* data, size_t size, long long offset);
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* port_ = nullptr;   // null when the writer thread does the writes
+#else
+    int fd_ = -1;
+#endif
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<Buffer*> queue_;
+    bool stopping_ = false;
+};
+
+#ifdef _WIN32
+// Creates path for writes at explicit offsets and reports whether they can be overlapped. NTFS
+// carries out a write beyond the valid data length synchronously even on an overlapped handle,
+// and setting the end of file does not move that length; only SetFileValidData does, which needs
+// SE_MANAGE_VOLUME_NAME (held by administrators). Without it, or without a known size, the handle
+// is opened for plain synchronous writes and the caller must keep them off threads that must not
+// block. Returns null on failure.
+void* open_for_offset_writes(const std::string& path, long long expected_size, bool& overlapped);
+#endif
+
+#endif
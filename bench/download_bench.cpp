@@ -0,0 +1,314 @@
+// Download engine benchmark under faults. Serves a set of synthetic jars from two local HTTP
+// stand-ins ("A" and "B", mirrors of each other) and runs the installer's own download engine
+// (try_download_any, over a plain-socket transport) against a series of scenarios: a clean,
+// throttled or slow link, and mirrors that fail with 5xx, stall, drop or truncate bodies, send
+// wrong lengths, ignore Range or slow down partway. This shows how well range resume, hedged
+// requests and mid-transfer mirror switching hold up, and what they cost.
+//
+// Each scenario runs in a fresh child process, so mirror statistics start empty, with the
+// installer's download concurrency. Reported per scenario: files fetched, throughput of the
+// useful bytes, p50/p99 time to complete a file, and wasted bytes (everything the stand-ins sent
+// beyond the files that arrived). Results are printed as one JSON document. --async runs the
+// same scenarios through download_batch(), which multiplexes the transfers on the I/O loop.
+//
+// Linux only. Build from the repository root:
+//   g++ -O2 -std=c++14 -pthread -I. -Ibench bench/download_bench.cpp bench/http_standin.cpp bench/http_client.cpp bench/fixtures.cpp archive.cpp download.cpp async_writer.cpp bundle.cpp cassette.cpp executor.cpp file_ops.cpp hash.cpp io_loop.cpp memory_stats.cpp mirrors.cpp peer_cache.cpp perf_counters.cpp phases.cpp progress.cpp -lz -o download_bench
+// Usage: download_bench [--files <count>] [--seed <n>] [--only <scenario,...>] [--async]
+
+#include "constants.hpp"
+#include "download.hpp"
+#include "filesystem.hpp"
+#include "fixtures.hpp"
+#include "hash.hpp"
+#include "http_standin.hpp"
+#include "json.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+static const long long LARGE_FILE_BYTES = 24LL * 1024 * 1024;
+static const int LARGE_FILE_COUNT = 4;
+
+struct BenchFile {
+    std::string path;     // on the stand-ins
+    std::string sha1;
+    long long size = 0;
+};
+
+struct Scenario {
+    std::string name;
+    std::string description;
+    StandinOptions a;
+    StandinOptions b;
+    bool use_b = true;
+    bool large_files = false;   // a few big files instead of the jar set
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<Scenario> make_scenarios() {
+    std::vector<Scenario> scenarios;
+    auto add = [&](const std::string& name, const std::string& description, bool use_b) {
+        Scenario scenario;
+        scenario.name = name;
+        scenario.description = description;
+        scenario.use_b = use_b;
+        scenario.b.seed = 2;
+        scenarios.push_back(scenario);
+        return &scenarios.back();
+    };
+    add("baseline", "one clean mirror", false);
+    add("throttled", "one mirror limited to 8 MB/s", false)->a.bytes_per_sec = 8LL * 1024 * 1024;
+    add("latency", "one mirror answering after 150 ms", false)->a.latency_ms = 150;
+    add("errors_single", "one mirror answering 20% of requests with 503", false)->a.error_rate = 0.2;
+    add("errors", "A answers 20% with 503, B clean", true)->a.error_rate = 0.2;
+    add("drops", "A resets 30% of bodies partway, B clean", true)->a.drop_rate = 0.3;
+    Scenario* no_range = add("drops_no_range", "A resets 30% of bodies partway, B ignores Range", true);
+    no_range->a.drop_rate = 0.3;
+    no_range->b.ignore_range = true;
+    add("truncated", "A ends 30% of bodies early, B clean", true)->a.truncate_rate = 0.3;
+    add("wrong_length", "A understates Content-Length on 20%, B clean", true)->a.wrong_length_rate = 0.2;
+    Scenario* stalls = add("stalls", "both mirrors hold 10% of responses back 2 s (hedging)", true);
+    for (StandinOptions* options : { &stalls->a, &stalls->b }) {
+        options->latency_ms = 20;
+        options->stall_rate = 0.1;
+        options->stall_ms = 2000;
+    }
+    Scenario* slowdown = add("slowdown", "A crawls at 256 KB/s after 4 MB of each body, B 50 ms away (mirror switch)", true);
+    slowdown->large_files = true;
+    slowdown->a.slow_after = 4LL * 1024 * 1024;
+    slowdown->a.slow_bytes_per_sec = 256 * 1024;
+    slowdown->b.latency_ms = 50;
+    return scenarios;
+}
+
+static bool add_files(const std::string& dir, const std::vector<long long>& sizes, unsigned seed, const std::string& prefix,
+                      std::vector<BenchFile>& files) {
+    std::mt19937_64 random(seed);
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        std::string data = random_bytes(static_cast<size_t>(sizes[i]), random);
+        Sha1 sha1;
+        sha1.update(data.data(), data.size());
+        BenchFile file;
+        file.sha1 = sha1.hex_digest();
+        file.path = "/" + prefix + "/" + file.sha1 + ".jar";
+        file.size = sizes[i];
+        if (!write_file(dir + file.path, data)) {
+            return false;
+        }
+        files.push_back(file);
+    }
+    return true;
+}
+
+static double percentile(std::vector<double> values, double share) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(share * static_cast<double>(values.size()) + 0.999999);
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// In the child: fetch every file with the installer's concurrency and report how it went. With
+// async the files go through download_batch(), multiplexed on the I/O loop, instead of a thread each.
+static json fetch_all(const std::vector<BenchFile>& files, const std::string& a_url, const std::string& b_url, const std::string& out_dir, bool async) {
+    std::atomic<size_t> next_file(0);
+    std::mutex mutex;
+    std::vector<double> completion;
+    long long useful_bytes = 0;
+    int succeeded = 0;
+    json errors = json::array();
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        for (size_t i = next_file++; i < files.size(); i = next_file++) {
+            const BenchFile& file = files[i];
+            std::vector<std::string> urls = { a_url + file.path };
+            if (!b_url.empty()) {
+                urls.push_back(b_url + file.path);
+            }
+            ExpectedHashes expected;
+            expected.sha1 = file.sha1;
+            std::string error;
+            auto file_start = std::chrono::steady_clock::now();
+            bool ok = try_download_any(urls, out_dir + "/" + file.sha1, expected, error);
+            double seconds = seconds_since(file_start);
+            std::lock_guard<std::mutex> lock(mutex);
+            completion.push_back(seconds);
+            if (ok) {
+                succeeded++;
+                useful_bytes += file.size;
+            } else if (errors.size() < 5) {
+                errors.push_back(error);
+            }
+        }
+    };
+    if (async) {
+        std::vector<DownloadJob> jobs(files.size());
+        for (size_t i = 0; i < files.size(); ++i) {
+            jobs[i].urls = { a_url + files[i].path };
+            if (!b_url.empty()) {
+                jobs[i].urls.push_back(b_url + files[i].path);
+            }
+            jobs[i].output_path = out_dir + "/" + files[i].sha1;
+            jobs[i].expected.sha1 = files[i].sha1;
+        }
+        download_batch(jobs, MRPACK_DOWNLOAD_CONCURRENCY, [&](DownloadJob& job) {
+            completion.push_back(job.seconds);
+            if (job.ok) {
+                succeeded++;
+                useful_bytes += files[static_cast<size_t>(&job - jobs.data())].size;
+            } else if (errors.size() < 5) {
+                errors.push_back(job.error);
+            }
+            return true;
+        });
+    } else {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < std::min<int>(MRPACK_DOWNLOAD_CONCURRENCY, static_cast<int>(files.size())); ++i) {
+            workers.emplace_back(worker);
+        }
+        for (std::thread& t : workers) {
+            t.join();
+        }
+    }
+    double wall = seconds_since(start);
+    return {
+        { "files", files.size() },
+        { "succeeded", succeeded },
+        { "useful_bytes", useful_bytes },
+        { "wall_seconds", wall },
+        { "throughput_mb_per_sec", static_cast<double>(useful_bytes) / (1024.0 * 1024.0) / std::max(wall, 1e-6) },
+        { "p50_seconds", percentile(completion, 0.50) },
+        { "p99_seconds", percentile(completion, 0.99) },
+        { "first_errors", errors }
+    };
+}
+
+static json run_scenario(const Scenario& scenario, const std::string& root, const std::vector<BenchFile>& files, bool async) {
+    HttpStandin a;
+    HttpStandin b;
+    for (const BenchFile& file : files) {
+        a.add_file(file.path, root + file.path);
+        b.add_file(file.path, root + file.path);
+    }
+    if (!a.start(scenario.a) || (scenario.use_b && !b.start(scenario.b))) {
+        return { { "scenario", scenario.name }, { "error", "failed to start the stand-ins" } };
+    }
+    std::string out_dir = root + "/out-" + scenario.name;
+    make_directories(out_dir);
+
+    // The engine's progress messages go to stderr; the child's report comes back through a pipe
+    int report_pipe[2];
+    if (pipe(report_pipe) != 0) {
+        return { { "scenario", scenario.name }, { "error", "pipe failed" } };
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report_pipe[0]);
+        dup2(2, 1);
+        std::string report = fetch_all(files, a.url(""), scenario.use_b ? b.url("") : "", out_dir, async).dump();
+        ssize_t written = write(report_pipe[1], report.data(), report.size());
+        _exit(written == static_cast<ssize_t>(report.size()) ? 0 : 1);
+    }
+    close(report_pipe[1]);
+    std::string report;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(report_pipe[0], buffer, sizeof(buffer))) > 0) {
+        report.append(buffer, static_cast<size_t>(got));
+    }
+    close(report_pipe[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    a.stop();
+    b.stop();
+
+    json result = json::parse(report, nullptr, false);
+    if (result.is_discarded()) {
+        result = { { "error", "the scenario did not report" } };
+    }
+    long long served = a.bytes_sent() + b.bytes_sent();
+    result["scenario"] = scenario.name;
+    result["description"] = scenario.description;
+    result["bytes_served"] = served;
+    result["wasted_bytes"] = served - result.value("useful_bytes", 0LL);
+    result["requests"] = a.requests() + b.requests();
+    result["faults_injected"] = a.faults() + b.faults();
+    std::string cleanup = "rm -rf " + out_dir;
+    if (system(cleanup.c_str()) != 0) {
+        std::cerr << "Failed to remove " << out_dir << std::endl;
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int file_count = 40;
+    unsigned seed = 1;
+    std::vector<std::string> only;
+    bool async = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--files" && i + 1 < argc) {
+            file_count = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--only" && i + 1 < argc) {
+            std::stringstream in(argv[++i]);
+            std::string name;
+            while (std::getline(in, name, ',')) {
+                only.push_back(name);
+            }
+        } else if (arg == "--async") {
+            async = true;
+        } else {
+            std::cerr << "Usage: download_bench [--files <count>] [--seed <n>] [--only <scenario,...>] [--async]" << std::endl;
+            return 2;
+        }
+    }
+
+    std::string root = "/tmp/download_bench." + std::to_string(getpid());
+    std::vector<BenchFile> jars;
+    std::vector<BenchFile> large;
+    std::cerr << "Writing " << file_count << " jars and " << LARGE_FILE_COUNT << " large files..." << std::endl;
+    if (!make_directories(root + "/jars") || !make_directories(root + "/large") ||
+        !add_files(root, make_jar_sizes(file_count, seed), seed, "jars", jars) ||
+        !add_files(root, std::vector<long long>(LARGE_FILE_COUNT, LARGE_FILE_BYTES), seed + 1, "large", large)) {
+        std::cerr << "Failed to write the files under " << root << std::endl;
+        return 1;
+    }
+
+    json results = json::array();
+    for (const Scenario& scenario : make_scenarios()) {
+        if (!only.empty() && std::find(only.begin(), only.end(), scenario.name) == only.end()) {
+            continue;
+        }
+        std::cerr << "Scenario " << scenario.name << ": " << scenario.description << std::endl;
+        Scenario seeded = scenario;
+        seeded.a.seed += seed;
+        seeded.b.seed += seed;
+        results.push_back(run_scenario(seeded, root, scenario.large_files ? large : jars, async));
+    }
+
+    std::cout << json({ { "seed", seed }, { "concurrency", MRPACK_DOWNLOAD_CONCURRENCY }, { "mode", async ? "async" : "threads" }, { "scenarios", results } }).dump(2) << std::endl;
+    std::string cleanup = "rm -rf " + root;
+    return system(cleanup.c_str()) == 0 ? 0 : 1;
+}
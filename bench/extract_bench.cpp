@@ -0,0 +1,288 @@
+// Extraction throughput of the archive engine. Builds three synthetic packs (stored jars, deflated
+// jars, and many tiny deflated config files) and extracts each with 1 up to the number of cores
+// threads, cold (page cache dropped, when the kernel allows it) and warm. Every entry goes through
+// what the installer does per file: ZipArchive::read (inflate and CRC check), a SHA-1 for the
+// store, and a write under the target directory; each thread reads through its own ZipArchive.
+// Reported per run: MB/s of extracted data and files/s, as one JSON document, so worker counts
+// can be chosen from measurements. With --perf-counters, each entry's inflate, hash and write run
+// in phases of their own and the run also reports cycles, instructions, cache misses, page faults
+// and context switches per phase and per worker thread (this adds a few syscalls per entry).
+//
+// Linux only. Build from the repository root:
+//   g++ -O2 -std=c++14 -pthread -I. -Ibench bench/extract_bench.cpp bench/fixtures.cpp archive.cpp hash.cpp memory_stats.cpp perf_counters.cpp phases.cpp -lz -o extract_bench
+// Usage: extract_bench [--jars <count>] [--configs <count>] [--threads 1,2,4] [--runs <n>] [--perf-counters] [--keep]
+
+#include "archive.hpp"
+#include "fixtures.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+#include "perf_counters.hpp"
+#include "phases.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct Pack {
+    std::string name;
+    std::string path;
+    long long files = 0;
+    long long bytes = 0;            // extracted
+    long long archive_bytes = 0;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long long file_size(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return in ? static_cast<long long>(in.tellg()) : 0;
+}
+
+static bool build_pack(Pack& pack, const std::string& root, const std::string& name, std::vector<ZipSource> entries) {
+    pack.name = name;
+    pack.path = root + "/" + name + ".zip";
+    pack.files = static_cast<long long>(entries.size());
+    for (const ZipSource& entry : entries) {
+        pack.bytes += static_cast<long long>(entry.data.size());
+    }
+    if (!write_zip(pack.path, entries)) {
+        return false;
+    }
+    pack.archive_bytes = file_size(pack.path);
+    return true;
+}
+
+static bool build_packs(const std::string& root, int jars, int configs, std::vector<Pack>& packs) {
+    std::mt19937_64 random(44);
+    std::vector<long long> sizes = make_jar_sizes(jars, 44);
+    std::vector<ZipSource> stored, deflated, tiny;
+    for (int i = 0; i < jars; ++i) {
+        std::string name = "mods/mod-" + std::to_string(i) + ".jar";
+        stored.push_back({ name, random_bytes(static_cast<size_t>(sizes[i]), random) });
+        deflated.push_back({ name, compressible_bytes(static_cast<size_t>(sizes[i]), random), true });
+    }
+    std::uniform_int_distribution<int> config_size(200, 4096);
+    for (int i = 0; i < configs; ++i) {
+        std::string name = "config/mod-" + std::to_string(i % 200) + "/setting-" + std::to_string(i) + ".json";
+        tiny.push_back({ name, compressible_bytes(static_cast<size_t>(config_size(random)), random), true });
+    }
+    packs.resize(3);
+    return build_pack(packs[0], root, "stored_jars", stored) && build_pack(packs[1], root, "deflated_jars", deflated) &&
+           build_pack(packs[2], root, "tiny_configs", tiny);
+}
+
+// Evicting the archive from the page cache needs root; without it "cold" is only a first run
+static bool drop_page_cache() {
+    sync();
+    std::ofstream drop("/proc/sys/vm/drop_caches");
+    drop << "3" << std::endl;
+    return static_cast<bool>(drop);
+}
+
+static void remove_tree(const std::string& path) {
+    std::string command = "rm -rf '" + path + "'";
+    if (system(command.c_str()) != 0) {
+        std::cerr << "Failed to remove " << path << std::endl;
+    }
+}
+
+// Sub-phases per entry only when counters are on, since every scope takes the phase lock
+template <typename Body>
+static void run_in_phase(bool counted, const char* phase, Body body) {
+    if (!counted) {
+        body();
+        return;
+    }
+    PhaseScope scope(phase);
+    body();
+}
+
+// Extract every entry of the pack with the given number of threads; false if any entry failed
+static bool extract(const Pack& pack, const std::string& target_dir, int threads, bool counted) {
+    ZipArchive directory;
+    if (!directory.open(pack.path)) {
+        return false;
+    }
+    const std::vector<ZipEntry>& entries = directory.entries();
+    std::atomic<size_t> next_entry(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        PhaseScope phase("extraction");
+        ZipArchive archive;
+        if (!archive.open(pack.path)) {
+            failed = true;
+            return;
+        }
+        std::set<std::string> made_dirs;
+        std::vector<unsigned char> data;
+        for (size_t i = next_entry++; i < entries.size() && !failed; i = next_entry++) {
+            const ZipEntry& entry = entries[i];
+            if (entry.is_directory()) {
+                continue;
+            }
+            bool ok = true;
+            run_in_phase(counted, "inflate", [&]() { ok = archive.read(entry, data); });
+            if (!ok) {
+                failed = true;
+                break;
+            }
+            run_in_phase(counted, "hash", [&]() {
+                Sha1 sha1;
+                sha1.update(data.data(), data.size());
+                sha1.hex_digest();
+            });
+            run_in_phase(counted, "write", [&]() {
+                std::string target = target_dir + "/" + entry.name;
+                std::string parent = target.substr(0, target.find_last_of('/'));
+                if (made_dirs.insert(parent).second && !make_directories(parent)) {
+                    ok = false;
+                    return;
+                }
+                std::ofstream out(target, std::ios::binary | std::ios::trunc);
+                out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+                ok = static_cast<bool>(out);
+            });
+            if (!ok) {
+                failed = true;
+                break;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    return !failed;
+}
+
+static std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+    int jars = 300;
+    int configs = 5000;
+    int runs = 1;
+    bool keep = false;
+    bool counted = false;
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<int> thread_counts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jars" && i + 1 < argc) {
+            jars = std::atoi(argv[++i]);
+        } else if (arg == "--configs" && i + 1 < argc) {
+            configs = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            thread_counts = parse_list(argv[++i]);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--perf-counters") {
+            counted = true;
+        } else if (arg == "--keep") {
+            keep = true;
+        } else {
+            std::cerr << "Usage: extract_bench [--jars <count>] [--configs <count>] [--threads 1,2,4] [--runs <n>] [--perf-counters] [--keep]" << std::endl;
+            return 2;
+        }
+    }
+    // Powers of two up to the core count, and the core count itself
+    if (thread_counts.empty()) {
+        for (int threads = 1; threads < cores; threads *= 2) {
+            thread_counts.push_back(threads);
+        }
+        thread_counts.push_back(cores);
+    }
+    if (counted) {
+        enable_perf_counters();
+    }
+
+    std::string root = "/tmp/extract_bench." + std::to_string(getpid());
+    std::vector<Pack> packs;
+    std::cerr << "Building packs of " << jars << " jars and " << configs << " config files..." << std::endl;
+    if (!make_directories(root) || !build_packs(root, jars, configs, packs)) {
+        std::cerr << "Failed to build the packs under " << root << std::endl;
+        return 1;
+    }
+
+    json results = json::array();
+    bool dropped_any = false;
+    for (const Pack& pack : packs) {
+        json pack_runs = json::array();
+        for (int threads : thread_counts) {
+            for (int run = 0; run < runs; ++run) {
+                for (const char* cache : { "cold", "warm" }) {
+                    std::string target_dir = root + "/out";
+                    remove_tree(target_dir);
+                    // Writeback of the previous run's output should not be charged to this one
+                    sync();
+                    bool dropped = std::string(cache) == "cold" && drop_page_cache();
+                    dropped_any = dropped_any || dropped;
+                    reset_perf_counters();
+                    auto start = std::chrono::steady_clock::now();
+                    bool ok = extract(pack, target_dir, threads, counted);
+                    double seconds = std::max(seconds_since(start), 1e-9);
+                    json result = {
+                        { "threads", threads },
+                        { "cache", cache },
+                        { "page_cache_dropped", dropped },
+                        { "ok", ok },
+                        { "seconds", seconds },
+                        { "mb_per_sec", static_cast<double>(pack.bytes) / (1024.0 * 1024.0) / seconds },
+                        { "files_per_sec", static_cast<double>(pack.files) / seconds }
+                    };
+                    if (counted) {
+                        result["perf_counters"] = perf_counters_to_json();
+                    }
+                    pack_runs.push_back(result);
+                }
+            }
+        }
+        results.push_back({
+            { "pack", pack.name },
+            { "files", pack.files },
+            { "bytes", pack.bytes },
+            { "archive_bytes", pack.archive_bytes },
+            { "runs", pack_runs }
+        });
+        std::cerr << "Extracted " << pack.name << "." << std::endl;
+    }
+
+    json report = {
+        { "cores", cores },
+        { "page_cache_droppable", dropped_any },
+        { "packs", results }
+    };
+    std::cout << report.dump(2) << std::endl;
+    if (keep) {
+        std::cerr << "Scratch files kept in " << root << std::endl;
+        return 0;
+    }
+    remove_tree(root);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "fixtures.hpp"
+#include "archive.hpp"
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const double JAR_MEDIAN_BYTES = 300.0 * 1024;
+static const double JAR_SIZE_SIGMA = 1.1;
+static const long long JAR_MIN_BYTES = 4 * 1024;
+static const long long JAR_MAX_BYTES = 40LL * 1024 * 1024;
+
+bool make_directories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+bool write_file(const std::string& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+// Incompressible, like the class files inside a jar
+std::string random_bytes(size_t size, std::mt19937_64& random) {
+    std::string data(size, '\0');
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t value = random();
+        std::copy(reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 8, &data[i]);
+    }
+    for (; i < size; ++i) {
+        data[i] = static_cast<char>(random());
+    }
+    return data;
+}
+
+// Identifiers, keywords and punctuation drawn from a small vocabulary
+std::string compressible_bytes(size_t size, std::mt19937_64& random) {
+    static const char* const words[] = {
+        "java/lang/Object", "net/minecraft/world/level/Level", "getBlockState", "Lnet/fabricmc/api/ModInitializer;",
+        "<init>", "()V", "Code", "LineNumberTable", "this", "StackMapTable", "SourceFile", "RuntimeVisibleAnnotations",
+        "onInitialize", "org/slf4j/Logger", "info", "(Ljava/lang/String;)V", "register", "Identifier", "mixin", "\x01\x07\x0c"
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    std::string data;
+    data.reserve(size + 64);
+    while (data.size() < size) {
+        data += words[random() % word_count];
+        data += static_cast<char>(random() & 0xff);
+    }
+    data.resize(size);
+    return data;
+}
+
+std::vector<long long> make_jar_sizes(int count, unsigned seed) {
+    std::mt19937 random(seed);
+    std::lognormal_distribution<double> distribution(std::log(JAR_MEDIAN_BYTES), JAR_SIZE_SIGMA);
+    std::vector<long long> sizes;
+    for (int i = 0; i < count; ++i) {
+        sizes.push_back(std::min(JAR_MAX_BYTES, std::max(JAR_MIN_BYTES, static_cast<long long>(distribution(random)))));
+    }
+    return sizes;
+}
+
+static void put_u16(std::string& out, uint32_t value) {
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>((value >> 8) & 0xff);
+}
+
+static void put_u32(std::string& out, uint32_t value) {
+    put_u16(out, value & 0xffff);
+    put_u16(out, value >> 16);
+}
+
+// Raw deflate (no zlib header), as zip entries carry it
+static bool deflate_raw(const std::string& data, std::string& out) {
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&stream, static_cast<uLong>(data.size())));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+bool write_zip(const std::string& path, const std::vector<ZipSource>& entries) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string directory;
+    uint32_t offset = 0;
+    for (const ZipSource& entry : entries) {
+        uint32_t crc = crc32_update(0, reinterpret_cast<const unsigned char*>(entry.data.data()), entry.data.size());
+        uint32_t size = static_cast<uint32_t>(entry.data.size());
+        std::string body = entry.data;
+        uint32_t method = entry.deflate ? 8 : 0;
+        if (entry.deflate && !deflate_raw(entry.data, body)) {
+            return false;
+        }
+        uint32_t compressed_size = static_cast<uint32_t>(body.size());
+        std::string header;
+        put_u32(header, 0x04034b50);
+        put_u16(header, 20);     // version needed
+        put_u16(header, 0);      // flags
+        put_u16(header, method);
+        put_u32(header, 0);      // time, date
+        put_u32(header, crc);
+        put_u32(header, compressed_size);
+        put_u32(header, size);
+        put_u16(header, static_cast<uint32_t>(entry.name.size()));
+        put_u16(header, 0);      // extra length
+        header += entry.name;
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(body.data(), static_cast<std::streamsize>(body.size()));
+
+        put_u32(directory, 0x02014b50);
+        put_u16(directory, 20);  // version made by
+        put_u16(directory, 20);
+        put_u16(directory, 0);
+        put_u16(directory, method);
+        put_u32(directory, 0);
+        put_u32(directory, crc);
+        put_u32(directory, compressed_size);
+        put_u32(directory, size);
+        put_u16(directory, static_cast<uint32_t>(entry.name.size()));
+        put_u16(directory, 0);   // extra length
+        put_u16(directory, 0);   // comment length
+        put_u16(directory, 0);   // disk
+        put_u16(directory, 0);   // internal attributes
+        put_u32(directory, 0);   // external attributes
+        put_u32(directory, offset);
+        directory += entry.name;
+        offset += static_cast<uint32_t>(header.size()) + compressed_size;
+    }
+    std::string end;
+    put_u32(end, 0x06054b50);
+    put_u16(end, 0);
+    put_u16(end, 0);
+    put_u16(end, static_cast<uint32_t>(entries.size()));
+    put_u16(end, static_cast<uint32_t>(entries.size()));
+    put_u32(end, static_cast<uint32_t>(directory.size()));
+    put_u32(end, offset);
+    put_u16(end, 0);
+    out.write(directory.data(), static_cast<std::streamsize>(directory.size()));
+    out.write(end.data(), static_cast<std::streamsize>(end.size()));
+    return static_cast<bool>(out);
+}
+
+static bool copy_executable(const std::string& from, const std::string& to) {
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    return in && out && chmod(to.c_str(), 0755) == 0;
+}
+
+bool make_fake_jdk(const std::string& home, const std::string& version, int startup_ms, const std::string& java_stub) {
+    if (!make_directories(home + "/bin") ||
+        !write_file(home + "/release", "IMPLEMENTOR=\"Synthetic\"\nJAVA_VERSION=\"" + version + "\"\n")) {
+        return false;
+    }
+    if (!java_stub.empty()) {
+        for (const char* name : { "java", "javaw", "java.exe", "javaw.exe" }) {
+            if (!copy_executable(java_stub, home + "/bin/" + name)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    std::string banner = "openjdk version \"" + version + "\" 2024-01-16";
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%.3f", startup_ms / 1000.0);
+    // ping against an unused TEST-NET address waits for its timeout, the usual way to sleep in cmd
+    std::string bat = "@ping -n 1 -w " + std::to_string(std::max(startup_ms, 1)) + " 192.0.2.1 >nul\r\n@echo " + banner + " 1>&2\r\n";
+    std::string sh = "#!/bin/sh\nsleep " + std::string(seconds) + "\necho '" + banner + "' >&2\n";
+    bool ok = write_file(home + "/bin/java", sh) && write_file(home + "/bin/javaw", sh) &&
+              write_file(home + "/bin/java.bat", bat) && write_file(home + "/bin/javaw.bat", bat) &&
+              write_file(home + "/bin/java.exe", "") && write_file(home + "/bin/javaw.exe", "");
+    return ok && chmod((home + "/bin/java").c_str(), 0755) == 0 && chmod((home + "/bin/javaw").c_str(), 0755) == 0;
+}
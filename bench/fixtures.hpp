@@ -0,0 +1,36 @@
+#ifndef BENCH_FIXTURES_HPP
+#define BENCH_FIXTURES_HPP
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic inputs shared by the benchmarks: mod jars, zip archives and fake JDK trees.
+// Linux only, like the benchmarks themselves.
+
+struct ZipSource {
+    std::string name;    // '/' separated
+    std::string data;
+    bool deflate = false;
+};
+
+bool make_directories(const std::string& path);
+bool write_file(const std::string& path, const std::string& data);
+std::string random_bytes(size_t size, std::mt19937_64& random);
+std::string compressible_bytes(size_t size, std::mt19937_64& random);   // shrinks about 3x under deflate, like class files
+
+// Jar sizes as seen in real packs: mostly a few hundred KB, a long tail of libraries of several MB
+std::vector<long long> make_jar_sizes(int count, unsigned seed);
+
+// Zip readable by the installer's archive reader; entries are stored unless marked deflate
+// (compressed with zlib, so benchmarks using this link -lz)
+bool write_zip(const std::string& path, const std::vector<ZipSource>& entries);
+
+// A JDK directory with a "release" file and a bin/java that answers -version after startup_ms,
+// as a shell script for Linux and a .bat for Windows (found through PATH). With java_stub (a
+// build of bench/java_stub.cpp), copies of it become java, javaw, java.exe and javaw.exe instead;
+// they take their startup time from JAVA_STUB_STARTUP_MS.
+bool make_fake_jdk(const std::string& home, const std::string& version, int startup_ms, const std::string& java_stub = "");
+
+#endif
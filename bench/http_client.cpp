@@ -0,0 +1,346 @@
+// open_http() over plain sockets, so the download engine can run against the HTTP stand-in on
+// Linux. One connection per request ("Connection: close"), http:// only, no decoding: the
+// stand-in never compresses. A body that ends before its Content-Length counts as a broken
+// connection, as a socket reset does. open_http_async() does the same with non-blocking sockets
+// on the I/O loop, for download_batch().
+
+#include "download.hpp"
+#include "io_loop.hpp"
+
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+static const int CLIENT_RECEIVE_TIMEOUT_SECONDS = 30;
+static const size_t CLIENT_MAX_HEADER = 16384;
+
+class SocketResponse : public HttpResponse {
+public:
+    SocketResponse(int socket, int status, long long content_length, bool encoded, std::string pending)
+        : socket_(socket), status_(status), content_length_(content_length), encoded_(encoded), pending_(pending) {}
+    ~SocketResponse() override { close(socket_); }
+
+    int status() const override { return status_; }
+    long long content_length() const override { return content_length_; }
+    bool encoded() const override { return encoded_; }
+
+    bool read(char* buffer, size_t size, size_t& got) override {
+        got = 0;
+        if (content_length_ >= 0) {
+            size = static_cast<size_t>(std::min<long long>(static_cast<long long>(size), content_length_ - received_));
+            if (size == 0) {
+                return true;
+            }
+        }
+        if (!pending_.empty()) {
+            got = std::min(size, pending_.size());
+            std::memcpy(buffer, pending_.data(), got);
+            pending_.erase(0, got);
+        } else {
+            ssize_t result = recv(socket_, buffer, size, 0);
+            if (result < 0 || (result == 0 && content_length_ >= 0)) {
+                return false;
+            }
+            got = static_cast<size_t>(result);
+        }
+        received_ += static_cast<long long>(got);
+        return true;
+    }
+
+private:
+    int socket_;
+    int status_;
+    long long content_length_;
+    bool encoded_;
+    std::string pending_;   // body bytes that arrived with the headers
+    long long received_ = 0;
+};
+
+// Value of a header in a response head, "" if absent; names are matched case-insensitively
+static std::string get_header(const std::string& head, const std::string& name) {
+    size_t line = head.find("\r\n");
+    while (line != std::string::npos && line + 2 < head.size()) {
+        size_t start = line + 2;
+        size_t end = head.find("\r\n", start);
+        size_t colon = head.find(':', start);
+        if (colon != std::string::npos && colon < end && colon - start == name.size() &&
+            strncasecmp(head.c_str() + start, name.c_str(), name.size()) == 0) {
+            size_t value = head.find_first_not_of(' ', colon + 1);
+            return head.substr(value, end - value);
+        }
+        line = end;
+    }
+    return "";
+}
+
+// Where a request goes: "http://<authority><path>"
+struct HttpTarget {
+    std::string authority;
+    std::string host;
+    std::string port;
+    std::string path;
+};
+
+static bool parse_url(const std::string& url, HttpTarget& target, std::string& error) {
+    if (url.compare(0, 7, "http://") != 0) {
+        error = "only http:// is supported here: " + url;
+        return false;
+    }
+    size_t path_start = url.find('/', 7);
+    target.authority = url.substr(7, path_start == std::string::npos ? std::string::npos : path_start - 7);
+    target.path = path_start == std::string::npos ? "/" : url.substr(path_start);
+    size_t colon = target.authority.find(':');
+    target.host = target.authority.substr(0, colon);
+    target.port = colon == std::string::npos ? "80" : target.authority.substr(colon + 1);
+    return true;
+}
+
+static std::string build_request(const HttpTarget& target, long long offset, bool accept_encoding, long long length = -1) {
+    std::string request = "GET " + target.path + " HTTP/1.1\r\nHost: " + target.authority + "\r\nConnection: close\r\n";
+    if (length > 0) {
+        request += "Range: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1) + "\r\n";
+    } else if (offset > 0) {
+        request += "Range: bytes=" + std::to_string(offset) + "-\r\n";
+    } else if (accept_encoding) {
+        request += "Accept-Encoding: gzip, deflate\r\n";
+    }
+    return request + "\r\n";
+}
+
+// A socket for the target, connecting; non-blocking sockets return before the connection is up
+static int connect_socket(const HttpTarget& target, bool non_blocking, std::string& error) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(target.host.c_str(), target.port.c_str(), &hints, &addresses) != 0) {
+        error = "failed to resolve " + target.host;
+        return -1;
+    }
+    int flags = SOCK_CLOEXEC | (non_blocking ? SOCK_NONBLOCK : 0);
+    int s = socket(addresses->ai_family, addresses->ai_socktype | flags, addresses->ai_protocol);
+    bool connected = s >= 0 && (connect(s, addresses->ai_addr, addresses->ai_addrlen) == 0 || (non_blocking && errno == EINPROGRESS));
+    freeaddrinfo(addresses);
+    if (!connected) {
+        if (s >= 0) {
+            close(s);
+        }
+        error = "failed to open URL http://" + target.authority + target.path;
+        return -1;
+    }
+    return s;
+}
+
+std::unique_ptr<HttpResponse> open_http(const std::string& url, long long offset, bool accept_encoding, std::string& error, long long range_length) {
+    HttpTarget target;
+    if (!parse_url(url, target, error)) {
+        return nullptr;
+    }
+    int s = connect_socket(target, false, error);
+    if (s < 0) {
+        return nullptr;
+    }
+    timeval timeout = { CLIENT_RECEIVE_TIMEOUT_SECONDS, 0 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request = build_request(target, offset, accept_encoding, range_length);
+    if (send(s, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        close(s);
+        error = "failed to send request to " + url;
+        return nullptr;
+    }
+
+    std::string buffer;
+    char chunk[4096];
+    size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos && buffer.size() < CLIENT_MAX_HEADER) {
+        ssize_t got = recv(s, chunk, sizeof(chunk), 0);
+        if (got <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(got));
+    }
+    if (head_end == std::string::npos || buffer.compare(0, 5, "HTTP/") != 0) {
+        close(s);
+        error = "no response from " + url;
+        return nullptr;
+    }
+    std::string head = buffer.substr(0, head_end + 2);
+    int status = std::atoi(head.c_str() + head.find(' ') + 1);
+    std::string length = get_header(head, "Content-Length");
+    return std::unique_ptr<HttpResponse>(new SocketResponse(s, status, length.empty() ? -1 : std::atoll(length.c_str()),
+                                                            !get_header(head, "Content-Encoding").empty(), buffer.substr(head_end + 4)));
+}
+
+// The same over a non-blocking socket watched by the I/O loop
+class AsyncSocketResponse : public AsyncHttpResponse {
+public:
+    AsyncSocketResponse(int socket, int status, long long content_length, bool encoded, std::string pending)
+        : socket_(socket), status_(status), content_length_(content_length), encoded_(encoded), pending_(pending) {}
+    ~AsyncSocketResponse() override {
+        get_io_loop().forget(socket_);
+        close(socket_);
+    }
+
+    int status() const override { return status_; }
+    long long content_length() const override { return content_length_; }
+    bool encoded() const override { return encoded_; }
+
+    void read(char* buffer, size_t size, std::function<void(bool ok, size_t got)> done) override {
+        if (content_length_ >= 0) {
+            size = static_cast<size_t>(std::min<long long>(static_cast<long long>(size), content_length_ - received_));
+        }
+        if (size == 0 || !pending_.empty()) {
+            size_t got = std::min(size, pending_.size());
+            std::memcpy(buffer, pending_.data(), got);
+            pending_.erase(0, got);
+            received_ += static_cast<long long>(got);
+            get_io_loop().post([done, got] { done(true, got); });
+            return;
+        }
+        get_io_loop().watch(socket_, false, [this, buffer, size, done] {
+            ssize_t result = recv(socket_, buffer, size, MSG_DONTWAIT);
+            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !cancelled_) {
+                read(buffer, size, done);
+                return;
+            }
+            if (cancelled_ || result < 0 || (result == 0 && content_length_ >= 0)) {
+                done(false, 0);
+                return;
+            }
+            received_ += result;
+            done(true, static_cast<size_t>(result));
+        });
+    }
+
+    // Wakes a pending read, which then fails
+    void cancel() override {
+        cancelled_ = true;
+        shutdown(socket_, SHUT_RDWR);
+    }
+
+private:
+    int socket_;
+    int status_;
+    long long content_length_;
+    bool encoded_;
+    std::string pending_;
+    long long received_ = 0;
+    std::atomic<bool> cancelled_{ false };
+};
+
+// Connect, send the request and collect the response head, each step a wait on the I/O loop.
+// Name resolution still blocks, which costs nothing against the stand-ins on localhost.
+class AsyncOpen : public std::enable_shared_from_this<AsyncOpen> {
+public:
+    AsyncOpen(const std::string& url, OpenHttpCallback done) : url_(url), done_(done) {}
+
+    void start(long long offset, bool accept_encoding) {
+        HttpTarget target;
+        std::string error;
+        if (!parse_url(url_, target, error) || (socket_ = connect_socket(target, true, error)) < 0) {
+            OpenHttpCallback done = done_;
+            get_io_loop().post([done, error] { done(nullptr, error); });
+            return;
+        }
+        request_ = build_request(target, offset, accept_encoding);
+        std::shared_ptr<AsyncOpen> self = shared_from_this();
+        std::lock_guard<std::mutex> lock(mutex_);
+        timer_ = get_io_loop().after(CLIENT_RECEIVE_TIMEOUT_SECONDS * 1000, [self] { self->timed_out(); });
+        get_io_loop().watch(socket_, true, [self] { self->connected(); });
+    }
+
+private:
+    void timed_out() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!finished_) {
+            timed_out_ = true;
+            shutdown(socket_, SHUT_RDWR);
+        }
+    }
+
+    void connected() {
+        int socket_error = 0;
+        socklen_t length = sizeof(socket_error);
+        if (getsockopt(socket_, SOL_SOCKET, SO_ERROR, &socket_error, &length) != 0 || socket_error != 0 ||
+            send(socket_, request_.data(), request_.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request_.size())) {
+            fail("failed to send request to " + url_);
+            return;
+        }
+        std::shared_ptr<AsyncOpen> self = shared_from_this();
+        get_io_loop().watch(socket_, false, [self] { self->head_readable(); });
+    }
+
+    void head_readable() {
+        char chunk[4096];
+        ssize_t got;
+        while ((got = recv(socket_, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+            buffer_.append(chunk, static_cast<size_t>(got));
+            if (buffer_.find("\r\n\r\n") != std::string::npos || buffer_.size() >= CLIENT_MAX_HEADER) {
+                break;
+            }
+        }
+        size_t head_end = buffer_.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && buffer_.size() < CLIENT_MAX_HEADER) {
+                std::shared_ptr<AsyncOpen> self = shared_from_this();
+                get_io_loop().watch(socket_, false, [self] { self->head_readable(); });
+                return;
+            }
+            fail("no response from " + url_);
+            return;
+        }
+        if (buffer_.compare(0, 5, "HTTP/") != 0 || !finish()) {
+            fail("no response from " + url_);
+            return;
+        }
+        std::string head = buffer_.substr(0, head_end + 2);
+        int status = std::atoi(head.c_str() + head.find(' ') + 1);
+        std::string length = get_header(head, "Content-Length");
+        std::unique_ptr<AsyncHttpResponse> response(new AsyncSocketResponse(socket_, status, length.empty() ? -1 : std::atoll(length.c_str()),
+                                                                            !get_header(head, "Content-Encoding").empty(), buffer_.substr(head_end + 4)));
+        socket_ = -1;
+        done_(std::move(response), "");
+    }
+
+    // The timer either has not fired, and no longer will, or it has shut the socket down
+    bool finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        get_io_loop().cancel_timer(timer_);
+        return !timed_out_;
+    }
+
+    void fail(const std::string& error) {
+        finish();
+        get_io_loop().forget(socket_);
+        close(socket_);
+        socket_ = -1;
+        done_(nullptr, timed_out_ ? "no response from " + url_ + " in time" : error);
+    }
+
+    std::string url_;
+    OpenHttpCallback done_;
+    int socket_ = -1;
+    std::string request_;
+    std::string buffer_;
+    std::mutex mutex_;
+    uint64_t timer_ = 0;
+    bool finished_ = false;
+    bool timed_out_ = false;
+};
+
+void open_http_async(const std::string& url, long long offset, bool accept_encoding, OpenHttpCallback done) {
+    std::make_shared<AsyncOpen>(url, done)->start(offset, accept_encoding);
+}
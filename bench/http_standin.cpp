@@ -0,0 +1,311 @@
+#include "http_standin.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static const size_t STANDIN_SEND_CHUNK = 256 * 1024;
+static const size_t STANDIN_MAX_HEADER = 16384;
+
+static bool send_all(int s, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(s, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Value of a header in a request head, "" if absent; names are matched case-insensitively
+static std::string get_header(const std::string& head, const std::string& name) {
+    size_t line = head.find("\r\n");
+    while (line != std::string::npos && line + 2 < head.size()) {
+        size_t start = line + 2;
+        size_t end = head.find("\r\n", start);
+        size_t colon = head.find(':', start);
+        if (colon != std::string::npos && colon < end && colon - start == name.size() &&
+            strncasecmp(head.c_str() + start, name.c_str(), name.size()) == 0) {
+            size_t value = head.find_first_not_of(' ', colon + 1);
+            return head.substr(value, end - value);
+        }
+        line = end;
+    }
+    return "";
+}
+
+HttpStandin::~HttpStandin() {
+    stop();
+}
+
+void HttpStandin::add_data(const std::string& path, const std::string& data) {
+    Resource resource;
+    resource.data = data;
+    resource.size = static_cast<long long>(data.size());
+    resources_[path] = resource;
+}
+
+void HttpStandin::add_file(const std::string& path, const std::string& file_path) {
+    struct stat st;
+    Resource resource;
+    resource.file_path = file_path;
+    resource.size = stat(file_path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : 0;
+    resources_[path] = resource;
+}
+
+std::string HttpStandin::url(const std::string& path) const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+}
+
+bool HttpStandin::start(const StandinOptions& options) {
+    options_ = options;
+    random_.seed(options.seed);
+    // sendfile() to a client that has gone away would otherwise kill the process with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    listen_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<unsigned short>(options.port));
+    socklen_t length = sizeof(address);
+    if (listen_socket_ < 0 || bind(listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_socket_, 128) != 0 || getsockname(listen_socket_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        perror("http stand-in");
+        if (listen_socket_ >= 0) {
+            close(listen_socket_);
+        }
+        return false;
+    }
+    port_ = ntohs(address.sin_port);
+    running_ = true;
+    acceptor_ = std::thread(&HttpStandin::accept_loop, this);
+    return true;
+}
+
+// Clients blocked in recv are woken by shutting their sockets down
+void HttpStandin::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    shutdown(listen_socket_, SHUT_RDWR);
+    acceptor_.join();
+    close(listen_socket_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int client : open_clients_) {
+            shutdown(client, SHUT_RDWR);
+        }
+    }
+    for (std::thread& connection : connections_) {
+        connection.join();
+    }
+    connections_.clear();
+}
+
+void HttpStandin::accept_loop() {
+    while (running_) {
+        int client = accept4(listen_socket_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        int nodelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            close(client);
+            break;
+        }
+        open_clients_.insert(client);
+        connections_.emplace_back(&HttpStandin::serve_connection, this, client);
+    }
+}
+
+// Requests on one connection are answered in turn until the client closes it or asks to
+void HttpStandin::serve_connection(int client) {
+    std::string buffer;
+    char chunk[4096];
+    bool keep_alive = true;
+    while (keep_alive && running_) {
+        size_t head_end;
+        while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos && buffer.size() < STANDIN_MAX_HEADER) {
+            ssize_t got = recv(client, chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(got));
+        }
+        if (head_end == std::string::npos) {
+            break;
+        }
+        std::string head = buffer.substr(0, head_end + 2);
+        buffer.erase(0, head_end + 4);
+        requests_++;
+
+        size_t method_end = head.find(' ');
+        size_t target_end = head.find(' ', method_end + 1);
+        std::string method = head.substr(0, method_end);
+        std::string target = head.substr(method_end + 1, target_end - method_end - 1);
+        std::string connection = get_header(head, "Connection");
+        keep_alive = head.compare(target_end + 1, 8, "HTTP/1.0") == 0 ? strcasecmp(connection.c_str(), "keep-alive") == 0
+                                                                     : strcasecmp(connection.c_str(), "close") != 0;
+        bool stall = false;
+        Fault fault = pick_fault(stall);
+        if (options_.latency_ms > 0 || stall) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options_.latency_ms + (stall ? options_.stall_ms : 0)));
+        }
+
+        auto found = resources_.find(target.substr(0, target.find('#')));
+        std::string status = "200 OK";
+        std::string extra;
+        long long offset = 0;
+        long long length = 0;
+        if (found == resources_.end()) {
+            status = "404 Not Found";
+            fault = Fault::none;
+        } else if (fault == Fault::error) {
+            status = "503 Service Unavailable";
+        } else {
+            length = found->second.size;
+            // Only "bytes=<first>-[<last>]"; anything else is answered with the whole body
+            std::string range = options_.ignore_range ? "" : get_header(head, "Range");
+            if (range.compare(0, 6, "bytes=") == 0 && range.find(',') == std::string::npos && range[6] != '-') {
+                long long first = std::atoll(range.c_str() + 6);
+                size_t dash = range.find('-');
+                long long last = dash + 1 < range.size() ? std::atoll(range.c_str() + dash + 1) : length - 1;
+                last = std::min(last, length - 1);
+                if (first > last) {
+                    status = "416 Range Not Satisfiable";
+                    extra = "Content-Range: bytes */" + std::to_string(length) + "\r\n";
+                    length = 0;
+                } else {
+                    status = "206 Partial Content";
+                    extra = "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(length) + "\r\n";
+                    offset = first;
+                    length = last - first + 1;
+                }
+            }
+        }
+        if (fault != Fault::none) {
+            faults_++;
+            keep_alive = false;
+        }
+        // A dropped or truncated body stops somewhere in its middle; a wrong length announces less
+        // than is sent
+        long long announced = fault == Fault::wrong_length ? length - length / 4 : length;
+        long long body = length;
+        if (fault == Fault::drop || fault == Fault::truncate) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            body = static_cast<long long>(static_cast<double>(length) * std::uniform_real_distribution<double>(0.1, 0.9)(random_));
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Length: " + std::to_string(announced) +
+                               "\r\nContent-Type: application/octet-stream\r\nAccept-Ranges: bytes\r\n" + extra +
+                               (keep_alive ? "" : "Connection: close\r\n") + "\r\n";
+        if (!send_all(client, response.data(), response.size())) {
+            break;
+        }
+        if (method != "HEAD" && body > 0 && !send_body(client, found->second, offset, body)) {
+            break;
+        }
+        if (fault == Fault::drop) {
+            // A zero linger time makes close() send a reset instead of a clean end of stream
+            linger reset = { 1, 0 };
+            setsockopt(client, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_clients_.erase(client);
+    }
+    close(client);
+}
+
+// At most one fault per response; stalls come on top of any of them
+HttpStandin::Fault HttpStandin::pick_fault(bool& stall) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    stall = roll(random_) < options_.stall_rate;
+    double value = roll(random_);
+    const std::pair<double, Fault> faults[] = {
+        { options_.error_rate, Fault::error },
+        { options_.drop_rate, Fault::drop },
+        { options_.truncate_rate, Fault::truncate },
+        { options_.wrong_length_rate, Fault::wrong_length }
+    };
+    for (const auto& fault : faults) {
+        if (value < fault.first) {
+            return fault.second;
+        }
+        value -= fault.first;
+    }
+    return Fault::none;
+}
+
+bool HttpStandin::send_body(int client, const Resource& resource, long long offset, long long length) {
+    int fd = resource.file_path.empty() ? -1 : open(resource.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (!resource.file_path.empty() && fd < 0) {
+        return false;
+    }
+    off_t position = static_cast<off_t>(offset);
+    long long end = offset + length;
+    bool ok = true;
+    while (ok && position < end) {
+        size_t chunk = static_cast<size_t>(std::min<long long>(end - position, STANDIN_SEND_CHUNK));
+        bool crawling = options_.slow_after >= 0 && options_.slow_bytes_per_sec > 0 && position - offset >= options_.slow_after;
+        if (crawling) {
+            // Small pieces so a crawling body still trickles in rather than arriving in bursts
+            chunk = std::min(chunk, static_cast<size_t>(std::max<long long>(options_.slow_bytes_per_sec / 8, 1)));
+            std::this_thread::sleep_for(std::chrono::duration<double>(static_cast<double>(chunk) / static_cast<double>(options_.slow_bytes_per_sec)));
+        }
+        pace(static_cast<long long>(chunk));
+        ssize_t sent;
+        if (fd >= 0) {
+            sent = sendfile(client, fd, &position, chunk);
+        } else {
+            sent = send(client, resource.data.data() + position, chunk, MSG_NOSIGNAL);
+            position += sent > 0 ? sent : 0;
+        }
+        ok = sent > 0;
+        if (ok) {
+            bytes_sent_ += sent;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+// One token bucket for every connection, like a single uplink
+void HttpStandin::pace(long long bytes) {
+    if (options_.bytes_per_sec <= 0) {
+        return;
+    }
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (link_due_ < now) {
+            link_due_ = now;
+        }
+        link_due_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(options_.bytes_per_sec)));
+        due = link_due_;
+    }
+    std::this_thread::sleep_until(due);
+}
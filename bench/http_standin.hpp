@@ -0,0 +1,86 @@
+#ifndef HTTP_STANDIN_HPP
+#define HTTP_STANDIN_HPP
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Small HTTP/1.1 server standing in for Dropbox, Oracle, FabricMC and Modrinth in benchmarks.
+// Serves registered paths from memory or from disk, with keep-alive and single byte ranges,
+// behind a per-request delay and a bandwidth limit shared by all connections. It can also
+// misbehave the way real mirrors do: errors, stalls, dropped or truncated bodies, wrong
+// lengths, ignored ranges and transfers that slow down partway.
+//
+// Linux only; compiled into the benchmarks that need it.
+
+struct StandinOptions {
+    int port = 0;                    // 0 picks a free port
+    int latency_ms = 0;              // before each response
+    long long bytes_per_sec = 0;     // all connections together; 0 = unlimited
+
+    // Faults, drawn per response from a generator seeded with seed. A response with a fault
+    // closes its connection afterwards.
+    unsigned seed = 1;
+    bool ignore_range = false;       // answer range requests with the whole body
+    double error_rate = 0.0;         // share answered "503 Service Unavailable"
+    double stall_rate = 0.0;         // share held back a further stall_ms before the headers
+    int stall_ms = 0;
+    double drop_rate = 0.0;          // share whose body is cut off by a connection reset
+    double truncate_rate = 0.0;      // share whose body stops early with a clean close
+    double wrong_length_rate = 0.0;  // share whose Content-Length is a quarter short of the body
+    long long slow_after = -1;       // bytes into each body after which it crawls; -1 = never
+    long long slow_bytes_per_sec = 0;
+};
+
+class HttpStandin {
+public:
+    ~HttpStandin();
+    // Content is registered before start()
+    void add_data(const std::string& path, const std::string& data);
+    void add_file(const std::string& path, const std::string& file_path);
+    bool start(const StandinOptions& options);
+    void stop();
+    int port() const { return port_; }
+    std::string url(const std::string& path) const;   // "http://127.0.0.1:<port><path>"
+    long long bytes_sent() const { return bytes_sent_; }
+    long long requests() const { return requests_; }
+    long long faults() const { return faults_; }
+
+private:
+    struct Resource {
+        std::string data;
+        std::string file_path;   // served from disk when set
+        long long size = 0;
+    };
+
+    enum class Fault { none, error, drop, truncate, wrong_length };
+
+    void accept_loop();
+    void serve_connection(int client);
+    Fault pick_fault(bool& stall);
+    bool send_body(int client, const Resource& resource, long long offset, long long length);
+    void pace(long long bytes);
+
+    StandinOptions options_;
+    std::map<std::string, Resource> resources_;
+    int listen_socket_ = -1;
+    int port_ = 0;
+    std::atomic<bool> running_{ false };
+    std::atomic<long long> bytes_sent_{ 0 };
+    std::atomic<long long> requests_{ 0 };
+    std::atomic<long long> faults_{ 0 };
+    std::thread acceptor_;
+    std::vector<std::thread> connections_;
+    std::set<int> open_clients_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point link_due_;
+    std::mt19937 random_;
+};
+
+#endif
@@ -0,0 +1,274 @@
+// End-to-end install benchmark. Builds synthetic .mrpack modpacks (50, 300 and 1000 jars by
+// default, sized like real packs) and a fake JDK, serves the packs and their files from a local
+// HTTP stand-in, and runs the installer against them in a scratch profile: once cold (empty
+// store) and once warm (everything already installed). Each run's phase timings come from the
+// installer's --timings file (discovery, download, extraction, profile_write); the results are
+// printed as one JSON document so runs can be compared.
+//
+// The installer is run as given after "--", e.g. under Wine on a Linux box without network:
+//   install_bench --wine -- wine ./mc-mod-installer.exe
+// --wine passes scratch paths as Z:\... and the fake JDK through WINEPATH.
+//
+// Linux only. Build from the repository root:
+//   g++ -O2 -std=c++14 -pthread -I. -Ibench bench/install_bench.cpp bench/http_standin.cpp bench/fixtures.cpp archive.cpp hash.cpp -lz -o install_bench
+// Usage: install_bench [--packs 50,300,1000] [--latency <ms>] [--bandwidth <KB/s>] [--java-startup <ms>] [--java-stub <path>] [--wine] [--keep] -- <installer command...>
+
+#include "fixtures.hpp"
+#include "hash.hpp"
+#include "http_standin.hpp"
+#include "json.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+static const char* const PACK_HOST = "https://cdn.modrinth.com";
+static const int CONFIG_FILES_PER_PACK = 40;
+
+struct BenchOptions {
+    std::vector<int> packs = { 50, 300, 1000 };
+    int latency_ms = 0;
+    long long bandwidth_kbps = 0;
+    int java_startup_ms = 150;
+    std::string java_stub;   // build of bench/java_stub.cpp to use as java/javaw
+    bool wine = false;
+    bool keep = false;
+    std::vector<std::string> installer;
+};
+
+// How the installer sees a scratch path
+static std::string installer_path(const BenchOptions& options, std::string path) {
+    if (!options.wine) {
+        return path;
+    }
+    std::replace(path.begin(), path.end(), '/', '\\');
+    return "Z:" + path;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Jars go to the stand-in under their Modrinth-style URL; the pack itself lists them by hash
+static bool build_pack(const std::string& root, int jars, HttpStandin& server, long long& pack_bytes) {
+    std::string files_dir = root + "/files";
+    make_directories(files_dir);
+    std::mt19937_64 random(static_cast<uint64_t>(jars));
+    std::vector<long long> sizes = make_jar_sizes(jars, static_cast<unsigned>(jars));
+    json files = json::array();
+    pack_bytes = 0;
+    for (int i = 0; i < jars; ++i) {
+        std::string data = random_bytes(static_cast<size_t>(sizes[i]), random);
+        Sha1 sha1;
+        sha1.update(data.data(), data.size());
+        Sha512 sha512;
+        sha512.update(data.data(), data.size());
+        std::string digest = sha1.hex_digest();
+        std::string file_path = files_dir + "/" + digest;
+        if (!write_file(file_path, data)) {
+            return false;
+        }
+        std::string url_path = "/data/" + digest.substr(0, 8) + "/versions/" + digest.substr(8, 8) + "/mod-" + std::to_string(i) + ".jar";
+        server.add_file(url_path, file_path);
+        files.push_back({
+            { "path", "mods/mod-" + std::to_string(i) + ".jar" },
+            { "hashes", { { "sha1", digest }, { "sha512", sha512.hex_digest() } } },
+            { "env", { { "client", "required" }, { "server", "required" } } },
+            { "downloads", { PACK_HOST + url_path } },
+            { "fileSize", sizes[i] }
+        });
+        pack_bytes += sizes[i];
+    }
+    json index = {
+        { "formatVersion", 1 },
+        { "game", "minecraft" },
+        { "versionId", "1.0." + std::to_string(jars) },
+        { "name", "Synthetic " + std::to_string(jars) },
+        { "files", files },
+        { "dependencies", { { "minecraft", "1.20.1" }, { "fabric-loader", "0.16.14" } } }
+    };
+    std::vector<ZipSource> entries = { { "modrinth.index.json", index.dump(2) } };
+    for (int i = 0; i < CONFIG_FILES_PER_PACK; ++i) {
+        entries.push_back({ "overrides/config/mod-" + std::to_string(i) + ".json", "{ \"enabled\": true, \"level\": " + std::to_string(i) + " }\n" });
+    }
+    std::string pack_path = root + "/pack-" + std::to_string(jars) + ".mrpack";
+    if (!write_zip(pack_path, entries)) {
+        return false;
+    }
+    server.add_file("/packs/pack-" + std::to_string(jars) + ".mrpack", pack_path);
+    return true;
+}
+
+// A profile where Java and Fabric are already present, so a run exercises discovery rather than
+// the JDK and Fabric installers
+static bool make_profile(const std::string& home) {
+    std::string minecraft = home + "/AppData/Roaming/.minecraft";
+    return make_directories(minecraft + "/versions/fabric-loader-0.16.14-1.20.1") &&
+           make_directories(home + "/AppData/Local") && make_directories(home + "/ProgramData") &&
+           write_file(minecraft + "/launcher_profiles.json", "{ \"profiles\": {} }\n");
+}
+
+static json run_installer(const BenchOptions& options, const std::string& home, const std::string& jdk, const std::string& pack_url,
+                          const std::string& mirror, const std::string& label, HttpStandin& server) {
+    std::string timings_path = home + "/timings-" + label + ".json";
+    std::string log_path = home + "/installer-" + label + ".log";
+    std::remove(timings_path.c_str());
+    long long bytes_before = server.bytes_sent();
+    long long requests_before = server.requests();
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("USERPROFILE", installer_path(options, home).c_str(), 1);
+        setenv("APPDATA", installer_path(options, home + "/AppData/Roaming").c_str(), 1);
+        setenv("LOCALAPPDATA", installer_path(options, home + "/AppData/Local").c_str(), 1);
+        setenv("ProgramData", installer_path(options, home + "/ProgramData").c_str(), 1);
+        setenv("JAVA_STUB_STARTUP_MS", std::to_string(options.java_startup_ms).c_str(), 1);
+        if (options.wine) {
+            setenv("WINEPATH", installer_path(options, jdk + "/bin").c_str(), 1);
+        } else {
+            std::string path = jdk + "/bin:" + (getenv("PATH") ? getenv("PATH") : "");
+            setenv("PATH", path.c_str(), 1);
+        }
+        int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(log, 1);
+        dup2(log, 2);
+        std::vector<std::string> args = options.installer;
+        args.insert(args.end(), { "--modpack", pack_url, "--mirror", std::string(PACK_HOST) + "=" + mirror,
+                                  "--timings", installer_path(options, timings_path) });
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    json result = {
+        { "run", label },
+        { "exit_code", WIFEXITED(status) ? WEXITSTATUS(status) : -1 },
+        { "wall_seconds", seconds_since(start) },
+        { "bytes_served", server.bytes_sent() - bytes_before },
+        { "requests", server.requests() - requests_before }
+    };
+    if (result["exit_code"] != 0) {
+        std::cerr << "The installer failed; see " << log_path << " (run with --keep to look at it afterwards)." << std::endl;
+    }
+    std::ifstream timings_file(timings_path);
+    json timings = json::parse(timings_file, nullptr, false);
+    if (!timings.is_discarded()) {
+        result["total_seconds"] = timings.value("total_seconds", 0.0);
+        result["phases"] = timings.value("phases", json::object());
+    }
+    return result;
+}
+
+static std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    int i = 1;
+    for (; i < argc && std::string(argv[i]) != "--"; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--packs" && i + 1 < argc) {
+            options.packs = parse_list(argv[++i]);
+        } else if (arg == "--latency" && i + 1 < argc) {
+            options.latency_ms = std::atoi(argv[++i]);
+        } else if (arg == "--bandwidth" && i + 1 < argc) {
+            options.bandwidth_kbps = std::atoll(argv[++i]);
+        } else if (arg == "--java-startup" && i + 1 < argc) {
+            options.java_startup_ms = std::atoi(argv[++i]);
+        } else if (arg == "--java-stub" && i + 1 < argc) {
+            options.java_stub = argv[++i];
+        } else if (arg == "--wine") {
+            options.wine = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+    options.installer.assign(argv + std::min(i + 1, argc), argv + argc);
+    if (options.installer.empty()) {
+        std::cerr << "Usage: install_bench [--packs 50,300,1000] [--latency <ms>] [--bandwidth <KB/s>] [--java-startup <ms>] [--java-stub <path>] [--wine] [--keep] -- <installer command...>" << std::endl;
+        return 2;
+    }
+
+    std::string root = "/tmp/install_bench." + std::to_string(getpid());
+    std::string jdk = root + "/jdk-21.0.2";
+    if (!make_directories(root) || !make_fake_jdk(jdk, "21.0.2", options.java_startup_ms, options.java_stub)) {
+        std::cerr << "Failed to create " << root << std::endl;
+        return 1;
+    }
+
+    HttpStandin server;
+    std::vector<long long> pack_bytes(options.packs.size());
+    for (size_t p = 0; p < options.packs.size(); ++p) {
+        std::cerr << "Building a pack of " << options.packs[p] << " jars..." << std::endl;
+        if (!build_pack(root, options.packs[p], server, pack_bytes[p])) {
+            std::cerr << "Failed to build the pack in " << root << std::endl;
+            return 1;
+        }
+    }
+    StandinOptions server_options;
+    server_options.latency_ms = options.latency_ms;
+    server_options.bytes_per_sec = options.bandwidth_kbps * 1024;
+    if (!server.start(server_options)) {
+        return 1;
+    }
+
+    json packs = json::array();
+    for (size_t p = 0; p < options.packs.size(); ++p) {
+        int jars = options.packs[p];
+        std::string home = root + "/home-" + std::to_string(jars);
+        make_profile(home);
+        std::string pack_url = server.url("/packs/pack-" + std::to_string(jars) + ".mrpack");
+        json runs = json::array();
+        for (const char* label : { "cold", "warm" }) {
+            std::cerr << "Installing " << jars << " jars (" << label << ")..." << std::endl;
+            runs.push_back(run_installer(options, home, jdk, pack_url, server.url(""), label, server));
+        }
+        packs.push_back({ { "jars", jars }, { "bytes", pack_bytes[p] }, { "runs", runs } });
+    }
+    server.stop();
+
+    json report = {
+        { "installer", options.installer },
+        { "latency_ms", options.latency_ms },
+        { "bandwidth_kbps", options.bandwidth_kbps },
+        { "java_startup_ms", options.java_startup_ms },
+        { "packs", packs }
+    };
+    std::cout << report.dump(2) << std::endl;
+    if (options.keep) {
+        std::cerr << "Scratch files kept in " << root << std::endl;
+        return 0;
+    }
+    std::string cleanup = "rm -rf " + root;
+    return system(cleanup.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+// Java discovery benchmark. Creates N synthetic JDKs spread over the vendor directories the
+// installer searches (Java, Oracle, Eclipse Adoptium, Eclipse Foundation under Program Files and
+// Program Files (x86)), each with a java/javaw that takes a JVM's startup time to answer
+// -version, and runs the installer's "java" mode against them: cold (page cache dropped when
+// allowed) and warm. Only one JDK is new enough, and by default it is the last one searched, so
+// every other candidate is started too.
+//
+// Reported per run: wall time, the discovery phase, the installer's own counts of process spawns
+// and directory scans (from --timings), and the JVM launches the stubs logged, also per candidate.
+// A change in how many JVMs an install starts shows up here as a number.
+//
+// The installer is run as given after "--", normally under Wine with stubs built from
+// bench/java_stub.cpp:
+//   java_bench --wine --java-stub java_stub.exe -- wine ./mc-mod-installer.exe
+// --wine uses a scratch WINEPREFIX and puts the JDKs under its drive_c; otherwise ProgramFiles
+// and ProgramFiles(x86) point into the scratch directory.
+//
+// Linux only. Build from the repository root:
+//   g++ -O2 -std=c++14 -I. -Ibench bench/java_bench.cpp bench/fixtures.cpp archive.cpp -lz -o java_bench
+// Usage: java_bench [--jdks 1,8,32] [--java-startup <ms>] [--java-stub <path>] [--suitable first|last|none] [--in-path] [--wine] [--keep] -- <installer command...>
+
+#include "fixtures.hpp"
+#include "json.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+static const char* const VENDORS[] = { "Java", "Oracle", "Eclipse Adoptium", "Eclipse Foundation" };
+static const char* const OLD_VERSIONS[] = { "17.0.10", "11.0.22", "1.8.0_402" };
+static const char* const SUITABLE_VERSION = "21.0.2";
+
+struct BenchOptions {
+    std::vector<int> jdks = { 1, 8, 32 };
+    int java_startup_ms = 150;
+    std::string java_stub;
+    std::string suitable = "last";
+    bool in_path = false;
+    bool wine = false;
+    bool keep = false;
+    std::vector<std::string> installer;
+};
+
+// How the installer sees a scratch path
+static std::string installer_path(const BenchOptions& options, std::string path) {
+    if (!options.wine) {
+        return path;
+    }
+    std::replace(path.begin(), path.end(), '/', '\\');
+    return "Z:" + path;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long long count_lines(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    long long lines = 0;
+    while (std::getline(in, line)) {
+        lines++;
+    }
+    return lines;
+}
+
+// Program Files and Program Files (x86) as the installer will see them
+static void get_program_files(const BenchOptions& options, const std::string& root, std::string& program_files, std::string& program_files_x86) {
+    if (options.wine) {
+        program_files = root + "/wine/drive_c/Program Files";
+        program_files_x86 = root + "/wine/drive_c/Program Files (x86)";
+    } else {
+        program_files = root + "/Program Files";
+        program_files_x86 = root + "/Program Files (x86)";
+    }
+}
+
+// JDKs round-robin over the vendor directories in the order the installer searches them; the one
+// suitable JDK goes first, last, or nowhere. Returns the suitable JDK's home ("" if none).
+static std::string make_jdks(const BenchOptions& options, const std::string& root, int count) {
+    std::string program_files, program_files_x86;
+    get_program_files(options, root, program_files, program_files_x86);
+    std::vector<std::string> vendor_dirs;
+    for (const std::string& base : { program_files, program_files_x86 }) {
+        for (const char* vendor : VENDORS) {
+            vendor_dirs.push_back(base + "/" + vendor);
+        }
+    }
+    std::string suitable_home;
+    for (int i = 0; i < count; ++i) {
+        // Spread over all eight vendor directories before any gets a second JDK, so "last" really is searched last
+        std::string vendor_dir = vendor_dirs[static_cast<size_t>(i) % vendor_dirs.size()];
+        bool suitable = (options.suitable == "first" && i == 0) || (options.suitable == "last" && i == count - 1);
+        std::string version = suitable ? SUITABLE_VERSION : OLD_VERSIONS[i % 3];
+        std::string home = vendor_dir + "/jdk-" + version + "-" + std::to_string(i);
+        if (!make_fake_jdk(home, version, options.java_startup_ms, options.java_stub)) {
+            std::cerr << "Failed to create " << home << std::endl;
+            exit(1);
+        }
+        if (suitable) {
+            suitable_home = home;
+        }
+    }
+    return suitable_home;
+}
+
+static void remove_tree(const std::string& path) {
+    std::string command = "rm -rf '" + path + "'";
+    if (system(command.c_str()) != 0) {
+        std::cerr << "Failed to remove " << path << std::endl;
+    }
+}
+
+// Evicting the JDK trees from the page cache needs root; without it "cold" is only a first run
+static bool drop_page_cache() {
+    sync();
+    std::ofstream drop("/proc/sys/vm/drop_caches");
+    drop << "3" << std::endl;
+    return static_cast<bool>(drop);
+}
+
+static json run_installer(const BenchOptions& options, const std::string& root, const std::string& home, const std::string& suitable_bin,
+                          const std::string& label) {
+    std::string timings_path = home + "/timings-" + label + ".json";
+    std::string launches_path = home + "/launches-" + label + ".log";
+    std::string log_path = home + "/installer-" + label + ".log";
+    std::remove(timings_path.c_str());
+    std::remove(launches_path.c_str());
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("USERPROFILE", installer_path(options, home).c_str(), 1);
+        setenv("APPDATA", installer_path(options, home + "/AppData/Roaming").c_str(), 1);
+        setenv("LOCALAPPDATA", installer_path(options, home + "/AppData/Local").c_str(), 1);
+        setenv("JAVA_STUB_STARTUP_MS", std::to_string(options.java_startup_ms).c_str(), 1);
+        setenv("JAVA_STUB_LOG", installer_path(options, launches_path).c_str(), 1);
+        if (options.wine) {
+            setenv("WINEPREFIX", (root + "/wine").c_str(), 1);
+            setenv("WINEDEBUG", "-all", 1);
+            setenv("WINEPATH", options.in_path ? installer_path(options, suitable_bin).c_str() : "", 1);
+        } else {
+            std::string program_files, program_files_x86;
+            get_program_files(options, root, program_files, program_files_x86);
+            setenv("ProgramFiles", program_files.c_str(), 1);
+            setenv("ProgramFiles(x86)", program_files_x86.c_str(), 1);
+            if (options.in_path) {
+                std::string path = suitable_bin + ":" + (getenv("PATH") ? getenv("PATH") : "");
+                setenv("PATH", path.c_str(), 1);
+            }
+        }
+        int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(log, 1);
+        dup2(log, 2);
+        std::vector<std::string> args = options.installer;
+        args.insert(args.end(), { "java", "--timings", installer_path(options, timings_path) });
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    json result = {
+        { "run", label },
+        { "exit_code", WIFEXITED(status) ? WEXITSTATUS(status) : -1 },
+        { "wall_seconds", seconds_since(start) },
+        { "jvm_launches", count_lines(launches_path) }
+    };
+    std::ifstream timings_file(timings_path);
+    json timings = json::parse(timings_file, nullptr, false);
+    if (!timings.is_discarded()) {
+        json phases = timings.value("phases", json::object());
+        result["discovery_seconds"] = phases.count("discovery") ? phases["discovery"].value("seconds", 0.0) : 0.0;
+        result["counts"] = timings.value("counts", json::object());
+    } else {
+        std::cerr << "No timings from the installer; see " << log_path << " (run with --keep to look at it afterwards)." << std::endl;
+    }
+    return result;
+}
+
+static std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    int i = 1;
+    for (; i < argc && std::string(argv[i]) != "--"; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jdks" && i + 1 < argc) {
+            options.jdks = parse_list(argv[++i]);
+        } else if (arg == "--java-startup" && i + 1 < argc) {
+            options.java_startup_ms = std::atoi(argv[++i]);
+        } else if (arg == "--java-stub" && i + 1 < argc) {
+            options.java_stub = argv[++i];
+        } else if (arg == "--suitable" && i + 1 < argc) {
+            options.suitable = argv[++i];
+        } else if (arg == "--in-path") {
+            options.in_path = true;
+        } else if (arg == "--wine") {
+            options.wine = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+    options.installer.assign(argv + std::min(i + 1, argc), argv + argc);
+    if (options.installer.empty() || (options.suitable != "first" && options.suitable != "last" && options.suitable != "none")) {
+        std::cerr << "Usage: java_bench [--jdks 1,8,32] [--java-startup <ms>] [--java-stub <path>] [--suitable first|last|none] [--in-path] [--wine] [--keep] -- <installer command...>" << std::endl;
+        return 2;
+    }
+
+    std::string root = "/tmp/java_bench." + std::to_string(getpid());
+    std::string home = root + "/home";
+    if (!make_directories(home + "/AppData/Roaming/.minecraft") || !make_directories(home + "/AppData/Local")) {
+        std::cerr << "Failed to create " << root << std::endl;
+        return 1;
+    }
+    if (options.wine) {
+        // The first run only creates the Wine prefix the JDKs are then put into
+        std::cerr << "Creating a Wine prefix..." << std::endl;
+        run_installer(options, root, home, "", "prefix");
+    }
+
+    std::string program_files, program_files_x86;
+    get_program_files(options, root, program_files, program_files_x86);
+    json results = json::array();
+    for (int count : options.jdks) {
+        for (const std::string& base : { program_files, program_files_x86 }) {
+            for (const char* vendor : VENDORS) {
+                remove_tree(base + "/" + vendor);
+            }
+        }
+        std::cerr << "Creating " << count << " JDKs..." << std::endl;
+        std::string suitable_home = make_jdks(options, root, count);
+        json runs = json::array();
+        for (const char* label : { "cold", "warm" }) {
+            bool dropped = std::string(label) == "cold" && drop_page_cache();
+            json run = run_installer(options, root, home, suitable_home.empty() ? "" : suitable_home + "/bin", label);
+            run["page_cache_dropped"] = dropped;
+            run["jvm_launches_per_candidate"] = count > 0 ? static_cast<double>(run["jvm_launches"].get<long long>()) / count : 0.0;
+            runs.push_back(run);
+        }
+        results.push_back({ { "jdks", count }, { "runs", runs } });
+    }
+
+    json report = {
+        { "installer", options.installer },
+        { "java_startup_ms", options.java_startup_ms },
+        { "java_stub", !options.java_stub.empty() },
+        { "suitable", options.suitable },
+        { "in_path", options.in_path },
+        { "results", results }
+    };
+    std::cout << report.dump(2) << std::endl;
+    if (options.keep) {
+        std::cerr << "Scratch files kept in " << root << std::endl;
+        return 0;
+    }
+    remove_tree(root);
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Stand-in for java/javaw in synthetic JDK trees. Sleeps like a JVM starting up, then answers
+// -version on stderr with the JAVA_VERSION from the "release" file of the JDK it sits in, as
+// "<home>/bin/java". Startup time is JAVA_STUB_STARTUP_MS (default 150); when JAVA_STUB_LOG is
+// set, every launch appends a line to that file, so benchmarks can count JVM launches from outside.
+//
+// Build for Wine/Windows:  x86_64-w64-mingw32-g++ -O2 -static bench/java_stub.cpp -o java_stub.exe
+// Build for Linux:         g++ -O2 bench/java_stub.cpp -o java_stub
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+static std::string own_path() {
+#ifdef _WIN32
+    char buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, buffer, MAX_PATH);
+    return std::string(buffer, length);
+#else
+    char buffer[4096];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer));
+    return length > 0 ? std::string(buffer, static_cast<size_t>(length)) : "";
+#endif
+}
+
+static std::string release_version(const std::string& exe_path) {
+    size_t bin = exe_path.find_last_of("/\\");
+    size_t home = bin == std::string::npos || bin == 0 ? std::string::npos : exe_path.find_last_of("/\\", bin - 1);
+    if (home == std::string::npos) {
+        return "";
+    }
+    std::ifstream release(exe_path.substr(0, home) + "/release");
+    std::string line;
+    while (std::getline(release, line)) {
+        if (line.rfind("JAVA_VERSION=", 0) == 0) {
+            size_t first_quote = line.find('\"');
+            size_t second_quote = line.find('\"', first_quote + 1);
+            if (first_quote != std::string::npos && second_quote != std::string::npos) {
+                return line.substr(first_quote + 1, second_quote - first_quote - 1);
+            }
+        }
+    }
+    return "";
+}
+
+int main() {
+    std::string path = own_path();
+    const char* log = std::getenv("JAVA_STUB_LOG");
+    if (log) {
+        std::ofstream(log, std::ios::app) << path << "\n";
+    }
+    const char* startup = std::getenv("JAVA_STUB_STARTUP_MS");
+    std::this_thread::sleep_for(std::chrono::milliseconds(startup ? std::atoi(startup) : 150));
+    std::string version = release_version(path);
+    if (version.empty()) {
+        std::fprintf(stderr, "Error: could not find the release file next to %s\n", path.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, "openjdk version \"%s\" 2024-01-16\nOpenJDK Runtime Environment (build %s)\n", version.c_str(), version.c_str());
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Compares the nlohmann DOM against the streaming reader (json_stream.cpp) on a synthetic
+// modrinth.index.json of about 5 MB: parse time and peak heap while parsing.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++14 -I. bench/json_bench.cpp json_stream.cpp -o json_bench
+// Usage: json_bench [files] [iterations]
+
+#include "json.hpp"
+#include "json_stream.hpp"
+#include "mrpack.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+
+// Heap accounting: every block carries its size in a 16-byte header
+static size_t g_current_bytes = 0;
+static size_t g_peak_bytes = 0;
+static size_t g_allocations = 0;
+
+void* operator new(size_t size) {
+    unsigned char* block = static_cast<unsigned char*>(std::malloc(size + 16));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    g_current_bytes += size;
+    g_peak_bytes = std::max(g_peak_bytes, g_current_bytes);
+    g_allocations++;
+    return block + 16;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) {
+        return;
+    }
+    unsigned char* block = static_cast<unsigned char*>(p) - 16;
+    g_current_bytes -= *reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+static std::string make_index(int file_count) {
+    std::string out = "{\n  \"formatVersion\": 1,\n  \"game\": \"minecraft\",\n  \"versionId\": \"1.0.0\",\n  \"name\": \"Synthetic Pack\",\n  \"files\": [\n";
+    char buffer[1024];
+    unsigned seed = 12345;
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return seed; };
+    auto hex = [&next](int chars) {
+        std::string s;
+        for (int i = 0; i < chars; ++i) {
+            s += "0123456789abcdef"[next() % 16];
+        }
+        return s;
+    };
+    static const char* envs[] = { "required", "optional", "unsupported" };
+    for (int i = 0; i < file_count; ++i) {
+        std::string sha1 = hex(40);
+        std::snprintf(buffer, sizeof(buffer),
+            "    {\n      \"path\": \"mods/mod-%d-%u.jar\",\n      \"hashes\": {\n        \"sha1\": \"%s\",\n        \"sha512\": \"%s\"\n      },\n"
+            "      \"env\": {\n        \"client\": \"required\",\n        \"server\": \"%s\"\n      },\n"
+            "      \"downloads\": [\n        \"https://cdn.modrinth.com/data/%s/versions/%s/mod-%d.jar\"\n      ],\n      \"fileSize\": %u\n    }%s\n",
+            i, next() % 1000000, sha1.c_str(), hex(128).c_str(), envs[next() % 3], sha1.substr(0, 8).c_str(), sha1.substr(8, 8).c_str(), i,
+            next() % 5000000, i + 1 < file_count ? "," : "");
+        out += buffer;
+    }
+    out += "  ],\n  \"dependencies\": {\n    \"minecraft\": \"1.20.1\",\n    \"fabric-loader\": \"0.16.14\"\n  }\n}\n";
+    return out;
+}
+
+// What the installer used before: parse the whole document, then copy fields out of the DOM
+static size_t parse_with_dom(const std::string& text) {
+    using json = nlohmann::json;
+    json j = json::parse(text);
+    size_t files = 0;
+    for (const json& f : j["files"]) {
+        std::string path = f.value("path", "");
+        std::string sha1 = f["hashes"].value("sha1", "");
+        files += !path.empty() && !sha1.empty();
+    }
+    return files;
+}
+
+static size_t parse_with_stream(const std::string& text) {
+    MrpackIndex index;
+    if (!parse_mrpack_index(text.data(), text.size(), index)) {
+        std::cerr << "streaming parse failed" << std::endl;
+        std::exit(1);
+    }
+    return index.files.size();
+}
+
+struct Result {
+    double best_ms = 1e30;
+    size_t peak_bytes = 0;
+    size_t allocations = 0;
+    size_t files = 0;
+};
+
+template <typename Parse>
+static Result measure(const std::string& text, int iterations, Parse parse) {
+    Result result;
+    for (int i = 0; i < iterations; ++i) {
+        size_t baseline = g_current_bytes;
+        g_peak_bytes = baseline;
+        g_allocations = 0;
+        auto start = std::chrono::steady_clock::now();
+        result.files = parse(text);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.best_ms = std::min(result.best_ms, ms);
+        result.peak_bytes = g_peak_bytes - baseline;
+        result.allocations = g_allocations;
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 9000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+    std::string text = make_index(file_count);
+
+    Result dom = measure(text, iterations, parse_with_dom);
+    Result stream = measure(text, iterations, parse_with_stream);
+    if (dom.files == 0 || stream.files != static_cast<size_t>(file_count)) {
+        std::cerr << "parsers disagree: dom " << dom.files << ", stream " << stream.files << std::endl;
+        return 1;
+    }
+
+    std::printf("input: %.2f MB, %d files, best of %d\n", text.size() / 1048576.0, file_count, iterations);
+    std::printf("%-8s %10s %14s %12s\n", "parser", "time ms", "peak heap MB", "allocations");
+    std::printf("%-8s %10.2f %14.2f %12zu\n", "dom", dom.best_ms, dom.peak_bytes / 1048576.0, dom.allocations);
+    std::printf("%-8s %10.2f %14.2f %12zu\n", "stream", stream.best_ms, stream.peak_bytes / 1048576.0, stream.allocations);
+    std::printf("speedup %.1fx, peak heap %.1fx smaller\n", dom.best_ms / stream.best_ms, static_cast<double>(dom.peak_bytes) / std::max<size_t>(stream.peak_bytes, 1));
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Simulates a LAN event on loopback: one throttled origin (the shared uplink) and several
+// installers that each need the same set of files, arriving a little apart. Reports the wall time
+// until everyone is done, how many bytes came through the origin versus from peers, and the
+// origin's CPU time per GB (the cost of a local mirror box serving many installs).
+//
+// Linux only. Build from the repository root:
+//   g++ -O2 -std=c++14 -pthread -I. bench/peer_bench.cpp peer_cache.cpp async_writer.cpp file_ops.cpp hash.cpp -o peer_bench
+// Usage: peer_bench [clients] [files] [file KB] [origin KB/s] [--no-peers]
+
+#include "hash.hpp"
+#include "peer_cache.hpp"
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int CLIENT_STAGGER_MS = 300;
+static const int DISCOVERY_WAIT_MS = 700;
+
+struct ClientResult {
+    double seconds = 0;
+    long long origin_bytes = 0;
+    long long peer_bytes = 0;
+};
+
+// CPU time (user + system) of this process, which after forking is the origin server's
+static double cpu_seconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Each installer serves what it already has and takes what it can from peers before the origin
+static ClientResult run_client(int index, const std::string& dir, const std::vector<std::string>& digests,
+                               const std::string& origin, bool use_peers) {
+    std::mutex mutex;
+    std::set<std::string> held;
+    PeerCacheOptions options;
+    options.interface_address = "127.0.0.1";
+    options.http_port = 0;
+    options.announce_interval_ms = 500;
+    options.list_keys = [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<std::string>(held.begin(), held.end());
+    };
+    options.resolve = [&](const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return held.count(key) ? dir + "/" + key.substr(5) : std::string();
+    };
+    PeerCache cache;
+    if (use_peers && !cache.start(options)) {
+        exit(1);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(DISCOVERY_WAIT_MS));
+
+    // Every installer walks the pack in its own order, like parallel downloads finishing unevenly
+    std::vector<std::string> order = digests;
+    std::shuffle(order.begin(), order.end(), std::mt19937(index));
+    ClientResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& digest : order) {
+        std::string key = "sha1:" + digest;
+        std::string path = dir + "/" + digest;
+        ExpectedHashes expected;
+        expected.sha1 = digest;
+        std::string error;
+        long long bytes = 0;
+        if (use_peers && cache.fetch(key, path, expected, error)) {
+            result.peer_bytes = cache.bytes_fetched();
+        } else if (http_fetch_object(origin, key, path, expected, bytes, error)) {
+            result.origin_bytes += bytes;
+        } else {
+            std::cerr << "client " << index << ": " << error << std::endl;
+            exit(1);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        held.insert(key);
+        if (use_peers) {
+            cache.announce_now();
+        }
+    }
+    result.seconds = seconds_since(start);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    bool use_peers = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--no-peers") {
+            use_peers = false;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int clients = args.size() > 0 ? std::atoi(args[0].c_str()) : 6;
+    int files = args.size() > 1 ? std::atoi(args[1].c_str()) : 12;
+    long long file_kb = args.size() > 2 ? std::atoll(args[2].c_str()) : 1024;
+    long long origin_kbps = args.size() > 3 ? std::atoll(args[3].c_str()) : 8192;
+
+    std::string root = "/tmp/peer_bench." + std::to_string(getpid());
+    mkdir(root.c_str(), 0755);
+    mkdir((root + "/origin").c_str(), 0755);
+
+    // Origin content, named by SHA-1
+    std::vector<std::string> digests;
+    std::mt19937_64 random(42);
+    std::vector<char> data(static_cast<size_t>(file_kb) * 1024);
+    for (int i = 0; i < files; ++i) {
+        for (char& c : data) {
+            c = static_cast<char>(random());
+        }
+        Sha1 hasher;
+        hasher.update(data.data(), data.size());
+        std::string digest = hasher.hex_digest();
+        std::ofstream(root + "/origin/" + digest, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+        digests.push_back(digest);
+    }
+
+    // The origin is a server on another port that never announces, throttled like a venue uplink
+    PeerCacheOptions origin_options;
+    origin_options.interface_address = "127.0.0.1";
+    origin_options.http_port = 0;
+    origin_options.multicast_port = 47779;
+    origin_options.upload_bytes_per_sec = origin_kbps * 1024;
+    origin_options.resolve = [&](const std::string& key) { return root + "/origin/" + key.substr(5); };
+    PeerCache origin_server;
+    if (!origin_server.start(origin_options)) {
+        return 1;
+    }
+    std::string origin = "127.0.0.1:" + std::to_string(origin_server.http_port());
+
+    std::cout << clients << " installers, " << files << " files of " << file_kb << " KB, origin "
+              << origin_kbps << " KB/s, peers " << (use_peers ? "on" : "off") << std::endl;
+
+    // Clients report through a pipe and keep serving their peers until everyone is done
+    int results_pipe[2];
+    if (pipe(results_pipe) != 0) {
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    double origin_cpu_start = cpu_seconds();
+    std::vector<pid_t> children;
+    for (int i = 0; i < clients; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::string dir = root + "/client" + std::to_string(i);
+            mkdir(dir.c_str(), 0755);
+            std::this_thread::sleep_for(std::chrono::milliseconds(i * CLIENT_STAGGER_MS));
+            ClientResult result = run_client(i, dir, digests, origin, use_peers);
+            if (write(results_pipe[1], &result, sizeof(result)) != sizeof(result)) {
+                _exit(1);
+            }
+            pause();
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    ClientResult total;
+    double slowest = 0;
+    for (int i = 0; i < clients; ++i) {
+        ClientResult result;
+        if (read(results_pipe[0], &result, sizeof(result)) != sizeof(result)) {
+            std::cerr << "An installer failed." << std::endl;
+            break;
+        }
+        total.seconds += result.seconds;
+        total.origin_bytes += result.origin_bytes;
+        total.peer_bytes += result.peer_bytes;
+        slowest = std::max(slowest, result.seconds);
+    }
+    double wall = seconds_since(start);
+    double origin_cpu = cpu_seconds() - origin_cpu_start;
+    for (pid_t pid : children) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+    origin_server.stop();
+
+    printf("wall %.2f s, mean per installer %.2f s, slowest %.2f s\n", wall, total.seconds / clients, slowest);
+    printf("origin %.1f MB, peers %.1f MB (%.0f%% from peers)\n", total.origin_bytes / 1048576.0, total.peer_bytes / 1048576.0,
+           100.0 * total.peer_bytes / std::max(1LL, total.origin_bytes + total.peer_bytes));
+    printf("origin CPU %.0f ms, %.0f ms per GB served\n", origin_cpu * 1000, origin_cpu * 1000 / std::max(1e-9, origin_server.bytes_served() / 1073741824.0));
+    std::string cleanup = "rm -rf " + root;
+    return system(cleanup.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "bundle.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const char BUNDLE_MAGIC[8] = { 'M', 'C', 'M', 'I', 'B', 'N', 'D', '1' };
+static const size_t BUNDLE_FOOTER_SIZE = 24;
+
+static uint64_t load_le64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static void store_le64(unsigned char* p, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<uint64_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // the mapping keeps the file alive
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<uint64_t>(st.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    file_ = mapping_ = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data_), static_cast<size_t>(size_));
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// Start of the payload within a file whose last bytes are a bundle footer, or false if there is none
+static bool find_payload(const unsigned char* data, uint64_t size, uint64_t& payload_start, uint64_t& index_size) {
+    if (size < BUNDLE_FOOTER_SIZE) {
+        return false;
+    }
+    const unsigned char* footer = data + size - BUNDLE_FOOTER_SIZE;
+    if (memcmp(footer, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+        return false;
+    }
+    index_size = load_le64(footer + 8);
+    uint64_t payload_size = load_le64(footer + 16);
+    if (payload_size > size - BUNDLE_FOOTER_SIZE || index_size > payload_size) {
+        return false;
+    }
+    payload_start = size - BUNDLE_FOOTER_SIZE - payload_size;
+    return true;
+}
+
+bool Bundle::open_payload(const std::string& path) {
+    using json = nlohmann::json;
+    uint64_t payload_start, index_size;
+    if (!file_.open(path) || !find_payload(file_.data(), file_.size(), payload_start, index_size)) {
+        file_.close();
+        return false;
+    }
+    payload_ = file_.data() + payload_start;
+    path_ = path;
+    payload_start_ = payload_start;
+    uint64_t payload_size = file_.size() - BUNDLE_FOOTER_SIZE - payload_start;
+    const char* index = reinterpret_cast<const char*>(payload_ + payload_size - index_size);
+    json j = json::parse(index, index + index_size, nullptr, false);
+    if (j.is_discarded() || !j.contains("files") || !j["files"].is_array()) {
+        std::cerr << "The offline bundle in " << path << " has a damaged index." << std::endl;
+        file_.close();
+        return false;
+    }
+    entries_.clear();
+    for (const json& file : j["files"]) {
+        BundleEntry entry;
+        entry.name = file.value("name", "");
+        entry.offset = file.value("offset", 0ULL);
+        entry.size = file.value("size", 0ULL);
+        entry.sha256 = file.value("sha256", "");
+        if (entry.name.empty() || entry.offset > payload_size - index_size || entry.size > payload_size - index_size - entry.offset) {
+            std::cerr << "The offline bundle in " << path << " has an invalid entry." << std::endl;
+            file_.close();
+            return false;
+        }
+        entries_.push_back(entry);
+    }
+    return true;
+}
+
+// The payload is normally appended to the installer itself; a separate payload file next to it
+// is accepted too, which is how bundles are tested where the image cannot carry one
+bool Bundle::open(const std::string& image_path) {
+    return open_payload(image_path) || open_payload(image_path + ".payload");
+}
+
+const BundleEntry* Bundle::find(const std::string& name) const {
+    for (const BundleEntry& entry : entries_) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// A bundle copied around on USB sticks may be damaged; entries are checked before use
+bool Bundle::verify(const BundleEntry& entry) const {
+    Sha256 hasher;
+    hasher.update(data(entry), static_cast<size_t>(entry.size));
+    return hasher.hex_digest() == entry.sha256;
+}
+
+#ifdef __linux__
+// Copy a byte range between files inside the kernel (sharing extents where the filesystem can);
+// returns how much was copied, the caller writes the rest itself
+static uint64_t copy_file_region(const std::string& source, uint64_t offset, uint64_t size, int out) {
+    int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return 0;
+    }
+    loff_t in_offset = static_cast<loff_t>(offset);
+    uint64_t copied = 0;
+    while (copied < size) {
+        ssize_t n = copy_file_range(in, &in_offset, out, nullptr, static_cast<size_t>(size - copied), 0);
+        if (n <= 0) {
+            break;
+        }
+        copied += static_cast<uint64_t>(n);
+    }
+    ::close(in);
+    return copied;
+}
+#endif
+
+bool Bundle::extract(const BundleEntry& entry, const std::string& path) const {
+    if (!verify(entry)) {
+        std::cerr << "Offline bundle entry " << entry.name << " is damaged." << std::endl;
+        return false;
+    }
+    const unsigned char* data = this->data(entry);
+    uint64_t remaining = entry.size;
+#ifdef _WIN32
+    HANDLE out = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (out == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to create " << path << " (error " << GetLastError() << ")." << std::endl;
+        return false;
+    }
+    bool ok = true;
+    while (ok && remaining > 0) {
+        DWORD chunk = static_cast<DWORD>(std::min<uint64_t>(remaining, 64u << 20));
+        DWORD written = 0;
+        ok = WriteFile(out, data, chunk, &written, nullptr) && written == chunk;
+        data += chunk;
+        remaining -= chunk;
+    }
+    CloseHandle(out);
+#else
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        std::cerr << "Failed to create " << path << "." << std::endl;
+        return false;
+    }
+    bool ok = true;
+#ifdef __linux__
+    // The entry was just hashed through the mapping; the copy itself need not pass through here
+    uint64_t copied = copy_file_region(path_, payload_start_ + entry.offset, entry.size, out);
+    data += copied;
+    remaining -= copied;
+#endif
+    while (ok && remaining > 0) {
+        ssize_t written = ::write(out, data, static_cast<size_t>(std::min<uint64_t>(remaining, 64u << 20)));
+        ok = written > 0;
+        if (ok) {
+            data += written;
+            remaining -= static_cast<uint64_t>(written);
+        }
+    }
+    ok = ::close(out) == 0 && ok;
+#endif
+    if (!ok) {
+        std::cerr << "Failed to write " << path << "." << std::endl;
+    }
+    return ok;
+}
+
+void BundleWriter::add(const std::string& name, const std::string& source_path) {
+    files_.push_back(std::make_pair(name, source_path));
+}
+
+bool BundleWriter::write(const std::string& base_image_path, const std::string& output_path) {
+    using json = nlohmann::json;
+    std::ofstream out(output_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to create " << output_path << std::endl;
+        return false;
+    }
+
+    // An image that already carries a payload contributes only the part before it
+    if (!base_image_path.empty()) {
+        MappedFile image;
+        if (!image.open(base_image_path)) {
+            std::cerr << "Failed to read " << base_image_path << std::endl;
+            return false;
+        }
+        uint64_t image_size = image.size();
+        uint64_t payload_start, index_size;
+        if (find_payload(image.data(), image.size(), payload_start, index_size)) {
+            image_size = payload_start;
+        }
+        out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image_size));
+    }
+
+    json files = json::array();
+    uint64_t offset = 0;
+    std::vector<char> buffer(1 << 20);
+    for (const auto& file : files_) {
+        std::ifstream in(file.second, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to read " << file.second << std::endl;
+            return false;
+        }
+        Sha256 hasher;
+        uint64_t size = 0;
+        while (in) {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            std::streamsize got = in.gcount();
+            hasher.update(buffer.data(), static_cast<size_t>(got));
+            out.write(buffer.data(), got);
+            size += static_cast<uint64_t>(got);
+        }
+        files.push_back({ { "name", file.first }, { "offset", offset }, { "size", size }, { "sha256", hasher.hex_digest() } });
+        offset += size;
+    }
+
+    std::string index = json({ { "files", files } }).dump();
+    out.write(index.data(), static_cast<std::streamsize>(index.size()));
+    unsigned char footer[BUNDLE_FOOTER_SIZE];
+    memcpy(footer, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    store_le64(footer + 8, index.size());
+    store_le64(footer + 16, offset + index.size());
+    out.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write " << output_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string get_own_image_path() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+    return length > 0 && length < MAX_PATH ? std::string(path, length) : "";
+#else
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+    return length > 0 ? std::string(path, static_cast<size_t>(length)) : "";
+#endif
+}
@@ -0,0 +1,75 @@
+#ifndef BUNDLE_HPP
+#define BUNDLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline bundle: installer files appended to the installer's own image (or kept in
+// "<image>.payload" next to it) and located through a fixed-size footer at the very end:
+//
+//   [image][file data...][index JSON][footer: "MCMIBND1", u64 index size, u64 payload size]
+//
+// Entry offsets are relative to the start of the payload, so the same payload bytes work
+// appended to an executable or as a separate file.
+
+struct BundleEntry {
+    std::string name;     // '/' separated, e.g. "jdk/jdk-22.0.2_windows-x64_bin.msi"
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    std::string sha256;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    bool open(const std::string& path);
+    void close();
+    const unsigned char* data() const { return data_; }
+    uint64_t size() const { return size_; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const unsigned char* data_ = nullptr;
+    uint64_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+class Bundle {
+public:
+    bool open(const std::string& image_path);   // the image itself, then "<image>.payload"
+    const std::vector<BundleEntry>& entries() const { return entries_; }
+    const BundleEntry* find(const std::string& name) const;
+    const unsigned char* data(const BundleEntry& entry) const { return payload_ + entry.offset; }
+    bool verify(const BundleEntry& entry) const;
+    bool extract(const BundleEntry& entry, const std::string& path) const;   // written straight from the mapping
+
+private:
+    bool open_payload(const std::string& path);
+    MappedFile file_;
+    std::string path_;
+    uint64_t payload_start_ = 0;
+    const unsigned char* payload_ = nullptr;
+    std::vector<BundleEntry> entries_;
+};
+
+// Builds a bundle: the base image (may be empty for a payload file) followed by the added files
+class BundleWriter {
+public:
+    void add(const std::string& name, const std::string& source_path);
+    bool write(const std::string& base_image_path, const std::string& output_path);
+
+private:
+    std::vector<std::pair<std::string, std::string>> files_;
+};
+
+std::string get_own_image_path();
+
+#endif
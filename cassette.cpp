@@ -0,0 +1,259 @@
+#include "cassette.hpp"
+#include "async_writer.hpp"
+#include "file_ops.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* const CASSETTE_INDEX_NAME = "cassette.json";
+static const size_t CASSETTE_REPLAY_CHUNK = 256 * 1024;
+
+#ifdef _WIN32
+static const char PATH_SEPARATOR = '\\';
+#else
+static const char PATH_SEPARATOR = '/';
+#endif
+
+CassetteRecorder::~CassetteRecorder() {
+    close();
+}
+
+bool CassetteRecorder::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    parts_dir_ = path + ".parts";
+    if (!make_directory(parts_dir_)) {
+        std::cerr << "Failed to create " << parts_dir_ << std::endl;
+        return false;
+    }
+    open_ = true;
+    return true;
+}
+
+// Caller holds mutex_
+void CassetteRecorder::add_exchange(const std::string& url, int status, const std::string& digest, uint64_t size) {
+    nlohmann::json exchange = { { "url", url }, { "status", status } };
+    if (!digest.empty()) {
+        exchange["body"] = digest;
+        exchange["size"] = size;
+    }
+    exchanges_.push_back(exchange);
+}
+
+void CassetteRecorder::record_file(const std::string& url, int status, const std::string& body_path) {
+    std::string digest = sha256_file(body_path);
+    std::ifstream in(body_path, std::ios::binary | std::ios::ate);
+    if (digest.empty() || !in) {
+        return;
+    }
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) {
+        return;
+    }
+    if (!stored_.count(digest)) {
+        if (!copy_file(body_path, parts_dir_ + PATH_SEPARATOR + digest)) {
+            std::cerr << "Failed to record the response from " << url << std::endl;
+            return;
+        }
+        stored_.insert(digest);
+    }
+    add_exchange(url, status, digest, size);
+}
+
+void CassetteRecorder::record_body(const std::string& url, int status, const std::string& body) {
+    std::string digest;
+    if (!body.empty()) {
+        Sha256 hasher;
+        hasher.update(body.data(), body.size());
+        digest = hasher.hex_digest();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) {
+        return;
+    }
+    if (!digest.empty() && !stored_.count(digest)) {
+        std::ofstream out(parts_dir_ + PATH_SEPARATOR + digest, std::ios::binary | std::ios::trunc);
+        if (!out.write(body.data(), static_cast<std::streamsize>(body.size()))) {
+            std::cerr << "Failed to record the response from " << url << std::endl;
+            return;
+        }
+        stored_.insert(digest);
+    }
+    add_exchange(url, status, digest, body.size());
+}
+
+// Pack the collected bodies and the exchange list into the cassette and remove the parts
+bool CassetteRecorder::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) {
+        return true;
+    }
+    open_ = false;
+    std::string index_path = parts_dir_ + PATH_SEPARATOR + CASSETTE_INDEX_NAME;
+    std::string index = nlohmann::json({ { "exchanges", exchanges_ } }).dump();
+    bool ok = static_cast<bool>(std::ofstream(index_path, std::ios::binary | std::ios::trunc) << index);
+
+    BundleWriter writer;
+    writer.add(CASSETTE_INDEX_NAME, index_path);
+    for (const std::string& digest : stored_) {
+        writer.add(digest, parts_dir_ + PATH_SEPARATOR + digest);
+    }
+    ok = ok && writer.write("", path_);
+    if (ok) {
+        std::cout << "Recorded " << exchanges_.size() << " HTTP exchanges to " << path_ << "." << std::endl;
+    } else {
+        std::cerr << "Failed to write the cassette " << path_ << std::endl;
+    }
+
+    std::remove(index_path.c_str());
+    for (const std::string& digest : stored_) {
+        std::remove((parts_dir_ + PATH_SEPARATOR + digest).c_str());
+    }
+    remove_directory(parts_dir_);
+    return ok;
+}
+
+bool Cassette::open(const std::string& path) {
+    const BundleEntry* index;
+    if (!bundle_.open(path) || !(index = bundle_.find(CASSETTE_INDEX_NAME))) {
+        std::cerr << path << " is not a cassette." << std::endl;
+        return false;
+    }
+    const char* text = reinterpret_cast<const char*>(bundle_.data(*index));
+    nlohmann::json j = nlohmann::json::parse(text, text + index->size, nullptr, false);
+    if (j.is_discarded() || !j.contains("exchanges") || !j["exchanges"].is_array()) {
+        std::cerr << "The cassette " << path << " has a damaged index." << std::endl;
+        return false;
+    }
+    exchanges_.clear();
+    for (const nlohmann::json& item : j["exchanges"]) {
+        CassetteExchange exchange;
+        exchange.url = item.value("url", "");
+        exchange.status = item.value("status", 200);
+        exchange.body = item.value("body", "");
+        exchange.size = item.value("size", 0ULL);
+        const BundleEntry* entry = exchange.body.empty() ? nullptr : bundle_.find(exchange.body);
+        if (exchange.url.empty() || (!exchange.body.empty() && (!entry || entry->size != exchange.size))) {
+            std::cerr << "The cassette " << path << " has an invalid exchange." << std::endl;
+            return false;
+        }
+        // A URL fetched more than once replays its last response
+        exchanges_[exchange.url] = exchange;
+    }
+    return true;
+}
+
+const CassetteExchange* Cassette::find(const std::string& url) const {
+    auto it = exchanges_.find(url);
+    return it == exchanges_.end() ? nullptr : &it->second;
+}
+
+const unsigned char* Cassette::body(const CassetteExchange& exchange) const {
+    const BundleEntry* entry = exchange.body.empty() ? nullptr : bundle_.find(exchange.body);
+    return entry ? bundle_.data(*entry) : nullptr;
+}
+
+// All replayed responses share one link, like downloads sharing the real connection
+void Cassette::pace(long long bytes) {
+    if (shaping_.bytes_per_sec <= 0) {
+        return;
+    }
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (link_due_ < now) {
+            link_due_ = now;
+        }
+        link_due_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(shaping_.bytes_per_sec)));
+        due = link_due_;
+    }
+    std::this_thread::sleep_until(due);
+}
+
+const CassetteExchange* Cassette::start_response(const std::string& url, std::string& error) {
+    const CassetteExchange* exchange = find(url);
+    if (!exchange) {
+        error = "no recorded response for " + url;
+        return nullptr;
+    }
+    if (shaping_.latency_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(shaping_.latency_ms));
+    }
+    if (exchange->status >= 400) {
+        error = "HTTP " + std::to_string(exchange->status) + " from " + url + " (recorded)";
+        return nullptr;
+    }
+    return exchange;
+}
+
+// Written and verified the way a download is: through the async writer into "<output_path>.part",
+// hashed on the way, renamed into place only if the digests match
+bool Cassette::replay_file(const std::vector<std::string>& urls, const std::string& output_path, const ExpectedHashes& expected, std::string& error) {
+    auto url = std::find_if(urls.begin(), urls.end(), [&](const std::string& candidate) { return find(candidate) != nullptr; });
+    const CassetteExchange* exchange = start_response(url == urls.end() ? urls.front() : *url, error);
+    if (!exchange) {
+        return false;
+    }
+    std::string part_path = output_path + ".part";
+    AsyncFileWriter writer;
+    if (!writer.open(part_path, static_cast<long long>(exchange->size))) {
+        error = "failed to open output file " + part_path;
+        return false;
+    }
+    Sha1 sha1;
+    Sha256 sha256;
+    Sha512 sha512;
+    const char* data = reinterpret_cast<const char*>(body(*exchange));
+    bool write_ok = true;
+    for (uint64_t offset = 0; write_ok && offset < exchange->size; offset += CASSETTE_REPLAY_CHUNK) {
+        size_t len = static_cast<size_t>(std::min<uint64_t>(exchange->size - offset, CASSETTE_REPLAY_CHUNK));
+        pace(static_cast<long long>(len));
+        if (!expected.sha1.empty()) {
+            sha1.update(data + offset, len);
+        }
+        if (!expected.sha256.empty()) {
+            sha256.update(data + offset, len);
+        }
+        if (!expected.sha512.empty()) {
+            sha512.update(data + offset, len);
+        }
+        write_ok = writer.write(data + offset, len);
+    }
+    write_ok = writer.close() && write_ok;
+
+    if (!write_ok) {
+        error = "failed to write " + part_path;
+    } else if (!expected.sha1.empty() && sha1.hex_digest() != expected.sha1) {
+        error = "SHA-1 mismatch for " + exchange->url + " (recorded)";
+    } else if (!expected.sha256.empty() && sha256.hex_digest() != expected.sha256) {
+        error = "SHA-256 mismatch for " + exchange->url + " (recorded)";
+    } else if (!expected.sha512.empty() && sha512.hex_digest() != expected.sha512) {
+        error = "SHA-512 mismatch for " + exchange->url + " (recorded)";
+    } else if (!move_into_place(part_path, output_path)) {
+        error = "failed to move " + part_path + " into place";
+    } else {
+        return true;
+    }
+    std::remove(part_path.c_str());
+    return false;
+}
+
+bool Cassette::replay_text(const std::string& url, std::string& text, std::string& error) {
+    const CassetteExchange* exchange = start_response(url, error);
+    if (!exchange) {
+        return false;
+    }
+    pace(static_cast<long long>(exchange->size));
+    const unsigned char* data = body(*exchange);
+    text.assign(data ? reinterpret_cast<const char*>(data) : "", static_cast<size_t>(exchange->size));
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef CASSETTE_HPP
+#define CASSETTE_HPP
+
+#include "bundle.hpp"
+#include "filesystem.hpp"
+#include "json.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+// HTTP cassette: the responses an install received, recorded once and replayed later so the
+// whole install can be timed without Dropbox, Oracle or FabricMC. A cassette is a bundle (see
+// bundle.hpp) whose entries are the response bodies, named by SHA-256 so identical bodies are
+// kept once, plus "cassette.json" listing every exchange:
+//
+//   { "exchanges": [ { "url": "...", "status": 200, "body": "<sha256>", "size": 1234 }, ... ] }
+//
+// Exchanges are keyed by the URL the installer asked for, before mirror rewriting.
+
+struct CassetteExchange {
+    std::string url;
+    int status = 200;
+    std::string body;    // bundle entry holding the body, "" for none
+    uint64_t size = 0;
+};
+
+// Link conditions applied while replaying
+struct CassetteShaping {
+    int latency_ms = 0;              // before each response
+    long long bytes_per_sec = 0;     // shared by all responses in flight; 0 = unlimited
+};
+
+// Collects bodies in "<cassette>.parts" as they arrive and packs them into the cassette when
+// closed; safe to use from several download threads
+class CassetteRecorder {
+public:
+    ~CassetteRecorder();
+    bool open(const std::string& path);
+    void record_file(const std::string& url, int status, const std::string& body_path);
+    void record_body(const std::string& url, int status, const std::string& body);
+    bool close();
+
+private:
+    void add_exchange(const std::string& url, int status, const std::string& digest, uint64_t size);
+
+    std::mutex mutex_;
+    std::string path_;
+    std::string parts_dir_;
+    nlohmann::json exchanges_ = nlohmann::json::array();
+    std::set<std::string> stored_;
+    bool open_ = false;
+};
+
+class Cassette {
+public:
+    bool open(const std::string& path);
+    void set_shaping(const CassetteShaping& shaping) { shaping_ = shaping; }
+    const CassetteExchange* find(const std::string& url) const;
+    const unsigned char* body(const CassetteExchange& exchange) const;   // null when there is none
+    size_t exchange_count() const { return exchanges_.size(); }
+
+    // Stand-ins for try_download_any and a small text fetch, served from the recording
+    bool replay_file(const std::vector<std::string>& urls, const std::string& output_path, const ExpectedHashes& expected, std::string& error);
+    bool replay_text(const std::string& url, std::string& text, std::string& error);
+
+private:
+    const CassetteExchange* start_response(const std::string& url, std::string& error);
+    void pace(long long bytes);
+
+    Bundle bundle_;
+    std::map<std::string, CassetteExchange> exchanges_;
+    CassetteShaping shaping_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point link_due_;
+};
+
+#endif
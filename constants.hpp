@@ -6,11 +6,29 @@
 // constants
 const std::string JAVA_INSTALLER_URL = "https://download.oracle.com/java/22/archive/jdk-22.0.2_windows-x64_bin.msi";
 const std::string REQUIRED_JAVA_VERSION = "21"; // Required Java version
+const std::string JAVA_INSTALLER_FILENAME = "jdk-22.0.2_windows-x64_bin.msi"; // Saved under the store's downloads directory
+const std::string JAVA_INSTALLER_SHA256_URL = JAVA_INSTALLER_URL + ".sha256"; // Checksum Oracle publishes next to the installer
 
 const std::string FABRIC_INSTALLER_URL = "https://maven.fabricmc.net/net/fabricmc/fabric-installer/1.0.3/fabric-installer-1.0.3.jar";
 const std::string FABRIC_LOADER_VERSION = "0.16.14"; // Fabric loader version
+const std::string FABRIC_INSTALLER_FILENAME = "fabric-installer.jar"; // Saved under the store's downloads directory
+const std::string FABRIC_INSTALLER_SHA1_URL = FABRIC_INSTALLER_URL + ".sha1"; // Checksum Maven publishes next to the jar
 
 const std::string MINECRAFT_VERSION = "1.20.1"; // Minecraft version to install Fabric for
 const std::string MODPACK_URL = "https://www.dropbox.com/scl/fi/5g7ygqza18345os79bpvx/cove-s8-client-mods-full.zip?rlkey=fhjxukhk969lbpee8j2dxcr4p&st=uyidgl06&dl=1"; // URL to the modpack zip file
+const std::string MODPACK_ZIP_FILENAME = "cove-s8-modpack.zip"; // Saved under the store's downloads directory
+const std::string MODPACK_SHA256 = ""; // SHA-256 of the file at MODPACK_URL; update together with the URL (empty skips the check, and the archive is then never taken from LAN peers)
+const int MRPACK_DOWNLOAD_CONCURRENCY = 16; // Parallel file downloads for .mrpack modpacks (WinINet allows 16 connections per server)
+const int MOD_VERSIONS_TO_KEEP = 3; // Complete mod sets kept under mod-versions for rollback
+const int MIRROR_DEFAULT_HEDGE_MS = 800; // Wait before asking a second mirror when the first one's latency is unknown
+const int MIRROR_PROBE_TIMEOUT_MS = 1500; // Mirrors slower than this to answer a probe are ranked last
+const double MIRROR_SWITCH_RATIO = 0.25; // Switch mirrors mid-download when throughput falls below this share of its peak
+const long long MIRROR_SWITCH_MIN_REMAINING = 4LL * 1024 * 1024; // Not worth switching for less than this
+const int EXECUTOR_IO_THREADS_PER_CORE = 2; // Threads of the shared pool's I/O lane per core (downloads, spawned processes)
+const int EXECUTOR_MIN_IO_THREADS = 4; // ...but at least this many, since they mostly wait
+const int IO_LOOP_THREADS = 2; // Threads completing multiplexed transfers and file writes
+const int DOWNLOAD_IDLE_TIMEOUT_MS = 30000; // A multiplexed transfer that receives nothing for this long is given up on that mirror
+const int PROGRESS_REFRESH_MS = 250; // How often the live progress status and buffered console output are written
+const std::string MODPACK_PROFILE_NAME = "The Cove - Season 8 (" + MINECRAFT_VERSION + ")"; // Launcher profile display name
 
 #endif
\ No newline at end of file
@@ -0,0 +1,934 @@
+#include "download.hpp"
+#include "async_writer.hpp"
+#include "cassette.hpp"
+#include "constants.hpp"
+#include "executor.hpp"
+#include "file_ops.hpp"
+#include "filesystem.hpp"
+#include "hash.hpp"
+#include "io_loop.hpp"
+#include "mirrors.hpp"
+#include "peer_cache.hpp"
+#include "phases.hpp"
+#include "progress.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// URL prefix rewrites ("mirrors"), applied to every download
+static std::vector<std::pair<std::string, std::string>> g_download_mirrors;
+
+void add_download_mirror(const std::string& from_prefix, const std::string& to_prefix) {
+    g_download_mirrors.push_back({ from_prefix, to_prefix });
+}
+
+std::string resolve_download_url(const std::string& url) {
+    for (const auto& mirror : g_download_mirrors) {
+        if (url.compare(0, mirror.first.size(), mirror.first) == 0) {
+            return mirror.second + url.substr(mirror.first.size());
+        }
+    }
+    return url;
+}
+
+// LAN peer cache asked first for any download whose content can be verified
+static PeerCache* g_peer_cache = nullptr;
+
+void use_peer_cache(PeerCache* cache) {
+    g_peer_cache = cache;
+}
+
+// Let peers know about new content without waiting for the next periodic announcement
+void announce_to_peers() {
+    if (g_peer_cache) {
+        g_peer_cache->announce_now();
+    }
+}
+
+// Every response can be recorded into a cassette, or served from one instead of the network
+static CassetteRecorder* g_cassette_recorder = nullptr;
+static Cassette* g_cassette = nullptr;
+
+void use_cassette_recorder(CassetteRecorder* recorder) {
+    g_cassette_recorder = recorder;
+}
+
+void use_cassette(Cassette* cassette) {
+    g_cassette = cassette;
+}
+
+// Text such as JSON manifests and checksum files shrinks several times under gzip; archives,
+// jars and installers are already compressed and are fetched as they are
+static bool is_compressible_url(const std::string& url) {
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    size_t dot = name.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : name.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    static const char* const compressed[] = { "jar", "zip", "mrpack", "msi", "exe", "gz", "zst", "xz", "7z", "png", "jpg", "ogg" };
+    for (const char* candidate : compressed) {
+        if (extension == candidate) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A server that does not honour a range request answers 200 with the whole file
+static bool is_usable_status(int status_code, long long offset) {
+    return status_code < 400 && (offset == 0 || status_code == 206);
+}
+
+// Open a URL (after mirror rewriting) and reject HTTP error responses. With an offset only the
+// rest of the file is requested, and a server that does not honour the range is rejected.
+static std::unique_ptr<HttpResponse> open_download(const std::string& url, std::string& resolved_url, std::string& error, long long offset = 0) {
+    resolved_url = resolve_download_url(url);
+    std::unique_ptr<HttpResponse> response = open_http(resolved_url, offset, offset == 0 && is_compressible_url(resolved_url), error);
+    if (!response) {
+        return nullptr;
+    }
+    int status_code = response->status();
+    if (!is_usable_status(status_code, offset)) {
+        if (g_cassette_recorder && status_code >= 400) {
+            g_cassette_recorder->record_body(url, status_code, "");
+        }
+        error = "HTTP " + std::to_string(status_code) + " from " + resolved_url;
+        return nullptr;
+    }
+    return response;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Time to first byte of a URL, or -1 if it cannot be opened; used to rank mirrors. Only the first
+// byte is asked for, so a probe costs a round trip rather than a download.
+static double probe_mirror(const std::string& url) {
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    std::unique_ptr<HttpResponse> response = open_http(resolve_download_url(url), 0, false, error, 1);
+    if (!response || response->status() >= 400) {
+        return -1.0;
+    }
+    return seconds_since(start);
+}
+
+// Open the first of several mirrors to answer. The best-ranked one is asked first; whenever the
+// latest one has not answered within its usual (p95) time to first byte, the next one is asked
+// too. Answers that lose the race are closed by the thread that opened them.
+static std::unique_ptr<HttpResponse> open_hedged(const std::vector<std::string>& urls, size_t& index, std::string& error) {
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::unique_ptr<HttpResponse> winner;
+        size_t winner_index = 0;
+        size_t finished = 0;
+        std::string errors;
+    };
+    auto race = std::make_shared<Race>();
+    std::unique_lock<std::mutex> lock(race->mutex);
+    size_t started = 0;
+    for (;;) {
+        if (started < urls.size()) {
+            std::string url = urls[started];
+            size_t i = started++;
+            std::thread([race, url, i] {
+                auto start = std::chrono::steady_clock::now();
+                std::string resolved_url, open_error;
+                std::unique_ptr<HttpResponse> response = open_download(url, resolved_url, open_error);
+                if (response) {
+                    record_mirror_ttfb(url, seconds_since(start));
+                }
+                std::lock_guard<std::mutex> race_lock(race->mutex);
+                race->finished++;
+                if (response && !race->winner) {
+                    race->winner = std::move(response);
+                    race->winner_index = i;
+                } else if (!response) {
+                    race->errors += (race->errors.empty() ? "" : "; ") + open_error;
+                }
+                race->done.notify_all();
+            }).detach();
+        }
+        auto answered = [&] { return race->winner || race->finished == started; };
+        if (started < urls.size()) {
+            race->done.wait_for(lock, std::chrono::milliseconds(get_hedge_delay_ms(urls[started - 1])), answered);
+        } else {
+            race->done.wait(lock, answered);
+        }
+        if (race->winner) {
+            index = race->winner_index;
+            return std::move(race->winner);
+        }
+        if (race->finished == urls.size()) {
+            error = race->errors;
+            return nullptr;
+        }
+    }
+}
+
+// Alternative hosts for a URL prefix; each download may be served by any of them
+static std::vector<std::pair<std::string, std::string>> g_alternate_mirrors;
+
+void add_alternate_mirror(const std::string& from_prefix, const std::string& to_prefix) {
+    g_alternate_mirrors.push_back({ from_prefix, to_prefix });
+}
+
+std::vector<std::string> get_download_candidates(const std::string& url) {
+    std::vector<std::string> urls = { url };
+    for (const auto& mirror : g_alternate_mirrors) {
+        if (url.compare(0, mirror.first.size(), mirror.first) == 0) {
+            urls.push_back(mirror.second + url.substr(mirror.first.size()));
+        }
+    }
+    return urls;
+}
+
+// Distinct URLs of a file, fastest mirror first
+static std::vector<std::string> rank_candidates(const std::vector<std::string>& urls, bool wait_for_probes = true) {
+    std::vector<std::string> candidates;
+    for (const std::string& url : urls) {
+        if (std::find(candidates.begin(), candidates.end(), url) == candidates.end()) {
+            candidates.push_back(url);
+        }
+    }
+    return rank_mirrors(candidates, probe_mirror, wait_for_probes);
+}
+
+bool try_download_file(const std::string& url, const std::string& output_path, const ExpectedHashes& expected, std::string& error) {
+    return try_download_any(get_download_candidates(url), output_path, expected, error);
+}
+
+// One pass over the candidates for the whole file. The mirrors that sent any of it are added to
+// served; retry tells whether what went wrong (broken or wrong content) may go better elsewhere.
+static bool download_attempt(const std::vector<std::string>& candidates, const std::string& output_path, const ExpectedHashes& expected,
+                             std::vector<std::string>& served, bool& retry, std::string& error) {
+    static ProgressTask& progress = progress_task("download");
+    retry = false;
+    size_t index = 0;
+    std::unique_ptr<HttpResponse> response = open_hedged(candidates, index, error);
+    if (!response) {
+        return false;
+    }
+    std::string resolved_url = resolve_download_url(candidates[index]);
+    served.push_back(candidates[index]);
+
+    // Preallocate when the server says how much is coming; a compressed response's length says
+    // nothing about the decoded size
+    bool encoded = response->encoded();
+    long long expected_size = encoded ? -1 : response->content_length();
+
+    std::string part_path = output_path + ".part";
+    AsyncFileWriter writer;
+    if (!writer.open(part_path, expected_size)) {
+        error = "failed to open output file " + part_path;
+        return false;
+    }
+
+    // Continue from another mirror at the current offset; offsets of an encoded body mean nothing
+    long long received = 0;
+    double peak_rate = 0.0;
+    size_t next_mirror = 0;
+    auto switch_mirror = [&](const char* reason) {
+        while (!encoded && next_mirror < candidates.size()) {
+            size_t candidate = next_mirror++;
+            std::string candidate_url, switch_error;
+            std::unique_ptr<HttpResponse> resumed = candidate == index ? nullptr : open_download(candidates[candidate], candidate_url, switch_error, received);
+            if (resumed) {
+                std::cout << "Continuing " << output_path << " from " << candidate_url << " (" << reason << ")" << std::endl;
+                response = std::move(resumed);
+                index = candidate;
+                resolved_url = candidate_url;
+                served.push_back(candidates[candidate]);
+                peak_rate = 0.0;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Each read lands in a writer buffer and is hashed there, so verification needs no second pass;
+    // earlier buffers are written to disk while the next ones arrive from the network
+    Sha1 sha1;
+    Sha256 sha256;
+    Sha512 sha512;
+    bool write_ok = true;
+    bool read_ok = true;
+    auto transfer_start = std::chrono::steady_clock::now();
+    auto window_start = transfer_start;
+    long long window_bytes = 0;
+    for (;;) {
+        size_t available = 0;
+        char* space = writer.reserve(available);
+        if (!space) {
+            write_ok = false;
+            break;
+        }
+        size_t bytesRead = 0;
+        read_ok = response->read(space, available, bytesRead);
+        if (!read_ok && switch_mirror("connection failed")) {
+            read_ok = true;
+            continue;
+        }
+        if (!read_ok || bytesRead == 0) {
+            break;
+        }
+        if (!expected.sha1.empty()) {
+            sha1.update(space, bytesRead);
+        }
+        if (!expected.sha256.empty()) {
+            sha256.update(space, bytesRead);
+        }
+        if (!expected.sha512.empty()) {
+            sha512.update(space, bytesRead);
+        }
+        if (!writer.commit(bytesRead)) {
+            write_ok = false;
+            break;
+        }
+        received += static_cast<long long>(bytesRead);
+        progress.add_bytes(static_cast<long long>(bytesRead));
+
+        // Throughput over windows of a couple of seconds; a mirror that sags well below what it
+        // managed earlier in this transfer is abandoned if enough is left to make it worthwhile
+        window_bytes += static_cast<long long>(bytesRead);
+        double window_seconds = seconds_since(window_start);
+        if (window_seconds >= 2.0) {
+            double rate = static_cast<double>(window_bytes) / window_seconds;
+            peak_rate = std::max(peak_rate, rate);
+            if (rate < peak_rate * MIRROR_SWITCH_RATIO && expected_size - received > MIRROR_SWITCH_MIN_REMAINING) {
+                switch_mirror("throughput dropped");
+            }
+            window_start = std::chrono::steady_clock::now();
+            window_bytes = 0;
+        }
+    }
+    write_ok = writer.close() && write_ok;
+    response.reset();
+    // Everything that came over the wire, including what a failed attempt then throws away
+    count_event("bytes_origin", received);
+    if (read_ok && received > 0) {
+        record_mirror_throughput(candidates[index], static_cast<double>(received) / std::max(seconds_since(transfer_start), 1e-3));
+    }
+
+    if (!read_ok || !write_ok) {
+        error = !read_ok ? "connection failed while reading " + resolved_url : "failed to write " + part_path;
+        retry = !read_ok;
+    } else if (!expected.sha1.empty() && sha1.hex_digest() != expected.sha1) {
+        error = "SHA-1 mismatch for " + resolved_url;
+        retry = true;
+    } else if (!expected.sha256.empty() && sha256.hex_digest() != expected.sha256) {
+        error = "SHA-256 mismatch for " + resolved_url;
+        retry = true;
+    } else if (!expected.sha512.empty() && sha512.hex_digest() != expected.sha512) {
+        error = "SHA-512 mismatch for " + resolved_url;
+        retry = true;
+    } else if (!move_into_place(part_path, output_path)) {
+        error = "failed to move " + part_path + " into place";
+    } else {
+        if (g_cassette_recorder) {
+            g_cassette_recorder->record_file(candidates[index], 200, output_path);
+        }
+        return true;
+    }
+    std::remove(part_path.c_str());
+    return false;
+}
+
+// The mirrors of candidates that have not sent any part of the file yet
+static std::vector<std::string> unserved_candidates(const std::vector<std::string>& candidates, const std::vector<std::string>& served) {
+    std::vector<std::string> remaining;
+    for (const std::string& url : candidates) {
+        if (std::find(served.begin(), served.end(), url) == served.end()) {
+            remaining.push_back(url);
+        }
+    }
+    return remaining;
+}
+
+// Download one file that several mirrors serve to "<output_path>.part", hashing as bytes arrive,
+// and rename it into place only if the expected digests match. Mirrors are ranked by measured
+// latency and the first request is hedged; a transfer that breaks, or slows to a fraction of its
+// peak, continues from the next mirror with a range request, and one that cannot be continued or
+// fails verification starts over from a mirror that has not sent any of it. Returns false (with a
+// reason) instead of exiting so callers can retry.
+bool try_download_any(const std::vector<std::string>& urls, const std::string& output_path, const ExpectedHashes& expected, std::string& error) {
+    PhaseScope phase("download");
+    static ProgressTask& progress = progress_task("download");
+
+    // Bytes are counted per source ("bytes_origin", "bytes_peer", "bytes_replay") for --metrics
+    if (g_cassette) {
+        if (!g_cassette->replay_file(urls, output_path, expected, error)) {
+            return false;
+        }
+        long long size = size_of_file(output_path);
+        count_event("bytes_replay", size);
+        progress.add_bytes(size);
+        return true;
+    }
+    std::string key = get_peer_key(expected);
+    std::string peer_error;
+    if (g_peer_cache && !key.empty() && g_peer_cache->fetch(key, output_path, expected, peer_error)) {
+        long long size = size_of_file(output_path);
+        count_event("bytes_peer", size);
+        progress.add_bytes(size);
+        if (g_cassette_recorder) {
+            g_cassette_recorder->record_file(urls.front(), 200, output_path);
+        }
+        return true;
+    }
+
+    // A file that broke off where no mirror could continue it, or arrived with the wrong content,
+    // is fetched whole again from the mirrors that did not send any of it
+    std::vector<std::string> candidates = rank_candidates(urls);
+    std::vector<std::string> served;
+    for (;;) {
+        bool retry = false;
+        if (download_attempt(candidates, output_path, expected, served, retry, error)) {
+            return true;
+        }
+        candidates = unserved_candidates(candidates, served);
+        if (!retry || candidates.empty()) {
+            return false;
+        }
+        std::cout << "Retrying " << output_path << " from another mirror (" << error << ")" << std::endl;
+    }
+}
+
+// Read buffer of a multiplexed transfer. Besides it a transfer holds only its connection, file
+// handle and hash states, so hundreds of them fit where a handful of blocked threads used to.
+static const size_t TRANSFER_BUFFER_SIZE = 64 * 1024;
+
+// Jobs of a batch that have ended, in the order they did
+struct BatchState {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<size_t> finished;
+};
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+// One file of a batch: try_download_any() as a chain of I/O loop callbacks. The first request is
+// hedged the same way; a broken, stalled or slowing transfer continues from another mirror with a
+// range request, and starts over from an unused one when that fails or the digest does not match
+// (each start over is an "attempt"). Reads and writes alternate, so at most one of them is in flight. Everything is
+// guarded by mutex_, since callbacks of one transfer may run on different loop threads. Nothing
+// here blocks the batch thread: mirrors still being probed are ranked last rather than waited for.
+class Transfer : public std::enable_shared_from_this<Transfer> {
+public:
+    Transfer(DownloadJob& job, size_t index, std::shared_ptr<BatchState> batch)
+        : job_(job), index_(index), batch_(batch), progress_(progress_task("download")) {}
+
+    void start() {
+        TimePoint started = std::chrono::steady_clock::now();
+        std::vector<std::string> candidates = rank_candidates(job_.urls, false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        candidates_ = candidates;
+        part_path_ = job_.output_path + ".part";
+        started_ = started;
+        if (candidates_.empty()) {
+            finish_locked(false, "no URL to download " + job_.output_path + " from");
+            return;
+        }
+        open_next_locked();
+    }
+
+    // Abandons the transfer; the job is reported once the callback in flight has come back
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_ || cancelled_) {
+            return;
+        }
+        cancelled_ = true;
+        get_io_loop().cancel_timer(hedge_timer_);
+        if (reading_) {
+            response_->cancel();
+        }
+    }
+
+private:
+    // Ask the next mirror for the whole file; another one is asked too if it does not answer in time.
+    // An attempt that gets no answer within DOWNLOAD_IDLE_TIMEOUT_MS of its last request gives up.
+    void open_next_locked() {
+        size_t candidate = next_candidate_++;
+        std::string url = resolve_download_url(candidates_[candidate]);
+        std::shared_ptr<Transfer> self = shared_from_this();
+        TimePoint start = std::chrono::steady_clock::now();
+        size_t attempt = attempt_;
+        opens_pending_++;
+        open_http_async(url, 0, is_compressible_url(url), [self, attempt, candidate, start](std::unique_ptr<AsyncHttpResponse> response, const std::string& error) {
+            self->opened(attempt, candidate, start, std::move(response), error);
+        });
+        if (next_candidate_ < candidates_.size()) {
+            hedge_timer_ = get_io_loop().after(get_hedge_delay_ms(candidates_[candidate]), [self] { self->hedge(); });
+        }
+        get_io_loop().cancel_timer(open_timer_);
+        open_timer_ = get_io_loop().after(DOWNLOAD_IDLE_TIMEOUT_MS, [self, attempt, url] { self->open_timed_out(attempt, url); });
+    }
+
+    // Also ends a cancelled transfer whose requests never come back
+    void open_timed_out(size_t attempt, const std::string& url) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_ || opened_ || attempt != attempt_) {
+            return;
+        }
+        if (!cancelled_ && next_candidate_ < candidates_.size()) {
+            get_io_loop().cancel_timer(hedge_timer_);
+            open_next_locked();
+            return;
+        }
+        std::string reason = "no answer from " + url + " within " + std::to_string(DOWNLOAD_IDLE_TIMEOUT_MS / 1000) + " s";
+        finish_locked(false, cancelled_ ? "cancelled" : errors_ + (errors_.empty() ? "" : "; ") + reason);
+    }
+
+    void hedge() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!response_ && !done_ && !cancelled_ && next_candidate_ < candidates_.size()) {
+            open_next_locked();
+        }
+    }
+
+    // Answers that lose the race are closed as they arrive
+    void opened(size_t attempt, size_t candidate, TimePoint start, std::unique_ptr<AsyncHttpResponse> response, const std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        opens_pending_--;
+        // A hedged open of an attempt given up since (candidates_ has changed); if it was the last
+        // open out, it reports for the current attempt when that has nothing left to wait for
+        if (attempt != attempt_) {
+            if (!opened_ && opens_pending_ == 0 && (cancelled_ || next_candidate_ >= candidates_.size())) {
+                finish_locked(false, cancelled_ ? "cancelled" : errors_);
+            }
+            return;
+        }
+        std::string url = resolve_download_url(candidates_[candidate]);
+        bool usable = response && is_usable_status(response->status(), 0);
+        if (usable) {
+            record_mirror_ttfb(candidates_[candidate], seconds_since(start));
+        }
+        if (done_ || opened_) {
+            return;
+        }
+        if (cancelled_) {
+            if (opens_pending_ == 0) {
+                finish_locked(false, "cancelled");
+            }
+            return;
+        }
+        if (!usable) {
+            std::string reason = response ? "HTTP " + std::to_string(response->status()) + " from " + url : error;
+            errors_ += (errors_.empty() ? "" : "; ") + reason;
+            if (next_candidate_ < candidates_.size()) {
+                get_io_loop().cancel_timer(hedge_timer_);
+                open_next_locked();
+            } else if (opens_pending_ == 0) {
+                finish_locked(false, errors_);
+            }
+            return;
+        }
+        get_io_loop().cancel_timer(hedge_timer_);
+        get_io_loop().cancel_timer(open_timer_);
+        opened_ = true;
+        current_ = candidate;
+        served_.push_back(candidates_[candidate]);
+        response_ = std::move(response);
+        // Preallocate when the server says how much is coming; a compressed response's length says
+        // nothing about the decoded size
+        encoded_ = response_->encoded();
+        expected_size_ = encoded_ ? -1 : response_->content_length();
+        if (!file_.open(part_path_, expected_size_)) {
+            finish_locked(false, "failed to open output file " + part_path_);
+            return;
+        }
+        transfer_start_ = window_start_ = std::chrono::steady_clock::now();
+        read_locked();
+    }
+
+    // Continue at the current offset from a mirror not tried for that yet; offsets of an encoded
+    // body mean nothing. A mirror that does not answer within DOWNLOAD_IDLE_TIMEOUT_MS is passed over.
+    bool resume_locked(const std::string& reason) {
+        while (!encoded_ && next_resume_ < candidates_.size()) {
+            size_t candidate = next_resume_++;
+            if (candidate == current_) {
+                continue;
+            }
+            std::string url = resolve_download_url(candidates_[candidate]);
+            std::shared_ptr<Transfer> self = shared_from_this();
+            uint64_t serial = ++resume_serial_;
+            open_http_async(url, received_, false, [self, serial, candidate, url, reason](std::unique_ptr<AsyncHttpResponse> response, const std::string&) {
+                self->resumed(serial, candidate, url, reason, std::move(response));
+            });
+            get_io_loop().cancel_timer(open_timer_);
+            open_timer_ = get_io_loop().after(DOWNLOAD_IDLE_TIMEOUT_MS, [self, serial, url, reason] { self->resume_timed_out(serial, url, reason); });
+            return true;
+        }
+        return false;
+    }
+
+    bool can_resume_locked() const {
+        for (size_t candidate = next_resume_; !encoded_ && candidate < candidates_.size(); ++candidate) {
+            if (candidate != current_) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // An answer that comes after its timeout is closed
+    void resumed(uint64_t serial, size_t candidate, const std::string& url, const std::string& reason, std::unique_ptr<AsyncHttpResponse> response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_ || serial != resume_serial_) {
+            return;
+        }
+        resume_serial_++;
+        get_io_loop().cancel_timer(open_timer_);
+        if (cancelled_) {
+            finish_locked(false, "cancelled");
+            return;
+        }
+        if (!response || !is_usable_status(response->status(), received_)) {
+            if (!resume_locked(reason)) {
+                restart_or_finish_locked("connection failed while reading " + resolve_download_url(candidates_[current_]));
+            }
+            return;
+        }
+        std::cout << "Continuing " << job_.output_path << " from " << url << " (" << reason << ")" << std::endl;
+        response_ = std::move(response);
+        current_ = candidate;
+        served_.push_back(candidates_[candidate]);
+        peak_rate_ = 0.0;
+        window_start_ = std::chrono::steady_clock::now();
+        window_bytes_ = 0;
+        read_locked();
+    }
+
+    void resume_timed_out(uint64_t serial, const std::string& url, const std::string& reason) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_ || serial != resume_serial_) {
+            return;
+        }
+        resume_serial_++;
+        if (cancelled_) {
+            finish_locked(false, "cancelled");
+        } else if (!resume_locked(reason)) {
+            restart_or_finish_locked("no answer from " + url + " within " + std::to_string(DOWNLOAD_IDLE_TIMEOUT_MS / 1000) + " s");
+        }
+    }
+
+    // Every read is timed; one that receives nothing for DOWNLOAD_IDLE_TIMEOUT_MS is cancelled
+    void read_locked() {
+        std::shared_ptr<Transfer> self = shared_from_this();
+        uint64_t serial = ++read_serial_;
+        reading_ = true;
+        idle_timer_ = get_io_loop().after(DOWNLOAD_IDLE_TIMEOUT_MS, [self, serial] { self->idle(serial); });
+        response_->read(buffer_.data(), buffer_.size(), [self](bool ok, size_t got) { self->received(ok, got); });
+    }
+
+    void idle(uint64_t serial) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reading_ && serial == read_serial_) {
+            stalled_ = true;
+            response_->cancel();
+        }
+    }
+
+    void received(bool ok, size_t got) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reading_ = false;
+        get_io_loop().cancel_timer(idle_timer_);
+        if (cancelled_) {
+            finish_locked(false, "cancelled");
+            return;
+        }
+        if (!ok) {
+            std::string url = resolve_download_url(candidates_[current_]);
+            std::string reason = stalled_ ? "connection stalled" : "connection failed";
+            stalled_ = false;
+            response_.reset();
+            if (!resume_locked(reason)) {
+                restart_or_finish_locked(reason + " while reading " + url);
+            }
+            return;
+        }
+        if (got == 0) {
+            complete_locked();
+            return;
+        }
+        // Hashed while it is in the buffer, so verification needs no second pass
+        if (!job_.expected.sha1.empty()) {
+            sha1_.update(buffer_.data(), got);
+        }
+        if (!job_.expected.sha256.empty()) {
+            sha256_.update(buffer_.data(), got);
+        }
+        if (!job_.expected.sha512.empty()) {
+            sha512_.update(buffer_.data(), got);
+        }
+        long long offset = received_;
+        received_ += static_cast<long long>(got);
+        progress_.add_bytes(static_cast<long long>(got));
+
+        // Same rule as try_download_any(): a mirror that sags well below what it managed earlier in
+        // this transfer is left once this buffer is written, if enough is left to be worth it
+        window_bytes_ += static_cast<long long>(got);
+        double window_seconds = seconds_since(window_start_);
+        if (window_seconds >= 2.0) {
+            double rate = static_cast<double>(window_bytes_) / window_seconds;
+            peak_rate_ = std::max(peak_rate_, rate);
+            if (rate < peak_rate_ * MIRROR_SWITCH_RATIO && expected_size_ - received_ > MIRROR_SWITCH_MIN_REMAINING && can_resume_locked()) {
+                switching_ = true;
+            }
+            window_start_ = std::chrono::steady_clock::now();
+            window_bytes_ = 0;
+        }
+        std::shared_ptr<Transfer> self = shared_from_this();
+        file_.write(offset, buffer_.data(), got, [self](bool written) { self->written(written); });
+    }
+
+    void written(bool ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_) {
+            finish_locked(false, "cancelled");
+        } else if (!ok) {
+            finish_locked(false, "failed to write " + part_path_);
+        } else if (switching_) {
+            switching_ = false;
+            response_.reset();
+            if (!resume_locked("throughput dropped")) {
+                restart_or_finish_locked("connection failed while reading " + resolve_download_url(candidates_[current_]));
+            }
+        } else {
+            read_locked();
+        }
+    }
+
+    void complete_locked() {
+        std::string url = resolve_download_url(candidates_[current_]);
+        response_.reset();
+        record_mirror_throughput(candidates_[current_], static_cast<double>(received_) / std::max(seconds_since(transfer_start_), 1e-3));
+        if (!file_.close(received_)) {
+            finish_locked(false, "failed to write " + part_path_);
+        } else if (!job_.expected.sha1.empty() && sha1_.hex_digest() != job_.expected.sha1) {
+            restart_or_finish_locked("SHA-1 mismatch for " + url);
+        } else if (!job_.expected.sha256.empty() && sha256_.hex_digest() != job_.expected.sha256) {
+            restart_or_finish_locked("SHA-256 mismatch for " + url);
+        } else if (!job_.expected.sha512.empty() && sha512_.hex_digest() != job_.expected.sha512) {
+            restart_or_finish_locked("SHA-512 mismatch for " + url);
+        } else if (!move_into_place(part_path_, job_.output_path)) {
+            finish_locked(false, "failed to move " + part_path_ + " into place");
+        } else {
+            finish_locked(true, "");
+        }
+    }
+
+    // Same rule as try_download_any(): start over from the mirrors that have not sent any of the
+    // file. Called with no read, write or resume in flight.
+    void restart_or_finish_locked(const std::string& error) {
+        std::vector<std::string> remaining = unserved_candidates(candidates_, served_);
+        if (remaining.empty()) {
+            finish_locked(false, error);
+            return;
+        }
+        std::cout << "Retrying " << job_.output_path << " from another mirror (" << error << ")" << std::endl;
+        get_io_loop().cancel_timer(hedge_timer_);
+        get_io_loop().cancel_timer(open_timer_);
+        response_.reset();
+        file_.close(-1);
+        count_event("bytes_origin", received_);
+        attempt_++;
+        candidates_ = remaining;
+        errors_.clear();
+        next_candidate_ = next_resume_ = current_ = 0;
+        opened_ = encoded_ = stalled_ = switching_ = false;
+        expected_size_ = -1;
+        received_ = 0;
+        sha1_ = Sha1();
+        sha256_ = Sha256();
+        sha512_ = Sha512();
+        peak_rate_ = 0.0;
+        window_bytes_ = 0;
+        open_next_locked();
+    }
+
+    // Called with no read or write in flight; a hedged open may still answer later
+    void finish_locked(bool ok, const std::string& error) {
+        if (done_) {
+            return;
+        }
+        done_ = true;
+        get_io_loop().cancel_timer(hedge_timer_);
+        get_io_loop().cancel_timer(open_timer_);
+        response_.reset();
+        file_.close(-1);
+        if (!ok) {
+            std::remove(part_path_.c_str());
+        }
+        // Everything that came over the wire, including what a failed attempt then throws away
+        count_event("bytes_origin", received_);
+        buffer_ = std::vector<char>();
+        job_.ok = ok;
+        job_.error = error;
+        job_.seconds = seconds_since(started_);
+        {
+            std::lock_guard<std::mutex> batch_lock(batch_->mutex);
+            batch_->finished.push_back(index_);
+        }
+        batch_->changed.notify_all();
+    }
+
+    std::mutex mutex_;
+    DownloadJob& job_;   // not touched once done_
+    size_t index_;
+    std::shared_ptr<BatchState> batch_;
+    ProgressTask& progress_;
+    std::vector<std::string> candidates_;
+    std::vector<std::string> served_;   // mirrors that sent part of the file, in any attempt
+    size_t attempt_ = 0;
+    std::string part_path_;
+    std::string errors_;
+    TimePoint started_;
+    size_t next_candidate_ = 0;   // next mirror to ask for the whole file
+    size_t next_resume_ = 0;      // next mirror to ask for the rest of it
+    size_t opens_pending_ = 0;
+    size_t current_ = 0;          // mirror the response comes from
+    uint64_t hedge_timer_ = 0;
+    uint64_t open_timer_ = 0;
+    uint64_t idle_timer_ = 0;
+    uint64_t read_serial_ = 0;
+    uint64_t resume_serial_ = 0;   // of the resume in flight; a stale answer does not match
+    std::unique_ptr<AsyncHttpResponse> response_;
+    IoFile file_;
+    std::vector<char> buffer_ = std::vector<char>(TRANSFER_BUFFER_SIZE);
+    bool opened_ = false;
+    bool encoded_ = false;
+    bool reading_ = false;
+    bool stalled_ = false;
+    bool switching_ = false;
+    bool cancelled_ = false;
+    bool done_ = false;
+    long long expected_size_ = -1;
+    long long received_ = 0;
+    Sha1 sha1_;
+    Sha256 sha256_;
+    Sha512 sha512_;
+    TimePoint transfer_start_;
+    TimePoint window_start_;
+    long long window_bytes_ = 0;
+    double peak_rate_ = 0.0;
+};
+
+// Peer cache and cassette hooks work on whole files through try_download_any(), so with any of
+// them active the batch runs that in the executor's I/O lane instead of multiplexing transfers
+bool download_batch(std::vector<DownloadJob>& jobs, size_t max_in_flight, const std::function<bool(DownloadJob& job)>& finished) {
+    PhaseScope phase("download");
+    bool blocking = g_peer_cache || g_cassette || g_cassette_recorder;
+    std::shared_ptr<BatchState> batch = std::make_shared<BatchState>();
+    std::vector<std::shared_ptr<Transfer>> transfers(jobs.size());
+    TaskGroup group(TaskLane::Io);
+
+    auto start = [&](size_t i) {
+        if (jobs[i].before_start && !jobs[i].before_start(jobs[i])) {
+            {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.push_back(i);
+            }
+            batch->changed.notify_all();
+            return;
+        }
+        if (!blocking) {
+            transfers[i] = std::make_shared<Transfer>(jobs[i], i, batch);
+            transfers[i]->start();
+            return;
+        }
+        group.run([&jobs, batch, i]() {
+            DownloadJob& job = jobs[i];
+            auto job_start = std::chrono::steady_clock::now();
+            job.ok = try_download_any(job.urls, job.output_path, job.expected, job.error);
+            job.seconds = seconds_since(job_start);
+            {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.push_back(i);
+            }
+            batch->changed.notify_all();
+        });
+    };
+
+    size_t next = 0;
+    size_t running = 0;
+    bool cancelled = false;
+    bool ok = true;
+    while (running > 0 || (!cancelled && next < jobs.size())) {
+        while (!cancelled && running < std::max<size_t>(max_in_flight, 1) && next < jobs.size()) {
+            start(next++);
+            running++;
+        }
+        std::vector<size_t> ended;
+        {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->changed.wait(lock, [&] { return !batch->finished.empty(); });
+            ended.swap(batch->finished);
+        }
+        for (size_t i : ended) {
+            running--;
+            transfers[i].reset();
+            ok = ok && jobs[i].ok;
+            if (!cancelled && !finished(jobs[i])) {
+                cancelled = true;
+                for (const std::shared_ptr<Transfer>& transfer : transfers) {
+                    if (transfer) {
+                        transfer->cancel();
+                    }
+                }
+            }
+        }
+    }
+    group.wait();
+    return ok && !cancelled;
+}
+
+// Fetch a published checksum file ("<hex digest>" or "<hex digest>  <file name>") and return the
+// digest in lowercase, or "" if it cannot be fetched or does not look like a hex digest
+std::string fetch_published_digest(const std::string& checksum_url) {
+    PhaseScope phase("download");
+    std::string resolved_url = checksum_url;
+    std::string error;
+    std::string body;
+    if (g_cassette) {
+        if (!g_cassette->replay_text(checksum_url, body, error)) {
+            std::cerr << "Could not fetch checksum: " << error << std::endl;
+            return "";
+        }
+    } else {
+        std::unique_ptr<HttpResponse> response = open_download(checksum_url, resolved_url, error);
+        if (!response) {
+            std::cerr << "Could not fetch checksum: " << error << std::endl;
+            return "";
+        }
+        char buffer[1024];
+        size_t bytesRead = 0;
+        while (body.size() < 64 * 1024 && response->read(buffer, sizeof(buffer), bytesRead) && bytesRead > 0) {
+            body.append(buffer, bytesRead);
+        }
+        if (g_cassette_recorder) {
+            g_cassette_recorder->record_body(checksum_url, 200, body);
+        }
+    }
+
+    std::string digest = body.substr(0, body.find_first_of(" \t\r\n"));
+    std::transform(digest.begin(), digest.end(), digest.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    bool is_hex = !digest.empty() && digest.find_first_not_of("0123456789abcdef") == std::string::npos;
+    if (!is_hex || (digest.size() != 40 && digest.size() != 64 && digest.size() != 128)) {
+        std::cerr << "Unexpected checksum format from " << resolved_url << std::endl;
+        return "";
+    }
+    return digest;
+}
@@ -0,0 +1,86 @@
+#ifndef DOWNLOAD_HPP
+#define DOWNLOAD_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Cassette;
+class CassetteRecorder;
+class PeerCache;
+
+// The download engine: mirror rewriting and ranking, hedged requests, mid-transfer mirror
+// switching, streaming verification, and the peer cache and cassette hooks. It runs on whatever
+// open_http() provides, so the same code can be benchmarked away from Windows.
+
+// One HTTP response being received
+class HttpResponse {
+public:
+    virtual ~HttpResponse() {}
+    virtual int status() const = 0;
+    virtual long long content_length() const = 0;   // -1 when not sent
+    virtual bool encoded() const = 0;               // had a Content-Encoding; read() returns the decoded body
+    virtual bool read(char* buffer, size_t size, size_t& got) = 0;   // got == 0 at the end; false if the connection broke
+};
+
+// GET a URL, from offset onwards when it is positive (only length bytes of it when that is
+// positive), asking for gzip/deflate when allowed. Null (with a reason) if no response arrived.
+// Defined by the platform: WinINet in filesystem.cpp; benchmarks link a plain-socket client.
+std::unique_ptr<HttpResponse> open_http(const std::string& url, long long offset, bool accept_encoding, std::string& error, long long length = -1);
+
+// The same response received without holding a thread: done runs on the I/O loop (io_loop.hpp),
+// never inside read(). One read at a time, and a response is only destroyed while no read is
+// pending, so a transfer that gives up calls cancel() and waits for its read to fail.
+class AsyncHttpResponse {
+public:
+    virtual ~AsyncHttpResponse() {}
+    virtual int status() const = 0;
+    virtual long long content_length() const = 0;
+    virtual bool encoded() const = 0;
+    virtual void read(char* buffer, size_t size, std::function<void(bool ok, size_t got)> done) = 0;
+    virtual void cancel() = 0;
+};
+
+typedef std::function<void(std::unique_ptr<AsyncHttpResponse> response, const std::string& error)> OpenHttpCallback;
+
+// open_http() without blocking; done runs on the I/O loop. Defined next to open_http().
+void open_http_async(const std::string& url, long long offset, bool accept_encoding, OpenHttpCallback done);
+
+// Digests (lowercase hex) to check while a download streams to disk; empty fields are not checked
+struct ExpectedHashes {
+    std::string sha1;
+    std::string sha256;
+    std::string sha512;
+};
+
+// One file of a download_batch() and, once it has been reported, how it went
+struct DownloadJob {
+    std::vector<std::string> urls;   // mirrors of the file
+    std::string output_path;
+    ExpectedHashes expected;
+    // Runs on the calling thread right before the transfer starts; returning false reports the job
+    // as it is (ok and error set by the hook) without transferring anything
+    std::function<bool(DownloadJob& job)> before_start;
+    bool ok = false;
+    std::string error;
+    double seconds = 0.0;   // from the first request to the end
+};
+
+bool try_download_file(const std::string& url, const std::string& output_path, const ExpectedHashes& expected, std::string& error);
+bool try_download_any(const std::vector<std::string>& urls, const std::string& output_path, const ExpectedHashes& expected, std::string& error);
+// Many files at once, at most max_in_flight transfers open. finished(job) runs on the calling thread
+// as each one ends; returning false cancels the rest. True if every job ran and succeeded.
+bool download_batch(std::vector<DownloadJob>& jobs, size_t max_in_flight, const std::function<bool(DownloadJob& job)>& finished);
+std::string fetch_published_digest(const std::string& checksum_url);
+void add_download_mirror(const std::string& from_prefix, const std::string& to_prefix);
+std::string resolve_download_url(const std::string& url);
+void add_alternate_mirror(const std::string& from_prefix, const std::string& to_prefix);
+std::vector<std::string> get_download_candidates(const std::string& url);
+void use_peer_cache(PeerCache* cache);
+void announce_to_peers();
+void use_cassette_recorder(CassetteRecorder* recorder);
+void use_cassette(Cassette* cassette);
+
+#endif
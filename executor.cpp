@@ -0,0 +1,246 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "executor.hpp"
+#include "constants.hpp"
+#include "memory_stats.hpp"
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+struct Task {
+    std::function<void()> run;
+    std::shared_ptr<TaskGroupState> group;
+    int phase = -1;   // of the submitting thread, so --memory and --perf-counters charge the worker's share to it
+};
+
+struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;   // submitted by this worker; it takes from the back, thieves from the front
+};
+
+struct Lane {
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<Task> queues[3];      // one per TaskPriority; all but normal-priority tasks of workers
+    std::atomic<size_t> queued{ 0 };  // tasks in all of the lane's queues and deques
+    std::atomic<size_t> high_queued{ 0 };   // in queues[High], so workers need not lock to look
+};
+
+static std::atomic<bool> g_low_priority{ false };
+static thread_local Lane* t_lane = nullptr;
+static thread_local size_t t_worker = 0;
+
+void set_executor_low_priority(bool low_priority) {
+    g_low_priority = low_priority;
+}
+
+static void lower_thread_priority() {
+#ifdef _WIN32
+    // Background mode lowers the thread's I/O and memory priority as well as its CPU priority
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN)) {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    }
+#elif defined(__linux__)
+    // Linux applies nice values per thread
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+// Call with lane.mutex held
+static bool pop_queued_locked(Lane& lane, Task& task) {
+    for (std::deque<Task>& queue : lane.queues) {
+        if (!queue.empty()) {
+            task = std::move(queue.front());
+            queue.pop_front();
+            if (&queue == &lane.queues[static_cast<int>(TaskPriority::High)]) {
+                lane.high_queued--;
+            }
+            lane.queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool take_task(Lane& lane, size_t self, Task& task) {
+    if (lane.high_queued > 0) {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        if (pop_queued_locked(lane, task)) {
+            return true;
+        }
+    }
+    if (self < lane.workers.size()) {
+        Worker& own = *lane.workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            lane.queued--;
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        if (pop_queued_locked(lane, task)) {
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= lane.workers.size(); ++i) {
+        Worker& victim = *lane.workers[(self + i) % lane.workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            lane.queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_task(Task& task) {
+    if (!task.group->cancelled) {
+        int previous_phase = set_memory_phase(task.phase);
+        if (task.phase >= 0) {
+            perf_scope_started();
+        }
+        task.run();
+        if (task.phase >= 0) {
+            perf_scope_ended(task.phase);
+        }
+        set_memory_phase(previous_phase);
+    }
+    std::lock_guard<std::mutex> lock(task.group->mutex);
+    if (--task.group->pending == 0) {
+        task.group->finished.notify_all();
+    }
+}
+
+static void worker_loop(Lane* lane, size_t index) {
+    t_lane = lane;
+    t_worker = index;
+    if (g_low_priority) {
+        lower_thread_priority();
+    }
+    for (;;) {
+        Task task;
+        if (take_task(*lane, index, task)) {
+            run_task(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(lane->mutex);
+        lane->available.wait(lock, [&] { return lane->queued > 0; });
+    }
+}
+
+static Lane* start_lane(size_t threads) {
+    Lane* lane = new Lane;
+    for (size_t i = 0; i < threads; ++i) {
+        lane->workers.emplace_back(new Worker);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        std::thread(worker_loop, lane, i).detach();
+    }
+    return lane;
+}
+
+static size_t lane_threads(TaskLane lane) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    if (lane == TaskLane::Cpu) {
+        return g_low_priority ? std::max<size_t>(1, cores / 2) : cores;
+    }
+    return std::max(cores * static_cast<size_t>(EXECUTOR_IO_THREADS_PER_CORE), static_cast<size_t>(EXECUTOR_MIN_IO_THREADS));
+}
+
+// Started on first use and never torn down: workers may be blocked in a network call when the
+// process exits, and joining them would hold up the exit
+static Lane& get_lane(TaskLane lane) {
+    static Lane* io_lane = start_lane(lane_threads(TaskLane::Io));
+    static Lane* cpu_lane = start_lane(lane_threads(TaskLane::Cpu));
+    return lane == TaskLane::Io ? *io_lane : *cpu_lane;
+}
+
+size_t get_executor_threads(TaskLane lane) {
+    return get_lane(lane).workers.size();
+}
+
+// queued is counted where the task is published, so no worker can take it and count it off first
+static void submit(TaskLane lane_id, TaskPriority priority, Task task) {
+    Lane& lane = get_lane(lane_id);
+    if (t_lane == &lane && priority == TaskPriority::Normal) {
+        {
+            Worker& own = *lane.workers[t_worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.tasks.push_back(std::move(task));
+            lane.queued++;
+        }
+        // Taken so a worker between checking for work and waiting cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(lane.mutex);
+    } else {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.queues[static_cast<int>(priority)].push_back(std::move(task));
+        if (priority == TaskPriority::High) {
+            lane.high_queued++;
+        }
+        lane.queued++;
+    }
+    lane.available.notify_one();
+}
+
+TaskGroup::TaskGroup(TaskLane lane, TaskPriority priority) : lane_(lane), priority_(priority), state_(std::make_shared<TaskGroupState>()) {
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->pending++;
+    }
+    submit(lane_, priority_, Task{ std::move(task), state_, get_memory_phase() });
+}
+
+void TaskGroup::wait() {
+    // Only a worker can be of the same lane; other threads must not start the pool just to wait
+    Lane* lane = t_lane;
+    bool helping = lane && lane == &get_lane(lane_);
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    while (state_->pending > 0) {
+        if (!helping) {
+            state_->finished.wait(lock, [&] { return state_->pending == 0; });
+            break;
+        }
+        // Blocking here could leave every worker of the lane waiting for tasks none of them runs
+        lock.unlock();
+        Task task;
+        if (take_task(*lane, t_worker, task)) {
+            run_task(task);
+            lock.lock();
+        } else {
+            lock.lock();
+            state_->finished.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void TaskGroup::cancel() {
+    state_->cancelled = true;
+}
+
+bool TaskGroup::cancelled() const {
+    return state_->cancelled;
+}
@@ -0,0 +1,61 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// One thread pool for the whole installer, so parallel phases share the machine instead of each
+// starting threads of its own. Work that mostly waits (network, spawned processes) runs in the I/O
+// lane, work that keeps a core busy (inflate, hashing) in the CPU lane; the CPU lane has one
+// thread per core and the I/O lane EXECUTOR_IO_THREADS_PER_CORE per core. Each worker keeps the
+// normal-priority tasks it submits itself in its own deque and takes the newest first; everything
+// else goes to the lane's queues. A worker takes high-priority tasks before its own, then the
+// rest of the lane's queue in priority order, and then steals the oldest task of another worker.
+enum class TaskLane {
+    Io,
+    Cpu
+};
+
+enum class TaskPriority {
+    High,
+    Normal,
+    Low
+};
+
+struct TaskGroupState {
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t pending = 0;
+    std::atomic<bool> cancelled{ false };
+};
+
+// Tasks submitted together, waited for and cancelled together. Cancellation is cooperative:
+// tasks that have not started are dropped, and running ones see cancelled() and return early.
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskLane lane, TaskPriority priority = TaskPriority::Normal);
+    ~TaskGroup();   // waits for everything submitted
+
+    void run(std::function<void()> task);
+    void wait();   // a worker of the same lane runs queued tasks meanwhile instead of blocking
+    void cancel();
+    bool cancelled() const;
+
+private:
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    TaskLane lane_;
+    TaskPriority priority_;
+    std::shared_ptr<TaskGroupState> state_;
+};
+
+// Low priority: half the cores for the CPU lane and workers at below-normal OS priority, so the
+// machine stays usable during an install. Takes effect when the pool starts, i.e. before the first task.
+void set_executor_low_priority(bool low_priority);
+size_t get_executor_threads(TaskLane lane);
+
+#endif
@@ -0,0 +1,120 @@
+#define NOMINMAX
+
+#include "file_lock.hpp"
+
+#include <windows.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// A lock file still empty this long after it was created lost its owner before it was written
+static const unsigned long long EMPTY_LOCK_GRACE_TICKS = 10ULL * 10000000ULL;   // 10 s in FILETIME ticks
+static const DWORD LOCK_POLL_MS = 100;
+
+static unsigned long long to_ticks(const FILETIME& time) {
+    return (static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+// Start time of a process; together with the PID it tells the owner from a process that reused its PID
+static bool get_process_start(HANDLE process, unsigned long long& start) {
+    FILETIME creation, exit_time, kernel_time, user_time;
+    if (!GetProcessTimes(process, &creation, &exit_time, &kernel_time, &user_time)) {
+        return false;
+    }
+    start = to_ticks(creation);
+    return true;
+}
+
+static bool is_owner_alive(DWORD pid, unsigned long long start) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process) {
+        // Another user's process may not be queryable; it exists, so assume it still holds the lock
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    DWORD exit_code = 0;
+    unsigned long long actual_start = 0;
+    bool alive = GetExitCodeProcess(process, &exit_code) && exit_code == STILL_ACTIVE &&
+                 get_process_start(process, actual_start) && actual_start == start;
+    CloseHandle(process);
+    return alive;
+}
+
+// Remove the lock file if its owner is gone. The file is deleted through the handle it was read
+// from, so a fresh lock created by another process in the meantime is never removed by mistake.
+static bool break_stale_lock(const std::string& path, DWORD& owner_pid) {
+    owner_pid = 0;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | DELETE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    char buffer[128];
+    DWORD bytes_read = 0;
+    ReadFile(file, buffer, sizeof(buffer), &bytes_read, nullptr);
+    unsigned long long start = 0;
+    std::istringstream(std::string(buffer, bytes_read)) >> owner_pid >> start;
+
+    bool stale;
+    if (owner_pid == 0) {
+        FILETIME created, now;
+        GetFileTime(file, &created, nullptr, nullptr);
+        GetSystemTimeAsFileTime(&now);
+        stale = to_ticks(now) > to_ticks(created) + EMPTY_LOCK_GRACE_TICKS;
+    } else {
+        stale = !is_owner_alive(owner_pid, start);
+    }
+    if (stale) {
+        FILE_DISPOSITION_INFO disposition = { TRUE };
+        stale = SetFileInformationByHandle(file, FileDispositionInfo, &disposition, sizeof(disposition)) != 0;
+    }
+    CloseHandle(file);
+    return stale;
+}
+
+FileLock::FileLock(const std::string& path, unsigned long timeout_ms) {
+    DWORD waited = 0;
+    DWORD reported_owner = 0;
+    for (;;) {
+        // Deleted on close, including when the process dies; only a power loss leaves it behind
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_NEW,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file != INVALID_HANDLE_VALUE) {
+            unsigned long long start = 0;
+            get_process_start(GetCurrentProcess(), start);
+            std::string owner = std::to_string(GetCurrentProcessId()) + " " + std::to_string(start) + "\n";
+            DWORD written = 0;
+            WriteFile(file, owner.data(), static_cast<DWORD>(owner.size()), &written, nullptr);
+            handle_ = file;
+            return;
+        }
+
+        // A file being deleted by its last owner reports access denied until it is gone
+        DWORD error = GetLastError();
+        if (error != ERROR_FILE_EXISTS && error != ERROR_ACCESS_DENIED) {
+            std::cerr << "Could not create lock file " << path << " (error " << error << ")." << std::endl;
+            return;
+        }
+        DWORD owner = 0;
+        if (error == ERROR_FILE_EXISTS && break_stale_lock(path, owner)) {
+            std::cout << "Removed a stale lock left by process " << owner << ": " << path << std::endl;
+            continue;
+        }
+        if (owner == 0 && waited >= timeout_ms) {
+            return;
+        }
+        if (owner != 0 && owner != reported_owner) {
+            std::cout << "Waiting for installer process " << owner << " to finish with " << path << std::endl;
+            reported_owner = owner;
+        }
+        Sleep(LOCK_POLL_MS);
+        if (owner == 0) {
+            waited += LOCK_POLL_MS;
+        }
+    }
+}
+
+FileLock::~FileLock() {
+    if (handle_) {
+        CloseHandle(handle_);
+    }
+}
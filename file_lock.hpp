@@ -0,0 +1,23 @@
+#ifndef FILE_LOCK_HPP
+#define FILE_LOCK_HPP
+
+#include <string>
+
+// Lock shared by every installer process on the machine, held by creating the lock file
+// exclusively. The file records the owner's PID and process start time, so a lock left behind
+// by a crash or power loss is recognised and broken instead of blocking later installers.
+// A live owner is waited for as long as it holds the lock; timeout_ms only bounds the time spent
+// on a lock whose owner cannot be told (one still being created or deleted).
+class FileLock {
+public:
+    FileLock(const std::string& path, unsigned long timeout_ms);
+    ~FileLock();
+    bool locked() const { return handle_ != nullptr; }
+
+private:
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+    void* handle_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FILE_OPS_HPP
+#define FILE_OPS_HPP
+
+#include <string>
+
+// The few file operations the portable modules (download engine, peer cache, cassettes) need,
+// on Win32 or POSIX. filesystem.cpp holds the Windows-only rest.
+bool make_directory(const std::string& path);   // true if it exists afterwards
+void remove_directory(const std::string& path);   // only if empty
+bool move_into_place(const std::string& from, const std::string& to);   // replaces to
+bool copy_file(const std::string& from, const std::string& to);
+long long size_of_file(const std::string& path);   // 0 if it cannot be read
+
+#endif
@@ -1,8 +1,15 @@
 #define NOMINMAX
 
 #include "constants.hpp"
+#include "executor.hpp"
 #include "filesystem.hpp"
+#include "hash.hpp"
+#include "install_state.hpp"
+#include "io_loop.hpp"
 #include "json.hpp"
+#include "phases.hpp"
+#include "progress.hpp"
+#include "store.hpp"
 
 #include <iostream>
 #include <windows.h>
@@ -12,6 +19,12 @@
 #include <cstdio>
 #include <wininet.h>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <memory>
+#include <mutex>
 #pragma comment(lib, "wininet.lib")
 
 
@@ -31,6 +44,8 @@ std::vector<std::string> split_path(const std::string& path, char delimiter = '\
 
 // Helper to execute a command and get its output
 std::string exec(const char* cmd) {
+    count_event("process_spawns");
+    flush_log();
     char buffer[128];
     std::string result = "";
     std::shared_ptr<FILE> pipe(_popen(cmd, "r"), _pclose);
@@ -69,39 +84,269 @@ void create_directory(const std::string& path) {
     }
 }
 
-// File download logic using WinINet
-void download_file(const std::string& url, const std::string& output_path) {
-    HINTERNET hInternet = InternetOpenA("MinecraftModInstaller", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+// One WinINet session shared by all downloads; request handles from it may be used concurrently
+static HINTERNET get_internet_session() {
+    static HINTERNET hInternet = [] {
+        HINTERNET handle = InternetOpenA("MinecraftModInstaller", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+        if (handle) {
+            // WinINet defaults to a handful of connections per server, which would serialize parallel fetches
+            DWORD max_connections = 16;
+            InternetSetOptionA(NULL, INTERNET_OPTION_MAX_CONNS_PER_SERVER, &max_connections, sizeof(max_connections));
+            InternetSetOptionA(NULL, INTERNET_OPTION_MAX_CONNS_PER_1_0SERVER, &max_connections, sizeof(max_connections));
+            // Let WinINet decode gzip/deflate responses; servers only send them when asked
+            BOOL decode = TRUE;
+            InternetSetOptionA(handle, INTERNET_OPTION_HTTP_DECODING, &decode, sizeof(decode));
+        }
+        return handle;
+    }();
+    return hInternet;
+}
+
+// A response read through WinINet, which has already decoded any gzip/deflate body
+class WinInetResponse : public HttpResponse {
+public:
+    explicit WinInetResponse(HINTERNET handle) : handle_(handle) {}
+    ~WinInetResponse() override { InternetCloseHandle(handle_); }
+
+    int status() const override {
+        DWORD status_code = 0;
+        DWORD status_size = sizeof(status_code);
+        HttpQueryInfoA(handle_, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status_code, &status_size, NULL);
+        return static_cast<int>(status_code);
+    }
+
+    long long content_length() const override {
+        ULONGLONG content_length = 0;
+        DWORD length_size = sizeof(content_length);
+        if (!HttpQueryInfoA(handle_, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER64, &content_length, &length_size, NULL)) {
+            return -1;
+        }
+        return static_cast<long long>(content_length);
+    }
+
+    bool encoded() const override {
+        char encoding[64];
+        DWORD encoding_size = sizeof(encoding);
+        return HttpQueryInfoA(handle_, HTTP_QUERY_CONTENT_ENCODING, encoding, &encoding_size, NULL) != FALSE;
+    }
+
+    bool read(char* buffer, size_t size, size_t& got) override {
+        DWORD bytes_read = 0;
+        BOOL ok = InternetReadFile(handle_, buffer, static_cast<DWORD>(size), &bytes_read);
+        got = bytes_read;
+        return ok != FALSE;
+    }
+
+private:
+    HINTERNET handle_;
+};
+
+static std::string get_request_headers(long long offset, long long length, bool accept_encoding) {
+    if (length > 0) {
+        return "Range: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1) + "\r\n";
+    }
+    if (offset > 0) {
+        return "Range: bytes=" + std::to_string(offset) + "-\r\n";
+    }
+    return accept_encoding ? "Accept-Encoding: gzip, deflate\r\n" : "";
+}
+
+std::unique_ptr<HttpResponse> open_http(const std::string& url, long long offset, bool accept_encoding, std::string& error, long long length) {
+    HINTERNET hInternet = get_internet_session();
     if (!hInternet) {
-        std::cerr << "Failed to initialize WinINet." << std::endl;
-        exit(1);
+        error = "failed to initialize WinINet";
+        return nullptr;
     }
 
-    HINTERNET hFile = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
+    std::string headers = get_request_headers(offset, length, accept_encoding);
+    HINTERNET hFile = InternetOpenUrlA(hInternet, url.c_str(), headers.empty() ? NULL : headers.c_str(),
+                                       headers.empty() ? 0 : static_cast<DWORD>(-1), INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE, 0);
     if (!hFile) {
-        std::cerr << "Failed to open URL: " << url << std::endl;
-        InternetCloseHandle(hInternet);
-        exit(1);
+        error = "failed to open URL " + url;
+        return nullptr;
     }
+    return std::unique_ptr<HttpResponse>(new WinInetResponse(hFile));
+}
 
-    FILE* file = nullptr;
-    if (fopen_s(&file, output_path.c_str(), "wb") != 0 || !file) {
-        std::cerr << "Failed to open output file: " << output_path << std::endl;
-        InternetCloseHandle(hFile);
-        InternetCloseHandle(hInternet);
-        exit(1);
+// The context of one asynchronous WinINet request. It lives until WinINet reports that the
+// request's handle is closing, which is always its last notification.
+struct WinInetAsyncRequest {
+    std::mutex mutex;
+    HINTERNET handle = nullptr;
+    INTERNET_BUFFERSA buffers;
+    std::function<void(bool ok, DWORD bytes)> pending;   // the open or read in progress
+};
+
+// Hand the operation in progress to the I/O loop; called at most once per operation
+static void complete_async_request(WinInetAsyncRequest* request, bool ok) {
+    std::function<void(bool ok, DWORD bytes)> pending;
+    DWORD bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(request->mutex);
+        pending.swap(request->pending);
+        bytes = request->buffers.dwBufferLength;
+    }
+    if (pending) {
+        get_io_loop().post([pending, ok, bytes] { pending(ok, bytes); });
+    }
+}
+
+// Runs on WinINet's threads; it only records the handle and passes completions on
+static void CALLBACK wininet_status_callback(HINTERNET, DWORD_PTR context, DWORD status, LPVOID info, DWORD) {
+    WinInetAsyncRequest* request = reinterpret_cast<WinInetAsyncRequest*>(context);
+    if (!request) {
+        return;
+    }
+    if (status == INTERNET_STATUS_HANDLE_CREATED) {
+        std::lock_guard<std::mutex> lock(request->mutex);
+        request->handle = reinterpret_cast<HINTERNET>(static_cast<INTERNET_ASYNC_RESULT*>(info)->dwResult);
+    } else if (status == INTERNET_STATUS_REQUEST_COMPLETE) {
+        complete_async_request(request, static_cast<INTERNET_ASYNC_RESULT*>(info)->dwResult != 0);
+    } else if (status == INTERNET_STATUS_HANDLE_CLOSING) {
+        delete request;
+    }
+}
+
+// A second session in asynchronous mode for open_http_async(); its requests report through
+// wininet_status_callback instead of blocking the caller
+static HINTERNET get_async_internet_session() {
+    static HINTERNET hInternet = [] {
+        get_internet_session();   // sets the per-server connection limits, which are process-wide
+        HINTERNET handle = InternetOpenA("MinecraftModInstaller", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, INTERNET_FLAG_ASYNC);
+        if (handle) {
+            BOOL decode = TRUE;
+            InternetSetOptionA(handle, INTERNET_OPTION_HTTP_DECODING, &decode, sizeof(decode));
+            InternetSetStatusCallbackA(handle, wininet_status_callback);
+        }
+        return handle;
+    }();
+    return hInternet;
+}
+
+class WinInetAsyncResponse : public AsyncHttpResponse {
+public:
+    explicit WinInetAsyncResponse(WinInetAsyncRequest* request) : request_(request) {
+        std::lock_guard<std::mutex> lock(request->mutex);
+        handle_ = request->handle;
+    }
+    ~WinInetAsyncResponse() override { cancel(); }
+
+    int status() const override {
+        DWORD status_code = 0;
+        DWORD status_size = sizeof(status_code);
+        HttpQueryInfoA(handle_, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status_code, &status_size, NULL);
+        return static_cast<int>(status_code);
+    }
+
+    long long content_length() const override {
+        ULONGLONG content_length = 0;
+        DWORD length_size = sizeof(content_length);
+        if (!HttpQueryInfoA(handle_, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER64, &content_length, &length_size, NULL)) {
+            return -1;
+        }
+        return static_cast<long long>(content_length);
+    }
+
+    bool encoded() const override {
+        char encoding[64];
+        DWORD encoding_size = sizeof(encoding);
+        return HttpQueryInfoA(handle_, HTTP_QUERY_CONTENT_ENCODING, encoding, &encoding_size, NULL) != FALSE;
+    }
+
+    void read(char* buffer, size_t size, std::function<void(bool ok, size_t got)> done) override {
+        if (!handle_) {
+            get_io_loop().post([done] { done(false, 0); });
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(request_->mutex);
+            request_->buffers = INTERNET_BUFFERSA();
+            request_->buffers.dwStructSize = sizeof(INTERNET_BUFFERSA);
+            request_->buffers.lpvBuffer = buffer;
+            request_->buffers.dwBufferLength = static_cast<DWORD>(size);
+            request_->pending = [done](bool ok, DWORD bytes) { done(ok, ok ? bytes : 0); };
+        }
+        // Data that is already there comes back at once, without a notification
+        if (InternetReadFileExA(handle_, &request_->buffers, IRF_ASYNC, reinterpret_cast<DWORD_PTR>(request_))) {
+            complete_async_request(request_, true);
+        } else if (GetLastError() != ERROR_IO_PENDING) {
+            complete_async_request(request_, false);
+        }
+    }
+
+    // Closing the handle fails a pending read; request_ may be gone afterwards
+    void cancel() override {
+        if (handle_) {
+            HINTERNET handle = handle_;
+            handle_ = nullptr;
+            InternetCloseHandle(handle);
+        }
     }
 
-    char buffer[4096];
-    DWORD bytesRead = 0;
-    while (InternetReadFile(hFile, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
-        fwrite(buffer, 1, bytesRead, file);
+private:
+    WinInetAsyncRequest* request_;
+    HINTERNET handle_ = nullptr;
+};
+
+void open_http_async(const std::string& url, long long offset, bool accept_encoding, OpenHttpCallback done) {
+    HINTERNET hInternet = get_async_internet_session();
+    if (!hInternet) {
+        get_io_loop().post([done] { done(nullptr, "failed to initialize WinINet"); });
+        return;
+    }
+    WinInetAsyncRequest* request = new WinInetAsyncRequest();
+    request->pending = [request, url, done](bool ok, DWORD) {
+        if (ok) {
+            done(std::unique_ptr<AsyncHttpResponse>(new WinInetAsyncResponse(request)), "");
+            return;
+        }
+        HINTERNET handle = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(request->mutex);
+            handle = request->handle;
+        }
+        if (handle) {
+            InternetCloseHandle(handle);   // the request is freed when WinINet reports the handle closing
+        } else {
+            delete request;
+        }
+        done(nullptr, "failed to open URL " + url);
+    };
+    std::string headers = get_request_headers(offset, -1, accept_encoding);
+    HINTERNET hFile = InternetOpenUrlA(hInternet, url.c_str(), headers.empty() ? NULL : headers.c_str(),
+                                       headers.empty() ? 0 : static_cast<DWORD>(-1), INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE,
+                                       reinterpret_cast<DWORD_PTR>(request));
+    if (hFile) {
+        {
+            std::lock_guard<std::mutex> lock(request->mutex);
+            request->handle = hFile;
+        }
+        complete_async_request(request, true);
+    } else if (GetLastError() != ERROR_IO_PENDING) {
+        complete_async_request(request, false);
     }
+}
 
-    fclose(file);
-    InternetCloseHandle(hFile);
-    InternetCloseHandle(hInternet);
+// File download logic using WinINet
+void download_file(const std::string& url, const std::string& output_path, const ExpectedHashes& expected) {
+    auto start = std::chrono::steady_clock::now();
+    ProgressTask& progress = progress_task("download");
+    progress.plan(1, 0);
+    std::string error;
+    if (!try_download_file(url, output_path, expected, error)) {
+        std::cerr << "Failed to download " << url << ": " << error << std::endl;
+        exit(1);
+    }
+    progress.finish_item();
     std::cout << "Downloaded: " << url << " to: " << output_path << std::endl;
+
+    // Remember size and throughput so plan mode can estimate future runs
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExA(output_path.c_str(), GetFileExInfoStandard, &attributes)) {
+        long long total_bytes = (static_cast<long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        record_download(url, total_bytes, seconds);
+    }
 }
 
 // Safe getenv using _dupenv_s
@@ -116,6 +361,30 @@ std::string safe_getenv(const char* var) {
     return std::string();
 }
 
+// Launcher profile id used for the modded install of a Minecraft version
+std::string get_launcher_profile_id(const std::string& mc_version) {
+    return "fabric-modded-" + mc_version;
+}
+
+// Build the launcher profile entry for the modded install
+nlohmann::json build_launcher_profile(const std::string& modded_install_dir, const std::string& fabric_loader_version, const std::string& mc_version, const std::string& profile_name, const std::string& javaw_path) {
+    std::string last_version_id = "fabric-loader-" + fabric_loader_version + "-" + mc_version;
+    return {
+        {"name", profile_name},
+        {"lastVersionId", last_version_id},
+        {"gameDir", modded_install_dir},
+        {"type", "custom"},
+        {"icon", "data:image/png;base64,iVBORw0KGgoAAAANSUhEUgAAA\
+IAAAACABAMAAAAxEHz4AAAAGFBMVEUAAAA4NCrb0LTGvKW8spyAem2uppSakn5Ssn\
+MLAAAAAXRSTlMAQObYZgAAAJ5JREFUaIHt1MENgCAMRmFWYAVXcAVXcAVXcH3bhCY\
+NkYjcKO8dSf7v1JASUWdZAlgb0PEmDSMAYYBdGkYApgf8ER3SbwRgesAf0BACMD1g\
+B6S9IbkEEBfwY49oNj4lgLhA64C0o9R9RABTAvp4SX5kB2TA5y8EEAK4pRrxB9QcA\
+4QBWkj3GCAMUCO/xwBhAI/kEsCagCHDY4AwAC3VA6t4zTAMj0OJAAAAAElFTkSuQmCC"},
+        {"javaArgs", "-Xmx4G -XX:+UnlockExperimentalVMOptions -XX:+UseG1GC -XX:G1NewSizePercent=20 -XX:G1ReservePercent=20 -XX:MaxGCPauseMillis=50 -XX:G1HeapRegionSize=32M"},
+        {"javaDir", javaw_path}
+    };
+}
+
 // Add a new Minecraft launcher profile for the modded install
 void add_minecraft_launcher_profile(const std::string& minecraft_dir, const std::string& modded_install_dir, const std::string& fabric_loader_version, const std::string& mc_version, const std::string& profile_name) {
     using json = nlohmann::json;
@@ -134,24 +403,8 @@ void add_minecraft_launcher_profile(const std::string& minecraft_dir, const std:
     }
     in.close();
 
-    std::string profile_id = "fabric-modded-" + mc_version;
-    std::string last_version_id = "fabric-loader-" + fabric_loader_version + "-" + mc_version;
-
     // Add or update the profile
-    j["profiles"][profile_id] = {
-        {"name", profile_name},
-        {"lastVersionId", last_version_id},
-        {"gameDir", modded_install_dir},
-        {"type", "custom"},
-        {"icon", "data:image/png;base64,iVBORw0KGgoAAAANSUhEUgAAA\
-IAAAACABAMAAAAxEHz4AAAAGFBMVEUAAAA4NCrb0LTGvKW8spyAem2uppSakn5Ssn\
-MLAAAAAXRSTlMAQObYZgAAAJ5JREFUaIHt1MENgCAMRmFWYAVXcAVXcAVXcH3bhCY\
-NkYjcKO8dSf7v1JASUWdZAlgb0PEmDSMAYYBdGkYApgf8ER3SbwRgesAf0BACMD1g\
-B6S9IbkEEBfwY49oNj4lgLhA64C0o9R9RABTAvp4SX5kB2TA5y8EEAK4pRrxB9QcA\
-4QBWkj3GCAMUCO/xwBhAI/kEsCagCHDY4AwAC3VA6t4zTAMj0OJAAAAAElFTkSuQmCC"},
-        {"javaArgs", "-Xmx4G -XX:+UnlockExperimentalVMOptions -XX:+UseG1GC -XX:G1NewSizePercent=20 -XX:G1ReservePercent=20 -XX:MaxGCPauseMillis=50 -XX:G1HeapRegionSize=32M"},
-        {"javaDir", get_javaw_path()}
-    };
+    j["profiles"][get_launcher_profile_id(mc_version)] = build_launcher_profile(modded_install_dir, fabric_loader_version, mc_version, profile_name, get_javaw_path());
 
     std::ofstream out(profiles_path);
     if (!out) {
@@ -163,6 +416,50 @@ B6S9IbkEEBfwY49oNj4lgLhA64C0o9R9RABTAvp4SX5kB2TA5y8EEAK4pRrxB9QcA\
     std::cout << "Added/updated Minecraft launcher profile: " << profile_name << std::endl;
 }
 
+// Vendor directories that JDK installers use by default
+std::vector<std::string> get_java_search_paths() {
+    // Program Files may live on another drive; the environment says where
+    std::string program_files = safe_getenv("ProgramFiles");
+    std::string program_files_x86 = safe_getenv("ProgramFiles(x86)");
+    if (program_files.empty()) {
+        program_files = "C:\\Program Files";
+    }
+    if (program_files_x86.empty()) {
+        program_files_x86 = "C:\\Program Files (x86)";
+    }
+    std::vector<std::string> search_paths;
+    for (const std::string& root : { program_files, program_files_x86 }) {
+        for (const char* vendor : { "Java", "Oracle", "Eclipse Adoptium", "Eclipse Foundation" }) {
+            search_paths.push_back(root + "\\" + vendor);
+        }
+    }
+    return search_paths;
+}
+
+// Read the version from the "release" file of the JDK that owns a bin\java(w).exe, without starting a JVM
+std::string read_java_release_version(const std::string& java_exe_path) {
+    size_t bin_pos = java_exe_path.find_last_of("\\");
+    if (bin_pos == std::string::npos) {
+        return "";
+    }
+    size_t home_pos = java_exe_path.find_last_of("\\", bin_pos - 1);
+    if (home_pos == std::string::npos) {
+        return "";
+    }
+    std::ifstream release(java_exe_path.substr(0, home_pos) + "\\release");
+    std::string line;
+    while (std::getline(release, line)) {
+        if (line.rfind("JAVA_VERSION=", 0) == 0) {
+            size_t first_quote = line.find('\"');
+            size_t second_quote = line.find('\"', first_quote + 1);
+            if (first_quote != std::string::npos && second_quote != std::string::npos) {
+                return line.substr(first_quote + 1, second_quote - first_quote - 1);
+            }
+        }
+    }
+    return "";
+}
+
 // Get the installed Java version string
 std::string get_java_version() {
     std::string output = exec("java -version 2>&1");
@@ -186,102 +483,93 @@ std::string get_java_version() {
     return ""; // Return empty if version not found
 }
 
-// Get the full path to javaw.exe from a Java installation that meets the required version
-std::string get_javaw_path() {
-    // First try to find javaw.exe in PATH
-    char buffer[MAX_PATH];
-    DWORD result = SearchPathA(NULL, "javaw.exe", NULL, MAX_PATH, buffer, NULL);
-    if (result > 0 && result < MAX_PATH) {
-        std::string javaw_path = buffer;
-
-        // Verify the version by running javaw -version (redirect to java -version)
-        std::string version_cmd = "\"" + javaw_path + "\" -version 2>&1";
-        std::string output = exec(version_cmd.c_str());
-        if (!output.empty()) {
-            // Parse version from output similar to get_java_version
-            size_t first_line_end = output.find('\n');
-            if (first_line_end == std::string::npos) {
-                first_line_end = output.length();
-            }
-            std::string first_line = output.substr(0, first_line_end);
-
-            size_t first_quote = first_line.find('\"');
-            if (first_quote != std::string::npos) {
-                size_t second_quote = first_line.find('\"', first_quote + 1);
-                if (second_quote != std::string::npos) {
-                    std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
-                    if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
-                        std::cout << "Found suitable javaw.exe in PATH: " << javaw_path << " (version " << version << ")" << std::endl;
-                        return javaw_path;
-                    }
-                }
-            }
-        }
+// Version that "<exe> -version" reports, or "" if it does not run or says something else
+static std::string get_executable_java_version(const std::string& exe_path) {
+    std::string version_cmd = "\"" + exe_path + "\" -version 2>&1";
+    std::string output = exec(version_cmd.c_str());
+    size_t first_line_end = output.find('\n');
+    std::string first_line = output.substr(0, first_line_end);
+    size_t first_quote = first_line.find('\"');
+    if (first_quote == std::string::npos) {
+        return "";
     }
+    size_t second_quote = first_line.find('\"', first_quote + 1);
+    if (second_quote == std::string::npos) {
+        return "";
+    }
+    return first_line.substr(first_quote + 1, second_quote - first_quote - 1);
+}
 
-    // If not found in PATH or version is insufficient, search common installation directories
-    std::vector<std::string> search_paths = {
-        "C:\\Program Files\\Java",
-        "C:\\Program Files\\Oracle",
-        "C:\\Program Files\\Eclipse Adoptium",
-        "C:\\Program Files\\Eclipse Foundation",
-        "C:\\Program Files (x86)\\Java",
-        "C:\\Program Files (x86)\\Oracle",
-        "C:\\Program Files (x86)\\Eclipse Adoptium",
-        "C:\\Program Files (x86)\\Eclipse Foundation"
-    };
-
-    for (const std::string& base_path : search_paths) {
+// Every copy of exe_name ("java.exe", "javaw.exe") worth asking for its version: the one on PATH
+// first, then those under the usual installation directories, in the order they are found
+std::vector<std::string> find_java_executables(const std::string& exe_name, bool& first_on_path) {
+    std::vector<std::string> candidates;
+    char buffer[MAX_PATH];
+    DWORD result = SearchPathA(NULL, exe_name.c_str(), NULL, MAX_PATH, buffer, NULL);
+    first_on_path = result > 0 && result < MAX_PATH;
+    if (first_on_path) {
+        candidates.push_back(buffer);
+    }
+    for (const std::string& base_path : get_java_search_paths()) {
         WIN32_FIND_DATAA findFileData;
         HANDLE hFind = FindFirstFileA((base_path + "\\*").c_str(), &findFileData);
-
-        if (hFind != INVALID_HANDLE_VALUE) {
-            do {
-                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                    std::string dir_name = findFileData.cFileName;
-                    if (dir_name != "." && dir_name != "..") {
-                        std::string java_dir = base_path + "\\" + dir_name;
-                        std::string javaw_path = java_dir + "\\bin\\javaw.exe";
-
-                        // Check if javaw.exe exists
-                        std::ifstream file(javaw_path);
-                        if (file.good()) {
-                            file.close();
-
-                            // Test version
-                            std::string version_cmd = "\"" + javaw_path + "\" -version 2>&1";
-                            std::string output = exec(version_cmd.c_str());
-                            if (!output.empty()) {
-                                // Parse version
-                                size_t first_line_end = output.find('\n');
-                                if (first_line_end == std::string::npos) {
-                                    first_line_end = output.length();
-                                }
-                                std::string first_line = output.substr(0, first_line_end);
-
-                                size_t first_quote = first_line.find('\"');
-                                if (first_quote != std::string::npos) {
-                                    size_t second_quote = first_line.find('\"', first_quote + 1);
-                                    if (second_quote != std::string::npos) {
-                                        std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
-                                        if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
-                                            std::cout << "Found suitable javaw.exe: " << javaw_path << " (version " << version << ")" << std::endl;
-                                            FindClose(hFind);
-                                            return javaw_path;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
+        count_event("directory_scans");
+        if (hFind == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        do {
+            std::string dir_name = findFileData.cFileName;
+            if ((findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && dir_name != "." && dir_name != "..") {
+                std::string exe_path = base_path + "\\" + dir_name + "\\bin\\" + exe_name;
+                if (std::ifstream(exe_path).good()) {
+                    candidates.push_back(exe_path);
                 }
-            } while (FindNextFileA(hFind, &findFileData) != 0);
-            FindClose(hFind);
+            }
+        } while (FindNextFileA(hFind, &findFileData) != 0);
+        FindClose(hFind);
+    }
+    return candidates;
+}
+
+// Index of the first candidate that reports at least REQUIRED_JAVA_VERSION, or -1. Each check
+// starts a JVM and mostly waits for it, so they run side by side in the executor's I/O lane; the
+// answer still follows the order of the candidates, and checks not started by the time one
+// qualifies are dropped.
+int pick_java_executable(const std::vector<std::string>& candidates, std::string& version) {
+    std::vector<std::string> versions(candidates.size());
+    TaskGroup group(TaskLane::Io);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        group.run([&group, &candidates, &versions, i] {
+            std::string found = get_executable_java_version(candidates[i]);
+            if (!found.empty() && is_version_greater_or_equal(found, REQUIRED_JAVA_VERSION)) {
+                group.cancel();
+            }
+            versions[i] = found;
+        });
+    }
+    group.wait();
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (!versions[i].empty() && is_version_greater_or_equal(versions[i], REQUIRED_JAVA_VERSION)) {
+            version = versions[i];
+            return static_cast<int>(i);
         }
     }
+    return -1;
+}
 
-    std::cout << "Could not find javaw.exe with version " << REQUIRED_JAVA_VERSION << " or newer." << std::endl;
-    return ""; // Return empty string if not found
+// Get the full path to javaw.exe from a Java installation that meets the required version
+std::string get_javaw_path() {
+    PhaseScope phase("discovery");
+    bool first_on_path = false;
+    std::vector<std::string> candidates = find_java_executables("javaw.exe", first_on_path);
+    std::string version;
+    int found = pick_java_executable(candidates, version);
+    if (found < 0) {
+        std::cout << "Could not find javaw.exe with version " << REQUIRED_JAVA_VERSION << " or newer." << std::endl;
+        return "";
+    }
+    std::cout << "Found suitable javaw.exe" << (found == 0 && first_on_path ? " in PATH" : "") << ": " << candidates[found] << " (version " << version << ")" << std::endl;
+    return candidates[found];
 }
 
 
@@ -307,4 +595,120 @@ bool is_version_greater_or_equal(const std::string& installed_version, const std
         if (inst_parts[i] < req_parts[i]) return false;
     }
     return true; // Versions are equal
-}
\ No newline at end of file
+}
+
+// Find the newest-enough fabric-loader-<version>-<mcversion> directory; returns its loader version or ""
+std::string find_installed_fabric_loader(const std::string& minecraft_dir, const std::string& mcversion, const std::string& required_loader_version) {
+    std::string versions_dir = minecraft_dir + "\\versions";
+    WIN32_FIND_DATAA findFileData;
+    HANDLE hFind = FindFirstFileA((versions_dir + "\\fabric-loader-*").c_str(), &findFileData);
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return "";
+    }
+
+    std::string prefix = "fabric-loader-";
+    std::string suffix = "-" + mcversion;
+    do {
+        if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            std::string dirname = findFileData.cFileName;
+            if (dirname.rfind(prefix, 0) == 0 && dirname.size() > suffix.size() && dirname.substr(dirname.size() - suffix.size()) == suffix) {
+                std::string installed_loader_version = dirname.substr(prefix.size(), dirname.size() - prefix.size() - suffix.size());
+                if (is_version_greater_or_equal(installed_loader_version, required_loader_version)) {
+                    FindClose(hFind);
+                    return installed_loader_version;
+                }
+            }
+        }
+    } while (FindNextFileA(hFind, &findFileData) != 0);
+
+    FindClose(hFind);
+    return "";
+}
+
+// Check whether a file (not a directory) exists
+bool file_exists(const std::string& path) {
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+// Recursively list the regular files under a directory, with paths relative to it
+std::vector<FileInfo> list_files_recursive(const std::string& root) {
+    std::vector<FileInfo> files;
+    std::vector<std::string> pending = { "" };
+    while (!pending.empty()) {
+        std::string relative_dir = pending.back();
+        pending.pop_back();
+        std::string dir = relative_dir.empty() ? root : root + "\\" + relative_dir;
+
+        WIN32_FIND_DATAA findFileData;
+        HANDLE hFind = FindFirstFileA((dir + "\\*").c_str(), &findFileData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        do {
+            std::string name = findFileData.cFileName;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string relative_path = relative_dir.empty() ? name : relative_dir + "\\" + name;
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                pending.push_back(relative_path);
+            } else {
+                FileInfo info;
+                info.relative_path = relative_path;
+                info.size = (static_cast<unsigned long long>(findFileData.nFileSizeHigh) << 32) | findFileData.nFileSizeLow;
+                info.last_write_time = (static_cast<unsigned long long>(findFileData.ftLastWriteTime.dwHighDateTime) << 32) | findFileData.ftLastWriteTime.dwLowDateTime;
+                files.push_back(info);
+            }
+        } while (FindNextFileA(hFind, &findFileData) != 0);
+        FindClose(hFind);
+    }
+    return files;
+}
+
+// Size and last write time of a regular file; false if it does not exist
+bool get_file_info(const std::string& path, FileInfo& info) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes) || (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    info.size = (static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    info.last_write_time = (static_cast<unsigned long long>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+// Size of a file in bytes, or -1 if it does not exist
+long long get_file_size(const std::string& path) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes) || (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return -1;
+    }
+    return (static_cast<long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+}
+
+// Directory part of a path ("" when there is none)
+std::string parent_directory(const std::string& path) {
+    size_t pos = path.find_last_of("\\/");
+    return pos == std::string::npos ? "" : path.substr(0, pos);
+}
+
+// Per-user cache for downloaded content, kept out of TEMP so cleanup tools leave it alone
+std::string get_cache_dir() {
+    return safe_getenv("LOCALAPPDATA") + "\\mc-mod-installer\\cache";
+}
+
+// Where the modpack archive lives: a local path is used as is, URLs are downloaded into the
+// shared downloads directory next to the store
+std::string get_modpack_archive_path(const std::string& modpack_url) {
+    if (file_exists(modpack_url)) {
+        return modpack_url;
+    }
+    if (modpack_url == MODPACK_URL) {
+        return get_shared_download_path(MODPACK_ZIP_FILENAME);
+    }
+    // Other packs get a name derived from their URL so switching packs never reuses a stale archive
+    Sha1 url_hash;
+    url_hash.update(modpack_url.data(), modpack_url.size());
+    return get_shared_download_path("modpack-" + url_hash.hex_digest().substr(0, 12) + ".zip");
+}
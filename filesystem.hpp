@@ -1,18 +1,41 @@
 #ifndef FILE_SYSTEM_H
 #define FILE_SYSTEM_H
 
+#include "download.hpp"
+#include "json.hpp"
+
 #include <string>
 #include <vector>
 
+// A regular file found while walking a directory tree
+struct FileInfo {
+    std::string relative_path;
+    unsigned long long size = 0;
+    unsigned long long last_write_time = 0;   // FILETIME ticks
+};
 
 std::vector<std::string> split_path(const std::string& path, char delimiter);
 std::string exec(const char* cmd);
 void create_directory(const std::string& path);
 std::string safe_getenv(const char* var);
-void download_file(const std::string& url, const std::string& output_path);
+void download_file(const std::string& url, const std::string& output_path, const ExpectedHashes& expected = ExpectedHashes());
+std::string get_launcher_profile_id(const std::string& mc_version);
+nlohmann::json build_launcher_profile(const std::string& modded_install_dir, const std::string& fabric_loader_version, const std::string& mc_version, const std::string& profile_name, const std::string& javaw_path);
 void add_minecraft_launcher_profile(const std::string& minecraft_dir, const std::string& modded_install_dir, const std::string& fabric_loader_version, const std::string& mc_version, const std::string& profile_name);
 std::string get_java_version();
 std::string get_javaw_path();
+std::vector<std::string> get_java_search_paths();
+std::vector<std::string> find_java_executables(const std::string& exe_name, bool& first_on_path);
+int pick_java_executable(const std::vector<std::string>& candidates, std::string& version);
+std::string read_java_release_version(const std::string& java_exe_path);
 bool is_version_greater_or_equal(const std::string& installed_version, const std::string& required_version);
+std::string find_installed_fabric_loader(const std::string& minecraft_dir, const std::string& mcversion, const std::string& required_loader_version);
+bool file_exists(const std::string& path);
+std::vector<FileInfo> list_files_recursive(const std::string& root);
+bool get_file_info(const std::string& path, FileInfo& info);
+long long get_file_size(const std::string& path);
+std::string parent_directory(const std::string& path);
+std::string get_cache_dir();
+std::string get_modpack_archive_path(const std::string& modpack_url);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,798 @@
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define HASH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HASH_TARGET(features)
+#else
+#include <cpuid.h>
+#define HASH_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+
+static inline uint32_t rotl32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint64_t rotr64(uint64_t x, int n) {
+    return (x >> n) | (x << (64 - n));
+}
+
+static inline uint32_t load_be32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint64_t load_be64(const unsigned char* p) {
+    return (static_cast<uint64_t>(load_be32(p)) << 32) | load_be32(p + 4);
+}
+
+std::string to_hex(const unsigned char* bytes, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(len * 2, '0');
+    for (size_t i = 0; i < len; ++i) {
+        hex[i * 2] = digits[bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[bytes[i] & 0x0f];
+    }
+    return hex;
+}
+
+// Shared Merkle-Damgard buffering: feed whole blocks to compress(), keep the tail
+template <size_t BlockSize, typename Compress>
+static void buffer_blocks(unsigned char* block, size_t& block_len, const unsigned char* data, size_t len, Compress compress) {
+    if (block_len > 0) {
+        size_t take = std::min(len, BlockSize - block_len);
+        std::memcpy(block + block_len, data, take);
+        block_len += take;
+        data += take;
+        len -= take;
+        if (block_len < BlockSize) {
+            return;
+        }
+        compress(block, 1);
+        block_len = 0;
+    }
+    size_t blocks = len / BlockSize;
+    if (blocks > 0) {
+        compress(data, blocks);
+        data += blocks * BlockSize;
+        len -= blocks * BlockSize;
+    }
+    if (len > 0) {
+        std::memcpy(block, data, len);
+        block_len = len;
+    }
+}
+
+// SHA-1
+
+static void sha1_compress_scalar(uint32_t state[5], const unsigned char* data, size_t blocks) {
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + i * 4);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        // One loop per round function keeps the selection out of the hot loop
+        for (int i = 0; i < 20; ++i) {
+            uint32_t t = rotl32(a, 5) + ((b & c) | (~b & d)) + e + 0x5a827999 + w[i];
+            e = d; d = c; c = rotl32(b, 30); b = a; a = t;
+        }
+        for (int i = 20; i < 40; ++i) {
+            uint32_t t = rotl32(a, 5) + (b ^ c ^ d) + e + 0x6ed9eba1 + w[i];
+            e = d; d = c; c = rotl32(b, 30); b = a; a = t;
+        }
+        for (int i = 40; i < 60; ++i) {
+            uint32_t t = rotl32(a, 5) + ((b & c) | (b & d) | (c & d)) + e + 0x8f1bbcdc + w[i];
+            e = d; d = c; c = rotl32(b, 30); b = a; a = t;
+        }
+        for (int i = 60; i < 80; ++i) {
+            uint32_t t = rotl32(a, 5) + (b ^ c ^ d) + e + 0xca62c1d6 + w[i];
+            e = d; d = c; c = rotl32(b, 30); b = a; a = t;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+    }
+}
+
+#ifdef HASH_X86
+// SHA-NI: four rounds per instruction. E alternates between two registers and the message
+// schedule rotates through four, so every group is the same step with compile-time indices:
+// m holds words 4G..4G+3 and next/after/prev are the schedule registers that follow it.
+template <int G>
+HASH_TARGET("sha,sse4.1")
+static inline void sha1_shani_group(__m128i& abcd, __m128i& e, __m128i& e_other, __m128i& m, __m128i& next, __m128i& after, __m128i& prev) {
+    e = G == 0 ? _mm_add_epi32(e, m) : _mm_sha1nexte_epu32(e, m);
+    e_other = abcd;
+    if (G >= 3 && G <= 18) {
+        next = _mm_sha1msg2_epu32(next, m);
+    }
+    abcd = _mm_sha1rnds4_epu32(abcd, e, G / 5);
+    if (G >= 1 && G <= 16) {
+        prev = _mm_sha1msg1_epu32(prev, m);
+    }
+    if (G >= 2 && G <= 17) {
+        after = _mm_xor_si128(after, m);
+    }
+}
+
+HASH_TARGET("sha,sse4.1")
+static void sha1_compress_shani(uint32_t state[5], const unsigned char* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+    __m128i e1;
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abcd_save = abcd;
+        __m128i e0_save = e0;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), byte_swap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), byte_swap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), byte_swap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), byte_swap);
+        sha1_shani_group<0>(abcd, e0, e1, m0, m1, m2, m3);
+        sha1_shani_group<1>(abcd, e1, e0, m1, m2, m3, m0);
+        sha1_shani_group<2>(abcd, e0, e1, m2, m3, m0, m1);
+        sha1_shani_group<3>(abcd, e1, e0, m3, m0, m1, m2);
+        sha1_shani_group<4>(abcd, e0, e1, m0, m1, m2, m3);
+        sha1_shani_group<5>(abcd, e1, e0, m1, m2, m3, m0);
+        sha1_shani_group<6>(abcd, e0, e1, m2, m3, m0, m1);
+        sha1_shani_group<7>(abcd, e1, e0, m3, m0, m1, m2);
+        sha1_shani_group<8>(abcd, e0, e1, m0, m1, m2, m3);
+        sha1_shani_group<9>(abcd, e1, e0, m1, m2, m3, m0);
+        sha1_shani_group<10>(abcd, e0, e1, m2, m3, m0, m1);
+        sha1_shani_group<11>(abcd, e1, e0, m3, m0, m1, m2);
+        sha1_shani_group<12>(abcd, e0, e1, m0, m1, m2, m3);
+        sha1_shani_group<13>(abcd, e1, e0, m1, m2, m3, m0);
+        sha1_shani_group<14>(abcd, e0, e1, m2, m3, m0, m1);
+        sha1_shani_group<15>(abcd, e1, e0, m3, m0, m1, m2);
+        sha1_shani_group<16>(abcd, e0, e1, m0, m1, m2, m3);
+        sha1_shani_group<17>(abcd, e1, e0, m1, m2, m3, m0);
+        sha1_shani_group<18>(abcd, e0, e1, m2, m3, m0, m1);
+        sha1_shani_group<19>(abcd, e1, e0, m3, m0, m1, m2);
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+#endif
+
+#ifdef HASH_X86
+HASH_TARGET("avx2")
+static inline __m256i rotl_x8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+// Multi-buffer AVX2: eight independent messages, one per 32-bit lane, advanced by the same number
+// of blocks. state is word-major (state[word][lane]) so each word loads as one register.
+HASH_TARGET("avx2")
+static void sha1_compress_x8_avx2(uint32_t state[5][8], const unsigned char* const data[8], size_t blocks) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[0]));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[1]));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[2]));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[3]));
+    __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[4]));
+
+    for (size_t block = 0; block < blocks; ++block) {
+        size_t offset = block * 64;
+        __m256i w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = _mm256_setr_epi32(
+                static_cast<int>(load_be32(data[0] + offset + i * 4)), static_cast<int>(load_be32(data[1] + offset + i * 4)),
+                static_cast<int>(load_be32(data[2] + offset + i * 4)), static_cast<int>(load_be32(data[3] + offset + i * 4)),
+                static_cast<int>(load_be32(data[4] + offset + i * 4)), static_cast<int>(load_be32(data[5] + offset + i * 4)),
+                static_cast<int>(load_be32(data[6] + offset + i * 4)), static_cast<int>(load_be32(data[7] + offset + i * 4)));
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl_x8(_mm256_xor_si256(_mm256_xor_si256(w[i - 3], w[i - 8]), _mm256_xor_si256(w[i - 14], w[i - 16])), 1);
+        }
+
+        __m256i a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+        const __m256i k0 = _mm256_set1_epi32(0x5a827999), k1 = _mm256_set1_epi32(0x6ed9eba1);
+        const __m256i k2 = _mm256_set1_epi32(static_cast<int>(0x8f1bbcdc)), k3 = _mm256_set1_epi32(static_cast<int>(0xca62c1d6));
+        for (int i = 0; i < 20; ++i) {
+            __m256i f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+            __m256i t = _mm256_add_epi32(_mm256_add_epi32(rotl_x8(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k0), w[i]));
+            e = d; d = c; c = rotl_x8(b, 30); b = a; a = t;
+        }
+        for (int i = 20; i < 40; ++i) {
+            __m256i f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+            __m256i t = _mm256_add_epi32(_mm256_add_epi32(rotl_x8(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k1), w[i]));
+            e = d; d = c; c = rotl_x8(b, 30); b = a; a = t;
+        }
+        for (int i = 40; i < 60; ++i) {
+            __m256i f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+            __m256i t = _mm256_add_epi32(_mm256_add_epi32(rotl_x8(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k2), w[i]));
+            e = d; d = c; c = rotl_x8(b, 30); b = a; a = t;
+        }
+        for (int i = 60; i < 80; ++i) {
+            __m256i f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+            __m256i t = _mm256_add_epi32(_mm256_add_epi32(rotl_x8(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k3), w[i]));
+            e = d; d = c; c = rotl_x8(b, 30); b = a; a = t;
+        }
+        a = _mm256_add_epi32(a, a0); b = _mm256_add_epi32(b, b0); c = _mm256_add_epi32(c, c0);
+        d = _mm256_add_epi32(d, d0); e = _mm256_add_epi32(e, e0);
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[0]), a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[1]), b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[2]), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[3]), d);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[4]), e);
+}
+#endif
+
+// SHA-256
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// The 64 rounds over an expanded schedule with the round constants already added (wk[i * stride]);
+// shared by the scalar and AVX2 kernels
+static void sha256_rounds(uint32_t state[8], const uint32_t* wk, size_t stride) {
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + wk[i * stride];
+        uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256_compress_scalar(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + i * 4);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        for (int i = 0; i < 64; ++i) {
+            w[i] += SHA256_K[i];
+        }
+        sha256_rounds(state, w, 1);
+    }
+}
+
+#ifdef HASH_X86
+// SHA-NI: two rounds per instruction on the state split as ABEF / CDGH. As with SHA-1, each
+// group of four rounds is one step over the rotating schedule registers.
+template <int G>
+HASH_TARGET("sha,sse4.1")
+static inline void sha256_shani_group(__m128i& state0, __m128i& state1, __m128i& m, __m128i& next, __m128i& prev) {
+    __m128i wk = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHA256_K + G * 4)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+    if (G >= 3 && G <= 14) {
+        next = _mm_add_epi32(next, _mm_alignr_epi8(m, prev, 4));
+        next = _mm_sha256msg2_epu32(next, m);
+    }
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0e));
+    if (G >= 1 && G <= 12) {
+        prev = _mm_sha256msg1_epu32(prev, m);
+    }
+}
+
+HASH_TARGET("sha,sse4.1")
+static void sha256_compress_shani(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), byte_swap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), byte_swap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), byte_swap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), byte_swap);
+        sha256_shani_group<0>(state0, state1, m0, m1, m3);
+        sha256_shani_group<1>(state0, state1, m1, m2, m0);
+        sha256_shani_group<2>(state0, state1, m2, m3, m1);
+        sha256_shani_group<3>(state0, state1, m3, m0, m2);
+        sha256_shani_group<4>(state0, state1, m0, m1, m3);
+        sha256_shani_group<5>(state0, state1, m1, m2, m0);
+        sha256_shani_group<6>(state0, state1, m2, m3, m1);
+        sha256_shani_group<7>(state0, state1, m3, m0, m2);
+        sha256_shani_group<8>(state0, state1, m0, m1, m3);
+        sha256_shani_group<9>(state0, state1, m1, m2, m0);
+        sha256_shani_group<10>(state0, state1, m2, m3, m1);
+        sha256_shani_group<11>(state0, state1, m3, m0, m2);
+        sha256_shani_group<12>(state0, state1, m0, m1, m3);
+        sha256_shani_group<13>(state0, state1, m1, m2, m0);
+        sha256_shani_group<14>(state0, state1, m2, m3, m1);
+        sha256_shani_group<15>(state0, state1, m3, m0, m2);
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+// AVX2: the rounds are inherently serial, but the message schedules of eight consecutive blocks
+// are independent of the state, so they are expanded together with one block per lane
+HASH_TARGET("avx2")
+static void sha256_compress_avx2(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    for (; blocks >= 8; blocks -= 8, data += 8 * 64) {
+        __m256i w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = _mm256_setr_epi32(
+                static_cast<int>(load_be32(data + i * 4)), static_cast<int>(load_be32(data + 64 + i * 4)),
+                static_cast<int>(load_be32(data + 128 + i * 4)), static_cast<int>(load_be32(data + 192 + i * 4)),
+                static_cast<int>(load_be32(data + 256 + i * 4)), static_cast<int>(load_be32(data + 320 + i * 4)),
+                static_cast<int>(load_be32(data + 384 + i * 4)), static_cast<int>(load_be32(data + 448 + i * 4)));
+        }
+        for (int i = 16; i < 64; ++i) {
+            __m256i x = w[i - 15];
+            __m256i y = w[i - 2];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(
+                _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 25)),
+                _mm256_or_si256(_mm256_srli_epi32(x, 18), _mm256_slli_epi32(x, 14))), _mm256_srli_epi32(x, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(
+                _mm256_or_si256(_mm256_srli_epi32(y, 17), _mm256_slli_epi32(y, 15)),
+                _mm256_or_si256(_mm256_srli_epi32(y, 19), _mm256_slli_epi32(y, 13))), _mm256_srli_epi32(y, 10));
+            w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0), _mm256_add_epi32(w[i - 7], s1));
+        }
+        alignas(32) uint32_t lanes[64][8];
+        for (int i = 0; i < 64; ++i) {
+            __m256i k = _mm256_set1_epi32(static_cast<int>(SHA256_K[i]));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[i]), _mm256_add_epi32(w[i], k));
+        }
+        for (int b = 0; b < 8; ++b) {
+            sha256_rounds(state, &lanes[0][b], 8);
+        }
+    }
+    sha256_compress_scalar(state, data, blocks);
+}
+#endif
+
+// SHA-512
+
+static const uint64_t SHA512_K[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+    0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+    0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+    0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+    0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+    0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+// The 80 rounds over an expanded schedule with the round constants already added (wk[i * stride]);
+// shared by the scalar and AVX2 kernels
+static void sha512_rounds(uint64_t state[8], const uint64_t* wk, size_t stride) {
+    uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 80; ++i) {
+        uint64_t s1 = rotr64(e, 14) ^ rotr64(e, 18) ^ rotr64(e, 41);
+        uint64_t ch = (e & f) ^ (~e & g);
+        uint64_t t1 = h + s1 + ch + wk[i * stride];
+        uint64_t s0 = rotr64(a, 28) ^ rotr64(a, 34) ^ rotr64(a, 39);
+        uint64_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint64_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha512_compress_scalar(uint64_t state[8], const unsigned char* data, size_t blocks) {
+    for (; blocks > 0; --blocks, data += 128) {
+        uint64_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be64(data + i * 8);
+        }
+        for (int i = 16; i < 80; ++i) {
+            uint64_t s0 = rotr64(w[i - 15], 1) ^ rotr64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+            uint64_t s1 = rotr64(w[i - 2], 19) ^ rotr64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        for (int i = 0; i < 80; ++i) {
+            w[i] += SHA512_K[i];
+        }
+        sha512_rounds(state, w, 1);
+    }
+}
+
+#ifdef HASH_X86
+// AVX2: the same lane-per-block schedule expansion as SHA-256, four blocks of 64-bit words
+HASH_TARGET("avx2")
+static void sha512_compress_avx2(uint64_t state[8], const unsigned char* data, size_t blocks) {
+    for (; blocks >= 4; blocks -= 4, data += 4 * 128) {
+        __m256i w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = _mm256_setr_epi64x(
+                static_cast<long long>(load_be64(data + i * 8)), static_cast<long long>(load_be64(data + 128 + i * 8)),
+                static_cast<long long>(load_be64(data + 256 + i * 8)), static_cast<long long>(load_be64(data + 384 + i * 8)));
+        }
+        for (int i = 16; i < 80; ++i) {
+            __m256i x = w[i - 15];
+            __m256i y = w[i - 2];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(
+                _mm256_or_si256(_mm256_srli_epi64(x, 1), _mm256_slli_epi64(x, 63)),
+                _mm256_or_si256(_mm256_srli_epi64(x, 8), _mm256_slli_epi64(x, 56))), _mm256_srli_epi64(x, 7));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(
+                _mm256_or_si256(_mm256_srli_epi64(y, 19), _mm256_slli_epi64(y, 45)),
+                _mm256_or_si256(_mm256_srli_epi64(y, 61), _mm256_slli_epi64(y, 3))), _mm256_srli_epi64(y, 6));
+            w[i] = _mm256_add_epi64(_mm256_add_epi64(w[i - 16], s0), _mm256_add_epi64(w[i - 7], s1));
+        }
+        alignas(32) uint64_t lanes[80][4];
+        for (int i = 0; i < 80; ++i) {
+            __m256i k = _mm256_set1_epi64x(static_cast<long long>(SHA512_K[i]));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[i]), _mm256_add_epi64(w[i], k));
+        }
+        for (int b = 0; b < 4; ++b) {
+            sha512_rounds(state, &lanes[0][b], 4);
+        }
+    }
+    sha512_compress_scalar(state, data, blocks);
+}
+#endif
+
+// Kernel selection
+
+#ifdef HASH_X86
+static void cpuid(int leaf, int subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = static_cast<unsigned>(r[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// AVX2 also needs the OS to save YMM state across context switches (OSXSAVE + XCR0)
+HASH_TARGET("xsave")
+static bool os_saves_ymm() {
+    return (_xgetbv(0) & 6) == 6;
+}
+#endif
+
+static HashKernels select_hash_kernels() {
+    HashKernels kernels = { sha1_compress_scalar, nullptr, sha256_compress_scalar, sha512_compress_scalar, "scalar", "scalar", "scalar" };
+#ifdef HASH_X86
+    unsigned leaf0[4], leaf1[4], leaf7[4] = { 0, 0, 0, 0 };
+    cpuid(0, 0, leaf0);
+    cpuid(1, 0, leaf1);
+    if (leaf0[0] >= 7) {
+        cpuid(7, 0, leaf7);
+    }
+    bool sse41 = (leaf1[2] >> 19) & 1;
+    bool sha = (leaf7[1] >> 29) & 1;
+    bool avx2 = ((leaf7[1] >> 5) & 1) && ((leaf1[2] >> 27) & 1) && os_saves_ymm();
+    if (sha && sse41) {
+        kernels.sha1 = sha1_compress_shani;
+        kernels.sha256 = sha256_compress_shani;
+        kernels.sha1_name = kernels.sha256_name = "sha-ni";
+    } else if (avx2) {
+        // Without SHA-NI, hashing eight files side by side beats hashing them one at a time
+        kernels.sha1_x8 = sha1_compress_x8_avx2;
+        kernels.sha256 = sha256_compress_avx2;
+        kernels.sha256_name = "avx2";
+    }
+    if (avx2) {
+        kernels.sha512 = sha512_compress_avx2;
+        kernels.sha512_name = "avx2";
+    }
+#endif
+    return kernels;
+}
+
+// Chosen once, on first use
+const HashKernels& hash_kernels() {
+    static const HashKernels kernels = select_hash_kernels();
+    return kernels;
+}
+
+// Incremental hashers
+
+Sha1::Sha1() {
+    static const uint32_t init[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    std::memcpy(state_, init, sizeof(state_));
+}
+
+void Sha1::update(const void* data, size_t len) {
+    length_ += len;
+    uint32_t* state = state_;
+    buffer_blocks<64>(block_, block_len_, static_cast<const unsigned char*>(data), len,
+        [state](const unsigned char* p, size_t n) { hash_kernels().sha1(state, p, n); });
+}
+
+std::string Sha1::hex_digest() {
+    uint64_t bit_length = length_ * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t pad_len = (block_len_ < 56 ? 56 : 120) - block_len_;
+    for (int i = 0; i < 8; ++i) {
+        pad[pad_len + i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+    }
+    update(pad, pad_len + 8);
+
+    unsigned char digest[20];
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<unsigned char>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(state_[i]);
+    }
+    return to_hex(digest, sizeof(digest));
+}
+
+Sha256::Sha256() {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(state_, init, sizeof(state_));
+}
+
+void Sha256::update(const void* data, size_t len) {
+    length_ += len;
+    uint32_t* state = state_;
+    buffer_blocks<64>(block_, block_len_, static_cast<const unsigned char*>(data), len,
+        [state](const unsigned char* p, size_t n) { hash_kernels().sha256(state, p, n); });
+}
+
+std::string Sha256::hex_digest() {
+    uint64_t bit_length = length_ * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t pad_len = (block_len_ < 56 ? 56 : 120) - block_len_;
+    for (int i = 0; i < 8; ++i) {
+        pad[pad_len + i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+    }
+    update(pad, pad_len + 8);
+
+    unsigned char digest[32];
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = static_cast<unsigned char>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(state_[i]);
+    }
+    return to_hex(digest, sizeof(digest));
+}
+
+Sha512::Sha512() {
+    static const uint64_t init[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+    };
+    std::memcpy(state_, init, sizeof(state_));
+}
+
+void Sha512::update(const void* data, size_t len) {
+    length_ += len;
+    uint64_t* state = state_;
+    buffer_blocks<128>(block_, block_len_, static_cast<const unsigned char*>(data), len,
+        [state](const unsigned char* p, size_t n) { hash_kernels().sha512(state, p, n); });
+}
+
+std::string Sha512::hex_digest() {
+    // Message lengths here never exceed 2^64 bits, so the upper half of the 128-bit length is zero
+    uint64_t bit_length = length_ * 8;
+    unsigned char pad[144] = { 0x80 };
+    size_t pad_len = (block_len_ < 112 ? 112 : 240) - block_len_;
+    for (int i = 0; i < 8; ++i) {
+        pad[pad_len + 8 + i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+    }
+    update(pad, pad_len + 16);
+
+    unsigned char digest[64];
+    for (int i = 0; i < 8; ++i) {
+        for (int b = 0; b < 8; ++b) {
+            digest[i * 8 + b] = static_cast<unsigned char>(state_[i] >> (56 - 8 * b));
+        }
+    }
+    return to_hex(digest, sizeof(digest));
+}
+
+template <typename Hasher>
+static std::string hash_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return "";
+    }
+    Hasher hasher;
+    std::vector<char> buffer(256 * 1024);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = in.gcount();
+        if (got > 0) {
+            hasher.update(buffer.data(), static_cast<size_t>(got));
+        }
+    }
+    return hasher.hex_digest();
+}
+
+// Hex SHA-1 of a whole file, or "" if it cannot be read
+std::string sha1_file(const std::string& path) {
+    return hash_file<Sha1>(path);
+}
+
+// Hex SHA-256 of a whole file, or "" if it cannot be read
+std::string sha256_file(const std::string& path) {
+    return hash_file<Sha256>(path);
+}
+
+// One message being hashed in a lane of the multi-buffer kernel
+struct Sha1Lane {
+    std::ifstream in;
+    size_t index = 0;                  // position in paths/digests
+    bool active = false;
+    bool padded = false;               // the final padding has been appended to buffer
+    uint64_t length = 0;
+    std::vector<unsigned char> buffer;
+    size_t pos = 0;                    // first unhashed byte of buffer
+
+    size_t available_blocks() const { return (buffer.size() - pos) / 64; }
+};
+
+// Top up a lane so it has at least one whole block, appending the padding at end of file
+static void fill_sha1_lane(Sha1Lane& lane) {
+    const size_t read_size = 256 * 1024;
+    if (lane.padded || lane.available_blocks() > 0) {
+        return;
+    }
+    lane.buffer.erase(lane.buffer.begin(), lane.buffer.begin() + static_cast<std::ptrdiff_t>(lane.pos));
+    lane.pos = 0;
+    size_t old_size = lane.buffer.size();
+    lane.buffer.resize(old_size + read_size);
+    lane.in.read(reinterpret_cast<char*>(lane.buffer.data() + old_size), static_cast<std::streamsize>(read_size));
+    size_t got = static_cast<size_t>(lane.in.gcount());
+    lane.buffer.resize(old_size + got);
+    lane.length += got;
+    if (got < read_size) {
+        uint64_t bit_length = lane.length * 8;
+        size_t tail = lane.buffer.size() % 64;
+        lane.buffer.push_back(0x80);
+        lane.buffer.resize(lane.buffer.size() + (tail < 56 ? 55 - tail : 119 - tail), 0);
+        for (int i = 0; i < 8; ++i) {
+            lane.buffer.push_back(static_cast<unsigned char>(bit_length >> (56 - 8 * i)));
+        }
+        lane.padded = true;
+    }
+}
+
+// Hex SHA-1 of each file ("" if unreadable). With a multi-buffer kernel, up to eight files are in
+// flight at once and a lane is refilled with the next file as soon as its message is finished.
+std::vector<std::string> sha1_files(const std::vector<std::string>& paths) {
+    std::vector<std::string> digests(paths.size());
+    const HashKernels& kernels = hash_kernels();
+    if (!kernels.sha1_x8) {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            digests[i] = sha1_file(paths[i]);
+        }
+        return digests;
+    }
+
+    static const uint32_t init[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    Sha1Lane lanes[8];
+    uint32_t state[5][8];
+    std::vector<unsigned char> idle(256 * 1024 + 192, 0);   // stands in for empty lanes
+    size_t next_path = 0;
+
+    for (;;) {
+        size_t active = 0;
+        for (int l = 0; l < 8; ++l) {
+            Sha1Lane& lane = lanes[l];
+            while (!lane.active && next_path < paths.size()) {
+                lane.index = next_path++;
+                lane.in.close();
+                lane.in.clear();
+                lane.in.open(paths[lane.index], std::ios::binary);
+                if (!lane.in) {
+                    continue;
+                }
+                lane.active = true;
+                lane.padded = false;
+                lane.length = 0;
+                lane.buffer.clear();
+                lane.pos = 0;
+                for (int w = 0; w < 5; ++w) {
+                    state[w][l] = init[w];
+                }
+            }
+            if (lane.active) {
+                fill_sha1_lane(lane);
+                active++;
+            }
+        }
+        if (active == 0) {
+            break;
+        }
+
+        size_t blocks = SIZE_MAX;
+        const unsigned char* data[8];
+        int only_lane = -1;
+        for (int l = 0; l < 8; ++l) {
+            if (lanes[l].active) {
+                blocks = std::min(blocks, lanes[l].available_blocks());
+                data[l] = lanes[l].buffer.data() + lanes[l].pos;
+                only_lane = l;
+            } else {
+                data[l] = idle.data();
+            }
+        }
+        if (active == 1) {
+            // A lone message runs faster through the single-buffer kernel
+            Sha1Lane& lane = lanes[only_lane];
+            blocks = lane.available_blocks();
+            uint32_t single[5];
+            for (int w = 0; w < 5; ++w) {
+                single[w] = state[w][only_lane];
+            }
+            kernels.sha1(single, data[only_lane], blocks);
+            for (int w = 0; w < 5; ++w) {
+                state[w][only_lane] = single[w];
+            }
+        } else {
+            kernels.sha1_x8(state, data, blocks);
+        }
+
+        for (int l = 0; l < 8; ++l) {
+            Sha1Lane& lane = lanes[l];
+            if (!lane.active) {
+                continue;
+            }
+            lane.pos += blocks * 64;
+            if (lane.padded && lane.pos == lane.buffer.size()) {
+                unsigned char digest[20];
+                for (int w = 0; w < 5; ++w) {
+                    for (int b = 0; b < 4; ++b) {
+                        digest[w * 4 + b] = static_cast<unsigned char>(state[w][l] >> (24 - 8 * b));
+                    }
+                }
+                digests[lane.index] = to_hex(digest, sizeof(digest));
+                lane.active = false;
+            }
+        }
+    }
+    return digests;
+}
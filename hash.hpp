@@ -0,0 +1,69 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Incremental SHA-1 (FIPS 180-4)
+class Sha1 {
+public:
+    Sha1();
+    void update(const void* data, size_t len);
+    std::string hex_digest();   // finalizes; call once
+
+private:
+    uint32_t state_[5];
+    uint64_t length_ = 0;
+    unsigned char block_[64];
+    size_t block_len_ = 0;
+};
+
+// Incremental SHA-256 (FIPS 180-4)
+class Sha256 {
+public:
+    Sha256();
+    void update(const void* data, size_t len);
+    std::string hex_digest();   // finalizes; call once
+
+private:
+    uint32_t state_[8];
+    uint64_t length_ = 0;
+    unsigned char block_[64];
+    size_t block_len_ = 0;
+};
+
+// Incremental SHA-512 (FIPS 180-4)
+class Sha512 {
+public:
+    Sha512();
+    void update(const void* data, size_t len);
+    std::string hex_digest();   // finalizes; call once
+
+private:
+    uint64_t state_[8];
+    uint64_t length_ = 0;
+    unsigned char block_[128];
+    size_t block_len_ = 0;
+};
+
+// Block compression functions, picked once at runtime from what the CPU supports
+// (SHA-NI, then AVX2, then portable C++)
+struct HashKernels {
+    void (*sha1)(uint32_t state[5], const unsigned char* data, size_t blocks);
+    void (*sha1_x8)(uint32_t state[5][8], const unsigned char* const data[8], size_t blocks);   // null if not faster
+    void (*sha256)(uint32_t state[8], const unsigned char* data, size_t blocks);
+    void (*sha512)(uint64_t state[8], const unsigned char* data, size_t blocks);
+    const char* sha1_name;
+    const char* sha256_name;
+    const char* sha512_name;
+};
+
+const HashKernels& hash_kernels();
+std::string sha1_file(const std::string& path);
+std::string sha256_file(const std::string& path);
+std::vector<std::string> sha1_files(const std::vector<std::string>& paths);
+std::string to_hex(const unsigned char* bytes, size_t len);
+
+#endif
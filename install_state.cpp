@@ -0,0 +1,91 @@
+#include "install_state.hpp"
+#include "filesystem.hpp"
+#include "json.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+
+// Weight of the newest sample in the throughput moving averages
+static const double EWMA_WEIGHT = 0.3;
+
+static double blend(double average, double sample) {
+    return average <= 0.0 ? sample : average * (1.0 - EWMA_WEIGHT) + sample * EWMA_WEIGHT;
+}
+
+// State lives next to the modded install so it survives TEMP cleanup
+std::string get_install_state_path() {
+    return safe_getenv("USERPROFILE") + "\\Games\\Minecraft\\modded-install\\installer-state.json";
+}
+
+InstallState load_install_state() {
+    using json = nlohmann::json;
+    InstallState state;
+    std::ifstream in(get_install_state_path());
+    if (!in) {
+        return state;
+    }
+    json j = json::parse(in, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return state;
+    }
+    if (j.contains("artifact_bytes") && j["artifact_bytes"].is_object()) {
+        for (auto it = j["artifact_bytes"].begin(); it != j["artifact_bytes"].end(); ++it) {
+            if (it.value().is_number_integer()) {
+                state.artifact_bytes[it.key()] = it.value().get<long long>();
+            }
+        }
+    }
+    if (j.contains("step_seconds") && j["step_seconds"].is_object()) {
+        for (auto it = j["step_seconds"].begin(); it != j["step_seconds"].end(); ++it) {
+            if (it.value().is_number()) {
+                state.step_seconds[it.key()] = it.value().get<double>();
+            }
+        }
+    }
+    state.download_bytes_per_sec = j.value("download_bytes_per_sec", 0.0);
+    state.extract_bytes_per_sec = j.value("extract_bytes_per_sec", 0.0);
+    return state;
+}
+
+void save_install_state(const InstallState& state) {
+    using json = nlohmann::json;
+    json j;
+    j["artifact_bytes"] = state.artifact_bytes;
+    j["step_seconds"] = state.step_seconds;
+    j["download_bytes_per_sec"] = state.download_bytes_per_sec;
+    j["extract_bytes_per_sec"] = state.extract_bytes_per_sec;
+
+    std::ofstream out(get_install_state_path());
+    if (!out) {
+        // The modded install directory may not exist yet; measurements are best effort
+        return;
+    }
+    out << j.dump(4);
+}
+
+void record_download(const std::string& url, long long bytes, double seconds) {
+    InstallState state = load_install_state();
+    state.artifact_bytes[url] = bytes;
+    // Tiny transfers are dominated by connection setup and would skew the average
+    if (seconds > 0.05 && bytes > 64 * 1024) {
+        state.download_bytes_per_sec = blend(state.download_bytes_per_sec, bytes / seconds);
+    }
+    save_install_state(state);
+}
+
+void record_extraction(long long bytes, double seconds) {
+    if (seconds <= 0.0 || bytes <= 0) {
+        return;
+    }
+    InstallState state = load_install_state();
+    state.extract_bytes_per_sec = blend(state.extract_bytes_per_sec, bytes / seconds);
+    save_install_state(state);
+}
+
+void record_step_duration(const std::string& step, double seconds) {
+    InstallState state = load_install_state();
+    state.step_seconds[step] = blend(state.step_seconds.count(step) ? state.step_seconds[step] : 0.0, seconds);
+    save_install_state(state);
+}
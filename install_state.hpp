@@ -0,0 +1,22 @@
+#ifndef INSTALL_STATE_HPP
+#define INSTALL_STATE_HPP
+
+#include <map>
+#include <string>
+
+// Measurements recorded by real runs, used by plan mode to estimate sizes and durations
+struct InstallState {
+    std::map<std::string, long long> artifact_bytes;   // url -> bytes of the last completed download
+    double download_bytes_per_sec = 0.0;               // moving average over completed downloads
+    double extract_bytes_per_sec = 0.0;                // moving average over modpack extractions
+    std::map<std::string, double> step_seconds;        // e.g. "java_install" -> seconds
+};
+
+std::string get_install_state_path();
+InstallState load_install_state();
+void save_install_state(const InstallState& state);
+void record_download(const std::string& url, long long bytes, double seconds);
+void record_extraction(long long bytes, double seconds);
+void record_step_duration(const std::string& step, double seconds);
+
+#endif
@@ -0,0 +1,391 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include "io_loop.hpp"
+#include "async_writer.hpp"
+#include "constants.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef std::chrono::steady_clock::time_point Deadline;
+
+struct IoLoop::State {
+    std::mutex mutex;
+    std::deque<std::function<void()>> posted;
+    std::map<std::pair<Deadline, uint64_t>, std::function<void()>> timers;   // earliest first
+    std::map<uint64_t, Deadline> timer_deadlines;
+    uint64_t next_timer = 1;
+#ifdef _WIN32
+    HANDLE port = nullptr;
+#else
+    int epoll = -1;
+    int wake_fd = -1;
+    std::map<int, std::function<void()>> watches;
+    std::set<int> registered;   // fds known to epoll, armed or not
+#endif
+};
+
+#ifdef _WIN32
+// Completion keys: posted work and timers only need a loop thread to wake up
+static const ULONG_PTR IO_WAKE_KEY = 1;
+static const ULONG_PTR IO_FILE_KEY = 2;
+
+// One overlapped write; the OVERLAPPED comes first so a completion packet leads back to it
+struct IoOperation {
+    OVERLAPPED overlapped;
+    size_t size;
+    std::function<void(bool ok)> done;
+};
+
+static HANDLE g_port = nullptr;
+#endif
+
+IoLoop::IoLoop() : state_(new State) {
+#ifdef _WIN32
+    state_->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, IO_LOOP_THREADS);
+    g_port = state_->port;
+#else
+    state_->epoll = epoll_create1(EPOLL_CLOEXEC);
+    state_->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = state_->wake_fd;
+    epoll_ctl(state_->epoll, EPOLL_CTL_ADD, state_->wake_fd, &event);
+#endif
+    for (int i = 0; i < IO_LOOP_THREADS; ++i) {
+        std::thread(&IoLoop::run, this).detach();
+    }
+}
+
+IoLoop& get_io_loop() {
+    static IoLoop* loop = new IoLoop;
+    return *loop;
+}
+
+void IoLoop::wake() {
+#ifdef _WIN32
+    PostQueuedCompletionStatus(state_->port, 0, IO_WAKE_KEY, nullptr);
+#else
+    uint64_t one = 1;
+    ssize_t written = ::write(state_->wake_fd, &one, sizeof(one));
+    (void)written;   // EAGAIN: the counter is already far from zero, a wakeup is pending anyway
+#endif
+}
+
+void IoLoop::post(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->posted.push_back(std::move(work));
+    }
+    wake();
+}
+
+uint64_t IoLoop::after(int ms, std::function<void()> work) {
+    Deadline deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    uint64_t id;
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        id = state_->next_timer++;
+        earliest = state_->timers.empty() || deadline < state_->timers.begin()->first.first;
+        state_->timers[{ deadline, id }] = std::move(work);
+        state_->timer_deadlines[id] = deadline;
+    }
+    // Loop threads may be waiting for a later deadline, or none at all
+    if (earliest) {
+        wake();
+    }
+    return id;
+}
+
+void IoLoop::cancel_timer(uint64_t id) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto it = state_->timer_deadlines.find(id);
+    if (it != state_->timer_deadlines.end()) {
+        state_->timers.erase({ it->second, id });
+        state_->timer_deadlines.erase(it);
+    }
+}
+
+int IoLoop::run_due_timers() {
+    std::vector<std::function<void()>> due;
+    int timeout = -1;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        Deadline now = std::chrono::steady_clock::now();
+        while (!state_->timers.empty() && state_->timers.begin()->first.first <= now) {
+            auto it = state_->timers.begin();
+            due.push_back(std::move(it->second));
+            state_->timer_deadlines.erase(it->first.second);
+            state_->timers.erase(it);
+        }
+        if (!state_->timers.empty()) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(state_->timers.begin()->first.first - now);
+            timeout = static_cast<int>(wait.count()) + 1;
+        }
+    }
+    for (std::function<void()>& work : due) {
+        work();
+    }
+    return due.empty() ? timeout : 0;
+}
+
+void IoLoop::run_posted() {
+    for (;;) {
+        std::function<void()> work;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (state_->posted.empty()) {
+                return;
+            }
+            work = std::move(state_->posted.front());
+            state_->posted.pop_front();
+        }
+        work();
+    }
+}
+
+#ifdef _WIN32
+void IoLoop::run() {
+    for (;;) {
+        int timeout = run_due_timers();
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = nullptr;
+        BOOL ok = GetQueuedCompletionStatus(state_->port, &bytes, &key, &overlapped, timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
+        if (overlapped && key == IO_FILE_KEY) {
+            IoOperation* operation = reinterpret_cast<IoOperation*>(overlapped);
+            operation->done(ok && bytes == operation->size);
+            delete operation;
+        }
+        run_posted();
+    }
+}
+#else
+void IoLoop::watch(int fd, bool writable, std::function<void()> ready) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->watches[fd] = std::move(ready);
+    epoll_event event = {};
+    event.events = (writable ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = fd;
+    bool known = state_->registered.count(fd) != 0;
+    if (epoll_ctl(state_->epoll, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == 0) {
+        state_->registered.insert(fd);
+    } else {
+        // The caller finds out what is wrong with fd when it uses it
+        state_->posted.push_back(std::move(state_->watches[fd]));
+        state_->watches.erase(fd);
+        wake();
+    }
+}
+
+void IoLoop::forget(int fd) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->registered.erase(fd)) {
+        epoll_ctl(state_->epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    state_->watches.erase(fd);
+}
+
+void IoLoop::run() {
+    epoll_event events[16];
+    for (;;) {
+        int timeout = run_due_timers();
+        int count = epoll_wait(state_->epoll, events, 16, timeout);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == state_->wake_fd) {
+                uint64_t value;
+                ssize_t got = ::read(state_->wake_fd, &value, sizeof(value));
+                (void)got;
+                continue;
+            }
+            std::function<void()> ready;
+            {
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                auto it = state_->watches.find(fd);
+                if (it == state_->watches.end()) {
+                    continue;
+                }
+                ready = std::move(it->second);
+                state_->watches.erase(it);
+            }
+            ready();
+        }
+        run_posted();
+    }
+}
+#endif
+
+// Writes that may block: the writer thread runs them in order and reports on the loop
+struct FileWrite {
+    std::function<bool()> write;
+    std::function<void(bool ok)> done;
+};
+
+static std::mutex g_writes_mutex;
+static std::condition_variable g_writes_ready;
+static std::deque<FileWrite> g_writes;
+
+static void file_writer_loop() {
+    for (;;) {
+        FileWrite next;
+        {
+            std::unique_lock<std::mutex> lock(g_writes_mutex);
+            g_writes_ready.wait(lock, [] { return !g_writes.empty(); });
+            next = std::move(g_writes.front());
+            g_writes.pop_front();
+        }
+        bool ok = next.write();
+        std::function<void(bool ok)> done = std::move(next.done);
+        get_io_loop().post([done, ok] { done(ok); });
+    }
+}
+
+static void queue_file_write(std::function<bool()> write, std::function<void(bool ok)> done) {
+    static std::once_flag started;
+    std::call_once(started, [] { std::thread(file_writer_loop).detach(); });
+    {
+        std::lock_guard<std::mutex> lock(g_writes_mutex);
+        g_writes.push_back(FileWrite{ std::move(write), std::move(done) });
+    }
+    g_writes_ready.notify_one();
+}
+
+IoFile::~IoFile() {
+    close(-1);
+}
+
+#ifdef _WIN32
+bool IoFile::open(const std::string& path, long long expected_size) {
+    bool overlapped = false;
+    HANDLE file = open_for_offset_writes(path, expected_size, overlapped);
+    if (!file) {
+        return false;
+    }
+    get_io_loop();
+    if (overlapped && !CreateIoCompletionPort(file, g_port, IO_FILE_KEY, 0)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    overlapped_ = overlapped;
+    return true;
+}
+
+void IoFile::write(long long offset, const char* data, size_t size, std::function<void(bool ok)> done) {
+    if (!overlapped_) {
+        HANDLE file = file_;
+        queue_file_write([file, offset, data, size] {
+            long long position = offset;
+            const char* next = data;
+            size_t remaining = size;
+            while (remaining > 0) {
+                OVERLAPPED at;
+                memset(&at, 0, sizeof(at));
+                at.Offset = static_cast<DWORD>(position & 0xFFFFFFFF);
+                at.OffsetHigh = static_cast<DWORD>(position >> 32);
+                DWORD written = 0;
+                if (!WriteFile(file, next, static_cast<DWORD>(remaining), &written, &at) || written == 0) {
+                    return false;
+                }
+                next += written;
+                remaining -= written;
+                position += written;
+            }
+            return true;
+        }, std::move(done));
+        return;
+    }
+    IoOperation* operation = new IoOperation();
+    operation->overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    operation->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    operation->size = size;
+    operation->done = std::move(done);
+    // Even a write that finishes at once reports through the port
+    if (!WriteFile(file_, data, static_cast<DWORD>(size), nullptr, &operation->overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        std::function<void(bool ok)> failed = std::move(operation->done);
+        delete operation;
+        get_io_loop().post([failed] { failed(false); });
+    }
+}
+
+bool IoFile::close(long long final_size) {
+    if (!file_) {
+        return true;
+    }
+    bool ok = true;
+    if (final_size >= 0) {
+        FILE_END_OF_FILE_INFO end_of_file;
+        end_of_file.EndOfFile.QuadPart = final_size;
+        ok = SetFileInformationByHandle(file_, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file)) != FALSE;
+    }
+    ok = CloseHandle(file_) != FALSE && ok;
+    file_ = nullptr;
+    return ok;
+}
+#else
+bool IoFile::open(const std::string& path, long long expected_size) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+#ifdef __linux__
+    if (expected_size > 0) {
+        fallocate(fd_, 0, 0, static_cast<off_t>(expected_size));
+    }
+#else
+    (void)expected_size;
+#endif
+    return true;
+}
+
+void IoFile::write(long long offset, const char* data, size_t size, std::function<void(bool ok)> done) {
+    int fd = fd_;
+    queue_file_write([fd, offset, data, size] {
+        off_t position = static_cast<off_t>(offset);
+        const char* next = data;
+        size_t remaining = size;
+        while (remaining > 0) {
+            ssize_t written = pwrite(fd, next, remaining, position);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            next += written;
+            remaining -= static_cast<size_t>(written);
+            position += written;
+        }
+        return true;
+    }, std::move(done));
+}
+
+bool IoFile::close(long long final_size) {
+    if (fd_ < 0) {
+        return true;
+    }
+    bool ok = final_size < 0 || ftruncate(fd_, static_cast<off_t>(final_size)) == 0;
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    return ok;
+}
+#endif
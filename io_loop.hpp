@@ -0,0 +1,65 @@
+#ifndef IO_LOOP_HPP
+#define IO_LOOP_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Completion-driven I/O, so work that mostly waits does not need a thread per operation: an
+// operation is started from any thread and its callback runs on one of IO_LOOP_THREADS loop
+// threads once it finishes, never inside the call that started it. Callbacks must not block.
+// Windows waits on an I/O completion port, which also carries overlapped file writes and the
+// completions WinINet reports from its own threads (through post()); elsewhere epoll waits for
+// socket readiness and an eventfd for posted work.
+class IoLoop {
+public:
+    void post(std::function<void()> work);
+    uint64_t after(int ms, std::function<void()> work);   // a timer, cancelled with its id
+    void cancel_timer(uint64_t id);   // no-op if it already ran
+#ifndef _WIN32
+    // Call ready() once fd is readable (writable), or has failed; only one wait per fd at a time
+    void watch(int fd, bool writable, std::function<void()> ready);
+    void forget(int fd);   // before closing fd; drops a wait that has not fired
+#endif
+
+private:
+    friend IoLoop& get_io_loop();
+    IoLoop();
+    IoLoop(const IoLoop&) = delete;
+    IoLoop& operator=(const IoLoop&) = delete;
+    void run();
+    int run_due_timers();   // ms until the next timer, -1 if none
+    void run_posted();
+    void wake();
+
+    struct State;
+    State* state_;
+};
+
+// Started on first use and never torn down, like the executor
+IoLoop& get_io_loop();
+
+// A file written at explicit offsets, with completions on the I/O loop. Windows issues overlapped
+// writes when the file's valid data length could be set up front (see open_for_offset_writes);
+// otherwise, and elsewhere, one file writer thread shared by all IoFiles does the writes, so a
+// write that blocks never holds up a loop thread.
+class IoFile {
+public:
+    IoFile() {}
+    ~IoFile();
+    bool open(const std::string& path, long long expected_size = -1);   // sizes the file up front when known
+    void write(long long offset, const char* data, size_t size, std::function<void(bool ok)> done);
+    bool close(long long final_size);   // trims to final_size; no write may be in flight
+
+private:
+    IoFile(const IoFile&) = delete;
+    IoFile& operator=(const IoFile&) = delete;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    bool overlapped_ = false;
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,483 @@
+#include "json_stream.hpp"
+#include "mrpack.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+bool JsonSlice::equals(const char* literal) const {
+    size_t len = std::strlen(literal);
+    return len == size && std::memcmp(data, literal, len) == 0;
+}
+
+JsonReader::JsonReader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+void JsonReader::skip_whitespace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+        ++p_;
+    }
+}
+
+char JsonReader::peek() {
+    skip_whitespace();
+    return p_ < end_ ? *p_ : 0;
+}
+
+bool JsonReader::expect(char c) {
+    if (failed_ || peek() != c) {
+        return fail();
+    }
+    ++p_;
+    return true;
+}
+
+bool JsonReader::begin_object() {
+    first_ = true;
+    return expect('{');
+}
+
+bool JsonReader::begin_array() {
+    first_ = true;
+    return expect('[');
+}
+
+bool JsonReader::next_key(JsonSlice& key) {
+    if (failed_) {
+        return false;
+    }
+    bool first = first_;
+    first_ = false;
+    char c = peek();
+    if (c == '}') {
+        ++p_;
+        return false;
+    }
+    if (!first && !expect(',')) {
+        return false;
+    }
+    return read_string(key) && expect(':');
+}
+
+bool JsonReader::next_element() {
+    if (failed_) {
+        return false;
+    }
+    bool first = first_;
+    first_ = false;
+    char c = peek();
+    if (c == ']') {
+        ++p_;
+        return false;
+    }
+    return first || expect(',');
+}
+
+// Advance past a string body; p_ points just after the opening quote
+bool JsonReader::skip_string() {
+    for (;;) {
+        const char* quote = static_cast<const char*>(std::memchr(p_, '"', end_ - p_));
+        if (!quote) {
+            return fail();
+        }
+        // The quote is escaped only if an odd number of backslashes precedes it
+        const char* b = quote;
+        while (b > p_ && b[-1] == '\\') {
+            --b;
+        }
+        p_ = quote + 1;
+        if ((quote - b) % 2 == 0) {
+            return true;
+        }
+    }
+}
+
+static void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xc0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xe0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+}
+
+static bool parse_hex4(const char* p, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+// Decode the string between start and p_ - 1 (the closing quote) into the scratch buffer
+bool JsonReader::decode_escapes(const char* start, JsonSlice& value) {
+    const char* end = p_ - 1;
+    scratch_.clear();
+    for (const char* s = start; s < end; ++s) {
+        if (*s != '\\') {
+            scratch_ += *s;
+            continue;
+        }
+        if (++s >= end) {
+            return fail();
+        }
+        switch (*s) {
+            case '"': scratch_ += '"'; break;
+            case '\\': scratch_ += '\\'; break;
+            case '/': scratch_ += '/'; break;
+            case 'b': scratch_ += '\b'; break;
+            case 'f': scratch_ += '\f'; break;
+            case 'n': scratch_ += '\n'; break;
+            case 'r': scratch_ += '\r'; break;
+            case 't': scratch_ += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (end - s < 5 || !parse_hex4(s + 1, cp)) {
+                    return fail();
+                }
+                s += 4;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    uint32_t low;
+                    if (end - s < 7 || s[1] != '\\' || s[2] != 'u' || !parse_hex4(s + 3, low) || low < 0xdc00 || low > 0xdfff) {
+                        return fail();
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    s += 6;
+                }
+                append_utf8(scratch_, cp);
+                break;
+            }
+            default:
+                return fail();
+        }
+    }
+    value.data = scratch_.data();
+    value.size = scratch_.size();
+    return true;
+}
+
+bool JsonReader::read_string(JsonSlice& value) {
+    if (!expect('"')) {
+        return false;
+    }
+    const char* start = p_;
+    if (!skip_string()) {
+        return false;
+    }
+    size_t len = static_cast<size_t>(p_ - 1 - start);
+    if (!std::memchr(start, '\\', len)) {
+        value.data = start;
+        value.size = len;
+        return true;
+    }
+    return decode_escapes(start, value);
+}
+
+bool JsonReader::read_integer(long long& value) {
+    if (failed_) {
+        return false;
+    }
+    skip_whitespace();
+    bool negative = p_ < end_ && *p_ == '-';
+    if (negative) {
+        ++p_;
+    }
+    if (p_ >= end_ || *p_ < '0' || *p_ > '9') {
+        return fail();
+    }
+    unsigned long long v = 0;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+        v = v * 10 + static_cast<unsigned>(*p_++ - '0');
+    }
+    if (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+        return fail();
+    }
+    value = negative ? -static_cast<long long>(v) : static_cast<long long>(v);
+    return true;
+}
+
+bool JsonReader::skip_value() {
+    JsonSlice raw;
+    return skip_value(raw);
+}
+
+bool JsonReader::skip_value(JsonSlice& raw) {
+    char c = peek();
+    if (failed_ || c == 0) {
+        return fail();
+    }
+    raw.data = p_;
+    if (c == '"') {
+        ++p_;
+        if (!skip_string()) {
+            return false;
+        }
+    } else if (c == '{' || c == '[') {
+        // Strings are skipped as units so brackets inside them do not count
+        int depth = 0;
+        do {
+            char ch = *p_++;
+            if (ch == '"') {
+                if (!skip_string()) {
+                    return false;
+                }
+            } else if (ch == '{' || ch == '[') {
+                depth++;
+            } else if (ch == '}' || ch == ']') {
+                depth--;
+            }
+        } while (depth > 0 && p_ < end_);
+        if (depth != 0) {
+            return fail();
+        }
+    } else {
+        // number, true, false or null
+        while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' && *p_ != '\n' && *p_ != '\r' && *p_ != '\t') {
+            ++p_;
+        }
+    }
+    raw.size = static_cast<size_t>(p_ - raw.data);
+    return true;
+}
+
+// StringPool
+
+// Word-at-a-time multiplicative hash; good enough for table placement, not for adversarial input
+static uint32_t hash_bytes(const char* s, size_t len) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    while (len >= 8) {
+        uint64_t word;
+        std::memcpy(&word, s, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        s += 8;
+        len -= 8;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, s, len);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    return static_cast<uint32_t>(h ^ (h >> 29));
+}
+
+StringPool::StringPool() : data_(1, '\0'), slots_(64, 0) {}   // offset 0 is the empty string
+
+void StringPool::grow() {
+    std::vector<uint32_t> old;
+    old.swap(slots_);
+    slots_.assign(old.size() * 2, 0);
+    size_t mask = slots_.size() - 1;
+    for (uint32_t slot : old) {
+        if (slot == 0) {
+            continue;
+        }
+        const char* s = data_.data() + slot - 1;
+        size_t i = hash_bytes(s, std::strlen(s)) & mask;
+        while (slots_[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = slot;
+    }
+}
+
+void StringPool::reserve(size_t bytes) {
+    data_.reserve(bytes);
+}
+
+uint32_t StringPool::intern(const char* s, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if ((count_ + 1) * 4 > slots_.size() * 3) {
+        grow();
+    }
+    size_t mask = slots_.size() - 1;
+    size_t i = hash_bytes(s, len) & mask;
+    while (slots_[i] != 0) {
+        const char* existing = data_.data() + slots_[i] - 1;
+        if (std::memcmp(existing, s, len) == 0 && existing[len] == '\0') {
+            return slots_[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    uint32_t offset = static_cast<uint32_t>(data_.size());
+    data_.insert(data_.end(), s, s + len);
+    data_.push_back('\0');
+    slots_[i] = offset + 1;
+    count_++;
+    return offset;
+}
+
+// Manifest extractors
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex_digest(const JsonSlice& hex, unsigned char* out, size_t len) {
+    if (hex.size != len * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        int high = hex_value(hex.data[i * 2]);
+        int low = hex_value(hex.data[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    return true;
+}
+
+static EnvSupport parse_env(const JsonSlice& value) {
+    if (value.equals("required")) return EnvSupport::Required;
+    if (value.equals("optional")) return EnvSupport::Optional;
+    if (value.equals("unsupported")) return EnvSupport::Unsupported;
+    return EnvSupport::Unspecified;
+}
+
+static bool parse_mrpack_file(JsonReader& reader, MrpackIndex& index, MrpackFile& file) {
+    JsonSlice key, value;
+    if (!reader.begin_object()) {
+        return false;
+    }
+    file.first_download = static_cast<uint32_t>(index.download_urls.size());
+    while (reader.next_key(key)) {
+        if (key.equals("path")) {
+            if (!reader.read_string(value)) return false;
+            file.path = index.strings.intern(value);
+        } else if (key.equals("fileSize")) {
+            if (!reader.read_integer(file.file_size)) return false;
+        } else if (key.equals("hashes")) {
+            if (!reader.begin_object()) return false;
+            while (reader.next_key(key)) {
+                bool sha1 = key.equals("sha1");
+                bool sha512 = key.equals("sha512");
+                if (!sha1 && !sha512) {
+                    if (!reader.skip_value()) return false;
+                    continue;
+                }
+                if (!reader.read_string(value)) return false;
+                // Digests are kept as bytes; a malformed one leaves has_* false for the caller to reject
+                if (sha1) {
+                    file.has_sha1 = parse_hex_digest(value, file.sha1, sizeof(file.sha1));
+                } else {
+                    file.has_sha512 = parse_hex_digest(value, file.sha512, sizeof(file.sha512));
+                }
+            }
+        } else if (key.equals("env")) {
+            if (!reader.begin_object()) return false;
+            while (reader.next_key(key)) {
+                bool client = key.equals("client");
+                bool server = key.equals("server");
+                if (!client && !server) {
+                    if (!reader.skip_value()) return false;
+                    continue;
+                }
+                if (!reader.read_string(value)) return false;
+                (client ? file.client_env : file.server_env) = parse_env(value);
+            }
+        } else if (key.equals("downloads")) {
+            if (!reader.begin_array()) return false;
+            while (reader.next_element()) {
+                if (!reader.read_string(value)) return false;
+                index.download_urls.push_back(index.strings.intern(value));
+            }
+        } else if (!reader.skip_value()) {
+            return false;
+        }
+    }
+    file.download_count = static_cast<uint32_t>(index.download_urls.size()) - file.first_download;
+    return !reader.failed();
+}
+
+// Pull the fields the installer uses out of modrinth.index.json without building a DOM
+bool parse_mrpack_index(const char* data, size_t size, MrpackIndex& index) {
+    JsonReader reader(data, size);
+    JsonSlice key, value;
+    long long format_version = 0;
+    std::string game;
+    if (!reader.begin_object()) {
+        return false;
+    }
+    while (reader.next_key(key)) {
+        if (key.equals("formatVersion")) {
+            if (!reader.read_integer(format_version)) return false;
+        } else if (key.equals("game")) {
+            if (!reader.read_string(value)) return false;
+            game = value.str();
+        } else if (key.equals("name")) {
+            if (!reader.read_string(value)) return false;
+            index.name = value.str();
+        } else if (key.equals("versionId")) {
+            if (!reader.read_string(value)) return false;
+            index.version_id = value.str();
+        } else if (key.equals("dependencies")) {
+            if (!reader.begin_object()) return false;
+            while (reader.next_key(key)) {
+                std::string name = key.str();
+                if (!reader.read_string(value)) return false;
+                index.dependencies[name] = value.str();
+            }
+        } else if (key.equals("files")) {
+            if (!reader.begin_array()) return false;
+            // Each entry carries ~170 bytes of hex digests plus its path and URLs; sizing up front
+            // avoids the doubling copies that would otherwise dominate peak memory
+            index.files.reserve(size / 400);
+            index.strings.reserve(size / 4);
+            while (reader.next_element()) {
+                MrpackFile file;
+                if (!parse_mrpack_file(reader, index, file)) return false;
+                index.files.push_back(file);
+            }
+        } else if (!reader.skip_value()) {
+            return false;
+        }
+    }
+    return !reader.failed() && format_version == 1 && game == "minecraft";
+}
+
+// Return the raw JSON text of profiles[profile_id] from launcher_profiles.json, skipping everything else
+bool find_launcher_profile(const char* data, size_t size, const std::string& profile_id, std::string& raw_profile) {
+    JsonReader reader(data, size);
+    JsonSlice key, raw;
+    if (!reader.begin_object()) {
+        return false;
+    }
+    while (reader.next_key(key)) {
+        if (!key.equals("profiles")) {
+            if (!reader.skip_value()) return false;
+            continue;
+        }
+        if (reader.peek() != '{') {
+            return false;
+        }
+        reader.begin_object();
+        while (reader.next_key(key)) {
+            bool wanted = key.size == profile_id.size() && key.str() == profile_id;
+            if (!reader.skip_value(raw)) return false;
+            if (wanted) {
+                raw_profile.assign(raw.data, raw.size);
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
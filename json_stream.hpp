@@ -0,0 +1,72 @@
+#ifndef JSON_STREAM_HPP
+#define JSON_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MrpackIndex;
+
+// A byte range inside the parsed document (or the reader's scratch buffer for escaped strings)
+struct JsonSlice {
+    const char* data = nullptr;
+    size_t size = 0;
+    bool equals(const char* literal) const;
+    std::string str() const { return std::string(data, size); }
+};
+
+// Forward-only JSON reader over a contiguous buffer. Callers walk the structure they expect and
+// skip the rest; nothing is allocated except when a string contains escapes.
+class JsonReader {
+public:
+    JsonReader(const char* data, size_t size);
+
+    bool begin_object();                 // consumes '{'
+    bool next_key(JsonSlice& key);       // false at the closing '}' (consumed) or on error
+    bool begin_array();                  // consumes '['
+    bool next_element();                 // false at the closing ']' (consumed) or on error
+    bool read_string(JsonSlice& value);  // slice is valid until the next read_string
+    bool read_integer(long long& value);
+    bool skip_value();
+    bool skip_value(JsonSlice& raw);     // also returns the raw text of the skipped value
+    char peek();                         // next significant character, 0 at end of input
+
+    bool failed() const { return failed_; }
+
+private:
+    bool expect(char c);
+    bool fail() { failed_ = true; return false; }
+    void skip_whitespace();
+    bool skip_string();
+    bool decode_escapes(const char* start, JsonSlice& value);
+
+    const char* p_;
+    const char* end_;
+    bool failed_ = false;
+    bool first_ = false;                 // no separator expected before the next member/element
+    std::string scratch_;
+};
+
+// Interned, NUL-terminated strings stored back to back; values are offsets into one buffer.
+// Pointers returned by get() are invalidated by the next intern().
+class StringPool {
+public:
+    StringPool();
+    uint32_t intern(const char* s, size_t len);
+    uint32_t intern(const JsonSlice& s) { return intern(s.data, s.size); }
+    void reserve(size_t bytes);
+    const char* get(uint32_t offset) const { return data_.data() + offset; }
+    size_t bytes() const { return data_.capacity() + slots_.capacity() * sizeof(uint32_t); }
+
+private:
+    void grow();
+    std::vector<char> data_;
+    std::vector<uint32_t> slots_;        // open addressing; 0 = empty, otherwise offset + 1
+    size_t count_ = 0;
+};
+
+bool parse_mrpack_index(const char* data, size_t size, MrpackIndex& index);
+bool find_launcher_profile(const char* data, size_t size, const std::string& profile_id, std::string& raw_profile);
+
+#endif
@@ -1,8 +1,25 @@
 #define NOMINMAX
 
+#include "archive.hpp"
+#include "cassette.hpp"
 #include "constants.hpp"
+#include "executor.hpp"
 #include "filesystem.hpp"
+#include "hash.hpp"
+#include "install_state.hpp"
 #include "json.hpp"
+#include "memory_stats.hpp"
+#include "metrics.hpp"
+#include "mod_versions.hpp"
+#include "mrpack.hpp"
+#include "offline.hpp"
+#include "peer_cache.hpp"
+#include "perf_counters.hpp"
+#include "phases.hpp"
+#include "progress.hpp"
+#include "plan.hpp"
+#include "store.hpp"
+#include "verify.hpp"
 
 
 #include <iostream>
@@ -11,20 +28,28 @@
 #include <vector>
 #include <sstream>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <memory>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <set>
 
 
 // function declarations (to avoid linker errors)
 
 // core functions
 bool is_java_installed();
+std::string get_java_installer();
 void validate_java_installation();
 bool is_fabric_installed(const std::string& minecraft_dir, const std::string& mcversion, const std::string& loader_version);
+std::string get_fabric_installer();
 void validate_fabric_installation(const std::string& mcversion, const std::string& loader_version);
 bool is_version_greater_or_equal(const std::string& installed_version, const std::string& required_version);
-bool is_modpack_downloaded(const std::string& modpack_zip_path);
+std::string ensure_modpack_archive(const std::string& modpack_url);
 void validate_modpack_installation(const std::string& modpack_url);
+bool create_offline_bundle(const std::string& output_path, const std::string& modpack_url, const std::string& minecraft_dir);
 void refresh_environment_variables();
 bool check_java_in_common_locations();
 std::string get_java_path();
@@ -46,20 +71,20 @@ void refresh_environment_variables() {
     Sleep(2000);
 }
 
-// Check for Java in common installation locations without relying on PATH
+// Check for Java in common installation locations without relying on PATH. Each candidate's
+// "java -version" runs as a task in the I/O lane; the first one that meets the requirement
+// cancels the probes that have not started yet.
 bool check_java_in_common_locations() {
+    PhaseScope phase("discovery");
     std::cout << "Checking Java in common installation locations..." << std::endl;
     
-    std::vector<std::string> search_paths = {
-        "C:\\Program Files\\Java",
-        "C:\\Program Files\\Oracle",
-        "C:\\Program Files (x86)\\Java",
-        "C:\\Program Files (x86)\\Oracle"
-    };
+    std::vector<std::string> search_paths = get_java_search_paths();
+    std::vector<std::string> java_dirs;
     
     for (const std::string& base_path : search_paths) {
         WIN32_FIND_DATAA findFileData;
         HANDLE hFind = FindFirstFileA((base_path + "\\*").c_str(), &findFileData);
+        count_event("directory_scans");
         
         if (hFind != INVALID_HANDLE_VALUE) {
             do {
@@ -67,38 +92,12 @@ bool check_java_in_common_locations() {
                     std::string dir_name = findFileData.cFileName;
                     if (dir_name != "." && dir_name != "..") {
                         std::string java_dir = base_path + "\\" + dir_name;
-                        std::string java_exe = java_dir + "\\bin\\java.exe";
                         
                         // Check if java.exe exists
-                        std::ifstream file(java_exe);
+                        std::ifstream file(java_dir + "\\bin\\java.exe");
                         if (file.good()) {
-                            file.close();
                             std::cout << "Found Java installation at: " << java_dir << std::endl;
-                            
-                            // Test version using full path
-                            std::string version_cmd = "\"" + java_exe + "\" -version 2>&1";
-                            std::string output = exec(version_cmd.c_str());
-                            if (!output.empty()) {
-                                // Parse version
-                                size_t first_line_end = output.find('\n');
-                                if (first_line_end == std::string::npos) {
-                                    first_line_end = output.length();
-                                }
-                                std::string first_line = output.substr(0, first_line_end);
-                                
-                                size_t first_quote = first_line.find('\"');
-                                if (first_quote != std::string::npos) {
-                                    size_t second_quote = first_line.find('\"', first_quote + 1);
-                                    if (second_quote != std::string::npos) {
-                                        std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
-                                        std::cout << "Found Java version: " << version << " at " << java_exe << std::endl;
-                                        if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
-                                            FindClose(hFind);
-                                            return true;
-                                        }
-                                    }
-                                }
-                            }
+                            java_dirs.push_back(java_dir);
                         }
                     }
                 }
@@ -107,11 +106,48 @@ bool check_java_in_common_locations() {
         }
     }
     
-    return false;
+    std::atomic<bool> found(false);
+    TaskGroup group(TaskLane::Io);
+    for (const std::string& java_dir : java_dirs) {
+        group.run([&group, &found, java_dir]() {
+            // Test version using full path
+            std::string java_exe = java_dir + "\\bin\\java.exe";
+            std::string version_cmd = "\"" + java_exe + "\" -version 2>&1";
+            std::string output = exec(version_cmd.c_str());
+            if (output.empty()) {
+                return;
+            }
+            // Parse version
+            size_t first_line_end = output.find('\n');
+            if (first_line_end == std::string::npos) {
+                first_line_end = output.length();
+            }
+            std::string first_line = output.substr(0, first_line_end);
+            
+            size_t first_quote = first_line.find('\"');
+            if (first_quote == std::string::npos) {
+                return;
+            }
+            size_t second_quote = first_line.find('\"', first_quote + 1);
+            if (second_quote == std::string::npos) {
+                return;
+            }
+            std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
+            std::cout << "Found Java version: " << version << " at " << java_exe << std::endl;
+            if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
+                found = true;
+                group.cancel();
+            }
+        });
+    }
+    group.wait();
+    
+    return found;
 }
 
 // Check if Java is installed by running 'java -version'
 bool is_java_installed() {
+    PhaseScope phase("discovery");
     std::string installed_version = get_java_version();
     if (installed_version.empty()) {
         std::cout << "Java is NOT installed." << std::endl;
@@ -127,6 +163,37 @@ bool is_java_installed() {
     }
 }
 
+// The JDK installer from the offline bundle, or downloaded once into the machine-wide cache
+std::string get_java_installer() {
+    std::string java_installer_path = get_shared_download_path(JAVA_INSTALLER_FILENAME);
+    const Bundle* bundle = get_offline_bundle();
+    const BundleEntry* bundled = bundle ? bundle->find(BUNDLE_JDK_ENTRY) : nullptr;
+    ExpectedHashes java_hashes;
+    bool ok;
+    if (bundled) {
+        std::cout << "Using the Java installer from the offline bundle." << std::endl;
+        java_hashes.sha256 = bundled->sha256;
+        ok = ensure_shared_file(java_installer_path, java_hashes, [&](const std::string& temp_path) {
+            return bundle->extract(*bundled, temp_path);
+        });
+    } else {
+        // The MSI runs elevated, so it is only used if it matches the checksum Oracle publishes
+        java_hashes.sha256 = fetch_published_digest(JAVA_INSTALLER_SHA256_URL);
+        if (java_hashes.sha256.empty()) {
+            std::cerr << "Cannot verify the Java installer without its published checksum." << std::endl;
+            exit(1);
+        }
+        ok = ensure_shared_file(java_installer_path, java_hashes, [&](const std::string& temp_path) {
+            download_file(JAVA_INSTALLER_URL, temp_path, java_hashes);
+            return true;
+        });
+    }
+    if (!ok) {
+        exit(1);
+    }
+    return java_installer_path;
+}
+
 void validate_java_installation() {
     if (is_java_installed()) {
         std::cout << "Java is properly installed." << std::endl;
@@ -134,15 +201,16 @@ void validate_java_installation() {
     }
 
     std::cout << "Java is not installed. Attempting to download and install Oracle JDK..." << std::endl;
-    std::string temp_dir = safe_getenv("TEMP");
-    std::string java_installer_path = temp_dir + "\\jdk-22.0.2_windows-x64_bin.msi";
-
-    download_file(JAVA_INSTALLER_URL, java_installer_path);
+    std::string java_installer_path = get_java_installer();
 
     std::cout << "Running Java installer..." << std::endl;
     std::string install_cmd = "msiexec /i \"" + java_installer_path + "\" /qn /norestart";
     std::cout << "Java install command: " << install_cmd << std::endl;
+    auto install_start = std::chrono::steady_clock::now();
+    count_event("process_spawns");
+    flush_log();
     int result = system(install_cmd.c_str());
+    record_step_duration("java_install", std::chrono::duration<double>(std::chrono::steady_clock::now() - install_start).count());
     if (result != 0) {
         std::cerr << "Java install command failed. Please install Java manually from https://www.oracle.com/java/technologies/javase/jdk22-archive-downloads.html" << std::endl;
         exit(1);
@@ -202,35 +270,45 @@ void validate_java_installation() {
 
 // Check if a suitable Fabric version is installed
 bool is_fabric_installed(const std::string& minecraft_dir, const std::string& mcversion, const std::string& required_loader_version) {
-    std::string versions_dir = minecraft_dir + "\\versions";
-    WIN32_FIND_DATAA findFileData;
-    HANDLE hFind = FindFirstFileA((versions_dir + "\\fabric-loader-*").c_str(), &findFileData);
-
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return false;
+    PhaseScope phase("discovery");
+    std::string installed_loader_version = find_installed_fabric_loader(minecraft_dir, mcversion, required_loader_version);
+    if (!installed_loader_version.empty()) {
+        std::cout << "Found suitable Fabric version: " << installed_loader_version << " for Minecraft " << mcversion << std::endl;
+        return true;
     }
-
-    do {
-        if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            std::string dirname = findFileData.cFileName;
-            std::string prefix = "fabric-loader-";
-            std::string suffix = "-" + mcversion;
-            if (dirname.rfind(prefix, 0) == 0 && dirname.size() > suffix.size() && dirname.substr(dirname.size() - suffix.size()) == suffix) {
-                std::string installed_loader_version = dirname.substr(prefix.size(), dirname.size() - prefix.size() - suffix.size());
-                if (is_version_greater_or_equal(installed_loader_version, required_loader_version)) {
-                    std::cout << "Found suitable Fabric version: " << installed_loader_version << " for Minecraft " << mcversion << std::endl;
-                    FindClose(hFind);
-                    return true;
-                }
-            }
-        }
-    } while (FindNextFileA(hFind, &findFileData) != 0);
-
-    FindClose(hFind);
     std::cout << "No suitable Fabric version found for Minecraft " << mcversion << std::endl;
     return false;
 }
 
+// The Fabric installer from the offline bundle, or downloaded once into the machine-wide cache
+std::string get_fabric_installer() {
+    std::string fabric_installer_path = get_shared_download_path(FABRIC_INSTALLER_FILENAME);
+    const Bundle* bundle = get_offline_bundle();
+    const BundleEntry* bundled = bundle ? bundle->find(BUNDLE_FABRIC_ENTRY) : nullptr;
+    ExpectedHashes fabric_hashes;
+    bool ok;
+    if (bundled) {
+        fabric_hashes.sha256 = bundled->sha256;
+        ok = ensure_shared_file(fabric_installer_path, fabric_hashes, [&](const std::string& temp_path) {
+            return bundle->extract(*bundled, temp_path);
+        });
+    } else {
+        fabric_hashes.sha1 = fetch_published_digest(FABRIC_INSTALLER_SHA1_URL);
+        if (fabric_hashes.sha1.empty()) {
+            std::cerr << "Cannot verify the Fabric installer without its published checksum." << std::endl;
+            exit(1);
+        }
+        ok = ensure_shared_file(fabric_installer_path, fabric_hashes, [&](const std::string& temp_path) {
+            download_file(FABRIC_INSTALLER_URL, temp_path, fabric_hashes);
+            return true;
+        });
+    }
+    if (!ok) {
+        exit(1);
+    }
+    return fabric_installer_path;
+}
+
 // Validate Fabric installation by checking if it exists in the Minecraft directory for a specific version
 void validate_fabric_installation(const std::string& mcversion, const std::string& loader_version) {
     std::string home_dir = safe_getenv("USERPROFILE");
@@ -238,12 +316,15 @@ void validate_fabric_installation(const std::string& mcversion, const std::strin
     if (is_fabric_installed(minecraft_dir, mcversion, loader_version)) {
         return;
     }
+    // An offline bundle carries the profile and libraries the Fabric installer would have written
+    const Bundle* bundle = get_offline_bundle();
+    if (bundle && install_bundled_minecraft_files(*bundle, minecraft_dir) && is_fabric_installed(minecraft_dir, mcversion, loader_version)) {
+        return;
+    }
     std::cout << "Fabric for Minecraft " << mcversion << " (loader " << loader_version << ") is not installed. Attempting to download and install Fabric..." << std::endl;
     
     // Download Fabric installer
-    std::string temp_dir = safe_getenv("TEMP");
-    std::string fabric_installer_path = temp_dir + "\\fabric-installer.jar";
-    download_file(FABRIC_INSTALLER_URL, fabric_installer_path);
+    std::string fabric_installer_path = get_fabric_installer();
 
     // Get the specific Java executable path
     std::string java_path = get_java_path();
@@ -265,6 +346,9 @@ void validate_fabric_installation(const std::string& mcversion, const std::strin
     // First attempt: Use simple 'java' command (should work now that we added to PATH)
     std::string install_cmd = "java -jar \"" + fabric_installer_path + "\" client -dir \"" + minecraft_dir + "\" -mcversion " + mcversion + " -loader " + loader_version;
     std::cout << "Fabric install command: " << install_cmd << std::endl;
+    auto install_start = std::chrono::steady_clock::now();
+    count_event("process_spawns");
+    flush_log();
     int result = system(install_cmd.c_str());
     
     // If that fails, try with full path as fallback
@@ -277,12 +361,16 @@ void validate_fabric_installation(const std::string& mcversion, const std::strin
             std::string short_java_path_str(short_java_path);
             install_cmd = short_java_path_str + " -jar \"" + fabric_installer_path + "\" client -dir \"" + minecraft_dir + "\" -mcversion " + mcversion + " -loader " + loader_version;
             std::cout << "Fabric install command (short path): " << install_cmd << std::endl;
+            count_event("process_spawns");
+            flush_log();
             result = system(install_cmd.c_str());
         } else {
             std::cerr << "Could not get short path name for Java executable." << std::endl;
         }
     }
     
+    record_step_duration("fabric_install", std::chrono::duration<double>(std::chrono::steady_clock::now() - install_start).count());
+
     if (result != 0) {
         std::cerr << "Fabric installer failed. Please install Fabric manually from https://fabricmc.net/use/" << std::endl;
         exit(1);
@@ -298,43 +386,151 @@ void validate_fabric_installation(const std::string& mcversion, const std::strin
 }
 
 
-bool is_modpack_downloaded(const std::string& modpack_zip_path) {
-    std::ifstream file(modpack_zip_path, std::ios::binary);
-    if (file) {
-        file.close();
-        std::cout << "Modpack already downloaded at: " << modpack_zip_path << std::endl;
-        return true;
+// Local path of the modpack archive. Downloads go to the machine-wide cache, where concurrent
+// installers (one per logged-on user, say) share a single transfer and a cached copy that fails
+// its checksum is fetched again.
+std::string ensure_modpack_archive(const std::string& modpack_url) {
+	std::string modpack_zip_path = get_modpack_archive_path(modpack_url);
+    if (modpack_zip_path == modpack_url) {
+        return modpack_zip_path;
+    }
+
+    // An offline bundle carries the pack it was built with
+    const Bundle* bundle = get_offline_bundle();
+    ExpectedHashes modpack_hashes;
+    bool ok;
+    if (bundle && get_bundled_modpack_url(*bundle) == modpack_url) {
+        std::cout << "Using the modpack from the offline bundle." << std::endl;
+        const BundleEntry* bundled = bundle->find(BUNDLE_MODPACK_ENTRY);
+        modpack_hashes.sha256 = bundled->sha256;
+        ok = ensure_shared_file(modpack_zip_path, modpack_hashes, [&](const std::string& temp_path) {
+            return bundle->extract(*bundled, temp_path);
+        });
     } else {
-        std::cout << "Modpack not found at: " << modpack_zip_path << std::endl;
-        return false;
-	}
+        if (modpack_url == MODPACK_URL) {
+            modpack_hashes.sha256 = MODPACK_SHA256;
+        }
+        ok = ensure_shared_file(modpack_zip_path, modpack_hashes, [&](const std::string& temp_path) {
+            std::cout << "Modpack not downloaded. Downloading..." << std::endl;
+            download_file(modpack_url, temp_path, modpack_hashes);
+            return true;
+        });
+    }
+    if (!ok) {
+        exit(1);
+    }
+    std::cout << "Modpack archive: " << modpack_zip_path << std::endl;
+    return modpack_zip_path;
 }
 
-
 void validate_modpack_installation(const std::string& modpack_url) {
     std::cout << "Downloading and installing modpack..." << std::endl;
+    std::string modpack_zip_path = ensure_modpack_archive(modpack_url);
 
-	std::string temp_dir = safe_getenv("TEMP");
-	std::string modpack_zip_path = temp_dir + "\\cove-s8-modpack.zip";
-	
-    // Check if the modpack is already downloaded
-    if (!is_modpack_downloaded(modpack_zip_path)) {
-        std::cout << "Modpack not downloaded. Downloading..." << std::endl;
-        download_file(modpack_url, modpack_zip_path);
-	}
-    else {
-		std::cout << "Modpack already downloaded. Skipping download." << std::endl;
-    }
-	// Unzip the modpack into the modded install directory
-	std::string modded_install_dir = safe_getenv("USERPROFILE") + "\\Games\\Minecraft\\modded-install\\mods";
-    std::string unzip_cmd = "powershell -Command \"Expand-Archive -Path '" + modpack_zip_path + "' -DestinationPath '" + modded_install_dir + "' -Force\"";
-    std::cout << "Unzip command: " << unzip_cmd << std::endl;
-    int result = system(unzip_cmd.c_str());
-    if (result != 0) {
-        std::cerr << "Failed to unzip the modpack. Please unzip manually." << std::endl;
+    const Bundle* bundle = get_offline_bundle();
+    if (bundle && !import_bundled_store_objects(*bundle)) {
+        std::cerr << "Failed to import the modpack files from the offline bundle." << std::endl;
         exit(1);
     }
-	std::cout << "Modpack unzipped successfully into: " << modded_install_dir << std::endl;	
+
+    // The new mod set is built next to the current one and switched in only once it is complete.
+    // A plain zip pack is the whole mod set, so its stage starts empty and drops what the pack did.
+    std::string instance_dir = safe_getenv("USERPROFILE") + "\\Games\\Minecraft\\modded-install";
+    ZipArchive archive;
+    bool mrpack = archive.open(modpack_zip_path) && is_mrpack(archive);
+    std::string stage_dir;
+    if (!begin_mods_update(instance_dir, mrpack, stage_dir)) {
+        std::cerr << "Failed to prepare the mods update." << std::endl;
+        exit(1);
+    }
+
+    // Modrinth packs list their mods by hash and download them individually
+    bool installed;
+    if (mrpack) {
+        installed = install_mrpack(modpack_zip_path, instance_dir, stage_dir, PackSide::Client);
+    } else {
+        // Extract the modpack through the shared store
+        PhaseScope phase("extraction");
+        auto unzip_start = std::chrono::steady_clock::now();
+        MaterializeStats stats;
+        long long extracted_bytes = 0;
+        installed = materialize_zip(modpack_zip_path, stage_dir, stats, extracted_bytes);
+        if (installed) {
+            record_extraction(extracted_bytes, std::chrono::duration<double>(std::chrono::steady_clock::now() - unzip_start).count());
+            print_materialize_stats(stats);
+        }
+    }
+    if (!installed || !check_staged_mods(modpack_zip_path, stage_dir)) {
+        abort_mods_update(stage_dir);
+        std::cerr << "Failed to install the modpack; the current mods were left in place." << std::endl;
+        exit(1);
+    }
+    if (!commit_mods_update(instance_dir, stage_dir)) {
+        std::cerr << "Failed to switch to the new mods; the current mods were left in place." << std::endl;
+        exit(1);
+    }
+	std::cout << "Modpack installed into: " << instance_dir << "\\mods" << std::endl;
+}
+
+// Build an installer that needs no network: this executable with the JDK and Fabric installers,
+// the Fabric profile and libraries from this machine, the modpack and (for .mrpack) its files appended
+bool create_offline_bundle(const std::string& output_path, const std::string& modpack_url, const std::string& minecraft_dir) {
+    BundleWriter writer;
+    writer.add(BUNDLE_JDK_ENTRY, get_java_installer());
+    writer.add(BUNDLE_FABRIC_ENTRY, get_fabric_installer());
+
+    std::string loader_version = find_installed_fabric_loader(minecraft_dir, MINECRAFT_VERSION, FABRIC_LOADER_VERSION);
+    if (!loader_version.empty()) {
+        std::string version_id = "fabric-loader-" + loader_version + "-" + MINECRAFT_VERSION;
+        for (const std::string& path : get_fabric_profile_files(minecraft_dir, version_id)) {
+            std::string local_path = minecraft_dir + "\\" + path;
+            std::replace(local_path.begin(), local_path.end(), '/', '\\');
+            writer.add(BUNDLE_MINECRAFT_PREFIX + path, local_path);
+        }
+    } else {
+        std::cout << "Fabric is not installed here, so the bundle will run the Fabric installer (which needs the network)." << std::endl;
+    }
+
+    std::string modpack_zip_path = ensure_modpack_archive(modpack_url);
+    std::string url_path = get_store_dir() + "\\bundle-modpack-url.txt";
+    create_store_directory(parent_directory(url_path));
+    {
+        std::ofstream url_file(url_path, std::ios::binary | std::ios::trunc);
+        url_file << modpack_url;
+    }
+    writer.add(BUNDLE_MODPACK_ENTRY, modpack_zip_path);
+    writer.add(BUNDLE_MODPACK_URL_ENTRY, url_path);
+
+    ZipArchive archive;
+    MrpackIndex index;
+    if (archive.open(modpack_zip_path) && is_mrpack(archive)) {
+        if (!read_mrpack_index(archive, index)) {
+            return false;
+        }
+        std::vector<const MrpackFile*> files;
+        for (const MrpackFile& file : index.files) {
+            if (mrpack_file_applies(file, PackSide::Client)) {
+                files.push_back(&file);
+            }
+        }
+        if (!fetch_mrpack_files(index, files)) {
+            return false;
+        }
+        std::set<std::string> added;
+        for (const MrpackFile* file : files) {
+            std::string sha1 = to_hex(file->sha1, sizeof(file->sha1));
+            if (added.insert(sha1).second) {
+                writer.add(BUNDLE_STORE_PREFIX + sha1, get_store_object_path(sha1));
+            }
+        }
+    }
+
+    std::cout << "Writing offline bundle to " << output_path << std::endl;
+    if (!writer.write(get_own_image_path(), output_path)) {
+        return false;
+    }
+    std::cout << "Offline bundle written (" << get_file_size(output_path) << " bytes)." << std::endl;
+    return true;
 }
 
 // Add Java's bin directory to the current process PATH
@@ -379,109 +575,277 @@ bool add_java_to_path(const std::string& java_bin_dir) {
 
 // Get the full path to java.exe from a Java installation that meets the required version
 std::string get_java_path() {
-    // First try to find java.exe in PATH
-    char buffer[MAX_PATH];
-    DWORD result = SearchPathA(NULL, "java.exe", NULL, MAX_PATH, buffer, NULL);
-    if (result > 0 && result < MAX_PATH) {
-        std::string java_path = buffer;
-        
-        // Verify the version by running java -version
-        std::string version_cmd = "\"" + java_path + "\" -version 2>&1";
-        std::string output = exec(version_cmd.c_str());
-        if (!output.empty()) {
-            // Parse version from output similar to get_java_version
-            size_t first_line_end = output.find('\n');
-            if (first_line_end == std::string::npos) {
-                first_line_end = output.length();
+    PhaseScope phase("discovery");
+    bool first_on_path = false;
+    std::vector<std::string> candidates = find_java_executables("java.exe", first_on_path);
+    std::string version;
+    int found = pick_java_executable(candidates, version);
+    if (found < 0) {
+        std::cout << "Could not find java.exe with version " << REQUIRED_JAVA_VERSION << " or newer." << std::endl;
+        return "";
+    }
+    std::cout << "Found suitable java.exe" << (found == 0 && first_on_path ? " in PATH" : "") << ": " << candidates[found] << " (version " << version << ")" << std::endl;
+    return candidates[found];
+}
+
+// Command line options
+struct InstallerOptions {
+    std::string mode = "install";            // "install", "plan", "verify", "rollback", "bundle", "peer" or "java"
+    std::string bundle_output;               // "bundle": installer to write
+    std::string modpack_url = MODPACK_URL;   // URL or local path of a .zip or .mrpack
+    VerifyOptions verify;
+    bool peers = false;                      // share downloads with other installers on the LAN
+    std::string peer_interface;              // IPv4 address of the LAN interface to use
+    std::string record_path;                 // cassette to record every HTTP response into
+    std::string replay_path;                 // cassette to serve every HTTP response from
+    CassetteShaping replay_shaping;
+    std::string timings_path;                // JSON file to write phase timings to after an install or "java"
+    std::string metrics_path;                // OpenMetrics file for node_exporter, written however an install or "java" ends
+    bool memory = false;                     // count allocations and peak memory per phase, printed at exit
+    ProgressStyle progress = default_progress_style();   // live status and buffered console output during an install
+    bool perf_counters = false;              // CPU counters per phase and thread into the timings (Linux builds)
+    bool low_priority = false;               // fewer hashing/extraction threads, at below-normal OS priority
+};
+
+void print_usage() {
+    std::cerr << "Usage: mc-mod-installer [plan | verify [--repair] [--full] | rollback | bundle <output.exe> | peer | java] [--modpack <url or path>] [--mirror | --alt-mirror <url prefix>=<replacement>]... [--peers] [--peer-interface <ip>] [--record <cassette> | --replay <cassette> [--replay-latency <ms>] [--replay-bandwidth <KB/s>]] [--timings <file.json>] [--metrics <file.prom>] [--progress tty|json|off] [--memory] [--perf-counters] [--low-priority]" << std::endl;
+}
+
+bool parse_arguments(int argc, char* argv[], InstallerOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "plan" || arg == "verify" || arg == "rollback" || arg == "peer" || arg == "java") && i == 1) {
+            options.mode = arg;
+        } else if (arg == "bundle" && i == 1 && i + 1 < argc) {
+            options.mode = arg;
+            options.bundle_output = argv[++i];
+        } else if (arg == "--repair" && options.mode == "verify") {
+            options.verify.repair = true;
+        } else if (arg == "--full" && options.mode == "verify") {
+            options.verify.full = true;
+        } else if (arg == "--modpack" && i + 1 < argc) {
+            options.modpack_url = argv[++i];
+        } else if ((arg == "--mirror" || arg == "--alt-mirror") && i + 1 < argc) {
+            // e.g. --mirror https://cdn.modrinth.com=http://127.0.0.1:8080 to test against a local server;
+            // --alt-mirror adds the replacement as another source instead of replacing the original
+            std::string mapping = argv[++i];
+            size_t eq = mapping.find('=');
+            if (eq == std::string::npos || eq == 0) {
+                std::cerr << "Invalid " << arg << " value: " << mapping << std::endl;
+                return false;
             }
-            std::string first_line = output.substr(0, first_line_end);
-            
-            size_t first_quote = first_line.find('\"');
-            if (first_quote != std::string::npos) {
-                size_t second_quote = first_line.find('\"', first_quote + 1);
-                if (second_quote != std::string::npos) {
-                    std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
-                    if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
-                        std::cout << "Found suitable java.exe in PATH: " << java_path << " (version " << version << ")" << std::endl;
-                        return java_path;
-                    }
-                }
+            if (arg == "--mirror") {
+                add_download_mirror(mapping.substr(0, eq), mapping.substr(eq + 1));
+            } else {
+                add_alternate_mirror(mapping.substr(0, eq), mapping.substr(eq + 1));
             }
+        } else if (arg == "--peers") {
+            options.peers = true;
+        } else if (arg == "--peer-interface" && i + 1 < argc) {
+            options.peer_interface = argv[++i];
+        } else if (arg == "--timings" && i + 1 < argc) {
+            options.timings_path = argv[++i];
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            options.metrics_path = argv[++i];
+        } else if (arg == "--progress" && i + 1 < argc) {
+            std::string style = argv[++i];
+            if (style == "tty") {
+                options.progress = ProgressStyle::Tty;
+            } else if (style == "json") {
+                options.progress = ProgressStyle::JsonLines;
+            } else if (style == "off") {
+                options.progress = ProgressStyle::Off;
+            } else {
+                std::cerr << "Unknown progress style: " << style << std::endl;
+                return false;
+            }
+        } else if (arg == "--memory") {
+            options.memory = true;
+        } else if (arg == "--perf-counters") {
+            options.perf_counters = true;
+        } else if (arg == "--low-priority") {
+            options.low_priority = true;
+        } else if (arg == "--record" && i + 1 < argc) {
+            options.record_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replay_path = argv[++i];
+        } else if (arg == "--replay-latency" && i + 1 < argc) {
+            options.replay_shaping.latency_ms = std::atoi(argv[++i]);
+        } else if (arg == "--replay-bandwidth" && i + 1 < argc) {
+            options.replay_shaping.bytes_per_sec = std::atoll(argv[++i]) * 1024;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
         }
     }
-    
-    // If not found in PATH or version is insufficient, search common installation directories
-    std::vector<std::string> search_paths = {
-        "C:\\Program Files\\Java",
-        "C:\\Program Files\\Oracle",
-        "C:\\Program Files\\Eclipse Adoptium",
-        "C:\\Program Files\\Eclipse Foundation",
-        "C:\\Program Files (x86)\\Java",
-        "C:\\Program Files (x86)\\Oracle",
-        "C:\\Program Files (x86)\\Eclipse Adoptium",
-        "C:\\Program Files (x86)\\Eclipse Foundation"
+    return true;
+}
+
+// Phase timings and event counts of this run, for --timings
+static void write_timings(const std::string& path, std::chrono::steady_clock::time_point run_start) {
+    nlohmann::json timings = {
+        { "status", "ok" },
+        { "total_seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count() },
+        { "phases", phase_timings_to_json() },
+        { "counts", event_counts_to_json() }
     };
-    
-    for (const std::string& base_path : search_paths) {
-        WIN32_FIND_DATAA findFileData;
-        HANDLE hFind = FindFirstFileA((base_path + "\\*").c_str(), &findFileData);
-        
-        if (hFind != INVALID_HANDLE_VALUE) {
-            do {
-                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                    std::string dir_name = findFileData.cFileName;
-                    if (dir_name != "." && dir_name != "..") {
-                        std::string java_dir = base_path + "\\" + dir_name;
-                        std::string java_path = java_dir + "\\bin\\java.exe";
-                        
-                        // Check if java.exe exists
-                        std::ifstream file(java_path);
-                        if (file.good()) {
-                            file.close();
-                            
-                            // Test version
-                            std::string version_cmd = "\"" + java_path + "\" -version 2>&1";
-                            std::string output = exec(version_cmd.c_str());
-                            if (!output.empty()) {
-                                // Parse version
-                                size_t first_line_end = output.find('\n');
-                                if (first_line_end == std::string::npos) {
-                                    first_line_end = output.length();
-                                }
-                                std::string first_line = output.substr(0, first_line_end);
-                                
-                                size_t first_quote = first_line.find('\"');
-                                if (first_quote != std::string::npos) {
-                                    size_t second_quote = first_line.find('\"', first_quote + 1);
-                                    if (second_quote != std::string::npos) {
-                                        std::string version = first_line.substr(first_quote + 1, second_quote - first_quote - 1);
-                                        if (is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
-                                            std::cout << "Found suitable java.exe: " << java_path << " (version " << version << ")" << std::endl;
-                                            FindClose(hFind);
-                                            return java_path;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            } while (FindNextFileA(hFind, &findFileData) != 0);
-            FindClose(hFind);
-        }
+    if (memory_accounting_enabled()) {
+        timings["memory"] = memory_stats_to_json();
     }
-    
-    std::cout << "Could not find java.exe with version " << REQUIRED_JAVA_VERSION << " or newer." << std::endl;
-    return ""; // Return empty string if not found
+    if (perf_counters_enabled()) {
+        timings["perf_counters"] = perf_counters_to_json();
+    }
+    std::ofstream(path) << timings.dump(2) << std::endl;
+}
+
+// --metrics describes how the run ended, including through exit() on a failure: runs that do not
+// reach a successful end are reported as "failed" when the process exits
+static std::string g_metrics_path;
+static std::chrono::steady_clock::time_point g_run_start;
+static bool g_metrics_written = false;
+
+static void write_metrics(const std::string& status) {
+    if (g_metrics_path.empty() || g_metrics_written) {
+        return;
+    }
+    g_metrics_written = true;
+    write_openmetrics(g_metrics_path, status, std::chrono::duration<double>(std::chrono::steady_clock::now() - g_run_start).count());
+}
+
+static void write_failed_metrics() {
+    write_metrics("failed");
 }
 
 // main function to run the setup script
-int main() {
+int main(int argc, char* argv[]) {
+    auto run_start = std::chrono::steady_clock::now();
+
     // Get the user's home directory
     std::string home_dir = safe_getenv("USERPROFILE");
     std::string modded_install_dir = home_dir + "\\Games\\Minecraft\\modded-install";
     std::string minecraft_dir = home_dir + "\\AppData\\Roaming\\.minecraft";
 
+    InstallerOptions options;
+    if (!parse_arguments(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+    // Before anything submits work: the pool is sized when it starts
+    set_executor_low_priority(options.low_priority);
+    if (options.memory) {
+        enable_memory_accounting();
+    }
+    if (options.perf_counters && !enable_perf_counters()) {
+        std::cerr << "Hardware counters need perf_event_open and are only collected by Linux builds; --perf-counters is ignored." << std::endl;
+    }
+    if (!options.metrics_path.empty() && (options.mode == "install" || options.mode == "java")) {
+        g_metrics_path = options.metrics_path;
+        g_run_start = run_start;
+        std::atexit(write_failed_metrics);
+    }
+
+    // An offline bundle installs the pack it carries unless another one was asked for
+    const Bundle* bundle = get_offline_bundle();
+    if (bundle) {
+        std::cout << "Offline bundle found (" << bundle->entries().size() << " files)." << std::endl;
+        std::string bundled_url = get_bundled_modpack_url(*bundle);
+        if (!bundled_url.empty() && options.modpack_url == MODPACK_URL) {
+            options.modpack_url = bundled_url;
+        }
+    }
+
+    // A recording is packed when the process ends, including through exit() on a failure
+    static CassetteRecorder recorder;
+    static Cassette cassette;
+    if (!options.record_path.empty()) {
+        if (!recorder.open(options.record_path)) {
+            return 1;
+        }
+        use_cassette_recorder(&recorder);
+    } else if (!options.replay_path.empty()) {
+        if (!cassette.open(options.replay_path)) {
+            return 1;
+        }
+        cassette.set_shaping(options.replay_shaping);
+        use_cassette(&cassette);
+        std::cout << "Replaying " << cassette.exchange_count() << " recorded HTTP exchanges from " << options.replay_path << "." << std::endl;
+    }
+
+    // Serve the store to other installers on the LAN and fetch from them before the internet
+    PeerCache peer_cache;
+    if (options.peers || options.mode == "peer") {
+        PeerCacheOptions peer_options;
+        peer_options.interface_address = options.peer_interface;
+        peer_options.list_keys = store_list_keys;
+        peer_options.resolve = store_resolve_key;
+        if (peer_cache.start(peer_options)) {
+            use_peer_cache(&peer_cache);
+            std::cout << "Sharing downloads with LAN peers on port " << peer_cache.http_port() << "." << std::endl;
+            // Peers are only trusted against a known digest, which a bundle carries and MODPACK_SHA256 may
+            bool modpack_digest_known = (bundle && get_bundled_modpack_url(*bundle) == options.modpack_url)
+                || (options.modpack_url == MODPACK_URL && !MODPACK_SHA256.empty());
+            if (options.mode != "peer" && !modpack_digest_known && !file_exists(options.modpack_url)) {
+                std::cout << "The modpack archive has no published SHA-256, so it is downloaded from the internet rather than from peers." << std::endl;
+            }
+        } else {
+            std::cerr << "LAN peer cache unavailable; downloading from the internet only." << std::endl;
+        }
+    }
+
+    // "peer" only serves what this machine already has, e.g. from a machine set up before the event
+    if (options.mode == "peer") {
+        if (peer_cache.http_port() == 0) {
+            return 1;
+        }
+        std::cout << "Serving " << store_list_keys().size() << " files. Press Ctrl+C to stop." << std::endl;
+        for (;;) {
+            Sleep(60 * 1000);
+            std::cout << "Served " << peer_cache.bytes_served() / (1024 * 1024) << " MB so far." << std::endl;
+        }
+    }
+
+    // "bundle" writes a copy of this installer that works without a network connection
+    if (options.mode == "bundle") {
+        return create_offline_bundle(options.bundle_output, options.modpack_url, minecraft_dir) ? 0 : 1;
+    }
+
+    // "plan" only inspects this machine and prints what a real run would do, as JSON
+    if (options.mode == "plan") {
+        InstallPlan plan = build_install_plan(minecraft_dir, modded_install_dir, options.modpack_url);
+        std::cout << install_plan_to_json(plan).dump(2) << std::endl;
+        return 0;
+    }
+
+    // "verify" checks the installed files against the modpack and optionally repairs them
+    if (options.mode == "verify") {
+        std::string modpack_zip_path = ensure_modpack_archive(options.modpack_url);
+        VerifyReport report;
+        bool ok = verify_instance(modpack_zip_path, modded_install_dir, options.verify, report);
+        print_verify_report(report);
+        return ok && (report.clean() || options.verify.repair) ? 0 : 1;
+    }
+
+    // "rollback" points the mods directory back at the previous installed version
+    if (options.mode == "rollback") {
+        return rollback_mods(modded_install_dir) ? 0 : 1;
+    }
+
+    // "java" runs only the Java lookups an install makes, to time them and count the JVMs they start
+    if (options.mode == "java") {
+        bool installed = is_java_installed();
+        std::string java_path = get_java_path();
+        std::string javaw_path = get_javaw_path();
+        bool found = installed || (!java_path.empty() && !javaw_path.empty());
+        if (!options.timings_path.empty()) {
+            write_timings(options.timings_path, run_start);
+        }
+        write_metrics(found ? "ok" : "failed");
+        return found ? 0 : 1;
+    }
+
+    // From here on console output is buffered and written together with the live progress status
+    ProgressReporter progress(options.progress);
+
     std::cout << "Creating Minecraft modded install directory" << std::endl;
     create_directory(modded_install_dir);
 
@@ -492,7 +856,10 @@ int main() {
     validate_fabric_installation(MINECRAFT_VERSION, FABRIC_LOADER_VERSION);
 
     // Add launcher profile for the modded install
-    add_minecraft_launcher_profile(minecraft_dir, modded_install_dir, FABRIC_LOADER_VERSION, MINECRAFT_VERSION, "The Cove - Season 8 (" + MINECRAFT_VERSION + ")");
+    {
+        PhaseScope phase("profile_write");
+        add_minecraft_launcher_profile(minecraft_dir, modded_install_dir, FABRIC_LOADER_VERSION, MINECRAFT_VERSION, MODPACK_PROFILE_NAME);
+    }
 
     // Wait for user to launch modded Minecraft install and close it (can skip this step, mods folder can be there before install initialization)
     // std::cout << "\n\nNow, launch your modded Minecraft install and close it!" << std::endl;
@@ -500,9 +867,13 @@ int main() {
     // std::cin.get();
     
     // download and unzip the modpack into the modded install
-    validate_modpack_installation(MODPACK_URL);
+    validate_modpack_installation(options.modpack_url);
 
 
     std::cout << "Setup script completed." << std::endl;
+    if (!options.timings_path.empty()) {
+        write_timings(options.timings_path, run_start);
+    }
+    write_metrics("ok");
     return 0;
 }
@@ -0,0 +1,257 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "memory_stats.hpp"
+#include "phases.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+static const int MEMORY_PHASE_SLOTS = 16;   // phases beyond this many are counted as "outside phases"
+
+struct MemorySlot {
+    std::atomic<long long> allocations{ 0 };
+    std::atomic<long long> bytes{ 0 };
+    std::atomic<long long> peak_heap{ 0 };      // heap in use at its highest while this phase was allocating
+    std::atomic<long long> rss_at_start{ 0 };   // process peak RSS when the phase last became active
+    std::atomic<long long> rss_growth{ 0 };     // how far the process peak RSS rose while it was active
+    std::atomic<long long> peak_rss{ 0 };       // process peak RSS when it last went idle
+};
+
+static std::atomic<bool> g_enabled{ false };
+static std::atomic<long long> g_heap_in_use{ 0 };
+static std::atomic<long long> g_peak_heap{ 0 };
+static MemorySlot g_slots[MEMORY_PHASE_SLOTS + 1];   // the last one is "outside phases"
+static thread_local int t_phase = -1;
+
+// Only builds with INSTALLER_MEMORY_STATS replace operator new/delete and count the heap; the
+// others allocate exactly as they would without this file
+#ifdef INSTALLER_MEMORY_STATS
+static const bool HEAP_COUNTED = true;
+#else
+static const bool HEAP_COUNTED = false;
+#endif
+
+#ifdef INSTALLER_MEMORY_STATS
+// Every block starts with a header holding the size it was counted with, or -1 if it was
+// allocated while accounting was off, so a release only takes back what its allocation added.
+// 16 bytes keep the caller's pointer as aligned as malloc's.
+static const size_t BLOCK_HEADER_SIZE = 16;
+
+#ifdef _MSC_VER
+#define MEMORY_NOINLINE __declspec(noinline)
+#else
+#define MEMORY_NOINLINE __attribute__((noinline))
+#endif
+
+// Out of line on purpose: with free() inlined into operator delete, GCC pairs it with the
+// operator new of the caller and reports a mismatch (-Wmismatched-new-delete)
+static MEMORY_NOINLINE void* allocate_block(size_t size) {
+    return std::malloc(size);
+}
+
+static MEMORY_NOINLINE void release_block(void* block) {
+    std::free(block);
+}
+
+static void update_max(std::atomic<long long>& peak, long long value) {
+    long long seen = peak.load(std::memory_order_relaxed);
+    while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+static void note_allocation(long long size) {
+    MemorySlot& slot = g_slots[t_phase >= 0 && t_phase < MEMORY_PHASE_SLOTS ? t_phase : MEMORY_PHASE_SLOTS];
+    slot.allocations.fetch_add(1, std::memory_order_relaxed);
+    slot.bytes.fetch_add(size, std::memory_order_relaxed);
+    long long in_use = g_heap_in_use.fetch_add(size, std::memory_order_relaxed) + size;
+    update_max(g_peak_heap, in_use);
+    update_max(slot.peak_heap, in_use);
+}
+#endif
+
+// Peak resident set of the process so far, in bytes; reading it must not allocate
+static long long get_peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return static_cast<long long>(counters.PeakWorkingSetSize);
+#else
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status) {
+        char line[256];
+        long long kilobytes = 0;
+        while (fgets(line, sizeof(line), status)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kilobytes = atoll(line + 6);
+                break;
+            }
+        }
+        fclose(status);
+        return kilobytes * 1024;
+    }
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<long long>(usage.ru_maxrss) * 1024 : 0;
+#endif
+}
+
+#ifdef INSTALLER_MEMORY_STATS
+void* operator new(size_t size) {
+    if (size > static_cast<size_t>(-1) - BLOCK_HEADER_SIZE) {
+        throw std::bad_alloc();
+    }
+    void* block;
+    while (!(block = allocate_block(size + BLOCK_HEADER_SIZE))) {
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+    long long counted = -1;
+    if (g_enabled.load(std::memory_order_relaxed)) {
+        counted = static_cast<long long>(size);
+        note_allocation(counted);
+    }
+    memcpy(block, &counted, sizeof(counted));
+    return static_cast<char*>(block) + BLOCK_HEADER_SIZE;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) {
+        return;
+    }
+    void* block = static_cast<char*>(p) - BLOCK_HEADER_SIZE;
+    long long counted;
+    memcpy(&counted, block, sizeof(counted));
+    if (counted >= 0) {
+        g_heap_in_use.fetch_sub(counted, std::memory_order_relaxed);
+    }
+    release_block(block);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    operator delete(p);
+}
+#endif
+
+// Printed however the process ends, since the runs worth looking at are often the ones that fail
+void enable_memory_accounting() {
+    if (!g_enabled.exchange(true)) {
+        std::atexit(print_memory_summary);
+    }
+}
+
+bool memory_accounting_enabled() {
+    return g_enabled;
+}
+
+int set_memory_phase(int phase) {
+    int previous = t_phase;
+    t_phase = phase;
+    return previous;
+}
+
+int get_memory_phase() {
+    return t_phase;
+}
+
+void memory_phase_started(int phase) {
+    if (g_enabled && phase >= 0 && phase < MEMORY_PHASE_SLOTS) {
+        g_slots[phase].rss_at_start = get_peak_rss();
+    }
+}
+
+void memory_phase_ended(int phase) {
+    if (g_enabled && phase >= 0 && phase < MEMORY_PHASE_SLOTS) {
+        long long peak = get_peak_rss();
+        g_slots[phase].rss_growth += std::max(0LL, peak - g_slots[phase].rss_at_start.load());
+        g_slots[phase].peak_rss = peak;
+    }
+}
+
+static nlohmann::json slot_to_json(const MemorySlot& slot) {
+    return {
+        { "allocations", slot.allocations.load() },
+        { "bytes", slot.bytes.load() },
+        { "peak_heap_bytes", slot.peak_heap.load() },
+        { "peak_rss_bytes", slot.peak_rss.load() },
+        { "rss_growth_bytes", slot.rss_growth.load() }
+    };
+}
+
+nlohmann::json memory_stats_to_json() {
+    nlohmann::json phases = nlohmann::json::object();
+    std::vector<PhaseTiming> timings = get_phase_timings();
+    for (size_t i = 0; i < timings.size() && i < static_cast<size_t>(MEMORY_PHASE_SLOTS); ++i) {
+        phases[timings[i].name] = slot_to_json(g_slots[i]);
+    }
+    return {
+        { "heap_counted", HEAP_COUNTED },
+        { "peak_heap_bytes", g_peak_heap.load() },
+        { "peak_rss_bytes", get_peak_rss() },
+        { "phases", phases },
+        { "outside_phases", slot_to_json(g_slots[MEMORY_PHASE_SLOTS]) }
+    };
+}
+
+void print_memory_summary() {
+    auto mb = [](long long bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+    auto print_row = [&](const std::string& name, const MemorySlot& slot) {
+        std::cout << "  " << std::left << std::setw(16) << name << std::right << std::setw(12) << slot.allocations.load()
+                  << std::fixed << std::setprecision(1) << std::setw(14) << mb(slot.bytes) << std::setw(14) << mb(slot.peak_heap)
+                  << std::setw(14) << mb(slot.peak_rss) << std::setw(14) << mb(slot.rss_growth) << std::endl;
+    };
+    std::vector<PhaseTiming> timings = get_phase_timings();
+    std::cout << "Memory by phase:" << std::endl;
+    std::cout << "  " << std::left << std::setw(16) << "phase" << std::right << std::setw(12) << "allocations" << std::setw(14)
+              << "allocated MB" << std::setw(14) << "peak heap MB" << std::setw(14) << "peak RSS MB" << std::setw(14) << "RSS growth MB" << std::endl;
+    for (size_t i = 0; i < timings.size() && i < static_cast<size_t>(MEMORY_PHASE_SLOTS); ++i) {
+        print_row(timings[i].name, g_slots[i]);
+    }
+    print_row("(outside)", g_slots[MEMORY_PHASE_SLOTS]);
+    if (!HEAP_COUNTED) {
+        std::cout << "  (heap columns stay at 0 unless the installer is built with INSTALLER_MEMORY_STATS defined)" << std::endl;
+    }
+    std::cout << "Peak heap " << std::fixed << std::setprecision(1) << mb(g_peak_heap) << " MB, peak RSS " << mb(get_peak_rss()) << " MB." << std::endl;
+}
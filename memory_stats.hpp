@@ -0,0 +1,25 @@
+#ifndef MEMORY_STATS_HPP
+#define MEMORY_STATS_HPP
+
+#include "json.hpp"
+
+// Heap and resident-memory accounting per install phase, for --memory. Once enabled, the process's
+// peak working set / RSS is sampled whenever a phase starts and ends. In builds with
+// INSTALLER_MEMORY_STATS defined, the global operator new/delete also count every allocation
+// against the phase of the allocating thread (see PhaseScope); allocations made before it is
+// enabled are not counted, and neither is their release. Other builds leave the heap untouched.
+void enable_memory_accounting();
+bool memory_accounting_enabled();
+
+// Used by PhaseScope: tag this thread's allocations with a phase (-1 = none) and return the
+// previous tag, and note when a phase becomes active or idle. The executor hands the tag of the
+// thread that submits a task on to the worker that runs it.
+int set_memory_phase(int phase);
+int get_memory_phase();
+void memory_phase_started(int phase);
+void memory_phase_ended(int phase);
+
+nlohmann::json memory_stats_to_json();
+void print_memory_summary();
+
+#endif
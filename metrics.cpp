@@ -0,0 +1,114 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "metrics.hpp"
+#include "phases.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char* const METRIC_PREFIX = "mc_mod_installer_";
+
+static void write_family(std::ostream& out, const std::string& name, const char* help) {
+    out << "# TYPE " << METRIC_PREFIX << name << " gauge\n";
+    out << "# HELP " << METRIC_PREFIX << name << " " << help << "\n";
+}
+
+template <typename T>
+static void write_sample(std::ostream& out, const std::string& name, const std::string& labels, T value) {
+    out << METRIC_PREFIX << name;
+    if (!labels.empty()) {
+        out << "{" << labels << "}";
+    }
+    out << " " << value << "\n";
+}
+
+// Phase names are fixed identifiers, but label values must not break the format either way
+static std::string label(const char* name, const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+        }
+        escaped += c == '\n' ? ' ' : c;
+    }
+    return std::string(name) + "=\"" + escaped + "\"";
+}
+
+static std::string build_metrics(const std::string& status, double total_seconds) {
+    nlohmann::json counts = event_counts_to_json();
+    auto count = [&](const char* name) { return counts.value(name, 0LL); };
+    std::ostringstream out;
+
+    write_family(out, "run_success", "1 if the last run finished successfully, 0 otherwise.");
+    write_sample(out, "run_success", "", status == "ok" ? 1 : 0);
+    write_family(out, "run_status", "Final status of the last run, as a label.");
+    write_sample(out, "run_status", label("status", status), 1);
+    write_family(out, "run_timestamp_seconds", "Unix time the last run ended.");
+    write_sample(out, "run_timestamp_seconds", "", static_cast<long long>(std::time(nullptr)));
+    write_family(out, "run_duration_seconds", "Wall time of the last run.");
+    write_sample(out, "run_duration_seconds", "", total_seconds);
+
+    write_family(out, "phase_duration_seconds", "Wall time each install phase was running.");
+    for (const PhaseTiming& timing : get_phase_timings()) {
+        write_sample(out, "phase_duration_seconds", label("phase", timing.name), timing.seconds);
+    }
+
+    write_family(out, "downloaded_bytes", "Bytes obtained per source; origin includes bytes of failed attempts.");
+    const char* const sources[] = { "origin", "peer", "cache", "replay" };
+    for (const char* source : sources) {
+        write_sample(out, "downloaded_bytes", label("source", source), count(("bytes_" + std::string(source)).c_str()));
+    }
+
+    long long hits = count("cache_hits");
+    long long misses = count("cache_misses");
+    write_family(out, "cache_lookups", "Files looked up in the local store and download cache.");
+    write_sample(out, "cache_lookups", label("result", "hit"), hits);
+    write_sample(out, "cache_lookups", label("result", "miss"), misses);
+    write_family(out, "cache_hit_ratio", "Share of cache lookups that found the file; NaN without lookups.");
+    if (hits + misses > 0) {
+        write_sample(out, "cache_hit_ratio", "", static_cast<double>(hits) / static_cast<double>(hits + misses));
+    } else {
+        write_sample(out, "cache_hit_ratio", "", "NaN");
+    }
+
+    write_family(out, "files", "Instance files written, skipped because they were already in place, or failed.");
+    write_sample(out, "files", label("result", "written"), count("files_written"));
+    write_sample(out, "files", label("result", "skipped"), count("files_skipped"));
+    write_sample(out, "files", label("result", "failed"), count("files_failed"));
+
+    write_family(out, "process_spawns", "Processes started by the last run.");
+    write_sample(out, "process_spawns", "", count("process_spawns"));
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+bool write_openmetrics(const std::string& path, const std::string& status, double total_seconds) {
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out << build_metrics(status, total_seconds);
+        if (!out) {
+            std::cerr << "Failed to write metrics to " << temp_path << std::endl;
+            return false;
+        }
+    }
+#ifdef _WIN32
+    bool moved = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool moved = std::rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!moved) {
+        std::cerr << "Failed to move metrics into place at " << path << std::endl;
+        std::remove(temp_path.c_str());
+    }
+    return moved;
+}
@@ -0,0 +1,13 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+
+// Install metrics in the OpenMetrics text format, for --metrics and node_exporter's textfile
+// collector: phase durations, bytes per source (origin, peer, cache, replay), cache hit ratio,
+// files written/skipped, process spawns and the final status. Everything is a gauge describing
+// the last run. The file is written next to its final name and renamed over it, so the collector
+// never reads a half-written file.
+bool write_openmetrics(const std::string& path, const std::string& status, double total_seconds);
+
+#endif
@@ -0,0 +1,135 @@
+#include "mirrors.hpp"
+#include "constants.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t MIRROR_TTFB_SAMPLES = 32;
+static const int MIRROR_MIN_HEDGE_MS = 50;
+static const int MIRROR_MAX_HEDGE_MS = 3000;
+
+struct MirrorStats {
+    std::vector<double> ttfb;   // most recent samples, seconds
+    double bytes_per_sec = 0.0;
+    bool probe_failed = false;
+    bool probing = false;       // a probe is out; later calls neither start another nor wait for it
+};
+
+static std::mutex g_mirror_mutex;
+static std::map<std::string, MirrorStats> g_mirror_stats;
+
+std::string get_url_host(const std::string& url) {
+    size_t scheme = url.find("://");
+    size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+    size_t end = url.find_first_of("/?#", start);
+    return url.substr(0, end);
+}
+
+void record_mirror_ttfb(const std::string& url, double seconds) {
+    std::lock_guard<std::mutex> lock(g_mirror_mutex);
+    MirrorStats& stats = g_mirror_stats[get_url_host(url)];
+    if (stats.ttfb.size() == MIRROR_TTFB_SAMPLES) {
+        stats.ttfb.erase(stats.ttfb.begin());
+    }
+    stats.ttfb.push_back(seconds);
+    stats.probe_failed = false;
+}
+
+void record_mirror_throughput(const std::string& url, double bytes_per_sec) {
+    std::lock_guard<std::mutex> lock(g_mirror_mutex);
+    MirrorStats& stats = g_mirror_stats[get_url_host(url)];
+    stats.bytes_per_sec = stats.bytes_per_sec > 0.0 ? 0.7 * stats.bytes_per_sec + 0.3 * bytes_per_sec : bytes_per_sec;
+}
+
+static double percentile(std::vector<double> samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+    return samples[std::min(samples.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// A host that usually answers within this time is probably stuck if it has not answered yet
+int get_hedge_delay_ms(const std::string& url) {
+    std::lock_guard<std::mutex> lock(g_mirror_mutex);
+    auto it = g_mirror_stats.find(get_url_host(url));
+    if (it == g_mirror_stats.end() || it->second.ttfb.empty()) {
+        return MIRROR_DEFAULT_HEDGE_MS;
+    }
+    int ms = static_cast<int>(percentile(it->second.ttfb, 0.95) * 1000.0);
+    return std::min(MIRROR_MAX_HEDGE_MS, std::max(MIRROR_MIN_HEDGE_MS, ms));
+}
+
+std::vector<std::string> rank_mirrors(const std::vector<std::string>& urls, const std::function<double(const std::string& url)>& probe, bool wait_for_probes) {
+    if (urls.size() < 2) {
+        return urls;
+    }
+
+    // Probe each unmeasured host once, in parallel, and stop waiting after the probe timeout
+    std::vector<std::string> unmeasured;
+    {
+        std::lock_guard<std::mutex> lock(g_mirror_mutex);
+        for (const std::string& url : urls) {
+            std::string host = get_url_host(url);
+            auto it = g_mirror_stats.find(host);
+            bool known = it != g_mirror_stats.end() && (!it->second.ttfb.empty() || it->second.probe_failed || it->second.probing);
+            if (!known) {
+                g_mirror_stats[host].probing = true;
+                unmeasured.push_back(url);
+            }
+        }
+    }
+    if (!unmeasured.empty()) {
+        struct ProbeState {
+            std::mutex mutex;
+            std::condition_variable done;
+            size_t finished = 0;
+        };
+        auto state = std::make_shared<ProbeState>();
+        for (const std::string& url : unmeasured) {
+            // Detached: a probe stuck in a slow handshake must not hold up the install
+            std::thread([state, url, probe] {
+                double seconds = probe(url);
+                if (seconds >= 0.0) {
+                    record_mirror_ttfb(url, seconds);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(g_mirror_mutex);
+                    MirrorStats& stats = g_mirror_stats[get_url_host(url)];
+                    stats.probing = false;
+                    stats.probe_failed = seconds < 0.0 && stats.ttfb.empty();
+                }
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished++;
+                state->done.notify_all();
+            }).detach();
+        }
+        if (wait_for_probes) {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->done.wait_for(lock, std::chrono::milliseconds(MIRROR_PROBE_TIMEOUT_MS), [&] { return state->finished == unmeasured.size(); });
+        }
+    }
+
+    // Median time to first byte; failed or unanswered probes sort last, in their original order
+    std::vector<std::pair<double, size_t>> order;
+    {
+        std::lock_guard<std::mutex> lock(g_mirror_mutex);
+        for (size_t i = 0; i < urls.size(); ++i) {
+            auto it = g_mirror_stats.find(get_url_host(urls[i]));
+            bool measured = it != g_mirror_stats.end() && !it->second.ttfb.empty();
+            order.push_back({ measured ? percentile(it->second.ttfb, 0.5) : 1e9, i });
+        }
+    }
+    std::stable_sort(order.begin(), order.end());
+    std::vector<std::string> ranked;
+    for (const auto& entry : order) {
+        ranked.push_back(urls[entry.second]);
+    }
+    return ranked;
+}
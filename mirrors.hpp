@@ -0,0 +1,21 @@
+#ifndef MIRRORS_HPP
+#define MIRRORS_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Per-host latency and throughput seen by this process, used to pick between mirrors that
+// serve the same file. Hosts are "scheme://authority" of a URL.
+std::string get_url_host(const std::string& url);
+void record_mirror_ttfb(const std::string& url, double seconds);
+void record_mirror_throughput(const std::string& url, double bytes_per_sec);
+int get_hedge_delay_ms(const std::string& url);   // p95 time to first byte of the host, clamped
+
+// Order candidate URLs fastest first. Hosts never measured are probed first, all at once, with
+// probe(url) returning the time to first byte in seconds (or a negative value on failure). A host
+// whose probe outlasts MIRROR_PROBE_TIMEOUT_MS sorts last until the probe comes back; without
+// wait_for_probes, every host still being probed does.
+std::vector<std::string> rank_mirrors(const std::vector<std::string>& urls, const std::function<double(const std::string& url)>& probe, bool wait_for_probes = true);
+
+#endif
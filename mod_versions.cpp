@@ -0,0 +1,334 @@
+#define NOMINMAX
+
+#include "mod_versions.hpp"
+#include "constants.hpp"
+#include "filesystem.hpp"
+
+#include <windows.h>
+#include <winioctl.h>
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Suffix of a version that is still being built; never the target of the junction
+static const std::string STAGING_SUFFIX = ".staging";
+
+// REPARSE_DATA_BUFFER is only declared in the driver kit headers; this is its mount point form
+struct MountPointReparseBuffer {
+    DWORD ReparseTag;
+    WORD ReparseDataLength;
+    WORD Reserved;
+    WORD SubstituteNameOffset;
+    WORD SubstituteNameLength;
+    WORD PrintNameOffset;
+    WORD PrintNameLength;
+    WCHAR PathBuffer[1];
+};
+
+static bool is_directory(const std::string& path) {
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+static bool is_junction(const std::string& path) {
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+}
+
+static HANDLE open_reparse_point(const std::string& path, DWORD access) {
+    return CreateFileA(path.c_str(), access, 0, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+}
+
+// Junctions work for every user without the symlink privilege, and only need an absolute target
+static bool create_junction(const std::string& link, const std::string& target) {
+    char full_target[MAX_PATH];
+    if (!GetFullPathNameA(target.c_str(), MAX_PATH, full_target, nullptr)) {
+        return false;
+    }
+    std::string substitute_name = std::string("\\??\\") + full_target;
+    int substitute_chars = MultiByteToWideChar(CP_ACP, 0, substitute_name.c_str(), -1, nullptr, 0);
+    int print_chars = MultiByteToWideChar(CP_ACP, 0, full_target, -1, nullptr, 0);
+    if (substitute_chars <= 0 || print_chars <= 0) {
+        return false;
+    }
+
+    // Both names are stored NUL-terminated, one after the other
+    size_t names_bytes = static_cast<size_t>(substitute_chars + print_chars) * sizeof(WCHAR);
+    std::vector<char> buffer(offsetof(MountPointReparseBuffer, PathBuffer) + names_bytes, 0);
+    MountPointReparseBuffer* reparse = reinterpret_cast<MountPointReparseBuffer*>(buffer.data());
+    reparse->ReparseTag = IO_REPARSE_TAG_MOUNT_POINT;
+    reparse->ReparseDataLength = static_cast<WORD>(buffer.size() - offsetof(MountPointReparseBuffer, SubstituteNameOffset));
+    reparse->SubstituteNameOffset = 0;
+    reparse->SubstituteNameLength = static_cast<WORD>((substitute_chars - 1) * sizeof(WCHAR));
+    reparse->PrintNameOffset = static_cast<WORD>(substitute_chars * sizeof(WCHAR));
+    reparse->PrintNameLength = static_cast<WORD>((print_chars - 1) * sizeof(WCHAR));
+    MultiByteToWideChar(CP_ACP, 0, substitute_name.c_str(), -1, reparse->PathBuffer, substitute_chars);
+    MultiByteToWideChar(CP_ACP, 0, full_target, -1, reparse->PathBuffer + substitute_chars, print_chars);
+
+    if (!CreateDirectoryA(link.c_str(), nullptr)) {
+        return false;
+    }
+    HANDLE handle = open_reparse_point(link, GENERIC_WRITE);
+    DWORD returned;
+    bool ok = handle != INVALID_HANDLE_VALUE &&
+              DeviceIoControl(handle, FSCTL_SET_REPARSE_POINT, buffer.data(), static_cast<DWORD>(buffer.size()), nullptr, 0, &returned, nullptr);
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+    if (!ok) {
+        RemoveDirectoryA(link.c_str());
+    }
+    return ok;
+}
+
+// Absolute path a junction points to, or "" if path is not a junction
+static std::string read_junction_target(const std::string& path) {
+    HANDLE handle = open_reparse_point(path, 0);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return "";
+    }
+    std::vector<char> buffer(MAXIMUM_REPARSE_DATA_BUFFER_SIZE);
+    DWORD returned = 0;
+    bool ok = DeviceIoControl(handle, FSCTL_GET_REPARSE_POINT, nullptr, 0, buffer.data(), static_cast<DWORD>(buffer.size()), &returned, nullptr) != 0;
+    CloseHandle(handle);
+    const MountPointReparseBuffer* reparse = reinterpret_cast<const MountPointReparseBuffer*>(buffer.data());
+    if (!ok || reparse->ReparseTag != IO_REPARSE_TAG_MOUNT_POINT) {
+        return "";
+    }
+    const WCHAR* name = reparse->PathBuffer + reparse->SubstituteNameOffset / sizeof(WCHAR);
+    int name_chars = reparse->SubstituteNameLength / sizeof(WCHAR);
+    int bytes = WideCharToMultiByte(CP_ACP, 0, name, name_chars, nullptr, 0, nullptr, nullptr);
+    std::string target(static_cast<size_t>(std::max(bytes, 0)), '\0');
+    WideCharToMultiByte(CP_ACP, 0, name, name_chars, &target[0], bytes, nullptr, nullptr);
+    if (target.compare(0, 4, "\\??\\") == 0) {
+        target = target.substr(4);
+    }
+    return target;
+}
+
+// Delete a directory tree; junctions inside it are unlinked, never followed
+static void remove_tree(const std::string& path) {
+    if (is_junction(path)) {
+        RemoveDirectoryA(path.c_str());
+        return;
+    }
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &find_data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            std::string name = find_data.cFileName;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string child = path + "\\" + name;
+            if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                remove_tree(child);
+            } else {
+                SetFileAttributesA(child.c_str(), FILE_ATTRIBUTE_NORMAL);
+                DeleteFileA(child.c_str());
+            }
+        } while (FindNextFileA(find, &find_data) != 0);
+        FindClose(find);
+    }
+    RemoveDirectoryA(path.c_str());
+}
+
+std::string get_mod_versions_dir(const std::string& instance_dir) {
+    return instance_dir + "\\mod-versions";
+}
+
+// Complete versions, oldest first (names are timestamps)
+std::vector<std::string> list_mod_versions(const std::string& instance_dir) {
+    std::vector<std::string> versions;
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA((get_mod_versions_dir(instance_dir) + "\\*").c_str(), &find_data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return versions;
+    }
+    do {
+        std::string name = find_data.cFileName;
+        bool staging = name.size() > STAGING_SUFFIX.size() && name.compare(name.size() - STAGING_SUFFIX.size(), std::string::npos, STAGING_SUFFIX) == 0;
+        if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && name != "." && name != ".." && !staging) {
+            versions.push_back(name);
+        }
+    } while (FindNextFileA(find, &find_data) != 0);
+    FindClose(find);
+    std::sort(versions.begin(), versions.end());
+    return versions;
+}
+
+// Name of the version "mods" points to, or "" if it is not one of ours
+std::string get_current_mod_version(const std::string& instance_dir) {
+    std::string target = read_junction_target(instance_dir + "\\mods");
+    std::string versions_dir = get_mod_versions_dir(instance_dir) + "\\";
+    if (target.size() <= versions_dir.size()) {
+        return "";
+    }
+    std::string lower_target = target;
+    std::string lower_versions_dir = versions_dir;
+    std::transform(lower_target.begin(), lower_target.end(), lower_target.begin(), ::tolower);
+    std::transform(lower_versions_dir.begin(), lower_versions_dir.end(), lower_versions_dir.begin(), ::tolower);
+    if (lower_target.compare(0, lower_versions_dir.size(), lower_versions_dir) != 0) {
+        return "";
+    }
+    return target.substr(versions_dir.size());
+}
+
+// Moving the junction takes two renames ("mods" to "mods.old", "mods.next" to "mods");
+// an interrupted switch is finished, or undone, the next time the instance is touched
+static void recover_mods_switch(const std::string& instance_dir) {
+    std::string mods = instance_dir + "\\mods";
+    std::string next = mods + ".next";
+    std::string old = mods + ".old";
+    if (!is_directory(mods)) {
+        if (is_junction(next)) {
+            MoveFileExA(next.c_str(), mods.c_str(), 0);
+        } else if (is_junction(old)) {
+            MoveFileExA(old.c_str(), mods.c_str(), 0);
+        }
+    }
+    if (is_junction(next)) {
+        RemoveDirectoryA(next.c_str());
+    }
+    if (is_junction(old)) {
+        RemoveDirectoryA(old.c_str());
+    }
+}
+
+static bool switch_mods(const std::string& instance_dir, const std::string& version_dir) {
+    std::string mods = instance_dir + "\\mods";
+    std::string next = mods + ".next";
+    std::string old = mods + ".old";
+    if (!create_junction(next, version_dir)) {
+        std::cerr << "Failed to create a junction to " << version_dir << " (error " << GetLastError() << ")." << std::endl;
+        return false;
+    }
+    if (is_directory(mods) && !MoveFileExA(mods.c_str(), old.c_str(), 0)) {
+        std::cerr << "Failed to move the current mods directory aside (error " << GetLastError() << "). Is the game running?" << std::endl;
+        RemoveDirectoryA(next.c_str());
+        return false;
+    }
+    if (!MoveFileExA(next.c_str(), mods.c_str(), 0)) {
+        std::cerr << "Failed to switch the mods directory (error " << GetLastError() << ")." << std::endl;
+        MoveFileExA(old.c_str(), mods.c_str(), 0);
+        RemoveDirectoryA(next.c_str());
+        return false;
+    }
+    RemoveDirectoryA(old.c_str());
+    return true;
+}
+
+static std::string new_version_name(const std::string& versions_dir) {
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_s(&local, &now);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string name = stamp;
+    for (int n = 2; is_directory(versions_dir + "\\" + name) || is_directory(versions_dir + "\\" + name + STAGING_SUFFIX); ++n) {
+        name = std::string(stamp) + "-" + std::to_string(n);
+    }
+    return name;
+}
+
+// Keep the newest MOD_VERSIONS_TO_KEEP versions, and always the current one
+static void prune_mod_versions(const std::string& instance_dir) {
+    std::vector<std::string> versions = list_mod_versions(instance_dir);
+    std::string current = get_current_mod_version(instance_dir);
+    size_t keep = static_cast<size_t>(MOD_VERSIONS_TO_KEEP);
+    size_t keep_from = versions.size() > keep ? versions.size() - keep : 0;
+    for (size_t i = 0; i < keep_from; ++i) {
+        if (versions[i] != current) {
+            remove_tree(get_mod_versions_dir(instance_dir) + "\\" + versions[i]);
+        }
+    }
+}
+
+// Prepare a staging directory. With from_current it holds the current mod set as hardlinks, for
+// installers that remove what the pack dropped themselves (.mrpack keeps a list of its files);
+// otherwise it starts empty, and files put in through the store share their data all the same.
+bool begin_mods_update(const std::string& instance_dir, bool from_current, std::string& stage_dir) {
+    std::string versions_dir = get_mod_versions_dir(instance_dir);
+    std::string mods = instance_dir + "\\mods";
+    create_directory(versions_dir);
+    recover_mods_switch(instance_dir);
+
+    // Builds that never completed
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA((versions_dir + "\\*" + STAGING_SUFFIX).c_str(), &find_data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            remove_tree(versions_dir + "\\" + find_data.cFileName);
+        } while (FindNextFileA(find, &find_data) != 0);
+        FindClose(find);
+    }
+
+    // First update under this scheme: the existing mods directory becomes the first version
+    if (is_directory(mods) && !is_junction(mods)) {
+        std::string first = versions_dir + "\\" + new_version_name(versions_dir);
+        if (!MoveFileExA(mods.c_str(), first.c_str(), 0) || !create_junction(mods, first)) {
+            std::cerr << "Failed to move the mods directory under " << versions_dir << " (error " << GetLastError() << "). Is the game running?" << std::endl;
+            return false;
+        }
+        std::cout << "Existing mods kept as version " << first << std::endl;
+    }
+
+    stage_dir = versions_dir + "\\" + new_version_name(versions_dir) + STAGING_SUFFIX;
+    create_directory(stage_dir);
+    if (from_current && is_directory(mods)) {
+        for (const FileInfo& file : list_files_recursive(mods)) {
+            std::string source = mods + "\\" + file.relative_path;
+            std::string target = stage_dir + "\\" + file.relative_path;
+            create_directory(parent_directory(target));
+            if (!CreateHardLinkA(target.c_str(), source.c_str(), nullptr) && !CopyFileA(source.c_str(), target.c_str(), FALSE)) {
+                std::cerr << "Failed to stage " << file.relative_path << " (error " << GetLastError() << ")." << std::endl;
+                abort_mods_update(stage_dir);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Publish a checked staging directory as the new current version
+bool commit_mods_update(const std::string& instance_dir, const std::string& stage_dir) {
+    std::string version_dir = stage_dir.substr(0, stage_dir.size() - STAGING_SUFFIX.size());
+    if (!MoveFileExA(stage_dir.c_str(), version_dir.c_str(), 0)) {
+        std::cerr << "Failed to finish the staged mods (error " << GetLastError() << ")." << std::endl;
+        abort_mods_update(stage_dir);
+        return false;
+    }
+    if (!switch_mods(instance_dir, version_dir)) {
+        remove_tree(version_dir);
+        return false;
+    }
+    prune_mod_versions(instance_dir);
+    std::cout << "Switched mods to version " << version_dir.substr(parent_directory(version_dir).size() + 1) << std::endl;
+    return true;
+}
+
+void abort_mods_update(const std::string& stage_dir) {
+    remove_tree(stage_dir);
+}
+
+// Point "mods" back at the version before the current one
+bool rollback_mods(const std::string& instance_dir) {
+    recover_mods_switch(instance_dir);
+    std::vector<std::string> versions = list_mod_versions(instance_dir);
+    std::string current = get_current_mod_version(instance_dir);
+    auto it = std::find(versions.begin(), versions.end(), current);
+    if (current.empty() || it == versions.end() || it == versions.begin()) {
+        std::cerr << "No earlier mods version to roll back to (" << versions.size() << " kept under " << get_mod_versions_dir(instance_dir) << ")." << std::endl;
+        return false;
+    }
+    const std::string& previous = *(it - 1);
+    if (!switch_mods(instance_dir, get_mod_versions_dir(instance_dir) + "\\" + previous)) {
+        return false;
+    }
+    std::cout << "Rolled mods back from " << current << " to " << previous << std::endl;
+    return true;
+}
@@ -0,0 +1,18 @@
+#ifndef MOD_VERSIONS_HPP
+#define MOD_VERSIONS_HPP
+
+#include <string>
+#include <vector>
+
+// The instance's "mods" directory is a junction to one complete version under "mod-versions".
+// An update builds the next version in a staging directory and only then moves the junction,
+// so the game always sees either the old mod set or the new one.
+std::string get_mod_versions_dir(const std::string& instance_dir);
+std::vector<std::string> list_mod_versions(const std::string& instance_dir);
+std::string get_current_mod_version(const std::string& instance_dir);
+bool begin_mods_update(const std::string& instance_dir, bool from_current, std::string& stage_dir);
+bool commit_mods_update(const std::string& instance_dir, const std::string& stage_dir);
+void abort_mods_update(const std::string& stage_dir);
+bool rollback_mods(const std::string& instance_dir);
+
+#endif
@@ -0,0 +1,335 @@
+#define NOMINMAX
+
+#include "mrpack.hpp"
+#include "constants.hpp"
+#include "executor.hpp"
+#include "file_lock.hpp"
+#include "filesystem.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+#include "phases.hpp"
+#include "progress.hpp"
+#include "store.hpp"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Paths installed from "files" by the previous pack version, so an update can remove dropped mods
+static const char* INSTALLED_FILES_MANIFEST = "mrpack-files.json";
+
+static std::string to_windows_path(std::string path) {
+    std::replace(path.begin(), path.end(), '/', '\\');
+    return path;
+}
+
+// Where a pack path goes: "mods/..." into mods_dir (a staging directory during an update), the rest into the instance
+static std::string get_install_path(const std::string& instance_dir, const std::string& mods_dir, const std::string& path) {
+    if (path.compare(0, 5, "mods/") == 0) {
+        return mods_dir + "\\" + to_windows_path(path.substr(5));
+    }
+    return instance_dir + "\\" + to_windows_path(path);
+}
+
+bool is_mrpack(const ZipArchive& archive) {
+    return archive.find("modrinth.index.json") != nullptr;
+}
+
+bool read_mrpack_index(ZipArchive& archive, MrpackIndex& index) {
+    const ZipEntry* entry = archive.find("modrinth.index.json");
+    std::vector<unsigned char> data;
+    if (!entry || !archive.read(*entry, data)) {
+        std::cerr << "Could not read modrinth.index.json from the modpack." << std::endl;
+        return false;
+    }
+    if (!parse_mrpack_index(reinterpret_cast<const char*>(data.data()), data.size(), index)) {
+        std::cerr << "Failed to parse modrinth.index.json (malformed, or not formatVersion 1 for minecraft)." << std::endl;
+        return false;
+    }
+    for (const MrpackFile& file : index.files) {
+        std::string path = index.str(file.path);
+        if (!is_safe_pack_path(path) || !file.has_sha1 || file.download_count == 0) {
+            std::cerr << "Invalid file entry in modrinth.index.json: " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Files without an env block are required on both sides; "optional" files are installed
+bool mrpack_file_applies(const MrpackFile& file, PackSide side) {
+    EnvSupport env = side == PackSide::Client ? file.client_env : file.server_env;
+    return env != EnvSupport::Unsupported;
+}
+
+// Pack paths must stay inside the instance directory
+bool is_safe_pack_path(const std::string& path) {
+    if (path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos || path.find('\\') != std::string::npos) {
+        return false;
+    }
+    for (const std::string& part : split_path(path, '/')) {
+        if (part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fetch files into the store, verifying each against the index. The transfers are multiplexed on
+// the I/O loop by download_batch() into a staging file next to the store object, which is moved into
+// place when it ends. Each transfer holds the object's store lock, so an installer fetching the
+// same object at once waits and then finds it stored; the locks are taken in digest order, so two
+// installers never wait for each other. The first file that cannot be fetched cancels the rest.
+bool fetch_mrpack_files(const MrpackIndex& index, const std::vector<const MrpackFile*>& files) {
+    ProgressTask& progress = progress_task("download");
+    long long planned_bytes = 0;
+    for (const MrpackFile* file : files) {
+        planned_bytes += file->file_size;
+    }
+    progress.plan(static_cast<long long>(files.size()), planned_bytes);
+
+    std::vector<const MrpackFile*> ordered = files;
+    std::sort(ordered.begin(), ordered.end(), [](const MrpackFile* a, const MrpackFile* b) {
+        return std::memcmp(a->sha1, b->sha1, sizeof(a->sha1)) < 0;
+    });
+    std::vector<DownloadJob> jobs;
+    std::vector<const MrpackFile*> job_files;
+    std::vector<std::unique_ptr<FileLock>> locks;
+    std::vector<char> already_stored;
+    for (const MrpackFile* file : ordered) {
+        DownloadJob job;
+        job.expected.sha1 = to_hex(file->sha1, sizeof(file->sha1));
+        if (file->has_sha512) {
+            job.expected.sha512 = to_hex(file->sha512, sizeof(file->sha512));
+        }
+        std::string object_path = get_store_object_path(job.expected.sha1);
+        if (store_has_object(job.expected.sha1)) {
+            progress.finish_item();
+            continue;
+        }
+        // The pack's download URLs are mirrors of one file; the downloader picks and switches between them
+        for (size_t d = 0; d < file->download_count; ++d) {
+            std::vector<std::string> candidates = get_download_candidates(index.download_url(*file, d));
+            job.urls.insert(job.urls.end(), candidates.begin(), candidates.end());
+        }
+        job.output_path = object_path + "." + std::to_string(GetCurrentProcessId()) + ".download";
+        // The lock is taken right before the transfer; an object another installer stored by then
+        // is not transferred at all
+        job.before_start = [&](DownloadJob& started) {
+            size_t i = static_cast<size_t>(&started - jobs.data());
+            locks[i] = store_lock_object(started.expected.sha1);
+            if (!locks[i]) {
+                started.error = "could not lock the store object";
+                return false;
+            }
+            if (store_has_object_locked(started.expected.sha1)) {
+                already_stored[i] = 1;
+                started.ok = true;
+                return false;
+            }
+            return true;
+        };
+        jobs.push_back(job);
+        job_files.push_back(file);
+    }
+    locks.resize(jobs.size());
+    already_stored.resize(jobs.size(), 0);
+
+    return download_batch(jobs, MRPACK_DOWNLOAD_CONCURRENCY, [&](DownloadJob& job) {
+        size_t i = static_cast<size_t>(&job - jobs.data());
+        const MrpackFile& file = *job_files[i];
+        std::string path = index.str(file.path);
+        if (already_stored[i]) {
+            locks[i].reset();
+            progress.finish_item();
+            return true;
+        }
+        if (!job.ok) {
+            std::cerr << "Download of " << path << " failed: " << job.error << std::endl;
+        }
+        bool fetched = job.ok && store_put_locked(job.expected.sha1, [&](const std::string& temp_path) {
+            return MoveFileExA(job.output_path.c_str(), temp_path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+        });
+        DeleteFileA(job.output_path.c_str());
+        locks[i].reset();
+        if (!fetched) {
+            std::cerr << "Could not download " << path << " from any source." << std::endl;
+            return false;
+        }
+        announce_to_peers();
+        progress.finish_item();
+        std::cout << "Fetched " << path << " (" << file.file_size << " bytes)" << std::endl;
+        return true;
+    });
+}
+
+// The manifest lives in the mod version it describes, so moving the mods junction (an update, an
+// aborted update or a rollback) always brings the matching list along. The loader only reads jars.
+std::string get_installed_files_manifest_path(const std::string& mods_dir) {
+    return mods_dir + "\\" + INSTALLED_FILES_MANIFEST;
+}
+
+// Versions installed before the manifest moved keep it in the instance directory
+static std::set<std::string> load_installed_files(const std::string& instance_dir, const std::string& mods_dir) {
+    using json = nlohmann::json;
+    std::set<std::string> paths;
+    std::string manifest_path = get_installed_files_manifest_path(mods_dir);
+    if (!file_exists(manifest_path)) {
+        manifest_path = instance_dir + "\\" + INSTALLED_FILES_MANIFEST;
+    }
+    std::ifstream in(manifest_path);
+    json j = json::parse(in, nullptr, false);
+    if (!j.is_discarded() && j.is_array()) {
+        for (const json& path : j) {
+            if (path.is_string() && is_safe_pack_path(path.get<std::string>())) {
+                paths.insert(path.get<std::string>());
+            }
+        }
+    }
+    return paths;
+}
+
+static bool save_installed_files(const std::string& mods_dir, const std::set<std::string>& paths) {
+    using json = nlohmann::json;
+    // The staged manifest is a hardlink to the current version's; writing through it would change both
+    std::string manifest_path = get_installed_files_manifest_path(mods_dir);
+    DeleteFileA(manifest_path.c_str());
+    std::ofstream out(manifest_path);
+    out << json(paths).dump(4);
+    return static_cast<bool>(out);
+}
+
+// Extract "overrides/" and then the side-specific overrides over the instance directory
+static bool apply_overrides(ZipArchive& archive, const std::string& instance_dir, const std::string& mods_dir, PackSide side) {
+    const std::string prefixes[] = { "overrides/", side == PackSide::Client ? "client-overrides/" : "server-overrides/" };
+    for (const std::string& prefix : prefixes) {
+        for (const ZipEntry& entry : archive.entries()) {
+            if (entry.is_directory() || entry.name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            std::string relative_path = entry.name.substr(prefix.size());
+            if (!is_safe_pack_path(relative_path)) {
+                std::cerr << "Skipping unsafe override path: " << entry.name << std::endl;
+                continue;
+            }
+            std::vector<unsigned char> data;
+            if (!archive.read(entry, data)) {
+                return false;
+            }
+            // Overrides are copies, not store links, because mods edit their configs in place.
+            // Removing the old file first keeps a link from an earlier install from being written through.
+            std::string target = get_install_path(instance_dir, mods_dir, relative_path);
+            create_directory(parent_directory(target));
+            DeleteFileA(target.c_str());
+            std::ofstream out(target, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!out) {
+                std::cerr << "Failed to write override: " << target << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Install a Modrinth modpack into an instance directory, with its mods going to mods_dir
+bool install_mrpack(const std::string& mrpack_path, const std::string& instance_dir, const std::string& mods_dir, PackSide side) {
+    ZipArchive archive;
+    MrpackIndex index;
+    if (!archive.open(mrpack_path) || !read_mrpack_index(archive, index)) {
+        return false;
+    }
+    std::cout << "Installing modpack " << index.name << " " << index.version_id << " (" << index.files.size() << " files)" << std::endl;
+
+    std::vector<const MrpackFile*> wanted;
+    std::vector<const MrpackFile*> unique;
+    std::set<std::string> hashes;
+    for (const MrpackFile& file : index.files) {
+        if (!mrpack_file_applies(file, side)) {
+            continue;
+        }
+        wanted.push_back(&file);
+        if (hashes.insert(to_hex(file.sha1, sizeof(file.sha1))).second) {
+            unique.push_back(&file);
+        }
+    }
+
+    // Objects already in the store are hashed before they are trusted, on the CPU lane; one that
+    // does not match is dropped and downloaded again
+    std::vector<char> stored(unique.size());
+    {
+        PhaseScope phase("discovery");
+        TaskGroup group(TaskLane::Cpu);
+        for (size_t i = 0; i < unique.size(); ++i) {
+            group.run([&, i]() { stored[i] = store_has_object(to_hex(unique[i]->sha1, sizeof(unique[i]->sha1))); });
+        }
+        group.wait();
+    }
+    std::vector<const MrpackFile*> missing;
+    for (size_t i = 0; i < unique.size(); ++i) {
+        if (stored[i]) {
+            count_cache_hit(unique[i]->file_size);
+        } else {
+            count_event("cache_misses");
+            missing.push_back(unique[i]);
+        }
+    }
+    std::cout << wanted.size() - missing.size() << " files already in the store, " << missing.size() << " to download." << std::endl;
+
+    // Nothing in the instance changes until every file is available locally
+    if (!fetch_mrpack_files(index, missing)) {
+        std::cerr << "Modpack download failed; the installed mods were left untouched." << std::endl;
+        return false;
+    }
+    PhaseScope phase("extraction");
+    ProgressTask& progress = progress_task("extraction");
+    long long planned_bytes = 0;
+    for (const MrpackFile* file : wanted) {
+        planned_bytes += file->file_size;
+    }
+    progress.plan(static_cast<long long>(wanted.size()), planned_bytes);
+
+    std::set<std::string> installed;
+    MaterializeStats stats;
+    for (const MrpackFile* file : wanted) {
+        std::string path = index.str(file->path);
+        std::string target = get_install_path(instance_dir, mods_dir, path);
+        installed.insert(path);
+        MaterializeMethod method = materialize_from_store(to_hex(file->sha1, sizeof(file->sha1)), target);
+        if (method == MaterializeMethod::Failed) {
+            std::cerr << "Failed to place " << path << " in the instance (error " << GetLastError() << ")." << std::endl;
+            return false;
+        }
+        stats.add(method);
+        progress.add_bytes(file->file_size);
+        progress.finish_item();
+    }
+    print_materialize_stats(stats);
+
+    size_t removed = 0;
+    for (const std::string& old_path : load_installed_files(instance_dir, mods_dir)) {
+        if (installed.count(old_path) == 0 && DeleteFileA(get_install_path(instance_dir, mods_dir, old_path).c_str())) {
+            std::cout << "Removed file dropped from the pack: " << old_path << std::endl;
+            removed++;
+        }
+    }
+
+    if (!apply_overrides(archive, instance_dir, mods_dir, side)) {
+        return false;
+    }
+    if (!save_installed_files(mods_dir, installed)) {
+        std::cerr << "Failed to write " << get_installed_files_manifest_path(mods_dir) << std::endl;
+        return false;
+    }
+
+    std::cout << "Modpack installed: " << missing.size() << " downloaded, " << stats.total() - stats.existing << " written, "
+              << stats.existing << " unchanged, " << removed << " removed." << std::endl;
+    return true;
+}
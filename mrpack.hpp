@@ -0,0 +1,49 @@
+#ifndef MRPACK_HPP
+#define MRPACK_HPP
+
+#include "archive.hpp"
+#include "json_stream.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class PackSide { Client, Server };
+enum class EnvSupport : uint8_t { Unspecified, Required, Optional, Unsupported };
+
+// One entry of "files" in modrinth.index.json; strings are offsets into MrpackIndex::strings
+struct MrpackFile {
+    uint32_t path = 0;                   // relative to the instance directory, '/' separated
+    uint32_t first_download = 0;         // range of MrpackIndex::download_urls, tried in order
+    uint32_t download_count = 0;
+    long long file_size = 0;
+    unsigned char sha1[20] = {};
+    unsigned char sha512[64] = {};
+    bool has_sha1 = false;
+    bool has_sha512 = false;
+    EnvSupport client_env = EnvSupport::Unspecified;
+    EnvSupport server_env = EnvSupport::Unspecified;
+};
+
+struct MrpackIndex {
+    std::string name;
+    std::string version_id;
+    std::map<std::string, std::string> dependencies;   // e.g. "minecraft" -> "1.20.1"
+    std::vector<MrpackFile> files;
+    std::vector<uint32_t> download_urls;
+    StringPool strings;
+
+    std::string str(uint32_t offset) const { return strings.get(offset); }
+    std::string download_url(const MrpackFile& file, size_t i) const { return str(download_urls[file.first_download + i]); }
+};
+
+bool is_mrpack(const ZipArchive& archive);
+bool read_mrpack_index(ZipArchive& archive, MrpackIndex& index);
+bool mrpack_file_applies(const MrpackFile& file, PackSide side);
+bool is_safe_pack_path(const std::string& path);
+bool fetch_mrpack_files(const MrpackIndex& index, const std::vector<const MrpackFile*>& files);
+std::string get_installed_files_manifest_path(const std::string& mods_dir);
+bool install_mrpack(const std::string& mrpack_path, const std::string& instance_dir, const std::string& mods_dir, PackSide side);
+
+#endif
@@ -0,0 +1,115 @@
+#define NOMINMAX
+
+#include "offline.hpp"
+#include "filesystem.hpp"
+#include "json.hpp"
+#include "store.hpp"
+
+#include <windows.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The bundle appended to this executable, mapped once; null for a normal online installer
+const Bundle* get_offline_bundle() {
+    static Bundle bundle;
+    static bool found = bundle.open(get_own_image_path());
+    return found ? &bundle : nullptr;
+}
+
+std::string get_bundled_modpack_url(const Bundle& bundle) {
+    const BundleEntry* entry = bundle.find(BUNDLE_MODPACK_URL_ENTRY);
+    if (!entry || !bundle.find(BUNDLE_MODPACK_ENTRY)) {
+        return "";
+    }
+    return std::string(reinterpret_cast<const char*>(bundle.data(*entry)), static_cast<size_t>(entry->size));
+}
+
+// "group:artifact:version[:classifier]" -> "libraries/group/path/artifact/version/artifact-version[-classifier].jar"
+static std::string maven_library_path(const std::string& name) {
+    std::vector<std::string> parts = split_path(name, ':');
+    if (parts.size() < 3) {
+        return "";
+    }
+    std::string group = parts[0];
+    std::replace(group.begin(), group.end(), '.', '/');
+    std::string file = parts[1] + "-" + parts[2] + (parts.size() > 3 ? "-" + parts[3] : "") + ".jar";
+    return "libraries/" + group + "/" + parts[1] + "/" + parts[2] + "/" + file;
+}
+
+// The version profile the Fabric installer wrote and the libraries it lists that are present
+// locally, as '/' separated paths relative to .minecraft
+std::vector<std::string> get_fabric_profile_files(const std::string& minecraft_dir, const std::string& fabric_version_id) {
+    using json = nlohmann::json;
+    std::vector<std::string> files;
+    std::string profile = "versions/" + fabric_version_id + "/" + fabric_version_id + ".json";
+    std::ifstream in(minecraft_dir + "\\versions\\" + fabric_version_id + "\\" + fabric_version_id + ".json");
+    json j = json::parse(in, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return files;
+    }
+    files.push_back(profile);
+    if (j.contains("libraries") && j["libraries"].is_array()) {
+        for (const json& library : j["libraries"]) {
+            std::string path = maven_library_path(library.value("name", ""));
+            std::string local_path = minecraft_dir + "\\" + path;
+            std::replace(local_path.begin(), local_path.end(), '/', '\\');
+            if (!path.empty() && file_exists(local_path)) {
+                files.push_back(path);
+            }
+        }
+    }
+    return files;
+}
+
+// Put the bundled Fabric profile and libraries into .minecraft; files already present are kept
+bool install_bundled_minecraft_files(const Bundle& bundle, const std::string& minecraft_dir) {
+    size_t installed = 0;
+    for (const BundleEntry& entry : bundle.entries()) {
+        if (entry.name.compare(0, BUNDLE_MINECRAFT_PREFIX.size(), BUNDLE_MINECRAFT_PREFIX) != 0) {
+            continue;
+        }
+        std::string relative_path = entry.name.substr(BUNDLE_MINECRAFT_PREFIX.size());
+        if (relative_path.empty() || relative_path.find("..") != std::string::npos || relative_path.find(':') != std::string::npos) {
+            continue;
+        }
+        std::string target = minecraft_dir + "\\" + relative_path;
+        std::replace(target.begin(), target.end(), '/', '\\');
+        if (get_file_size(target) == static_cast<long long>(entry.size)) {
+            continue;
+        }
+        create_directory(parent_directory(target));
+        if (!bundle.extract(entry, target)) {
+            return false;
+        }
+        installed++;
+    }
+    if (installed > 0) {
+        std::cout << "Installed " << installed << " Fabric files from the offline bundle." << std::endl;
+    }
+    return true;
+}
+
+// Seed the store with the bundled pack files, so the mrpack install finds everything locally
+bool import_bundled_store_objects(const Bundle& bundle) {
+    size_t imported = 0;
+    for (const BundleEntry& entry : bundle.entries()) {
+        if (entry.name.compare(0, BUNDLE_STORE_PREFIX.size(), BUNDLE_STORE_PREFIX) != 0) {
+            continue;
+        }
+        std::string sha1 = entry.name.substr(BUNDLE_STORE_PREFIX.size());
+        if (sha1.size() != 40 || store_has_object(sha1)) {
+            continue;
+        }
+        if (!store_put(sha1, [&](const std::string& temp_path) { return bundle.extract(entry, temp_path); })) {
+            return false;
+        }
+        imported++;
+    }
+    if (imported > 0) {
+        std::cout << "Imported " << imported << " files from the offline bundle into the store." << std::endl;
+    }
+    return true;
+}
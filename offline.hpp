@@ -0,0 +1,23 @@
+#ifndef OFFLINE_HPP
+#define OFFLINE_HPP
+
+#include "bundle.hpp"
+
+#include <string>
+#include <vector>
+
+// Names of the files an offline bundle carries
+const std::string BUNDLE_JDK_ENTRY = "jdk/installer.msi";
+const std::string BUNDLE_FABRIC_ENTRY = "fabric/installer.jar";
+const std::string BUNDLE_MODPACK_ENTRY = "modpack/archive";
+const std::string BUNDLE_MODPACK_URL_ENTRY = "modpack/url";      // where the bundled pack came from
+const std::string BUNDLE_MINECRAFT_PREFIX = "minecraft/";        // Fabric profile and libraries, relative to .minecraft
+const std::string BUNDLE_STORE_PREFIX = "store/";                // store objects by SHA-1
+
+const Bundle* get_offline_bundle();
+std::string get_bundled_modpack_url(const Bundle& bundle);
+std::vector<std::string> get_fabric_profile_files(const std::string& minecraft_dir, const std::string& fabric_version_id);
+bool install_bundled_minecraft_files(const Bundle& bundle, const std::string& minecraft_dir);
+bool import_bundled_store_objects(const Bundle& bundle);
+
+#endif
@@ -0,0 +1,638 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+#include "peer_cache.hpp"
+#include "async_writer.hpp"
+#include "file_ops.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Announcement datagrams: "MCMI1 <instance id> <http port> <key> <key> ...", kept under a typical MTU
+static const size_t PEER_PACKET_LIMIT = 1400;
+static const int PEER_SERVE_THREADS = 4;
+static const int PEER_FETCH_ATTEMPTS = 3;
+static const int PEER_SOCKET_TIMEOUT_MS = 10000;
+static const int PEER_MIN_ANNOUNCE_GAP_MS = 1000;
+static const size_t PEER_SEND_CHUNK = 256 * 1024;
+static const size_t PEER_MAX_HOLDINGS = 100000;   // (key, peer) pairs remembered; anyone can send announcements
+
+#ifdef _WIN32
+typedef SOCKET native_socket_t;
+#else
+typedef int native_socket_t;
+#endif
+
+// Sockets are kept as intptr_t so the header needs no platform types
+static native_socket_t native(intptr_t s) {
+    return static_cast<native_socket_t>(s);
+}
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void close_socket(intptr_t s) {
+#ifdef _WIN32
+    closesocket(native(s));
+#else
+    ::close(native(s));
+#endif
+}
+
+static bool socket_ok(intptr_t s) {
+#ifdef _WIN32
+    return native(s) != INVALID_SOCKET;
+#else
+    return s >= 0;
+#endif
+}
+
+static intptr_t open_socket(int type) {
+#ifdef _WIN32
+    static bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    if (!started) {
+        return static_cast<intptr_t>(INVALID_SOCKET);
+    }
+    return static_cast<intptr_t>(socket(AF_INET, type, 0));
+#else
+    return static_cast<intptr_t>(socket(AF_INET, type, 0));
+#endif
+}
+
+static void set_timeout(intptr_t s, int option, int ms) {
+#ifdef _WIN32
+    DWORD value = static_cast<DWORD>(ms);
+#else
+    timeval value;
+    value.tv_sec = ms / 1000;
+    value.tv_usec = (ms % 1000) * 1000;
+#endif
+    setsockopt(native(s), SOL_SOCKET, option, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Wait until a socket is readable; false on timeout
+static bool wait_readable(intptr_t s, int ms) {
+#ifdef _WIN32
+    WSAPOLLFD fd = { native(s), POLLRDNORM, 0 };
+    return WSAPoll(&fd, 1, ms) > 0;
+#else
+    pollfd fd = { native(s), POLLIN, 0 };
+    return poll(&fd, 1, ms) > 0;
+#endif
+}
+
+static bool send_all(intptr_t s, const char* data, size_t len) {
+    while (len > 0) {
+        int sent = send(native(s), data, static_cast<int>(std::min<size_t>(len, 1 << 20)), 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+static in_addr parse_ipv4(const std::string& address) {
+    in_addr result;
+    result.s_addr = htonl(INADDR_ANY);
+    if (!address.empty()) {
+        inet_pton(AF_INET, address.c_str(), &result);
+    }
+    return result;
+}
+
+// "sha1:<hex>" for pack files, "sha256:<hex>" for artifacts only known by SHA-256
+std::string get_peer_key(const ExpectedHashes& expected) {
+    if (!expected.sha1.empty()) {
+        return "sha1:" + expected.sha1;
+    }
+    if (!expected.sha256.empty()) {
+        return "sha256:" + expected.sha256;
+    }
+    return "";
+}
+
+static bool is_valid_key(const std::string& key) {
+    size_t colon = key.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    std::string algorithm = key.substr(0, colon);
+    std::string digest = key.substr(colon + 1);
+    size_t length = algorithm == "sha1" ? 40 : algorithm == "sha256" ? 64 : 0;
+    return length != 0 && digest.size() == length && digest.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+PeerCache::~PeerCache() {
+    stop();
+}
+
+bool PeerCache::start(const PeerCacheOptions& options) {
+    options_ = options;
+    std::random_device random;
+    instance_id_ = std::to_string(random()) + std::to_string(random());
+
+    // HTTP server
+    http_socket_ = open_socket(SOCK_STREAM);
+    if (!socket_ok(http_socket_)) {
+        std::cerr << "Peer cache: could not create a socket." << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(native(http_socket_), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in http_address = {};
+    http_address.sin_family = AF_INET;
+    http_address.sin_addr = parse_ipv4(options_.interface_address);
+    http_address.sin_port = htons(static_cast<unsigned short>(options_.http_port));
+    socklen_t address_size = sizeof(http_address);
+    if (bind(native(http_socket_), reinterpret_cast<sockaddr*>(&http_address), sizeof(http_address)) != 0 ||
+        listen(native(http_socket_), 64) != 0 ||
+        getsockname(native(http_socket_), reinterpret_cast<sockaddr*>(&http_address), &address_size) != 0) {
+        std::cerr << "Peer cache: could not listen on port " << options_.http_port << "." << std::endl;
+        stop();
+        return false;
+    }
+    http_port_ = ntohs(http_address.sin_port);
+
+    // Multicast discovery; several installers on one host share the port
+    udp_socket_ = open_socket(SOCK_DGRAM);
+    if (!socket_ok(udp_socket_)) {
+        stop();
+        return false;
+    }
+    setsockopt(native(udp_socket_), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in udp_address = {};
+    udp_address.sin_family = AF_INET;
+    udp_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    udp_address.sin_port = htons(static_cast<unsigned short>(options_.multicast_port));
+    ip_mreq membership;
+    membership.imr_multiaddr = parse_ipv4(options_.multicast_group);
+    membership.imr_interface = parse_ipv4(options_.interface_address);
+    in_addr outgoing = parse_ipv4(options_.interface_address);
+    int ttl = 1;
+    int loop = 1;
+    if (bind(native(udp_socket_), reinterpret_cast<sockaddr*>(&udp_address), sizeof(udp_address)) != 0 ||
+        setsockopt(native(udp_socket_), IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership)) != 0) {
+        std::cerr << "Peer cache: could not join multicast group " << options_.multicast_group << "." << std::endl;
+        stop();
+        return false;
+    }
+    setsockopt(native(udp_socket_), IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&outgoing), sizeof(outgoing));
+    setsockopt(native(udp_socket_), IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+    setsockopt(native(udp_socket_), IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+
+    running_ = true;
+    threads_.emplace_back(&PeerCache::announce_loop, this);
+    threads_.emplace_back(&PeerCache::listen_loop, this);
+    threads_.emplace_back(&PeerCache::accept_loop, this);
+    for (int i = 0; i < PEER_SERVE_THREADS; ++i) {
+        threads_.emplace_back(&PeerCache::serve_loop, this);
+    }
+    return true;
+}
+
+void PeerCache::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) {
+        t.join();
+    }
+    threads_.clear();
+    for (intptr_t client : pending_clients_) {
+        close_socket(client);
+    }
+    pending_clients_.clear();
+    if (socket_ok(udp_socket_)) {
+        close_socket(udp_socket_);
+    }
+    if (socket_ok(http_socket_)) {
+        close_socket(http_socket_);
+    }
+    udp_socket_ = http_socket_ = -1;
+}
+
+// Send the announcement early, e.g. right after new content arrived
+void PeerCache::announce_now() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        announce_requested_ = true;
+    }
+    wake_.notify_all();
+}
+
+void PeerCache::announce_loop() {
+    sockaddr_in group = {};
+    group.sin_family = AF_INET;
+    group.sin_addr = parse_ipv4(options_.multicast_group);
+    group.sin_port = htons(static_cast<unsigned short>(options_.multicast_port));
+    std::string header = "MCMI1 " + instance_id_ + " " + std::to_string(http_port_);
+
+    while (running_) {
+        std::vector<std::string> keys = options_.list_keys ? options_.list_keys() : std::vector<std::string>();
+        std::string packet = header;
+        for (size_t i = 0; i <= keys.size(); ++i) {
+            bool last = i == keys.size();
+            if (last || packet.size() + 1 + keys[i].size() > PEER_PACKET_LIMIT) {
+                if (packet.size() > header.size() || (last && keys.empty())) {
+                    sendto(native(udp_socket_), packet.data(), static_cast<int>(packet.size()), 0,
+                           reinterpret_cast<const sockaddr*>(&group), sizeof(group));
+                }
+                packet = header;
+            }
+            if (!last) {
+                packet += " " + keys[i];
+            }
+        }
+
+        // Early announcements are coalesced: a pack download finishing hundreds of files asks often
+        std::unique_lock<std::mutex> lock(mutex_);
+        int gap = std::min(options_.announce_interval_ms, PEER_MIN_ANNOUNCE_GAP_MS);
+        wake_.wait_for(lock, std::chrono::milliseconds(gap), [this] { return !running_; });
+        wake_.wait_for(lock, std::chrono::milliseconds(options_.announce_interval_ms - gap), [this] { return !running_ || announce_requested_; });
+        announce_requested_ = false;
+    }
+}
+
+void PeerCache::listen_loop() {
+    std::vector<char> buffer(65536);
+    while (running_) {
+        if (!wait_readable(udp_socket_, 200)) {
+            continue;
+        }
+        sockaddr_in source = {};
+        socklen_t source_size = sizeof(source);
+        int received = recvfrom(native(udp_socket_), buffer.data(), static_cast<int>(buffer.size()), 0,
+                                reinterpret_cast<sockaddr*>(&source), &source_size);
+        if (received <= 0) {
+            continue;
+        }
+        std::istringstream packet(std::string(buffer.data(), static_cast<size_t>(received)));
+        std::string magic, instance;
+        int port = 0;
+        if (!(packet >> magic >> instance >> port) || magic != "MCMI1" || instance == instance_id_ || port <= 0 || port > 65535) {
+            continue;
+        }
+        char address[INET_ADDRSTRLEN] = {};
+        inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address));
+        std::string peer = std::string(address) + ":" + std::to_string(port);
+        long long now = now_ms();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string key;
+        while (packet >> key) {
+            if (is_valid_key(key)) {
+                remember_holder_locked(key, peer, now);
+            }
+        }
+    }
+}
+
+// Announcements are unauthenticated, so what they can make this process remember is bounded:
+// once full, peers that went quiet are forgotten (at most once a second) and new pairs are
+// dropped until there is room again
+void PeerCache::remember_holder_locked(const std::string& key, const std::string& peer, long long now) {
+    auto it = holders_.find(key);
+    if (it != holders_.end()) {
+        auto holder = it->second.find(peer);
+        if (holder != it->second.end()) {
+            holder->second = now;
+            return;
+        }
+    }
+    if (holdings_ >= PEER_MAX_HOLDINGS && now - last_prune_ms_ >= 1000) {
+        last_prune_ms_ = now;
+        long long cutoff = now - options_.peer_timeout_ms;
+        for (auto key_it = holders_.begin(); key_it != holders_.end();) {
+            for (auto holder = key_it->second.begin(); holder != key_it->second.end();) {
+                if (holder->second < cutoff) {
+                    holder = key_it->second.erase(holder);
+                    holdings_--;
+                } else {
+                    ++holder;
+                }
+            }
+            key_it = key_it->second.empty() ? holders_.erase(key_it) : std::next(key_it);
+        }
+    }
+    if (holdings_ >= PEER_MAX_HOLDINGS) {
+        return;
+    }
+    holders_[key][peer] = now;
+    holdings_++;
+}
+
+std::vector<std::string> PeerCache::find_peers(const std::string& key) {
+    std::vector<std::string> peers;
+    long long cutoff = now_ms() - options_.peer_timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = holders_.find(key);
+        if (it != holders_.end()) {
+            for (const auto& holder : it->second) {
+                if (holder.second >= cutoff) {
+                    peers.push_back(holder.first);
+                }
+            }
+        }
+    }
+    // Spread requests so the first machine to finish does not serve everyone
+    static thread_local std::mt19937 shuffle_random(std::random_device{}());
+    std::shuffle(peers.begin(), peers.end(), shuffle_random);
+    return peers;
+}
+
+// Try a few peers that announced the content; the caller falls back to the origin
+bool PeerCache::fetch(const std::string& key, const std::string& output_path, const ExpectedHashes& expected, std::string& error) {
+    std::vector<std::string> peers = find_peers(key);
+    if (peers.empty()) {
+        error = "no peer has " + key;
+        return false;
+    }
+    for (size_t i = 0; i < peers.size() && i < static_cast<size_t>(PEER_FETCH_ATTEMPTS); ++i) {
+        long long bytes = 0;
+        if (http_fetch_object(peers[i], key, output_path, expected, bytes, error)) {
+            bytes_fetched_ += bytes;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PeerCache::accept_loop() {
+    while (running_) {
+        if (!wait_readable(http_socket_, 200)) {
+            continue;
+        }
+        intptr_t client = static_cast<intptr_t>(accept(native(http_socket_), nullptr, nullptr));
+        if (!socket_ok(client)) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_clients_.push_back(client);
+        }
+        wake_.notify_all();
+    }
+}
+
+void PeerCache::serve_loop() {
+    for (;;) {
+        intptr_t client;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return !running_ || !pending_clients_.empty(); });
+            if (!running_) {
+                return;
+            }
+            client = pending_clients_.front();
+            pending_clients_.erase(pending_clients_.begin());
+        }
+        serve_connection(client);
+        close_socket(client);
+    }
+}
+
+// One request per connection: "GET /<algorithm>/<hex digest>"
+void PeerCache::serve_connection(intptr_t client) {
+    set_timeout(client, SO_RCVTIMEO, PEER_SOCKET_TIMEOUT_MS);
+    set_timeout(client, SO_SNDTIMEO, PEER_SOCKET_TIMEOUT_MS);
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        int received = recv(native(client), buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<size_t>(received));
+    }
+    std::istringstream line(request);
+    std::string method, target;
+    line >> method >> target;
+    std::string key = target.size() > 1 ? target.substr(1) : "";
+    std::replace(key.begin(), key.end(), '/', ':');
+    std::string path = method == "GET" && is_valid_key(key) && options_.resolve ? options_.resolve(key) : "";
+#ifdef __linux__
+    // A machine serving many installers spends its CPU copying file data; sendfile moves it from
+    // the page cache to the socket without passing through this process
+    int fd = path.empty() ? -1 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        std::string header = "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + std::to_string(st.st_size) + "\r\nConnection: close\r\n\r\n";
+        off_t offset = 0;
+        bool ok = send_all(client, header.data(), header.size());
+        while (ok && offset < st.st_size) {
+            size_t chunk = static_cast<size_t>(std::min<off_t>(st.st_size - offset, PEER_SEND_CHUNK));
+            pace_upload(static_cast<long long>(chunk));
+            ssize_t sent = sendfile(native(client), fd, &offset, chunk);
+            ok = sent > 0;
+            if (ok) {
+                bytes_served_ += sent;
+            }
+        }
+        ::close(fd);
+        return;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (path.empty() || !in) {
+        const char* not_found = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(client, not_found, strlen(not_found));
+        return;
+    }
+    long long size = static_cast<long long>(in.tellg());
+    in.seekg(0);
+    std::string header = "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + std::to_string(size) + "\r\nConnection: close\r\n\r\n";
+    if (!send_all(client, header.data(), header.size())) {
+        return;
+    }
+
+    std::vector<char> chunk(PEER_SEND_CHUNK);
+    while (in) {
+        in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        std::streamsize got = in.gcount();
+        if (got <= 0) {
+            break;
+        }
+        pace_upload(got);
+        if (!send_all(client, chunk.data(), static_cast<size_t>(got))) {
+            break;
+        }
+        bytes_served_ += got;
+    }
+}
+
+// Leave room on the serving machine's own link: all connections together stay under the limit
+void PeerCache::pace_upload(long long bytes) {
+    if (options_.upload_bytes_per_sec <= 0) {
+        return;
+    }
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (upload_due_ < now) {
+            upload_due_ = now;
+        }
+        upload_due_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(options_.upload_bytes_per_sec)));
+        due = upload_due_;
+    }
+    std::this_thread::sleep_until(due);
+}
+
+// GET one object from a peer into "<output_path>.part", verify it while it streams and rename it
+// into place. Peers are untrusted: nothing is kept unless the expected digests match.
+bool http_fetch_object(const std::string& peer, const std::string& key, const std::string& output_path,
+                       const ExpectedHashes& expected, long long& bytes, std::string& error) {
+    size_t colon = peer.rfind(':');
+    if (colon == std::string::npos) {
+        error = "invalid peer " + peer;
+        return false;
+    }
+    if (expected.sha1.empty() && expected.sha256.empty() && expected.sha512.empty()) {
+        error = "no digest to verify " + key + " against";
+        return false;
+    }
+    intptr_t s = open_socket(SOCK_STREAM);
+    if (!socket_ok(s)) {
+        error = "could not create a socket";
+        return false;
+    }
+    set_timeout(s, SO_RCVTIMEO, PEER_SOCKET_TIMEOUT_MS);
+    set_timeout(s, SO_SNDTIMEO, PEER_SOCKET_TIMEOUT_MS);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr = parse_ipv4(peer.substr(0, colon));
+    address.sin_port = htons(static_cast<unsigned short>(std::atoi(peer.c_str() + colon + 1)));
+    std::string target = key;
+    std::replace(target.begin(), target.end(), ':', '/');
+    std::string request = "GET /" + target + " HTTP/1.0\r\nHost: " + peer + "\r\n\r\n";
+    if (connect(native(s), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || !send_all(s, request.data(), request.size())) {
+        error = "could not connect to peer " + peer;
+        close_socket(s);
+        return false;
+    }
+
+    // Headers, then whatever part of the body arrived with them
+    std::vector<char> buffer(256 * 1024);
+    std::string head;
+    size_t header_end;
+    while ((header_end = head.find("\r\n\r\n")) == std::string::npos && head.size() < 16384) {
+        int received = recv(native(s), buffer.data(), static_cast<int>(buffer.size()), 0);
+        if (received <= 0) {
+            break;
+        }
+        head.append(buffer.data(), static_cast<size_t>(received));
+    }
+    if (header_end == std::string::npos || head.compare(0, 12, "HTTP/1.0 200") != 0) {
+        error = "peer " + peer + " does not have " + key;
+        close_socket(s);
+        return false;
+    }
+
+    long long content_length = -1;
+    size_t length_header = head.find("Content-Length: ");
+    if (length_header != std::string::npos && length_header < header_end) {
+        content_length = std::atoll(head.c_str() + length_header + 16);
+    }
+    std::string part_path = output_path + ".part";
+    AsyncFileWriter out;
+    if (!out.open(part_path, content_length)) {
+        error = "failed to open output file " + part_path;
+        close_socket(s);
+        return false;
+    }
+    Sha1 sha1;
+    Sha256 sha256;
+    Sha512 sha512;
+    auto hash = [&](const char* data, size_t len) {
+        if (!expected.sha1.empty()) {
+            sha1.update(data, len);
+        }
+        if (!expected.sha256.empty()) {
+            sha256.update(data, len);
+        }
+        if (!expected.sha512.empty()) {
+            sha512.update(data, len);
+        }
+        bytes += static_cast<long long>(len);
+    };
+    bytes = 0;
+    const char* body = head.data() + header_end + 4;
+    hash(body, head.size() - header_end - 4);
+    bool write_ok = out.write(body, head.size() - header_end - 4);
+
+    // Received straight into the writer's buffers, which go to disk while the next ones fill
+    int received = 0;
+    while (write_ok) {
+        size_t available = 0;
+        char* space = out.reserve(available);
+        if (!space) {
+            write_ok = false;
+            break;
+        }
+        received = recv(native(s), space, static_cast<int>(available), 0);
+        if (received <= 0) {
+            break;
+        }
+        hash(space, static_cast<size_t>(received));
+        write_ok = out.commit(static_cast<size_t>(received));
+    }
+    close_socket(s);
+    write_ok = out.close() && write_ok;
+
+    if (received < 0 || !write_ok) {
+        error = "transfer from peer " + peer + " failed";
+    } else if (!expected.sha1.empty() && sha1.hex_digest() != expected.sha1) {
+        error = "SHA-1 mismatch from peer " + peer;
+    } else if (!expected.sha256.empty() && sha256.hex_digest() != expected.sha256) {
+        error = "SHA-256 mismatch from peer " + peer;
+    } else if (!expected.sha512.empty() && sha512.hex_digest() != expected.sha512) {
+        error = "SHA-512 mismatch from peer " + peer;
+    } else if (!move_into_place(part_path, output_path)) {
+        error = "failed to move " + part_path + " into place";
+    } else {
+        return true;
+    }
+    std::remove(part_path.c_str());
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef PEER_CACHE_HPP
+#define PEER_CACHE_HPP
+
+#include "filesystem.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// LAN peer cache: installers announce the content they hold over UDP multicast and serve it
+// over a small HTTP server, so machines at the same event fetch from each other instead of
+// all pulling the same files through one uplink. Content is addressed by digest
+// ("sha1:<hex>" or "sha256:<hex>") and always verified by the receiver.
+
+struct PeerCacheOptions {
+    std::string multicast_group = "239.255.77.77";
+    int multicast_port = 47770;
+    int http_port = 47771;                       // 0 picks a free port
+    std::string interface_address;               // IPv4 address of the LAN interface; empty for the default route
+    int announce_interval_ms = 5000;
+    int peer_timeout_ms = 30000;                 // peers not heard from for this long are forgotten
+    long long upload_bytes_per_sec = 0;          // 0 = unlimited
+    std::function<std::vector<std::string>()> list_keys;                 // content this machine can serve
+    std::function<std::string(const std::string& key)> resolve;          // local path of a key, "" if not held
+};
+
+class PeerCache {
+public:
+    ~PeerCache();
+    bool start(const PeerCacheOptions& options);
+    void stop();
+    void announce_now();
+    std::vector<std::string> find_peers(const std::string& key);   // "ip:port" of peers holding key, shuffled
+    bool fetch(const std::string& key, const std::string& output_path, const ExpectedHashes& expected, std::string& error);
+    int http_port() const { return http_port_; }
+    long long bytes_served() const { return bytes_served_; }
+    long long bytes_fetched() const { return bytes_fetched_; }
+
+private:
+    void announce_loop();
+    void listen_loop();
+    void accept_loop();
+    void serve_loop();
+    void serve_connection(intptr_t client);
+    void remember_holder_locked(const std::string& key, const std::string& peer, long long now);
+    void pace_upload(long long bytes);
+
+    PeerCacheOptions options_;
+    std::string instance_id_;
+    int http_port_ = 0;
+    intptr_t udp_socket_ = -1;
+    intptr_t http_socket_ = -1;
+    std::atomic<bool> running_{ false };
+    std::atomic<long long> bytes_served_{ 0 };
+    std::atomic<long long> bytes_fetched_{ 0 };
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool announce_requested_ = false;
+    std::map<std::string, std::map<std::string, long long>> holders_;   // key -> peer -> last seen (ms)
+    size_t holdings_ = 0;                                               // pairs in holders_
+    long long last_prune_ms_ = 0;
+    std::vector<intptr_t> pending_clients_;
+    std::chrono::steady_clock::time_point upload_due_;
+};
+
+std::string get_peer_key(const ExpectedHashes& expected);
+bool http_fetch_object(const std::string& peer, const std::string& key, const std::string& output_path,
+                       const ExpectedHashes& expected, long long& bytes, std::string& error);
+
+#endif
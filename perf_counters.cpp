@@ -0,0 +1,229 @@
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.hpp"
+#include "phases.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const int PERF_EVENT_COUNT = 5;
+static const char* const PERF_EVENT_NAMES[PERF_EVENT_COUNT] = { "cycles", "instructions", "cache_misses", "page_faults", "context_switches" };
+
+struct PerfReading {
+    long long values[PERF_EVENT_COUNT] = {};
+};
+
+// What one thread spent inside one phase
+struct PerfTotals {
+    int phase;
+    long long thread;
+    long long scopes = 0;
+    long long values[PERF_EVENT_COUNT] = {};
+};
+
+// The counters are opened on each thread the first time it enters a phase and read as one group
+struct ThreadCounters {
+    bool opened = false;
+    int leader = -1;
+    int fds[PERF_EVENT_COUNT];
+    int positions[PERF_EVENT_COUNT];   // place of each event in a group read, -1 if it could not be opened
+    long long thread = 0;
+    std::vector<PerfReading> started;  // one per open scope, innermost last
+
+    ThreadCounters() {
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            fds[i] = -1;
+            positions[i] = -1;
+        }
+    }
+
+    ~ThreadCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+};
+
+static std::atomic<bool> g_perf_enabled{ false };
+static std::atomic<int> g_available_events{ 0 };   // bit per event that opened on some thread
+static std::atomic<bool> g_user_only{ false };      // some events had to leave out time spent in the kernel
+static std::mutex g_perf_mutex;
+static std::vector<PerfTotals> g_perf_totals;
+static thread_local ThreadCounters t_counters;
+
+#ifdef __linux__
+static int open_event(int event, int group_fd) {
+    static const uint32_t types[PERF_EVENT_COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE };
+    static const uint64_t configs[PERF_EVENT_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                                                        PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES };
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[event];
+    attr.config = configs[event];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_hv = 1;
+    // pid 0, cpu -1: this thread, wherever it runs
+    int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        // perf_event_paranoid 2 (the usual default) only allows user-space counting
+        attr.exclude_kernel = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+        if (fd >= 0) {
+            g_user_only = true;
+        }
+    }
+    return fd;
+}
+#endif
+
+static void open_thread_counters(ThreadCounters& counters) {
+    counters.opened = true;
+#ifdef __linux__
+    counters.thread = static_cast<long long>(syscall(SYS_gettid));
+    int position = 0;
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        // Events the PMU lacks are skipped; the first one that opens leads the group
+        counters.fds[i] = open_event(i, counters.leader);
+        if (counters.fds[i] < 0) {
+            continue;
+        }
+        if (counters.leader < 0) {
+            counters.leader = counters.fds[i];
+        }
+        counters.positions[i] = position++;
+        g_available_events |= 1 << i;
+    }
+#endif
+}
+
+static PerfReading read_counters(const ThreadCounters& counters) {
+    PerfReading reading;
+#ifdef __linux__
+    uint64_t buffer[1 + PERF_EVENT_COUNT];
+    if (counters.leader < 0 || read(counters.leader, buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(uint64_t))) {
+        return reading;
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if (counters.positions[i] >= 0 && static_cast<uint64_t>(counters.positions[i]) < buffer[0]) {
+            reading.values[i] = static_cast<long long>(buffer[1 + counters.positions[i]]);
+        }
+    }
+#else
+    (void)counters;
+#endif
+    return reading;
+}
+
+bool enable_perf_counters() {
+#ifdef __linux__
+    g_perf_enabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool perf_counters_enabled() {
+    return g_perf_enabled;
+}
+
+void reset_perf_counters() {
+    std::lock_guard<std::mutex> lock(g_perf_mutex);
+    g_perf_totals.clear();
+}
+
+void perf_scope_started() {
+    if (!g_perf_enabled) {
+        return;
+    }
+    if (!t_counters.opened) {
+        open_thread_counters(t_counters);
+    }
+    t_counters.started.push_back(read_counters(t_counters));
+}
+
+void perf_scope_ended(int phase) {
+    // Scopes opened before the counters were enabled have nothing to close
+    if (!g_perf_enabled || t_counters.started.empty()) {
+        return;
+    }
+    PerfReading now = read_counters(t_counters);
+    PerfReading start = t_counters.started.back();
+    t_counters.started.pop_back();
+
+    std::lock_guard<std::mutex> lock(g_perf_mutex);
+    PerfTotals* totals = nullptr;
+    for (PerfTotals& entry : g_perf_totals) {
+        if (entry.phase == phase && entry.thread == t_counters.thread) {
+            totals = &entry;
+            break;
+        }
+    }
+    if (!totals) {
+        PerfTotals entry;
+        entry.phase = phase;
+        entry.thread = t_counters.thread;
+        g_perf_totals.push_back(entry);
+        totals = &g_perf_totals.back();
+    }
+    totals->scopes++;
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        totals->values[i] += now.values[i] - start.values[i];
+    }
+}
+
+static void add_counters(nlohmann::json& target, const PerfTotals& totals) {
+    if (target.is_null()) {
+        target = nlohmann::json::object();
+    }
+    target["scopes"] = target.value("scopes", 0LL) + totals.scopes;
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if (g_available_events & (1 << i)) {
+            target[PERF_EVENT_NAMES[i]] = target.value(PERF_EVENT_NAMES[i], 0LL) + totals.values[i];
+        }
+    }
+}
+
+// Per phase summed over threads, and per thread and phase; nested phases are both charged, as in the timings
+nlohmann::json perf_counters_to_json() {
+    std::vector<PhaseTiming> timings = get_phase_timings();
+    nlohmann::json phases = nlohmann::json::object();
+    nlohmann::json threads = nlohmann::json::array();
+    nlohmann::json unavailable = nlohmann::json::array();
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if (!(g_available_events & (1 << i))) {
+            unavailable.push_back(PERF_EVENT_NAMES[i]);
+        }
+    }
+    std::lock_guard<std::mutex> lock(g_perf_mutex);
+    for (const PerfTotals& totals : g_perf_totals) {
+        if (totals.phase < 0 || static_cast<size_t>(totals.phase) >= timings.size()) {
+            continue;
+        }
+        const std::string& name = timings[totals.phase].name;
+        add_counters(phases[name], totals);
+        nlohmann::json thread = { { "thread", totals.thread }, { "phase", name } };
+        add_counters(thread, totals);
+        threads.push_back(thread);
+    }
+    return {
+        { "user_space_only", g_user_only.load() },
+        { "unavailable", unavailable },
+        { "phases", phases },
+        { "threads", threads }
+    };
+}
@@ -0,0 +1,22 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include "json.hpp"
+
+// Hardware and kernel counters per install phase and per thread, for --perf-counters: cycles,
+// instructions, cache misses, page faults and context switches, read with perf_event_open around
+// every PhaseScope so a phase can be told apart as compute-, fault- or syscall-bound. Linux only;
+// enable_perf_counters() returns false elsewhere, and on hosts where the kernel refuses the events
+// (perf_event_paranoid, no PMU in a VM) counters that could not be opened are left out. Each scope
+// costs two read() calls while enabled and one flag check while it is off.
+bool enable_perf_counters();
+bool perf_counters_enabled();
+void reset_perf_counters();   // drop what was collected so far, e.g. between benchmark runs
+
+// Used by PhaseScope, on the thread that opens and closes the scope; calls nest like the scopes
+void perf_scope_started();
+void perf_scope_ended(int phase);
+
+nlohmann::json perf_counters_to_json();
+
+#endif
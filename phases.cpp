@@ -0,0 +1,106 @@
+#include "phases.hpp"
+#include "memory_stats.hpp"
+#include "perf_counters.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PhaseState {
+    const char* name;
+    int active = 0;
+    std::chrono::steady_clock::time_point started;
+    double seconds = 0.0;
+    long long entries = 0;
+};
+
+static std::mutex g_phase_mutex;
+static std::vector<PhaseState> g_phases;
+static std::vector<std::pair<const char*, long long>> g_event_counts;
+
+PhaseScope::PhaseScope(const char* phase) {
+    {
+        std::lock_guard<std::mutex> lock(g_phase_mutex);
+        for (index_ = 0; index_ < g_phases.size() && strcmp(g_phases[index_].name, phase) != 0; ++index_) {
+        }
+        if (index_ == g_phases.size()) {
+            PhaseState state;
+            state.name = phase;
+            g_phases.push_back(state);
+        }
+        PhaseState& state = g_phases[index_];
+        if (state.active++ == 0) {
+            state.started = std::chrono::steady_clock::now();
+            memory_phase_started(static_cast<int>(index_));
+        }
+        state.entries++;
+        previous_memory_phase_ = set_memory_phase(static_cast<int>(index_));
+    }
+    // Counters are per thread and read outside the lock, so parallel workers do not wait on each
+    // other. A scope inside one of the same phase (e.g. in a task that inherited it) adds nothing.
+    if (previous_memory_phase_ != static_cast<int>(index_)) {
+        perf_scope_started();
+    }
+}
+
+PhaseScope::~PhaseScope() {
+    if (previous_memory_phase_ != static_cast<int>(index_)) {
+        perf_scope_ended(static_cast<int>(index_));
+    }
+    std::lock_guard<std::mutex> lock(g_phase_mutex);
+    PhaseState& state = g_phases[index_];
+    if (--state.active == 0) {
+        state.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - state.started).count();
+        memory_phase_ended(static_cast<int>(index_));
+    }
+    set_memory_phase(previous_memory_phase_);
+}
+
+// Phases still running are reported up to now
+std::vector<PhaseTiming> get_phase_timings() {
+    std::lock_guard<std::mutex> lock(g_phase_mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<PhaseTiming> timings;
+    for (const PhaseState& state : g_phases) {
+        PhaseTiming timing;
+        timing.name = state.name;
+        timing.seconds = state.seconds;
+        if (state.active > 0) {
+            timing.seconds += std::chrono::duration<double>(now - state.started).count();
+        }
+        timing.entries = state.entries;
+        timings.push_back(timing);
+    }
+    return timings;
+}
+
+nlohmann::json phase_timings_to_json() {
+    nlohmann::json phases = nlohmann::json::object();
+    for (const PhaseTiming& timing : get_phase_timings()) {
+        phases[timing.name] = { { "seconds", timing.seconds }, { "entries", timing.entries } };
+    }
+    return phases;
+}
+
+void count_event(const char* name, long long count) {
+    std::lock_guard<std::mutex> lock(g_phase_mutex);
+    for (auto& event : g_event_counts) {
+        if (strcmp(event.first, name) == 0) {
+            event.second += count;
+            return;
+        }
+    }
+    g_event_counts.push_back({ name, count });
+}
+
+nlohmann::json event_counts_to_json() {
+    std::lock_guard<std::mutex> lock(g_phase_mutex);
+    nlohmann::json counts = nlohmann::json::object();
+    for (const auto& event : g_event_counts) {
+        counts[event.first] = event.second;
+    }
+    return counts;
+}
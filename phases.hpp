@@ -0,0 +1,42 @@
+#ifndef PHASES_HPP
+#define PHASES_HPP
+
+#include "json.hpp"
+
+#include <string>
+#include <vector>
+
+// Wall-clock time of the install phases ("discovery", "download", "extraction", "profile_write"),
+// for benchmarks. A phase is running while at least one thread is inside a PhaseScope for it, so
+// parallel downloads add up to how long the download phase took rather than the sum of the files.
+// Phases may nest (writing the launcher profile looks for javaw.exe); both are then charged.
+// With --memory, the thread's allocations inside a scope are counted against the innermost phase;
+// with --perf-counters, the thread's CPU counters are read when the scope opens and closes. Tasks
+// submitted to the executor (executor.hpp) from inside a scope are charged to its phase as well.
+class PhaseScope {
+public:
+    explicit PhaseScope(const char* phase);
+    ~PhaseScope();
+
+private:
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+    size_t index_;
+    int previous_memory_phase_;
+};
+
+struct PhaseTiming {
+    std::string name;
+    double seconds = 0.0;
+    long long entries = 0;   // scopes opened, e.g. files downloaded
+};
+
+std::vector<PhaseTiming> get_phase_timings();   // in order of first use
+nlohmann::json phase_timings_to_json();
+
+// Counts of costly operations ("process_spawns", "directory_scans"), reported next to the phases
+// so that a change in how often they happen shows up as a number
+void count_event(const char* name, long long count = 1);
+nlohmann::json event_counts_to_json();
+
+#endif
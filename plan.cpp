@@ -0,0 +1,404 @@
+#define NOMINMAX
+
+#include "plan.hpp"
+#include "archive.hpp"
+#include "constants.hpp"
+#include "filesystem.hpp"
+#include "hash.hpp"
+#include "install_state.hpp"
+#include "json_stream.hpp"
+#include "mod_versions.hpp"
+#include "mrpack.hpp"
+#include "offline.hpp"
+#include "store.hpp"
+
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Fallbacks used until a real run on this machine has recorded measurements
+static const double DEFAULT_DOWNLOAD_BYTES_PER_SEC = 2.0 * 1024 * 1024;
+static const double DEFAULT_EXTRACT_BYTES_PER_SEC = 20.0 * 1024 * 1024;
+static const double DEFAULT_JAVA_INSTALL_SECONDS = 60.0;
+static const double DEFAULT_FABRIC_INSTALL_SECONDS = 15.0;
+
+static std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+// Version of a java executable: the JDK release file when present, otherwise ask the JVM
+static std::string probe_java_version(const std::string& java_exe_path) {
+    std::string version = read_java_release_version(java_exe_path);
+    if (!version.empty()) {
+        return version;
+    }
+    std::string output = exec(("\"" + java_exe_path + "\" -version 2>&1").c_str());
+    size_t first_quote = output.find('\"');
+    if (first_quote != std::string::npos) {
+        size_t second_quote = output.find('\"', first_quote + 1);
+        if (second_quote != std::string::npos) {
+            return output.substr(first_quote + 1, second_quote - first_quote - 1);
+        }
+    }
+    return "";
+}
+
+// Locate a suitable java/javaw the same way the installer does, preferring PATH, then vendor directories
+static bool find_suitable_java(const char* exe_name, std::string& found_path, std::string& found_version) {
+    char buffer[MAX_PATH];
+    DWORD result = SearchPathA(NULL, exe_name, NULL, MAX_PATH, buffer, NULL);
+    if (result > 0 && result < MAX_PATH) {
+        std::string version = probe_java_version(buffer);
+        if (!version.empty() && is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
+            found_path = buffer;
+            found_version = version;
+            return true;
+        }
+    }
+
+    for (const std::string& base_path : get_java_search_paths()) {
+        WIN32_FIND_DATAA findFileData;
+        HANDLE hFind = FindFirstFileA((base_path + "\\*").c_str(), &findFileData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        do {
+            std::string dir_name = findFileData.cFileName;
+            if (!(findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || dir_name == "." || dir_name == "..") {
+                continue;
+            }
+            std::string exe_path = base_path + "\\" + dir_name + "\\bin\\" + exe_name;
+            if (!file_exists(exe_path)) {
+                continue;
+            }
+            std::string version = probe_java_version(exe_path);
+            if (!version.empty() && is_version_greater_or_equal(version, REQUIRED_JAVA_VERSION)) {
+                found_path = exe_path;
+                found_version = version;
+                FindClose(hFind);
+                return true;
+            }
+        } while (FindNextFileA(hFind, &findFileData) != 0);
+        FindClose(hFind);
+    }
+    return false;
+}
+
+static void plan_download(InstallPlan& plan, const InstallState& state, const std::string& url, const std::string& path) {
+    PlannedDownload download;
+    download.url = url;
+    download.path = path;
+    auto it = state.artifact_bytes.find(url);
+    if (it != state.artifact_bytes.end()) {
+        download.bytes = it->second;
+    }
+    plan.downloads.push_back(download);
+    plan.writes.push_back({ path, "download" });
+}
+
+// Where a real run gets an installer: from the offline bundle when it carries one, otherwise it always
+// fetches the published checksum and downloads the installer only if the machine-wide copy fails it.
+// Without the network the cached copy cannot be checked here, so it is assumed to still match.
+static void plan_installer(InstallPlan& plan, const InstallState& state, const std::string& bundle_entry, const std::string& url, const std::string& digest_url, const std::string& path) {
+    const Bundle* bundle = get_offline_bundle();
+    const BundleEntry* bundled = bundle ? bundle->find(bundle_entry) : nullptr;
+    if (bundled) {
+        if (!file_exists(path) || sha256_file(path) != bundled->sha256) {
+            plan.writes.push_back({ path, "installer from the offline bundle" });
+        }
+        return;
+    }
+    PlannedDownload digest;
+    digest.url = digest_url;   // read into memory, not saved
+    plan.downloads.push_back(digest);
+    if (!file_exists(path)) {
+        plan_download(plan, state, url, path);
+    }
+}
+
+// Compare the launcher profile a real run would write against the one on disk
+static void plan_launcher_profile(InstallPlan& plan, const std::string& minecraft_dir, const std::string& modded_install_dir, const std::string& javaw_path) {
+    using json = nlohmann::json;
+    std::string profiles_path = minecraft_dir + "\\launcher_profiles.json";
+    std::ifstream in(profiles_path, std::ios::binary);
+    if (!in) {
+        return;   // a real run reports the missing file and skips the profile
+    }
+    plan.profiles_file_found = true;
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // Only our own profile is materialized; other profiles (often with large icons) are skipped
+    std::string raw_profile;
+    if (find_launcher_profile(data.data(), data.size(), get_launcher_profile_id(MINECRAFT_VERSION), raw_profile)) {
+        json current = json::parse(raw_profile, nullptr, false);
+        json wanted = build_launcher_profile(modded_install_dir, FABRIC_LOADER_VERSION, MINECRAFT_VERSION, MODPACK_PROFILE_NAME, javaw_path);
+        plan.profile_up_to_date = !current.is_discarded() && current == wanted;
+    }
+    plan.writes.push_back({ profiles_path, plan.profile_up_to_date ? "rewrite launcher profiles (no change)" : "add/update launcher profile" });
+}
+
+// Diff the cached modpack archive against the mods directory; the new set is written to stage_dir
+static void plan_mods(InstallPlan& plan, const std::string& modpack_zip_path, const std::string& mods_dir, const std::string& stage_dir, long long& extract_bytes) {
+    std::vector<ZipEntry> entries;
+    if (!read_zip_directory(modpack_zip_path, entries)) {
+        return;
+    }
+    plan.mods_known = true;
+
+    // Keyed case-insensitively like the file system; the value keeps the name as found for output
+    std::map<std::string, FileInfo> local_files;
+    for (const FileInfo& info : list_files_recursive(mods_dir)) {
+        local_files[to_lower(info.relative_path)] = info;
+    }
+
+    for (const ZipEntry& entry : entries) {
+        if (entry.is_directory()) {
+            continue;
+        }
+        std::string relative_path = entry.name;
+        std::replace(relative_path.begin(), relative_path.end(), '/', '\\');
+        extract_bytes += static_cast<long long>(entry.uncompressed_size);
+
+        auto it = local_files.find(to_lower(relative_path));
+        std::string target = stage_dir + "\\" + relative_path;
+        if (it == local_files.end()) {
+            plan.mods_added.push_back(relative_path);
+            plan.writes.push_back({ target, "new mod file" });
+        } else {
+            if (it->second.size != entry.uncompressed_size) {
+                plan.mods_changed.push_back(relative_path);
+                plan.writes.push_back({ target, "changed mod file" });
+            } else {
+                plan.mods_unchanged++;
+                plan.writes.push_back({ target, "link unchanged mod file from the store (skipped if it already is one)" });
+            }
+            local_files.erase(it);
+        }
+    }
+    for (const auto& leftover : local_files) {
+        plan.mods_extra.push_back(leftover.second.relative_path);
+    }
+}
+
+// Where a real run puts a pack path: "mods/..." into the staged mod set, the rest into the instance
+static std::string get_planned_install_path(const std::string& instance_dir, const std::string& stage_dir, const std::string& path) {
+    std::string target = path.compare(0, 5, "mods/") == 0 ? stage_dir + "\\" + path.substr(5) : instance_dir + "\\" + path;
+    std::replace(target.begin(), target.end(), '/', '\\');
+    return target;
+}
+
+// Diff a cached .mrpack against the instance: missing cache entries become downloads, differing files become writes
+static void plan_mrpack(InstallPlan& plan, const std::string& modpack_zip_path, const std::string& instance_dir, const std::string& stage_dir) {
+    ZipArchive archive;
+    MrpackIndex index;
+    if (!archive.open(modpack_zip_path) || !read_mrpack_index(archive, index)) {
+        return;
+    }
+    plan.mods_known = true;
+    plan.mrpack = true;
+
+    std::set<std::string> wanted_paths;
+    std::set<std::string> planned_hashes;
+    for (const MrpackFile& file : index.files) {
+        if (!mrpack_file_applies(file, PackSide::Client)) {
+            continue;
+        }
+        std::string path = index.str(file.path);
+        std::string sha1 = to_hex(file.sha1, sizeof(file.sha1));
+        wanted_paths.insert(path);
+        std::string object_path = get_store_object_path(sha1);
+        if (!file_exists(object_path) && planned_hashes.insert(sha1).second) {
+            PlannedDownload download;
+            download.url = resolve_download_url(index.download_url(file, 0));
+            download.path = object_path;
+            download.bytes = file.file_size;
+            plan.downloads.push_back(download);
+            plan.writes.push_back({ object_path, "store object" });
+        }
+
+        // The staged mod set starts out as links to the current one
+        std::string current = instance_dir + "\\" + path;
+        std::replace(current.begin(), current.end(), '/', '\\');
+        std::string target = get_planned_install_path(instance_dir, stage_dir, path);
+        long long size = get_file_size(current);
+        if (size < 0) {
+            plan.mods_added.push_back(path);
+            plan.writes.push_back({ target, "new pack file" });
+        } else if (size != file.file_size) {
+            plan.mods_changed.push_back(path);
+            plan.writes.push_back({ target, "changed pack file" });
+        } else {
+            plan.mods_unchanged++;   // same size; a real run confirms by hash before skipping
+        }
+    }
+
+    // The current mod set's list of installed pack files, or the one older versions left in the instance
+    std::string manifest_path = get_installed_files_manifest_path(instance_dir + "\\mods");
+    if (!file_exists(manifest_path)) {
+        manifest_path = instance_dir + "\\mrpack-files.json";
+    }
+    std::ifstream in(manifest_path);
+    nlohmann::json previous = nlohmann::json::parse(in, nullptr, false);
+    if (!previous.is_discarded() && previous.is_array()) {
+        for (const nlohmann::json& path : previous) {
+            if (path.is_string() && wanted_paths.count(path.get<std::string>()) == 0) {
+                plan.mods_extra.push_back(path.get<std::string>());
+                plan.writes.push_back({ get_planned_install_path(instance_dir, stage_dir, path.get<std::string>()), "delete file dropped from the pack" });
+            }
+        }
+    }
+    for (const ZipEntry& entry : archive.entries()) {
+        if (!entry.is_directory() && (entry.name.rfind("overrides/", 0) == 0 || entry.name.rfind("client-overrides/", 0) == 0)) {
+            std::string target = get_planned_install_path(instance_dir, stage_dir, entry.name.substr(entry.name.find('/') + 1));
+            plan.writes.push_back({ target, "pack override" });
+        }
+    }
+    plan.writes.push_back({ get_installed_files_manifest_path(stage_dir), "installed pack file list" });
+}
+
+// The writes around the mod files themselves: staging the new set, moving the junction, pruning
+static void plan_mod_versions(InstallPlan& plan, const std::string& mods_dir, const std::string& versions_dir, const std::string& stage_dir) {
+    DWORD attributes = GetFileAttributesA(mods_dir.c_str());
+    bool has_mods = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+    bool migrating = has_mods && !(attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+    std::vector<std::string> versions = list_mod_versions(parent_directory(mods_dir));
+    if (migrating) {
+        plan.writes.push_back({ versions_dir + "\\<timestamp>", "move the existing mods directory here as the first version" });
+        plan.writes.push_back({ mods_dir, "junction to the first version" });
+    }
+    plan.writes.push_back({ stage_dir, has_mods ? "stage the new mod set as hardlinks of the current one" : "stage the new mod set" });
+    plan.writes.push_back({ mods_dir + ".next", "junction to the new mod set" });
+    plan.writes.push_back({ mods_dir, "switch the junction to the new mod set" });
+
+    // Once the new version is current, the oldest ones beyond MOD_VERSIONS_TO_KEEP are deleted
+    size_t after = versions.size() + (migrating ? 1 : 0) + 1;
+    size_t keep = static_cast<size_t>(MOD_VERSIONS_TO_KEEP);
+    for (size_t i = 0; i < versions.size() && i + keep < after; ++i) {
+        plan.writes.push_back({ versions_dir + "\\" + versions[i], "delete old mod version" });
+    }
+}
+
+InstallPlan build_install_plan(const std::string& minecraft_dir, const std::string& modded_install_dir, const std::string& modpack_url) {
+    InstallPlan plan;
+    InstallState state = load_install_state();
+    double spawn_seconds = 0.0;
+
+    if (GetFileAttributesA(modded_install_dir.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        plan.writes.push_back({ modded_install_dir, "create modded install directory" });
+    }
+
+    // Java
+    plan.java_ok = find_suitable_java("java.exe", plan.java_path, plan.java_version);
+    if (!plan.java_ok) {
+        std::string java_installer_path = get_shared_download_path(JAVA_INSTALLER_FILENAME);
+        plan_installer(plan, state, BUNDLE_JDK_ENTRY, JAVA_INSTALLER_URL, JAVA_INSTALLER_SHA256_URL, java_installer_path);
+        plan.spawns.push_back({ "msiexec /i \"" + java_installer_path + "\" /qn /norestart", "install Java" });
+        auto it = state.step_seconds.find("java_install");
+        spawn_seconds += it != state.step_seconds.end() ? it->second : DEFAULT_JAVA_INSTALL_SECONDS;
+    }
+
+    // Fabric
+    plan.fabric_loader_version = find_installed_fabric_loader(minecraft_dir, MINECRAFT_VERSION, FABRIC_LOADER_VERSION);
+    plan.fabric_ok = !plan.fabric_loader_version.empty();
+    if (!plan.fabric_ok) {
+        std::string fabric_installer_path = get_shared_download_path(FABRIC_INSTALLER_FILENAME);
+        plan_installer(plan, state, BUNDLE_FABRIC_ENTRY, FABRIC_INSTALLER_URL, FABRIC_INSTALLER_SHA1_URL, fabric_installer_path);
+        plan.spawns.push_back({ "java -jar \"" + fabric_installer_path + "\" client -dir \"" + minecraft_dir + "\" -mcversion " + MINECRAFT_VERSION + " -loader " + FABRIC_LOADER_VERSION, "install Fabric" });
+        plan.writes.push_back({ minecraft_dir + "\\versions\\fabric-loader-" + FABRIC_LOADER_VERSION + "-" + MINECRAFT_VERSION, "Fabric version directory" });
+        auto it = state.step_seconds.find("fabric_install");
+        spawn_seconds += it != state.step_seconds.end() ? it->second : DEFAULT_FABRIC_INSTALL_SECONDS;
+    }
+
+    // Launcher profile; javaDir is only knowable when a suitable javaw already exists
+    std::string javaw_path, javaw_version;
+    find_suitable_java("javaw.exe", javaw_path, javaw_version);
+    plan_launcher_profile(plan, minecraft_dir, modded_install_dir, javaw_path);
+
+    // Modpack
+    std::string modpack_zip_path = get_modpack_archive_path(modpack_url);
+    std::string mods_dir = modded_install_dir + "\\mods";
+    std::string versions_dir = get_mod_versions_dir(modded_install_dir);
+    std::string stage_dir = versions_dir + "\\<timestamp>.staging";   // named when the update starts
+    long long extract_bytes = 0;
+    // A cached copy of the built-in pack that fails its checksum is downloaded again
+    bool cached = file_exists(modpack_zip_path);
+    if (cached && modpack_url == MODPACK_URL && !MODPACK_SHA256.empty()) {
+        cached = sha256_file(modpack_zip_path) == MODPACK_SHA256;
+    }
+    if (cached) {
+        ZipArchive archive;
+        if (archive.open(modpack_zip_path) && is_mrpack(archive)) {
+            plan_mrpack(plan, modpack_zip_path, modded_install_dir, stage_dir);
+        } else {
+            plan_mods(plan, modpack_zip_path, mods_dir, stage_dir, extract_bytes);
+        }
+    } else {
+        plan_download(plan, state, modpack_url, modpack_zip_path);
+        auto it = state.artifact_bytes.find(modpack_url);
+        if (it != state.artifact_bytes.end()) {
+            extract_bytes = it->second;   // compressed size is the best guess available
+        }
+    }
+    if (!plan.mrpack) {
+        plan.writes.push_back({ get_store_dir() + "\\objects", "store objects for mod files not stored yet" });
+    }
+    plan_mod_versions(plan, mods_dir, versions_dir, stage_dir);
+    plan.writes.push_back({ get_install_state_path(), "record installer measurements" });
+
+    // Estimate
+    double download_rate = state.download_bytes_per_sec > 0.0 ? state.download_bytes_per_sec : DEFAULT_DOWNLOAD_BYTES_PER_SEC;
+    double extract_rate = state.extract_bytes_per_sec > 0.0 ? state.extract_bytes_per_sec : DEFAULT_EXTRACT_BYTES_PER_SEC;
+    plan.estimate_from_history = state.download_bytes_per_sec > 0.0;
+    for (const PlannedDownload& download : plan.downloads) {
+        if (download.bytes > 0) {
+            plan.download_bytes += download.bytes;
+        }
+    }
+    plan.estimated_seconds = plan.download_bytes / download_rate + extract_bytes / extract_rate + spawn_seconds;
+    return plan;
+}
+
+nlohmann::json install_plan_to_json(const InstallPlan& plan) {
+    using json = nlohmann::json;
+    json j;
+    j["java"] = { {"ok", plan.java_ok}, {"path", plan.java_path}, {"version", plan.java_version} };
+    j["fabric"] = { {"ok", plan.fabric_ok}, {"loader_version", plan.fabric_loader_version} };
+    j["profile"] = { {"profiles_file_found", plan.profiles_file_found}, {"up_to_date", plan.profile_up_to_date} };
+    j["mods"] = {
+        {"known", plan.mods_known},
+        {"mrpack", plan.mrpack},
+        {"added", plan.mods_added},
+        {"changed", plan.mods_changed},
+        {"extra", plan.mods_extra},
+        {"unchanged", plan.mods_unchanged}
+    };
+
+    j["downloads"] = json::array();
+    for (const PlannedDownload& download : plan.downloads) {
+        json d = { {"url", download.url}, {"path", download.path} };
+        d["bytes"] = download.bytes >= 0 ? json(download.bytes) : json(nullptr);
+        j["downloads"].push_back(d);
+    }
+    j["writes"] = json::array();
+    for (const PlannedWrite& write : plan.writes) {
+        j["writes"].push_back({ {"path", write.path}, {"reason", write.reason} });
+    }
+    j["spawns"] = json::array();
+    for (const PlannedSpawn& spawn : plan.spawns) {
+        j["spawns"].push_back({ {"command", spawn.command}, {"reason", spawn.reason} });
+    }
+    j["estimate"] = {
+        {"download_bytes", plan.download_bytes},
+        {"seconds", plan.estimated_seconds},
+        {"from_history", plan.estimate_from_history}
+    };
+    return j;
+}
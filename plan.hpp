@@ -0,0 +1,57 @@
+#ifndef PLAN_HPP
+#define PLAN_HPP
+
+#include "json.hpp"
+
+#include <string>
+#include <vector>
+
+struct PlannedDownload {
+    std::string url;
+    std::string path;       // "" for published checksums, which are only read into memory
+    long long bytes = -1;   // -1 when no run on this machine has fetched it yet
+};
+
+struct PlannedWrite {
+    std::string path;
+    std::string reason;
+};
+
+struct PlannedSpawn {
+    std::string command;
+    std::string reason;
+};
+
+// Everything a real run would do on this machine, computed without writing to disk or using the network
+struct InstallPlan {
+    bool java_ok = false;
+    std::string java_path;
+    std::string java_version;
+
+    bool fabric_ok = false;
+    std::string fabric_loader_version;
+
+    bool profiles_file_found = false;
+    bool profile_up_to_date = false;
+
+    bool mods_known = false;             // false when the modpack archive is not cached yet
+    bool mrpack = false;
+    std::vector<std::string> mods_added;
+    std::vector<std::string> mods_changed;
+    std::vector<std::string> mods_extra;  // present locally, not in the pack (left alone by a real run, except
+                                          // files a previous .mrpack version installed, which it deletes)
+    size_t mods_unchanged = 0;
+
+    std::vector<PlannedDownload> downloads;
+    std::vector<PlannedWrite> writes;
+    std::vector<PlannedSpawn> spawns;
+
+    long long download_bytes = 0;
+    double estimated_seconds = 0.0;
+    bool estimate_from_history = false;
+};
+
+InstallPlan build_install_plan(const std::string& minecraft_dir, const std::string& modded_install_dir, const std::string& modpack_url);
+nlohmann::json install_plan_to_json(const InstallPlan& plan);
+
+#endif
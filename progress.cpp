@@ -0,0 +1,350 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "progress.hpp"
+#include "constants.hpp"
+#include "json.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+static const int PROGRESS_TASK_SLOTS = 8;
+
+static ProgressTask g_tasks[PROGRESS_TASK_SLOTS];
+static std::atomic<int> g_task_count{ 0 };
+static std::mutex g_task_mutex;
+
+// Tasks are only ever added, so a lookup of one that exists takes no lock
+ProgressTask& progress_task(const char* name) {
+    int count = g_task_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(g_tasks[i].name, name) == 0) {
+            return g_tasks[i];
+        }
+    }
+    std::lock_guard<std::mutex> lock(g_task_mutex);
+    count = g_task_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(g_tasks[i].name, name) == 0) {
+            return g_tasks[i];
+        }
+    }
+    if (count == PROGRESS_TASK_SLOTS) {
+        return g_tasks[PROGRESS_TASK_SLOTS - 1];
+    }
+    g_tasks[count].name = name;
+    g_task_count.store(count + 1, std::memory_order_release);
+    return g_tasks[count];
+}
+
+ProgressStyle default_progress_style() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdout)) ? ProgressStyle::Tty : ProgressStyle::Off;
+#else
+    return isatty(fileno(stdout)) ? ProgressStyle::Tty : ProgressStyle::Off;
+#endif
+}
+
+struct LogLine {
+    bool error;
+    std::string text;
+};
+
+static std::mutex g_log_mutex;
+static std::vector<LogLine> g_log_lines;
+static thread_local std::string t_partial_lines[2];   // stdout, stderr: what this thread wrote since its last newline
+
+// Stands in for the console streams' buffers while a reporter runs. Lines are assembled per thread,
+// so output from parallel workers never interleaves mid-line, and only complete lines are queued.
+class LogStreamBuf : public std::streambuf {
+public:
+    explicit LogStreamBuf(bool error) : error_(error) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char ch = traits_type::to_char_type(c);
+            append(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+    // std::endl lands here; the reporter decides when the console is written
+    int sync() override {
+        return 0;
+    }
+
+private:
+    void append(const char* s, size_t n) {
+        std::string& partial = t_partial_lines[error_ ? 1 : 0];
+        const char* end = s + n;
+        for (const char* newline; (newline = static_cast<const char*>(memchr(s, '\n', static_cast<size_t>(end - s)))) != nullptr; s = newline + 1) {
+            partial.append(s, newline);
+            std::lock_guard<std::mutex> lock(g_log_mutex);
+            g_log_lines.push_back({ error_, std::move(partial) });
+            partial.clear();
+        }
+        partial.append(s, end);
+    }
+
+    bool error_;
+};
+
+static LogStreamBuf g_out_log(false);
+static LogStreamBuf g_err_log(true);
+
+// Everything below is only touched under g_output_mutex
+static std::mutex g_output_mutex;
+static bool g_active = false;
+static ProgressStyle g_style = ProgressStyle::Off;
+static std::streambuf* g_console_out = nullptr;
+static std::streambuf* g_console_err = nullptr;
+static size_t g_status_width = 0;   // characters of the status line currently on screen
+static std::chrono::steady_clock::time_point g_started;
+static std::chrono::steady_clock::time_point g_last_sample;
+static long long g_last_bytes[PROGRESS_TASK_SLOTS];
+static double g_rates[PROGRESS_TASK_SLOTS];
+
+static std::mutex g_stop_mutex;
+static std::condition_variable g_stop_cv;
+static bool g_stop = false;
+static ProgressReporter* g_reporter = nullptr;
+
+static void write_console(std::streambuf* buffer, const std::string& text) {
+    buffer->sputn(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+static void clear_status_line() {
+    if (g_status_width > 0) {
+        write_console(g_console_out, "\r" + std::string(g_status_width, ' ') + "\r");
+        g_status_width = 0;
+    }
+}
+
+static void flush_log_locked() {
+    std::vector<LogLine> lines;
+    {
+        std::lock_guard<std::mutex> lock(g_log_mutex);
+        lines.swap(g_log_lines);
+    }
+    if (lines.empty()) {
+        return;
+    }
+    clear_status_line();
+    for (const LogLine& line : lines) {
+        if (g_style == ProgressStyle::JsonLines) {
+            nlohmann::json entry = { { "type", "log" }, { "stream", line.error ? "stderr" : "stdout" }, { "text", line.text } };
+            write_console(g_console_out, entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n");
+        } else {
+            write_console(line.error ? g_console_err : g_console_out, line.text + "\n");
+        }
+    }
+    g_console_err->pubsync();
+    g_console_out->pubsync();
+}
+
+void flush_log() {
+    std::lock_guard<std::mutex> lock(g_output_mutex);
+    if (g_active) {
+        flush_log_locked();
+    }
+}
+
+static std::string format_mb(long long bytes) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1024.0 * 1024.0);
+    return out.str();
+}
+
+static std::string format_eta(double seconds) {
+    long long total = static_cast<long long>(seconds + 0.5);
+    std::ostringstream out;
+    if (total >= 3600) {
+        out << total / 3600 << ":" << std::setw(2) << std::setfill('0') << total / 60 % 60;
+    } else {
+        out << total / 60;
+    }
+    out << ":" << std::setw(2) << std::setfill('0') << total % 60;
+    return out.str();
+}
+
+static void draw_status_locked(bool final) {
+    auto now = std::chrono::steady_clock::now();
+    double interval = std::chrono::duration<double>(now - g_last_sample).count();
+    g_last_sample = now;
+
+    double total_rate = 0.0;
+    std::vector<std::string> parts;
+    nlohmann::json tasks = nlohmann::json::array();
+    int count = g_task_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        const ProgressTask& task = g_tasks[i];
+        long long items_planned = task.items_planned.load(std::memory_order_relaxed);
+        long long items_done = task.items_done.load(std::memory_order_relaxed);
+        long long bytes_planned = task.bytes_planned.load(std::memory_order_relaxed);
+        long long bytes_done = task.bytes_done.load(std::memory_order_relaxed);
+        if (items_planned == 0 && items_done == 0 && bytes_done == 0) {
+            continue;
+        }
+        // Smoothed over refreshes, so one slow read does not make the ETA jump around
+        double rate = interval > 0.0 ? static_cast<double>(bytes_done - g_last_bytes[i]) / interval : 0.0;
+        g_rates[i] = g_last_bytes[i] == 0 && g_rates[i] == 0.0 ? rate : 0.5 * g_rates[i] + 0.5 * rate;
+        g_last_bytes[i] = bytes_done;
+
+        bool done = items_planned > 0 && items_done >= items_planned;
+        const char* status = done ? "done" : items_done == 0 && bytes_done == 0 ? "waiting" : "running";
+        double eta = !done && bytes_planned > bytes_done && g_rates[i] > 0.0 ? static_cast<double>(bytes_planned - bytes_done) / g_rates[i] : -1.0;
+        if (!done) {
+            total_rate += g_rates[i];
+        }
+
+        nlohmann::json entry = {
+            { "name", task.name },
+            { "status", status },
+            { "items_done", items_done },
+            { "items_planned", items_planned },
+            { "bytes_done", bytes_done },
+            { "bytes_planned", bytes_planned },
+            { "bytes_per_sec", done ? 0.0 : g_rates[i] },
+            { "eta_seconds", nullptr }
+        };
+        if (eta >= 0.0) {
+            entry["eta_seconds"] = eta;
+        }
+        tasks.push_back(entry);
+
+        std::string part = std::string(task.name) + " " + status;
+        if (strcmp(status, "running") == 0 && items_planned > 0) {
+            part = std::string(task.name) + " " + std::to_string(items_done) + "/" + std::to_string(items_planned);
+        }
+        if (bytes_done > 0) {
+            part += " " + format_mb(bytes_done) + (bytes_planned > 0 && !done ? "/" + format_mb(bytes_planned) : "") + " MB";
+        }
+        if (!done && bytes_done > 0) {
+            part += " " + format_mb(static_cast<long long>(g_rates[i])) + " MB/s";
+        }
+        if (eta >= 0.0) {
+            part += " ETA " + format_eta(eta);
+        }
+        parts.push_back(part);
+    }
+
+    if (g_style == ProgressStyle::JsonLines) {
+        nlohmann::json report = {
+            { "type", "progress" },
+            { "final", final },
+            { "elapsed_seconds", std::chrono::duration<double>(now - g_started).count() },
+            { "bytes_per_sec", total_rate },
+            { "tasks", tasks }
+        };
+        write_console(g_console_out, report.dump() + "\n");
+    } else if (g_style == ProgressStyle::Tty && !parts.empty()) {
+        std::string line = format_mb(static_cast<long long>(total_rate)) + " MB/s";
+        for (const std::string& part : parts) {
+            line += " | " + part;
+        }
+        size_t width = line.size();
+        // Shorter than the previous status: blank out what is left of it
+        if (width < g_status_width) {
+            line += std::string(g_status_width - width, ' ');
+        }
+        write_console(g_console_out, "\r" + line + (final ? "\n" : ""));
+        g_status_width = final ? 0 : width;
+    }
+    g_console_out->pubsync();
+}
+
+static void stop_active_reporter() {
+    if (g_reporter) {
+        g_reporter->stop();
+    }
+}
+
+ProgressReporter::ProgressReporter(ProgressStyle style) : style_(style) {
+    static bool registered = false;
+    std::lock_guard<std::mutex> lock(g_output_mutex);
+    if (g_active) {
+        return;
+    }
+    if (!registered) {
+        registered = true;
+        std::atexit(stop_active_reporter);
+    }
+    g_active = true;
+    g_style = style;
+    g_started = g_last_sample = std::chrono::steady_clock::now();
+    for (int i = 0; i < PROGRESS_TASK_SLOTS; ++i) {
+        g_last_bytes[i] = g_tasks[i].bytes_done.load(std::memory_order_relaxed);
+        g_rates[i] = 0.0;
+    }
+    g_console_out = std::cout.rdbuf(&g_out_log);
+    g_console_err = std::cerr.rdbuf(&g_err_log);
+    g_stop = false;
+    g_reporter = this;
+    thread_ = std::thread(&ProgressReporter::run, this);
+}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> stop_lock(g_stop_mutex);
+    while (!g_stop) {
+        g_stop_cv.wait_for(stop_lock, std::chrono::milliseconds(PROGRESS_REFRESH_MS), [] { return g_stop; });
+        stop_lock.unlock();
+        {
+            std::lock_guard<std::mutex> lock(g_output_mutex);
+            flush_log_locked();
+            draw_status_locked(false);
+        }
+        stop_lock.lock();
+    }
+}
+
+void ProgressReporter::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> stop_lock(g_stop_mutex);
+        g_stop = true;
+    }
+    g_stop_cv.notify_all();
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(g_output_mutex);
+    // A line this thread left without its newline, e.g. when exit() cut it short
+    for (int stream = 0; stream < 2; ++stream) {
+        if (!t_partial_lines[stream].empty()) {
+            std::lock_guard<std::mutex> log_lock(g_log_mutex);
+            g_log_lines.push_back({ stream == 1, std::move(t_partial_lines[stream]) });
+            t_partial_lines[stream].clear();
+        }
+    }
+    flush_log_locked();
+    draw_status_locked(true);
+    std::cout.rdbuf(g_console_out);
+    std::cerr.rdbuf(g_console_err);
+    g_active = false;
+    g_reporter = nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Progress of one kind of work ("download", "extraction") for the live display. Whoever knows the
+// batch plans it; workers then only bump relaxed atomics and never take a lock, and the reporter
+// thread reads the counters at its refresh rate. The object for a name lives for the whole run.
+struct ProgressTask {
+    const char* name = "";
+    std::atomic<long long> items_planned{ 0 };
+    std::atomic<long long> items_done{ 0 };
+    std::atomic<long long> bytes_planned{ 0 };   // 0 when the size is not known up front
+    std::atomic<long long> bytes_done{ 0 };
+
+    void plan(long long items, long long bytes) {
+        items_planned.fetch_add(items, std::memory_order_relaxed);
+        bytes_planned.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void add_bytes(long long bytes) { bytes_done.fetch_add(bytes, std::memory_order_relaxed); }
+    void finish_item() { items_done.fetch_add(1, std::memory_order_relaxed); }
+};
+
+ProgressTask& progress_task(const char* name);
+
+enum class ProgressStyle {
+    Off,         // no status, but console output is still buffered
+    Tty,         // one status line, redrawn in place
+    JsonLines    // {"type":"progress"} and {"type":"log"} objects, one per line, for a wrapper UI
+};
+
+ProgressStyle default_progress_style();   // Tty when stdout is a console, Off otherwise
+
+// While a reporter runs, std::cout and std::cerr go through a buffered log: each thread's lines
+// are kept whole and queued without flushing (std::endl costs nothing), and the reporter thread
+// writes them out every PROGRESS_REFRESH_MS between redraws of the status: aggregate throughput,
+// and per task what is done, its rate and an ETA. Also stopped when the process exits.
+class ProgressReporter {
+public:
+    explicit ProgressReporter(ProgressStyle style);
+    ~ProgressReporter();
+    void stop();   // final status, remaining log lines, console streams restored
+
+private:
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+    void run();
+
+    ProgressStyle style_;
+    std::thread thread_;
+};
+
+// Write out queued log lines now, e.g. before starting a process that shares the console
+void flush_log();
+
+#endif
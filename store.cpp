@@ -0,0 +1,575 @@
+#define NOMINMAX
+
+#include "store.hpp"
+#include "executor.hpp"
+#include "file_lock.hpp"
+#include "filesystem.hpp"
+#include "hash.hpp"
+#include "mrpack.hpp"
+#include "phases.hpp"
+#include "progress.hpp"
+
+#include <windows.h>
+#include <aclapi.h>
+#include <sddl.h>
+#include <winioctl.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// How long to wait for a lock whose owner cannot be told; a live owner writing the same object or
+// download is waited for until it is done, however long that takes
+static const DWORD STORE_LOCK_TIMEOUT_MS = 10 * 60 * 1000;
+
+// Owned by Administrators; SYSTEM and Administrators may change it, other users only read it
+static const char* STORE_SECURITY_DESCRIPTOR = "O:BAD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)(A;OICI;0x1200a9;;;BU)";
+
+// Objects this process wrote or re-hashed, so each is read at most once per run
+static std::mutex g_verified_mutex;
+static std::set<std::string> g_verified_objects;
+
+void MaterializeStats::add(MaterializeMethod method) {
+    count_event(method == MaterializeMethod::Existing ? "files_skipped" : method == MaterializeMethod::Failed ? "files_failed" : "files_written");
+    switch (method) {
+        case MaterializeMethod::Existing: existing++; break;
+        case MaterializeMethod::Hardlink: hardlinked++; break;
+        case MaterializeMethod::Reflink: reflinked++; break;
+        case MaterializeMethod::Copy: copied++; break;
+        case MaterializeMethod::Failed: break;
+    }
+}
+
+// Content found locally instead of being fetched, for --metrics
+void count_cache_hit(long long bytes) {
+    count_event("cache_hits");
+    count_event("bytes_cache", bytes);
+}
+
+static bool is_process_elevated() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_ELEVATION elevation = {};
+    DWORD size = 0;
+    bool elevated = GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size) && elevation.TokenIsElevated;
+    CloseHandle(token);
+    return elevated;
+}
+
+// Shared by every user on the machine, so a mod downloaded once is never downloaded again. Only
+// administrators may change it, so an installer that is not elevated keeps its own store in the
+// per-user cache, as it does when ProgramData is not available.
+std::string get_store_dir() {
+    static const bool elevated = is_process_elevated();
+    std::string program_data = safe_getenv("ProgramData");
+    if (!program_data.empty() && elevated) {
+        return program_data + "\\mc-mod-installer\\store";
+    }
+    return get_cache_dir() + "\\store";
+}
+
+static bool has_security(const std::string& path, PSECURITY_DESCRIPTOR wanted) {
+    PSID wanted_owner = nullptr;
+    PACL wanted_dacl = nullptr;
+    BOOL present = FALSE, defaulted = FALSE;
+    if (!GetSecurityDescriptorOwner(wanted, &wanted_owner, &defaulted) || !GetSecurityDescriptorDacl(wanted, &present, &wanted_dacl, &defaulted)) {
+        return false;
+    }
+    PSID owner = nullptr;
+    PACL dacl = nullptr;
+    PSECURITY_DESCRIPTOR current = nullptr;
+    if (GetNamedSecurityInfoA(path.c_str(), SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION, &owner, nullptr, &dacl, nullptr, &current) != ERROR_SUCCESS) {
+        return false;
+    }
+    SECURITY_DESCRIPTOR_CONTROL control = 0;
+    DWORD revision = 0;
+    bool same = GetSecurityDescriptorControl(current, &control, &revision) && (control & SE_DACL_PROTECTED) &&
+                owner && EqualSid(owner, wanted_owner) && dacl && wanted_dacl &&
+                dacl->AclSize == wanted_dacl->AclSize && memcmp(dacl, wanted_dacl, wanted_dacl->AclSize) == 0;
+    LocalFree(current);
+    return same;
+}
+
+// Installers link what they find in the store into other users' instances and serve it to peers,
+// so nobody but an administrator may plant or replace anything in it. The root gets an owner and a
+// protected DACL that everything below inherits; a store left by an earlier version, or created by
+// someone else first, is taken over and re-secured the first time an elevated installer uses it.
+static void secure_store_root() {
+    std::string root = get_store_dir();
+    if (root == get_cache_dir() + "\\store") {
+        return;   // the per-user store only needs the profile's own permissions
+    }
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorA(STORE_SECURITY_DESCRIPTOR, SDDL_REVISION_1, &descriptor, nullptr)) {
+        return;
+    }
+    create_directory(parent_directory(root));
+    SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+    if (!CreateDirectoryA(root.c_str(), &attributes) && GetLastError() == ERROR_ALREADY_EXISTS && !has_security(root, descriptor)) {
+        PSID owner = nullptr;
+        PACL dacl = nullptr;
+        BOOL present = FALSE, defaulted = FALSE;
+        GetSecurityDescriptorOwner(descriptor, &owner, &defaulted);
+        GetSecurityDescriptorDacl(descriptor, &present, &dacl, &defaulted);
+        DWORD error = SetNamedSecurityInfoA(&root[0], SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION,
+                                            owner, nullptr, dacl, nullptr);
+        if (error != ERROR_SUCCESS) {
+            std::cerr << "Could not restrict access to " << root << " (error " << error << ")." << std::endl;
+        }
+    }
+    LocalFree(descriptor);
+}
+
+// Create a directory inside the store, securing the store itself first
+void create_store_directory(const std::string& path) {
+    static std::once_flag secured;
+    std::call_once(secured, secure_store_root);
+    create_directory(path);
+}
+
+// Objects are named by SHA-1 and never change once they are in place
+std::string get_store_object_path(const std::string& sha1) {
+    return get_store_dir() + "\\objects\\" + sha1.substr(0, 2) + "\\" + sha1;
+}
+
+static bool is_verified(const std::string& sha1) {
+    std::lock_guard<std::mutex> lock(g_verified_mutex);
+    return g_verified_objects.count(sha1) != 0;
+}
+
+static void mark_verified(const std::string& sha1) {
+    std::lock_guard<std::mutex> lock(g_verified_mutex);
+    g_verified_objects.insert(sha1);
+}
+
+// Hash a stored object; one that does not match its name is deleted. The caller holds its lock.
+static bool check_object_locked(const std::string& sha1) {
+    std::string object_path = get_store_object_path(sha1);
+    if (!file_exists(object_path)) {
+        return false;
+    }
+    if (sha1_file(object_path) == sha1) {
+        mark_verified(sha1);
+        return true;
+    }
+    std::cerr << "Stored object " << sha1 << " is damaged; it will be fetched again." << std::endl;
+    DeleteFileA(object_path.c_str());
+    return false;
+}
+
+// Re-hash a stored object and drop it if it no longer matches its name. Hardlinked instance files
+// share the object's data, so a mod edited in place inside an instance damages the object too.
+bool store_check_object(const std::string& sha1) {
+    std::string object_path = get_store_object_path(sha1);
+    if (!file_exists(object_path)) {
+        return false;
+    }
+    FileLock lock(object_path + ".lock", STORE_LOCK_TIMEOUT_MS);
+    if (!lock.locked()) {
+        std::cerr << "Could not lock " << object_path << " in the store." << std::endl;
+        return false;
+    }
+    return check_object_locked(sha1);
+}
+
+// Whether an object can be linked: only content this process wrote or has hashed is trusted, since
+// anything else in the store may be damaged. Each object is hashed at most once per run.
+bool store_has_object(const std::string& sha1) {
+    return is_verified(sha1) || store_check_object(sha1);
+}
+
+// Add an object unless it is already stored. produce() writes the complete, verified content to
+// a temporary file, which is renamed into place so readers never see a partial object.
+bool store_put(const std::string& sha1, const std::function<bool(const std::string& temp_path)>& produce) {
+    if (is_verified(sha1)) {
+        return true;
+    }
+    std::unique_ptr<FileLock> lock = store_lock_object(sha1);
+    return lock && store_put_locked(sha1, produce);
+}
+
+// The object's lock, for callers that produce an object over a longer time than one call, e.g.
+// a multiplexed download. Null (after saying why) if it could not be taken.
+std::unique_ptr<FileLock> store_lock_object(const std::string& sha1) {
+    std::string object_path = get_store_object_path(sha1);
+    create_store_directory(parent_directory(object_path));
+    std::unique_ptr<FileLock> lock(new FileLock(object_path + ".lock", STORE_LOCK_TIMEOUT_MS));
+    if (!lock->locked()) {
+        std::cerr << "Could not lock " << object_path << " in the store." << std::endl;
+        return nullptr;
+    }
+    return lock;
+}
+
+// store_has_object() for a caller holding the object's lock
+bool store_has_object_locked(const std::string& sha1) {
+    return is_verified(sha1) || check_object_locked(sha1);
+}
+
+// store_put() for a caller holding the object's lock
+bool store_put_locked(const std::string& sha1, const std::function<bool(const std::string& temp_path)>& produce) {
+    std::string object_path = get_store_object_path(sha1);
+    // Stored before, or by another installer while we waited for the lock
+    if (store_has_object_locked(sha1)) {
+        return true;
+    }
+    std::string temp_path = object_path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+    if (!produce(temp_path)) {
+        DeleteFileA(temp_path.c_str());
+        return false;
+    }
+    if (!MoveFileExA(temp_path.c_str(), object_path.c_str(), MOVEFILE_WRITE_THROUGH)) {
+        DWORD error = GetLastError();
+        DeleteFileA(temp_path.c_str());
+        if (!file_exists(object_path)) {
+            std::cerr << "Failed to add " << sha1 << " to the store (error " << error << ")." << std::endl;
+            return false;
+        }
+    }
+    mark_verified(sha1);
+    return true;
+}
+
+// Installers, JDKs and modpack archives are downloaded once per machine, next to the store
+std::string get_shared_download_path(const std::string& file_name) {
+    return get_store_dir() + "\\downloads\\" + file_name;
+}
+
+static bool file_matches(const std::string& path, const ExpectedHashes& expected) {
+    if (!file_exists(path)) {
+        return false;
+    }
+    return (expected.sha256.empty() || sha256_file(path) == expected.sha256) &&
+           (expected.sha1.empty() || sha1_file(path) == expected.sha1);
+}
+
+// Single flight for a download shared by every installer on the machine: the first process to
+// take the lock produces the file, the others wait for it and then reuse the verified result.
+// Like store_put, produce() writes a temporary file that is renamed into place when complete.
+bool ensure_shared_file(const std::string& path, const ExpectedHashes& expected, const std::function<bool(const std::string& temp_path)>& produce) {
+    if (file_matches(path, expected)) {
+        count_cache_hit(get_file_size(path));
+        if (!expected.sha256.empty()) {
+            store_register_artifact(expected.sha256, path);   // just checked, so it can be served again
+        }
+        return true;
+    }
+    create_store_directory(parent_directory(path));
+    FileLock lock(path + ".lock", STORE_LOCK_TIMEOUT_MS);
+    if (!lock.locked()) {
+        std::cerr << "Could not lock " << path << "." << std::endl;
+        return false;
+    }
+    // Another process finished it while we waited for the lock
+    if (file_matches(path, expected)) {
+        count_cache_hit(get_file_size(path));
+        return true;
+    }
+    count_event("cache_misses");
+    std::string temp_path = path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+    if (!produce(temp_path)) {
+        DeleteFileA(temp_path.c_str());
+        return false;
+    }
+    if (!MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        std::cerr << "Failed to move " << temp_path << " into place (error " << GetLastError() << ")." << std::endl;
+        DeleteFileA(temp_path.c_str());
+        return false;
+    }
+    if (!expected.sha256.empty()) {
+        store_register_artifact(expected.sha256, path);
+        announce_to_peers();
+    }
+    return true;
+}
+
+static std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+static bool is_hex_digest(const std::string& name, size_t length) {
+    return name.size() == length && name.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+// Downloads only known by SHA-256 (installers, modpack archives) stay where they were saved;
+// "artifacts\<sha256>" records the path, and the size and write time the file had when its digest
+// was checked, so the peer cache can serve them too
+void store_register_artifact(const std::string& sha256, const std::string& path) {
+    FileInfo info;
+    if (!get_file_info(path, info)) {
+        return;
+    }
+    std::string index_path = get_store_dir() + "\\artifacts\\" + sha256;
+    create_store_directory(parent_directory(index_path));
+    std::string temp_path = index_path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        out << path << "\n" << info.size << "\n" << info.last_write_time << "\n";
+        if (!out) {
+            return;
+        }
+    }
+    if (!MoveFileExA(temp_path.c_str(), index_path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp_path.c_str());
+    }
+}
+
+// Everything this machine can hand to a peer: "sha1:<hex>" objects and "sha256:<hex>" artifacts
+std::vector<std::string> store_list_keys() {
+    std::vector<std::string> keys;
+    for (const FileInfo& file : list_files_recursive(get_store_dir() + "\\objects")) {
+        std::string name = file.relative_path.substr(file.relative_path.find_last_of('\\') + 1);
+        if (is_hex_digest(name, 40)) {
+            keys.push_back("sha1:" + name);
+        }
+    }
+    for (const FileInfo& file : list_files_recursive(get_store_dir() + "\\artifacts")) {
+        if (is_hex_digest(file.relative_path, 64)) {
+            keys.push_back("sha256:" + file.relative_path);
+        }
+    }
+    return keys;
+}
+
+// An artifact record is only honoured for a file inside the store that is unchanged since it was
+// registered; a record pointing anywhere else, or at a file replaced since, is not served
+static std::string resolve_artifact(const std::string& sha256) {
+    std::ifstream in(get_store_dir() + "\\artifacts\\" + sha256);
+    std::string path;
+    unsigned long long size = 0, last_write_time = 0;
+    if (!std::getline(in, path) || !(in >> size >> last_write_time)) {
+        return "";
+    }
+    std::string root = to_lower(get_store_dir() + "\\");
+    std::string lower_path = to_lower(path);
+    if (lower_path.compare(0, root.size(), root) != 0 || lower_path.find("\\..") != std::string::npos || lower_path.find('/') != std::string::npos) {
+        return "";
+    }
+    FileInfo info;
+    if (!get_file_info(path, info) || info.size != size || info.last_write_time != last_write_time) {
+        return "";
+    }
+    return path;
+}
+
+// Local path holding the content of a key, or "" if it is not here (any more)
+std::string store_resolve_key(const std::string& key) {
+    std::string path;
+    if (key.compare(0, 5, "sha1:") == 0 && is_hex_digest(key.substr(5), 40)) {
+        path = get_store_object_path(key.substr(5));
+    } else if (key.compare(0, 7, "sha256:") == 0 && is_hex_digest(key.substr(7), 64)) {
+        path = resolve_artifact(key.substr(7));
+    }
+    return !path.empty() && file_exists(path) ? path : "";
+}
+
+static bool get_file_identity(const std::string& path, BY_HANDLE_FILE_INFORMATION& info) {
+    HANDLE file = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool ok = GetFileInformationByHandle(file, &info) != 0;
+    CloseHandle(file);
+    return ok;
+}
+
+// True when both paths are links to the same file on the same volume
+static bool is_same_file(const std::string& a, const std::string& b) {
+    BY_HANDLE_FILE_INFORMATION info_a, info_b;
+    return get_file_identity(a, info_a) && get_file_identity(b, info_b) &&
+           info_a.dwVolumeSerialNumber == info_b.dwVolumeSerialNumber &&
+           info_a.nFileIndexHigh == info_b.nFileIndexHigh && info_a.nFileIndexLow == info_b.nFileIndexLow;
+}
+
+// Cluster size of the volume holding path if it supports block cloning, 0 otherwise.
+// Looked up once per volume.
+static DWORD get_clone_cluster_size(const std::string& path) {
+    static std::mutex mutex;
+    static std::map<std::string, DWORD> cluster_sizes;
+
+    char root[MAX_PATH];
+    if (!GetVolumePathNameA(path.c_str(), root, MAX_PATH)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cluster_sizes.find(root);
+    if (it != cluster_sizes.end()) {
+        return it->second;
+    }
+    DWORD cluster_size = 0;
+    DWORD flags = 0;
+    DWORD sectors_per_cluster, bytes_per_sector, free_clusters, total_clusters;
+    if (GetVolumeInformationA(root, nullptr, 0, nullptr, nullptr, &flags, nullptr, 0) && (flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) &&
+        GetDiskFreeSpaceA(root, &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters)) {
+        cluster_size = sectors_per_cluster * bytes_per_sector;
+    }
+    cluster_sizes[root] = cluster_size;
+    return cluster_size;
+}
+
+// Share the source's clusters with a new target file (copy-on-write, no data is read or written)
+static bool reflink_file(const std::string& source, const std::string& target) {
+    DWORD cluster_size = get_clone_cluster_size(target);
+    if (cluster_size == 0) {
+        return false;
+    }
+    HANDLE in = CreateFileA(source.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (in == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    HANDLE out = CreateFileA(target.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, 0, nullptr);
+    if (out == INVALID_HANDLE_VALUE) {
+        CloseHandle(in);
+        return false;
+    }
+
+    // The target must already be as long as the source; the cloned range is whole clusters
+    LARGE_INTEGER size;
+    FILE_END_OF_FILE_INFO end_of_file;
+    bool ok = GetFileSizeEx(in, &size) != 0;
+    end_of_file.EndOfFile = size;
+    ok = ok && SetFileInformationByHandle(out, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file));
+    if (ok && size.QuadPart > 0) {
+        DUPLICATE_EXTENTS_DATA extents;
+        extents.FileHandle = in;
+        extents.SourceFileOffset.QuadPart = 0;
+        extents.TargetFileOffset.QuadPart = 0;
+        extents.ByteCount.QuadPart = (size.QuadPart + cluster_size - 1) / cluster_size * cluster_size;
+        DWORD returned;
+        ok = DeviceIoControl(out, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents), nullptr, 0, &returned, nullptr) != 0;
+    }
+    CloseHandle(out);
+    CloseHandle(in);
+    if (!ok) {
+        DeleteFileA(target.c_str());
+    }
+    return ok;
+}
+
+// Put a stored object at target: a hardlink where possible (same volume, NTFS), then a block clone,
+// then a plain copy. The target is removed first, because writing through an existing hardlink
+// would change the stored object.
+MaterializeMethod materialize_from_store(const std::string& sha1, const std::string& target) {
+    std::string object_path = get_store_object_path(sha1);
+    if (!store_has_object(sha1)) {
+        return MaterializeMethod::Failed;
+    }
+    if (is_same_file(object_path, target)) {
+        return MaterializeMethod::Existing;
+    }
+    if (!DeleteFileA(target.c_str()) && GetLastError() != ERROR_FILE_NOT_FOUND && GetLastError() != ERROR_PATH_NOT_FOUND) {
+        return MaterializeMethod::Failed;
+    }
+    create_directory(parent_directory(target));
+    if (CreateHardLinkA(target.c_str(), object_path.c_str(), nullptr)) {
+        return MaterializeMethod::Hardlink;
+    }
+    if (reflink_file(object_path, target)) {
+        return MaterializeMethod::Reflink;
+    }
+    if (CopyFileA(object_path.c_str(), target.c_str(), FALSE)) {
+        return MaterializeMethod::Copy;
+    }
+    return MaterializeMethod::Failed;
+}
+
+// Extract one zip entry through the store. The entry is always decompressed and hashed: a CRC-32
+// and size are easy to forge, so nothing cheaper identifies its content.
+bool materialize_zip_entry(ZipArchive& archive, const ZipEntry& entry, const std::string& target, MaterializeStats& stats) {
+    std::vector<unsigned char> data;
+    if (!archive.read(entry, data)) {
+        return false;
+    }
+    Sha1 hasher;
+    hasher.update(data.data(), data.size());
+    std::string sha1 = hasher.hex_digest();
+    bool stored = store_put(sha1, [&](const std::string& temp_path) {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(out);
+    });
+    if (!stored) {
+        return false;
+    }
+    MaterializeMethod method = materialize_from_store(sha1, target);
+    if (method == MaterializeMethod::Failed) {
+        std::cerr << "Failed to write " << target << " (error " << GetLastError() << ")." << std::endl;
+        return false;
+    }
+    stats.add(method);
+    return true;
+}
+
+// Extract every file of a zip into target_dir through the store; bytes is the extracted size.
+// Entries are shared out over the CPU lane of the pool, each task reading through its own
+// ZipArchive; the first failure cancels the rest.
+bool materialize_zip(const std::string& zip_path, const std::string& target_dir, MaterializeStats& stats, long long& bytes) {
+    ZipArchive archive;
+    if (!archive.open(zip_path)) {
+        return false;
+    }
+    std::vector<const ZipEntry*> files;
+    long long planned_bytes = 0;
+    for (const ZipEntry& entry : archive.entries()) {
+        if (entry.is_directory()) {
+            continue;
+        }
+        if (!is_safe_pack_path(entry.name)) {
+            std::cerr << "Skipping unsafe archive path: " << entry.name << std::endl;
+            continue;
+        }
+        files.push_back(&entry);
+        planned_bytes += static_cast<long long>(entry.uncompressed_size);
+    }
+    ProgressTask& progress = progress_task("extraction");
+    progress.plan(static_cast<long long>(files.size()), planned_bytes);
+
+    size_t task_count = std::min(files.size(), get_executor_threads(TaskLane::Cpu));
+    std::vector<MaterializeStats> task_stats(task_count);
+    std::atomic<size_t> next_file(0);
+    TaskGroup group(TaskLane::Cpu);
+    for (size_t t = 0; t < task_count; ++t) {
+        group.run([&, t]() {
+            ZipArchive reader;
+            if (!reader.open(zip_path)) {
+                group.cancel();
+                return;
+            }
+            for (size_t i = next_file++; i < files.size() && !group.cancelled(); i = next_file++) {
+                const ZipEntry& entry = *files[i];
+                std::string target = target_dir + "\\" + entry.name;
+                std::replace(target.begin(), target.end(), '/', '\\');
+                if (!materialize_zip_entry(reader, entry, target, task_stats[t])) {
+                    group.cancel();
+                    return;
+                }
+                progress.add_bytes(static_cast<long long>(entry.uncompressed_size));
+                progress.finish_item();
+            }
+        });
+    }
+    group.wait();
+    for (const MaterializeStats& part : task_stats) {
+        stats.existing += part.existing;
+        stats.hardlinked += part.hardlinked;
+        stats.reflinked += part.reflinked;
+        stats.copied += part.copied;
+    }
+    bytes = planned_bytes;
+    return !group.cancelled();
+}
+
+void print_materialize_stats(const MaterializeStats& stats) {
+    std::cout << stats.total() << " files from the store: " << stats.existing << " already linked, " << stats.hardlinked << " hardlinked, "
+              << stats.reflinked << " cloned, " << stats.copied << " copied." << std::endl;
+}
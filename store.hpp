@@ -0,0 +1,54 @@
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include "archive.hpp"
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class FileLock;
+
+// How a file from the store ended up in an instance
+enum class MaterializeMethod {
+    Existing,    // the target already is the stored object (a hardlink from an earlier install)
+    Hardlink,
+    Reflink,     // block clone on a copy-on-write volume (ReFS)
+    Copy,
+    Failed
+};
+
+struct MaterializeStats {
+    size_t existing = 0;
+    size_t hardlinked = 0;
+    size_t reflinked = 0;
+    size_t copied = 0;
+
+    void add(MaterializeMethod method);
+    size_t total() const { return existing + hardlinked + reflinked + copied; }
+};
+
+std::string get_store_dir();
+std::string get_store_object_path(const std::string& sha1);
+void create_store_directory(const std::string& path);
+bool store_has_object(const std::string& sha1);
+bool store_put(const std::string& sha1, const std::function<bool(const std::string& temp_path)>& produce);
+std::unique_ptr<FileLock> store_lock_object(const std::string& sha1);
+bool store_has_object_locked(const std::string& sha1);
+bool store_put_locked(const std::string& sha1, const std::function<bool(const std::string& temp_path)>& produce);
+bool store_check_object(const std::string& sha1);
+std::string get_shared_download_path(const std::string& file_name);
+bool ensure_shared_file(const std::string& path, const ExpectedHashes& expected, const std::function<bool(const std::string& temp_path)>& produce);
+void store_register_artifact(const std::string& sha256, const std::string& path);
+std::vector<std::string> store_list_keys();
+std::string store_resolve_key(const std::string& key);
+MaterializeMethod materialize_from_store(const std::string& sha1, const std::string& target);
+bool materialize_zip_entry(ZipArchive& archive, const ZipEntry& entry, const std::string& target, MaterializeStats& stats);
+bool materialize_zip(const std::string& zip_path, const std::string& target_dir, MaterializeStats& stats, long long& bytes);
+void print_materialize_stats(const MaterializeStats& stats);
+void count_cache_hit(long long bytes);
+
+#endif
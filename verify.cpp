@@ -0,0 +1,450 @@
+#define NOMINMAX
+
+#include "verify.hpp"
+#include "archive.hpp"
+#include "executor.hpp"
+#include "filesystem.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+#include "mrpack.hpp"
+#include "store.hpp"
+
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// What the pack says a file in the instance should contain
+struct ExpectedFile {
+    std::string relative_path;                 // '\' separated
+    unsigned long long size = 0;
+    std::string sha1;                          // pack "files" entries carry a SHA-1...
+    uint32_t crc32 = 0;                        // ...everything extracted from the archive a CRC-32
+    const MrpackFile* mrpack_file = nullptr;
+    const ZipEntry* entry = nullptr;
+};
+
+// Digests of a file as it was when last read; stale once the size or write time changes
+struct HashIndexEntry {
+    unsigned long long size = 0;
+    unsigned long long last_write_time = 0;
+    std::string sha1;
+    bool has_crc32 = false;
+    uint32_t crc32 = 0;
+};
+
+// A file that has to be read because the hash index cannot vouch for it
+struct HashJob {
+    std::string key;
+    std::string path;
+    FileInfo info;
+    bool want_sha1 = false;
+    std::string sha1;
+    uint32_t crc32 = 0;
+    bool read_ok = false;
+};
+
+static std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+static std::string to_windows_path(std::string path) {
+    std::replace(path.begin(), path.end(), '/', '\\');
+    return path;
+}
+
+std::string get_hash_index_path(const std::string& instance_dir) {
+    return instance_dir + "\\hash-index.json";
+}
+
+static std::map<std::string, HashIndexEntry> load_hash_index(const std::string& instance_dir) {
+    using json = nlohmann::json;
+    std::map<std::string, HashIndexEntry> index;
+    std::ifstream in(get_hash_index_path(instance_dir));
+    json j = json::parse(in, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return index;
+    }
+    for (auto it = j.begin(); it != j.end(); ++it) {
+        const json& value = it.value();
+        HashIndexEntry entry;
+        entry.size = value.value("size", 0ULL);
+        entry.last_write_time = value.value("mtime", 0ULL);
+        entry.sha1 = value.value("sha1", "");
+        entry.has_crc32 = value.contains("crc32");
+        entry.crc32 = value.value("crc32", 0U);
+        index[it.key()] = entry;
+    }
+    return index;
+}
+
+static void save_hash_index(const std::string& instance_dir, const std::map<std::string, HashIndexEntry>& index) {
+    using json = nlohmann::json;
+    json j = json::object();
+    for (const auto& item : index) {
+        json value = { { "size", item.second.size }, { "mtime", item.second.last_write_time } };
+        if (!item.second.sha1.empty()) {
+            value["sha1"] = item.second.sha1;
+        }
+        if (item.second.has_crc32) {
+            value["crc32"] = item.second.crc32;
+        }
+        j[item.first] = value;
+    }
+    std::ofstream out(get_hash_index_path(instance_dir));
+    out << j.dump();
+}
+
+// Everything the pack puts in the instance, keyed by lowercase relative path (later sources win)
+static bool collect_expected_files(ZipArchive& archive, MrpackIndex& index, std::map<std::string, ExpectedFile>& expected) {
+    std::vector<std::string> prefixes;
+    if (is_mrpack(archive)) {
+        if (!read_mrpack_index(archive, index)) {
+            return false;
+        }
+        for (const MrpackFile& file : index.files) {
+            if (!mrpack_file_applies(file, PackSide::Client)) {
+                continue;
+            }
+            ExpectedFile info;
+            info.relative_path = to_windows_path(index.str(file.path));
+            info.size = static_cast<unsigned long long>(file.file_size);
+            info.sha1 = to_hex(file.sha1, sizeof(file.sha1));
+            info.mrpack_file = &file;
+            expected[to_lower(info.relative_path)] = info;
+        }
+        prefixes = { "overrides/", "client-overrides/" };
+    } else {
+        // Plain zip packs are extracted into the mods directory as they are
+        prefixes = { "" };
+    }
+
+    for (const std::string& prefix : prefixes) {
+        for (const ZipEntry& entry : archive.entries()) {
+            if (entry.is_directory() || entry.name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            std::string relative_path = entry.name.substr(prefix.size());
+            if (!is_safe_pack_path(relative_path)) {
+                continue;
+            }
+            ExpectedFile info;
+            info.relative_path = (prefix.empty() ? "mods\\" : "") + to_windows_path(relative_path);
+            info.size = entry.uncompressed_size;
+            info.crc32 = entry.crc32;
+            info.entry = &entry;
+            expected[to_lower(info.relative_path)] = info;
+        }
+    }
+    return true;
+}
+
+static bool crc32_file(const std::string& path, uint32_t& crc) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    crc = 0;
+    std::vector<char> buffer(256 * 1024);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = in.gcount();
+        if (got > 0) {
+            crc = crc32_update(crc, reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<size_t>(got));
+        }
+    }
+    return true;
+}
+
+// Hash files in the shared pool's CPU lane. SHA-1 jobs go out in batches so sha1_files() can keep all of its
+// SIMD lanes busy; CRC-32 jobs go out one at a time.
+static void run_hash_jobs(std::vector<HashJob>& jobs) {
+    const size_t sha1_batch = 16;
+    std::vector<std::vector<size_t>> tasks;
+    std::vector<size_t> batch;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].want_sha1) {
+            tasks.push_back({ i });
+            continue;
+        }
+        batch.push_back(i);
+        if (batch.size() == sha1_batch) {
+            tasks.push_back(batch);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        tasks.push_back(batch);
+    }
+
+    TaskGroup group(TaskLane::Cpu);
+    for (const std::vector<size_t>& task : tasks) {
+        group.run([&jobs, &task]() {
+            if (!jobs[task[0]].want_sha1) {
+                HashJob& job = jobs[task[0]];
+                job.read_ok = crc32_file(job.path, job.crc32);
+                return;
+            }
+            std::vector<std::string> paths;
+            for (size_t i : task) {
+                paths.push_back(jobs[i].path);
+            }
+            std::vector<std::string> digests = sha1_files(paths);
+            for (size_t k = 0; k < task.size(); ++k) {
+                jobs[task[k]].sha1 = digests[k];
+                jobs[task[k]].read_ok = !digests[k].empty();
+            }
+        });
+    }
+    group.wait();
+}
+
+static bool write_file(const std::string& path, const std::vector<unsigned char>& data) {
+    create_directory(parent_directory(path));
+    DeleteFileA(path.c_str());   // never write through a link into the store
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+// Put back missing and corrupt files, and move extra mods to "verify-removed" rather than delete them
+static bool repair_instance(ZipArchive& archive, const MrpackIndex& index, const std::string& instance_dir,
+                            const std::map<std::string, ExpectedFile>& expected, VerifyReport& report,
+                            std::map<std::string, HashIndexEntry>& hash_index) {
+    std::vector<const ExpectedFile*> restore;
+    std::vector<const MrpackFile*> downloads;
+    for (const std::vector<std::string>* list : { &report.missing, &report.corrupt }) {
+        for (const std::string& relative_path : *list) {
+            const ExpectedFile& file = expected.at(to_lower(relative_path));
+            restore.push_back(&file);
+            if (!file.mrpack_file) {
+                continue;
+            }
+            // A corrupt file may be a hardlink to its store object, so the object is checked too
+            if (!store_has_object(file.sha1)) {
+                downloads.push_back(file.mrpack_file);
+            }
+        }
+    }
+    if (!downloads.empty() && !fetch_mrpack_files(index, downloads)) {
+        return false;
+    }
+
+    // Plain zip packs put their mods in through the store; mrpack overrides are plain copies
+    bool mrpack = is_mrpack(archive);
+    MaterializeStats stats;
+    bool ok = true;
+    for (const ExpectedFile* file : restore) {
+        std::string target = instance_dir + "\\" + file->relative_path;
+        bool written;
+        if (file->mrpack_file) {
+            MaterializeMethod method = materialize_from_store(file->sha1, target);
+            stats.add(method);
+            written = method != MaterializeMethod::Failed;
+        } else if (!mrpack) {
+            written = materialize_zip_entry(archive, *file->entry, target, stats);
+        } else {
+            std::vector<unsigned char> data;
+            written = archive.read(*file->entry, data) && write_file(target, data);
+        }
+        if (!written) {
+            std::cerr << "Failed to restore " << file->relative_path << std::endl;
+            ok = false;
+            continue;
+        }
+        // The content is now known, so the next verify does not need to read it
+        HashIndexEntry entry;
+        FileInfo info;
+        if (get_file_info(target, info)) {
+            entry.size = info.size;
+            entry.last_write_time = info.last_write_time;
+            entry.sha1 = file->sha1;
+            entry.has_crc32 = !file->mrpack_file;
+            entry.crc32 = file->crc32;
+            hash_index[to_lower(file->relative_path)] = entry;
+        }
+        report.repaired++;
+    }
+
+    for (const std::string& relative_path : report.extra) {
+        std::string target = instance_dir + "\\verify-removed\\" + relative_path;
+        create_directory(parent_directory(target));
+        if (!MoveFileExA((instance_dir + "\\" + relative_path).c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            std::cerr << "Failed to move aside " << relative_path << " (error " << GetLastError() << ")." << std::endl;
+            ok = false;
+            continue;
+        }
+        report.repaired++;
+    }
+    return ok;
+}
+
+// Before a staged mods directory is switched in: every mod the pack installs is there at its
+// expected size, and no jar the pack does not list came along (an old version of an updated mod
+// next to the new one crashes the game). Contents were already checked by hash or CRC as they were written.
+bool check_staged_mods(const std::string& modpack_archive_path, const std::string& stage_dir) {
+    ZipArchive archive;
+    MrpackIndex index;
+    std::map<std::string, ExpectedFile> expected;
+    if (!archive.open(modpack_archive_path) || !collect_expected_files(archive, index, expected)) {
+        return false;
+    }
+    const std::string prefix = "mods\\";
+    bool ok = true;
+    for (const auto& item : expected) {
+        const ExpectedFile& file = item.second;
+        if (file.relative_path.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        long long size = get_file_size(stage_dir + "\\" + file.relative_path.substr(prefix.size()));
+        if (size < 0 || static_cast<unsigned long long>(size) != file.size) {
+            std::cerr << "Staged mod is " << (size < 0 ? "missing" : "the wrong size") << ": " << file.relative_path << std::endl;
+            ok = false;
+        }
+    }
+    const std::string jar = ".jar";
+    for (const FileInfo& info : list_files_recursive(stage_dir)) {
+        std::string relative_path = to_lower(prefix + info.relative_path);
+        bool is_jar = relative_path.size() >= jar.size() && relative_path.compare(relative_path.size() - jar.size(), jar.size(), jar) == 0;
+        if (is_jar && expected.count(relative_path) == 0) {
+            std::cerr << "Staged mods include a jar the pack does not list: " << prefix + info.relative_path << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Compare an instance against the modpack it was installed from
+bool verify_instance(const std::string& modpack_archive_path, const std::string& instance_dir, const VerifyOptions& options, VerifyReport& report) {
+    auto start = std::chrono::steady_clock::now();
+    ZipArchive archive;
+    MrpackIndex index;
+    std::map<std::string, ExpectedFile> expected;
+    if (!archive.open(modpack_archive_path) || !collect_expected_files(archive, index, expected)) {
+        std::cerr << "Could not read the modpack at " << modpack_archive_path << std::endl;
+        return false;
+    }
+
+    std::map<std::string, HashIndexEntry> hash_index;
+    if (!options.full) {
+        hash_index = load_hash_index(instance_dir);
+    }
+
+    // Sizes and write times come from metadata alone; only files the index cannot vouch for are read
+    std::vector<HashJob> jobs;
+    for (const auto& item : expected) {
+        const ExpectedFile& file = item.second;
+        HashJob job;
+        job.key = item.first;
+        job.path = instance_dir + "\\" + file.relative_path;
+        if (!get_file_info(job.path, job.info)) {
+            report.missing.push_back(file.relative_path);
+            continue;
+        }
+        if (job.info.size != file.size) {
+            report.corrupt.push_back(file.relative_path);
+            continue;
+        }
+        job.want_sha1 = file.mrpack_file != nullptr;
+        auto cached = hash_index.find(item.first);
+        if (cached != hash_index.end() && cached->second.size == job.info.size && cached->second.last_write_time == job.info.last_write_time) {
+            if (job.want_sha1 && !cached->second.sha1.empty()) {
+                if (cached->second.sha1 != file.sha1) {
+                    report.corrupt.push_back(file.relative_path);
+                }
+                continue;
+            }
+            if (!job.want_sha1 && cached->second.has_crc32) {
+                if (cached->second.crc32 != file.crc32) {
+                    report.corrupt.push_back(file.relative_path);
+                }
+                continue;
+            }
+        }
+        jobs.push_back(job);
+    }
+
+    run_hash_jobs(jobs);
+    for (const HashJob& job : jobs) {
+        const ExpectedFile& file = expected.at(job.key);
+        if (!job.read_ok) {
+            report.corrupt.push_back(file.relative_path);
+            continue;
+        }
+        HashIndexEntry& entry = hash_index[job.key];
+        if (entry.size != job.info.size || entry.last_write_time != job.info.last_write_time) {
+            entry = HashIndexEntry();
+        }
+        entry.size = job.info.size;
+        entry.last_write_time = job.info.last_write_time;
+        if (job.want_sha1) {
+            entry.sha1 = job.sha1;
+        } else {
+            entry.has_crc32 = true;
+            entry.crc32 = job.crc32;
+        }
+        bool matches = job.want_sha1 ? job.sha1 == file.sha1 : job.crc32 == file.crc32;
+        if (!matches) {
+            report.corrupt.push_back(file.relative_path);
+        }
+    }
+    report.checked = expected.size();
+    report.hashed = jobs.size();
+
+    // Mods the pack does not know about are a common cause of crashes; other directories are
+    // full of files the game writes itself, so they are not scanned for extras. The list of
+    // installed pack files is kept with the mod set and is not an extra either.
+    std::string manifest_path = to_lower(get_installed_files_manifest_path(instance_dir + "\\mods"));
+    for (const FileInfo& info : list_files_recursive(instance_dir + "\\mods")) {
+        std::string relative_path = "mods\\" + info.relative_path;
+        if (expected.count(to_lower(relative_path)) == 0 && to_lower(instance_dir + "\\" + relative_path) != manifest_path) {
+            report.extra.push_back(relative_path);
+        }
+    }
+    std::sort(report.missing.begin(), report.missing.end());
+    std::sort(report.corrupt.begin(), report.corrupt.end());
+    std::sort(report.extra.begin(), report.extra.end());
+
+    bool ok = true;
+    if (options.repair && !report.clean()) {
+        ok = repair_instance(archive, index, instance_dir, expected, report, hash_index);
+    }
+
+    // Only files the pack owns are worth remembering
+    for (auto it = hash_index.begin(); it != hash_index.end();) {
+        it = expected.count(it->first) ? std::next(it) : hash_index.erase(it);
+    }
+    save_hash_index(instance_dir, hash_index);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+static void print_paths(const char* label, const std::vector<std::string>& paths) {
+    std::cout << label << " (" << paths.size() << ")" << (paths.empty() ? "" : ":") << std::endl;
+    for (const std::string& path : paths) {
+        std::cout << "  " << path << std::endl;
+    }
+}
+
+void print_verify_report(const VerifyReport& report) {
+    std::cout << "Checked " << report.checked << " files in " << report.seconds << " s ("
+              << report.hashed << " read, the rest settled by size or the hash index)." << std::endl;
+    print_paths("Missing", report.missing);
+    print_paths("Corrupt", report.corrupt);
+    print_paths("Extra", report.extra);
+    if (report.repaired > 0) {
+        std::cout << "Repaired " << report.repaired << " files." << std::endl;
+        if (!report.extra.empty()) {
+            std::cout << "Extra mods were moved to the verify-removed folder." << std::endl;
+        }
+    } else if (report.clean()) {
+        std::cout << "The installation matches the modpack." << std::endl;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef VERIFY_HPP
+#define VERIFY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct VerifyOptions {
+    bool repair = false;   // restore missing and corrupt files, move extra mods aside
+    bool full = false;     // ignore the hash index and read every file
+};
+
+// Paths are relative to the instance directory, '\' separated
+struct VerifyReport {
+    std::vector<std::string> missing;
+    std::vector<std::string> extra;       // only reported for the mods directory
+    std::vector<std::string> corrupt;
+    size_t checked = 0;
+    size_t hashed = 0;                    // files read because the hash index had no current entry
+    size_t repaired = 0;
+    double seconds = 0.0;
+
+    bool clean() const { return missing.empty() && extra.empty() && corrupt.empty(); }
+};
+
+std::string get_hash_index_path(const std::string& instance_dir);
+bool verify_instance(const std::string& modpack_archive_path, const std::string& instance_dir, const VerifyOptions& options, VerifyReport& report);
+void print_verify_report(const VerifyReport& report);
+bool check_staged_mods(const std::string& modpack_archive_path, const std::string& stage_dir);
+
+#endif